@@ -76,6 +76,10 @@ void task_mem(struct seq_file *m, struct mm_struct *mm)
 	SEQ_PUT_DEC(" kB\nVmSwap:\t", swap);
 	seq_puts(m, " kB\n");
 	hugetlb_report_usage(m, mm);
+	seq_put_decimal_ull(m, "Forks:\t", mm->nr_forks);
+	seq_put_decimal_ull(m, "\nForkTime:\t",
+			    div_u64(mm->fork_time_ns, NSEC_PER_USEC));
+	seq_puts(m, " us\n");
 }
 #undef SEQ_PUT_DEC
 
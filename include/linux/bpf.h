@@ -162,6 +162,8 @@ struct bpf_map_ops {
 				     void *callback_ctx, u64 flags);
 
 	u64 (*map_mem_usage)(const struct bpf_map *map);
+	/* map type specific lines of the map's fdinfo */
+	void (*map_show_fdinfo)(struct bpf_map *map, struct seq_file *m);
 
 	/* BTF id of struct allocated by map_alloc */
 	int *map_btf_id;
@@ -422,6 +422,16 @@ struct bpf_verifier_state_list {
 	struct bpf_verifier_state state;
 	struct bpf_verifier_state_list *next;
 	int miss_cnt, hit_cnt;
+	u32 sig; /* see state_sig() */
+};
+
+/* per-insn counters collected with BPF_LOG_PROFILE */
+struct bpf_insn_prof {
+	u32 processed;	/* times the insn was simulated */
+	u32 visits;	/* is_state_visited() calls at this prune point */
+	u32 compared;	/* states_equal() calls */
+	u32 pruned;	/* visits which found an equivalent state */
+	u64 time_ns;	/* time spent in is_state_visited() */
 };
 
 struct bpf_loop_inline_state {
@@ -519,8 +529,10 @@ struct bpf_verifier_log {
 #define BPF_LOG_LEVEL2	2
 #define BPF_LOG_STATS	4
 #define BPF_LOG_FIXED	8
+#define BPF_LOG_PROFILE	16
 #define BPF_LOG_LEVEL	(BPF_LOG_LEVEL1 | BPF_LOG_LEVEL2)
-#define BPF_LOG_MASK	(BPF_LOG_LEVEL | BPF_LOG_STATS | BPF_LOG_FIXED)
+#define BPF_LOG_MASK	(BPF_LOG_LEVEL | BPF_LOG_STATS | BPF_LOG_FIXED | \
+			 BPF_LOG_PROFILE)
 #define BPF_LOG_KERNEL	(BPF_LOG_MASK + 1) /* kernel internal flag */
 #define BPF_LOG_MIN_ALIGNMENT 8U
 #define BPF_LOG_ALIGNMENT 40U
@@ -627,6 +639,11 @@ struct bpf_verifier_env {
 	u32 peak_states;
 	/* longest register parentage chain walked for liveness marking */
 	u32 longest_mark_read_walk;
+	/* states at the same insn, in the same list, with another signature */
+	u32 sig_skipped;
+	/* per-insn counters, BPF_LOG_PROFILE only */
+	struct bpf_insn_prof *insn_prof;
+	u32 insn_prof_cnt;
 	bpfptr_t fd_array;
 
 	/* bit mask to keep track of whether a register has been accessed
@@ -821,6 +821,9 @@ struct mm_struct {
 		 */
 		unsigned long ksm_rmap_items;
 #endif
+		/* number of fork()s of this mm and the time spent copying it */
+		unsigned long nr_forks;
+		u64 fork_time_ns;
 #ifdef CONFIG_LRU_GEN
 		struct {
 			/* this mm_struct is on lru_gen_mm_list */
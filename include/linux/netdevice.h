@@ -3082,6 +3082,9 @@ u16 dev_pick_tx_cpu_id(struct net_device *dev, struct sk_buff *skb,
 
 int __dev_queue_xmit(struct sk_buff *skb, struct net_device *sb_dev);
 int __dev_direct_xmit(struct sk_buff *skb, u16 queue_id);
+u32 __dev_direct_xmit_batch(struct sk_buff **skbs, u32 n, u16 queue_id,
+			    int *ret);
+void dev_queue_xmit_batch(struct sk_buff *skb);
 
 static inline int dev_queue_xmit(struct sk_buff *skb)
 {
@@ -3204,6 +3207,7 @@ struct softnet_data {
 
 	bool			in_net_rx_action;
 	bool			in_napi_threaded_poll;
+	bool			xmit_batching;
 
 #ifdef CONFIG_NET_FLOW_LIMIT
 	struct sd_flow_limit __rcu *flow_limit;
@@ -3211,6 +3215,7 @@ struct softnet_data {
 	struct Qdisc		*output_queue;
 	struct Qdisc		**output_queue_tailp;
 	struct sk_buff		*completion_queue;
+	struct sk_buff_head	xmit_batch;
 #ifdef CONFIG_XFRM_OFFLOAD
 	struct sk_buff_head	xfrm_backlog;
 #endif
@@ -673,6 +673,7 @@ struct trace_event_file {
 	unsigned long		flags;
 	atomic_t		sm_ref;	/* soft-mode reference counter */
 	atomic_t		tm_ref;	/* trigger-mode reference counter */
+	atomic_long_t		dropped; /* events that didn't fit in the buffer */
 };
 
 #define __TRACE_EVENT_FLAGS(name, value)				\
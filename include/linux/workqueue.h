@@ -125,6 +125,22 @@ struct rcu_work {
 	struct workqueue_struct *wq;
 };
 
+/*
+ * Affinity scopes of unbound workqueues.  CPUs are grouped into pods of the
+ * given scope and, for best locality, a work item is executed in the pod of
+ * the CPU it was queued on.
+ */
+enum wq_affn_scope {
+	WQ_AFFN_DFL,			/* use system default */
+	WQ_AFFN_CPU,			/* one pod per CPU */
+	WQ_AFFN_SMT,			/* one pod per SMT core */
+	WQ_AFFN_CACHE,			/* one pod per last level cache */
+	WQ_AFFN_NUMA,			/* one pod per NUMA node */
+	WQ_AFFN_SYSTEM,			/* one pod across the whole system */
+
+	WQ_AFFN_NR_TYPES,
+};
+
 /**
  * struct workqueue_attrs - A struct for workqueue attributes.
  *
@@ -142,13 +158,33 @@ struct workqueue_attrs {
 	cpumask_var_t cpumask;
 
 	/**
-	 * @no_numa: disable NUMA affinity
+	 * @__pod_cpumask: internal attribute used to create per-pod pools
+	 *
+	 * Internal use only.  For a worker_pool, the CPUs of the pod its
+	 * workers are preferably woken up on.  Equal to @cpumask in strict
+	 * mode.
+	 */
+	cpumask_var_t __pod_cpumask;
+
+	/**
+	 * @affn_scope: unbound CPU affinity scope
+	 *
+	 * Like @affn_strict, ``affn_scope`` isn't a property of a worker_pool.
+	 * It only modifies how :c:func:`apply_workqueue_attrs` select pools and
+	 * thus doesn't participate in pool hash calculations or equality
+	 * comparisons.
+	 */
+	enum wq_affn_scope affn_scope;
+
+	/**
+	 * @affn_strict: affinity scope is strict
 	 *
-	 * Unlike other fields, ``no_numa`` isn't a property of a worker_pool. It
-	 * only modifies how :c:func:`apply_workqueue_attrs` select pools and thus
-	 * doesn't participate in pool hash calculations or equality comparisons.
+	 * If clear, workers of a pod are allowed on all the CPUs of @cpumask
+	 * and are only woken up in the pod, leaving the scheduler free to
+	 * move them out of it under load.  If set, they're confined to the
+	 * pod.
 	 */
-	bool no_numa;
+	bool affn_strict;
 };
 
 static inline struct delayed_work *to_delayed_work(struct work_struct *work)
@@ -714,5 +750,6 @@ int workqueue_offline_cpu(unsigned int cpu);
 
 void __init workqueue_init_early(void);
 void __init workqueue_init(void);
+void __init workqueue_init_topology(void);
 
 #endif
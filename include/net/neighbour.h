@@ -130,9 +130,18 @@ struct neigh_statistics {
 
 	unsigned long unres_discards;	/* number of unresolved drops */
 	unsigned long table_fulls;      /* times even gc couldn't help */
+
+	unsigned long periodic_gc_removed; /* neighs removed by periodic GC */
+	unsigned long forced_gc_removed; /* neighs removed by forced GC */
+	unsigned long periodic_gc_buckets; /* hash buckets walked */
+	unsigned long periodic_gc_walk_us; /* time spent walking buckets */
+	unsigned long periodic_gc_walk_max_us; /* longest single walk */
+	unsigned long lockless_confirms; /* updates done without neigh->lock */
 };
 
 #define NEIGH_CACHE_STAT_INC(tbl, field) this_cpu_inc((tbl)->stats->field)
+#define NEIGH_CACHE_STAT_ADD(tbl, field, val) \
+	this_cpu_add((tbl)->stats->field, val)
 
 struct neighbour {
 	struct neighbour __rcu	*next;
@@ -231,6 +240,7 @@ struct neigh_table {
 	struct list_head	managed_list;
 	rwlock_t		lock;
 	unsigned long		last_rand;
+	unsigned int		gc_bucket;
 	struct neigh_statistics	__percpu *stats;
 	struct neigh_hash_table __rcu *nht;
 	struct pneigh_entry	**phash_buckets;
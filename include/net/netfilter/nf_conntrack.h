@@ -357,6 +357,15 @@ void nf_ct_tmpl_free(struct nf_conn *tmpl);
 u32 nf_ct_get_id(const struct nf_conn *ct);
 u32 nf_conntrack_count(const struct net *net);
 
+struct nf_conntrack_gc_stats {
+	unsigned int	workers;
+	u32		scanned;
+	u32		evicted;
+	u32		duration;	/* msecs */
+};
+
+void nf_conntrack_gc_stats(struct nf_conntrack_gc_stats *stats);
+
 static inline void
 nf_ct_set(struct sk_buff *skb, struct nf_conn *ct, enum ip_conntrack_info info)
 {
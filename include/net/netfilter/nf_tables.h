@@ -1000,10 +1000,20 @@ static inline void nft_set_elem_update_expr(const struct nft_set_ext *ext,
 
 #define NFT_CHAIN_POLICY_UNSET		U8_MAX
 
+/**
+ *	struct nft_rule_dp - nf_tables rule in the datapath blob
+ *
+ *	@is_last: end of blob marker
+ *	@dlen: length of expression data plus precompiled matches
+ *	@handle: rule handle, for tracing
+ *	@nmatch: number of precompiled matches following the expressions
+ *	@data: expressions, then @nmatch struct nft_rule_dp_match
+ */
 struct nft_rule_dp {
 	u64				is_last:1,
 					dlen:12,
-					handle:42;	/* for tracing */
+					handle:42,
+					nmatch:4;
 	unsigned char			data[]
 		__attribute__((aligned(__alignof__(struct nft_expr))));
 };
@@ -80,6 +80,38 @@ struct nft_payload {
 
 extern const struct nft_expr_ops nft_payload_fast_ops;
 
+/**
+ *	struct nft_rule_dp_match - precompiled payload load and compare
+ *
+ *	@base: payload base, network or transport header
+ *	@len: payload length, 1, 2 or 4 bytes
+ *	@dreg: register the payload expression loads into
+ *	@inv: invert the comparison
+ *	@offset: payload offset from @base
+ *	@next: offset in rule data of the first expression not covered
+ *	@mask: mask applied to the loaded value
+ *	@data: value to compare against
+ *
+ *	Lowered at commit time from a leading payload + cmp expression pair
+ *	that nf_tables would otherwise evaluate with two dispatches.
+ */
+struct nft_rule_dp_match {
+	u8			base;
+	u8			len;
+	u8			dreg;
+	bool			inv;
+	u16			offset;
+	u16			next;
+	u32			mask;
+	u32			data;
+};
+
+#define NFT_RULE_DP_MATCH_MAX	15
+
+unsigned int nft_rule_dp_match_max(const struct nft_rule *rule);
+unsigned int nft_rule_dp_compile(struct nft_rule_dp *prule, unsigned int size,
+				 unsigned int max);
+
 extern const struct nft_expr_ops nft_bitwise_fast_ops;
 
 extern struct static_key_false nft_counters_enabled;
@@ -92,6 +124,8 @@ extern const struct nft_set_type nft_set_rbtree_type;
 extern const struct nft_set_type nft_set_bitmap_type;
 extern const struct nft_set_type nft_set_pipapo_type;
 extern const struct nft_set_type nft_set_pipapo_avx2_type;
+extern const struct nft_set_type nft_set_pipapo_avx512_type;
+extern const struct nft_set_type nft_set_pipapo_neon_type;
 
 #ifdef CONFIG_RETPOLINE
 bool nft_rhash_lookup(const struct net *net, const struct nft_set *set,
@@ -116,12 +150,16 @@ nft_set_do_lookup(const struct net *net, const struct nft_set *set,
 }
 #endif
 
-/* called from nft_pipapo_avx2.c */
+/* called from nft_pipapo_avx2.c, nft_pipapo_avx512.c, nft_pipapo_neon.c */
 bool nft_pipapo_lookup(const struct net *net, const struct nft_set *set,
 		       const u32 *key, const struct nft_set_ext **ext);
 /* called from nft_set_pipapo.c */
 bool nft_pipapo_avx2_lookup(const struct net *net, const struct nft_set *set,
 			    const u32 *key, const struct nft_set_ext **ext);
+bool nft_pipapo_avx512_lookup(const struct net *net, const struct nft_set *set,
+			      const u32 *key, const struct nft_set_ext **ext);
+bool nft_pipapo_neon_lookup(const struct net *net, const struct nft_set *set,
+			    const u32 *key, const struct nft_set_ext **ext);
 
 void nft_counter_init_seqcount(void);
 
@@ -200,6 +200,7 @@ struct netns_ipv4 {
 #ifdef CONFIG_NET_L3_MASTER_DEV
 	u8 sysctl_udp_l3mdev_accept;
 #endif
+	u8 sysctl_udp_reuseport_lookup_cache;
 
 	u8 sysctl_igmp_llm_reports;
 	int sysctl_igmp_max_memberships;
@@ -10,6 +10,7 @@
 #include <net/dst_ops.h>
 
 struct ctl_table_header;
+struct xfrm_state_cache;
 
 struct xfrm_policy_hash {
 	struct hlist_head	__rcu *table;
@@ -46,6 +47,9 @@ struct netns_xfrm {
 	unsigned int		state_hmask;
 	unsigned int		state_num;
 	struct work_struct	state_hash_work;
+	/* Per-cpu cache of inbound SA lookups, see xfrm_input_state_lookup() */
+	struct xfrm_state_cache	__percpu *state_cache_input;
+	atomic64_t		state_cache_gen;
 
 	struct list_head	policy_all;
 	struct hlist_head	*policy_byidx;
@@ -10,6 +10,8 @@
 
 extern spinlock_t reuseport_lock;
 
+#define REUSEPORT_CPU_SHARED	((struct sock *)1UL)
+
 struct sock_reuseport {
 	struct rcu_head		rcu;
 
@@ -25,7 +27,16 @@ struct sock_reuseport {
 	unsigned int		reuseport_id;
 	unsigned int		bind_inany:1;
 	unsigned int		has_conns:1;
+	/* Bumped when a member connects or disconnects, invalidates the
+	 * UDP reuseport lookup cache entries pointing to this group.
+	 */
+	atomic64_t		gen;
 	struct bpf_prog __rcu	*prog;		/* optional BPF sock selector */
+	/* Indexed by CPU, the listening sk whose SO_INCOMING_CPU matches,
+	 * or REUSEPORT_CPU_SHARED if several of them do.  Only allocated
+	 * once incoming_cpu becomes non-zero.
+	 */
+	struct sock		**cpu_socks;
 	struct sock		*socks[];	/* array of sock pointers */
 };
 
@@ -59,6 +70,42 @@ static inline bool reuseport_has_conns(struct sock *sk)
 }
 
 void reuseport_has_conns_set(struct sock *sk);
+bool reuseport_invalidate(struct sock *sk);
+
+/* Snapshot the generation of the group of @sk before caching @sk as a
+ * lookup result.  Groups with connected sockets are never cached.
+ */
+static inline bool reuseport_cache_gen(struct sock *sk, u64 *gen)
+{
+	struct sock_reuseport *reuse;
+	bool ret = false;
+
+	rcu_read_lock();
+	reuse = rcu_dereference(sk->sk_reuseport_cb);
+	if (reuse && sk->sk_state != TCP_ESTABLISHED) {
+		*gen = atomic64_read(&reuse->gen);
+		/* Paired with smp_mb__after_atomic() in reuseport_invalidate() */
+		smp_rmb();
+		ret = !reuse->has_conns;
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+static inline bool reuseport_cache_valid(struct sock *sk, u64 gen)
+{
+	struct sock_reuseport *reuse;
+	bool ret = false;
+
+	rcu_read_lock();
+	reuse = rcu_dereference(sk->sk_reuseport_cb);
+	if (reuse && !reuse->has_conns)
+		ret = atomic64_read(&reuse->gen) == gen;
+	rcu_read_unlock();
+
+	return ret;
+}
 void reuseport_update_incoming_cpu(struct sock *sk, int val);
 
 #endif  /* _SOCK_REUSEPORT_H */
@@ -114,6 +114,9 @@ struct tls_sw_context_tx {
 	spinlock_t encrypt_compl_lock;
 	int async_notify;
 	u8 async_capable:1;
+	/* defer pushing sealed records to TCP, more full records follow */
+	u8 tx_defer:1;
+	u8 tx_batched;
 
 #define BIT_TX_SCHEDULED	0
 #define BIT_TX_CLOSING		1
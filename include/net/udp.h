@@ -69,15 +69,25 @@ struct udp_hslot {
  *	@hash2:	hash table, sockets are hashed on (local port, local address)
  *	@mask:	number of slots in hash tables, minus 1
  *	@log:	log2(number of slots in hash table)
+ *	@reuseport_gen: bumped whenever a socket is hashed, unhashed or
+ *		rehashed, invalidates the per-CPU reuseport lookup cache
  */
 struct udp_table {
 	struct udp_hslot	*hash;
 	struct udp_hslot	*hash2;
 	unsigned int		mask;
 	unsigned int		log;
+	atomic64_t		reuseport_gen;
 };
 extern struct udp_table udp_table;
 void udp_table_init(struct udp_table *, const char *);
+
+static inline void udp_table_invalidate(struct udp_table *table)
+{
+	atomic64_inc(&table->reuseport_gen);
+	/* Paired with smp_rmb() in __udp4_lib_lookup() */
+	smp_mb__after_atomic();
+}
 static inline struct udp_hslot *udp_hashslot(struct udp_table *table,
 					     struct net *net, unsigned int num)
 {
@@ -288,8 +298,10 @@ int udp_rcv(struct sk_buff *skb);
 int udp_ioctl(struct sock *sk, int cmd, int *karg);
 int udp_init_sock(struct sock *sk);
 int udp_pre_connect(struct sock *sk, struct sockaddr *uaddr, int addr_len);
+int udp_connect(struct sock *sk, struct sockaddr *uaddr, int addr_len);
 int __udp_disconnect(struct sock *sk, int flags);
 int udp_disconnect(struct sock *sk, int flags);
+void udp_lib_invalidate(struct sock *sk);
 __poll_t udp_poll(struct file *file, struct socket *sock, poll_table *wait);
 struct sk_buff *skb_udp_tunnel_segment(struct sk_buff *skb,
 				       netdev_features_t features,
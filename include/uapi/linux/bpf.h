@@ -1276,6 +1276,16 @@ enum {
 
 /* Get path from provided FD in BPF_OBJ_PIN/BPF_OBJ_GET commands */
 	BPF_F_PATH_FD		= (1U << 14),
+
+/* Size the buckets of a BPF_MAP_TYPE_[PERCPU_]HASH map after the number of
+ * elements in it, instead of max_entries. Requires BPF_F_NO_PREALLOC.
+ */
+	BPF_F_RESIZABLE		= (1U << 15),
+
+/* Maintain a multibit index in a BPF_MAP_TYPE_LPM_TRIE map, so that lookups
+ * of full length keys take one step per key byte. Keys up to 16 bytes.
+ */
+	BPF_F_LPM_MULTIBIT	= (1U << 16),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -4353,6 +4363,9 @@ union bpf_attr {
  *		* **BPF_RB_RING_SIZE**: The size of ring buffer.
  *		* **BPF_RB_CONS_POS**: Consumer position (can wrap around).
  *		* **BPF_RB_PROD_POS**: Producer(s) position (can wrap around).
+ *		* **BPF_RB_DROPS**: Number of records which couldn't be
+ *		  reserved for lack of space, summed over all CPUs. The
+ *		  counts of each CPU are shown in the map's fdinfo.
  *
  *		Data returned is just a momentary snapshot of actual values
  *		and could be inaccurate, so this facility should be used to
@@ -5939,6 +5952,7 @@ enum {
 	BPF_RB_RING_SIZE = 1,
 	BPF_RB_CONS_POS = 2,
 	BPF_RB_PROD_POS = 3,
+	BPF_RB_DROPS = 4,
 };
 
 /* BPF ring buffer constants */
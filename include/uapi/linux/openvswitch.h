@@ -112,7 +112,15 @@ struct ovs_dp_megaflow_stats {
 	__u32 n_masks;		 /* Number of masks for the datapath. */
 	__u32 pad0;		 /* Pad for future expension. */
 	__u64 n_cache_hit;       /* Number of cache matches for flow lookups. */
-	__u64 pad1;		 /* Pad for future expension. */
+	/* n_microflow_hit reuses the former pad1 field: the layout and size
+	 * of the structure are unchanged, and kernels without the microflow
+	 * cache always report zero there.  pad1 is kept as an alias so that
+	 * existing sources still build.
+	 */
+	union {
+		__u64 n_microflow_hit; /* Number of flows found in microflow cache. */
+		__u64 pad1;
+	};
 };
 
 struct ovs_vport_stats {
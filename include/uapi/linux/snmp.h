@@ -331,6 +331,10 @@ enum
 	LINUX_MIB_XFRMFWDHDRERROR,		/* XfrmFwdHdrError*/
 	LINUX_MIB_XFRMOUTSTATEINVALID,		/* XfrmOutStateInvalid */
 	LINUX_MIB_XFRMACQUIREERROR,		/* XfrmAcquireError */
+	LINUX_MIB_XFRMINSTATECACHEHIT,		/* XfrmInStateCacheHit */
+	LINUX_MIB_XFRMINSTATECACHEMISS,		/* XfrmInStateCacheMiss */
+	LINUX_MIB_XFRMINSTATERUNS,		/* XfrmInStateRuns */
+	LINUX_MIB_XFRMINSTATERUNPACKETS,	/* XfrmInStateRunPackets */
 	__LINUX_MIB_XFRMMAX
 };
 
@@ -350,6 +354,11 @@ enum
 	LINUX_MIB_TLSRXDEVICERESYNC,		/* TlsRxDeviceResync */
 	LINUX_MIB_TLSDECRYPTRETRY,		/* TlsDecryptRetry */
 	LINUX_MIB_TLSRXNOPADVIOL,		/* TlsRxNoPadViolation */
+	LINUX_MIB_TLSTXBATCH,			/* TlsTxBatch */
+	LINUX_MIB_TLSTXBATCHRECORDS,		/* TlsTxBatchRecords */
+	LINUX_MIB_TLSRXZEROCOPY,		/* TlsRxZeroCopy */
+	LINUX_MIB_TLSRXZEROCOPYPARTIAL,		/* TlsRxZeroCopyPartial */
+	LINUX_MIB_TLSRXCOPY,			/* TlsRxCopy */
 	__LINUX_MIB_TLSMAX
 };
 
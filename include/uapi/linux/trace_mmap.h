@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_TRACE_MMAP_H_
+#define _UAPI_TRACE_MMAP_H_
+
+#include <linux/types.h>
+
+/**
+ * struct trace_buffer_meta - first page of a per CPU ring buffer mapping
+ * @meta_page_size:	Size of this page.
+ * @meta_struct_len:	Size of this structure.
+ * @subbuf_size:	Size of each sub-buffer, including its header.
+ * @nr_subbufs:		Number of sub-buffers, including the reader one.
+ * @reader.lost_events:	Events lost before the current reader sub-buffer.
+ * @reader.id:		ID of the reader sub-buffer, in [0, @nr_subbufs).
+ * @reader.read:	Offset of the first event handed over to user space,
+ *			the ones up to the sub-buffer commit are new.
+ * @flags:		Unused for now, always 0.
+ * @entries:		Number of entries in the ring buffer.
+ * @overrun:		Number of entries lost to overwriting.
+ * @read:		Number of entries read.
+ *
+ * The sub-buffer with ID n follows at offset (n + 1) * @meta_page_size of
+ * the mapping. TRACE_MMAP_IOCTL_GET_READER hands over the next events, and
+ * blocks until there are some, unless the file was opened with O_NONBLOCK.
+ */
+struct trace_buffer_meta {
+	__u32		meta_page_size;
+	__u32		meta_struct_len;
+
+	__u32		subbuf_size;
+	__u32		nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+	} reader;
+
+	__u64	flags;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+};
+
+#define TRACE_MMAP_IOCTL_GET_READER	_IO('R', 0x20)
+
+#endif /* _UAPI_TRACE_MMAP_H_ */
@@ -4,12 +4,20 @@
 #include <linux/cpumask.h>
 #include <linux/spinlock.h>
 #include <linux/percpu.h>
+#include <linux/sched/clock.h>
+#include <linux/slab.h>
 
 #include "bpf_lru_list.h"
 
 #define LOCAL_FREE_TARGET		(128)
 #define LOCAL_NR_SCANS			LOCAL_FREE_TARGET
 
+/* CPUs sharing a shard of the common LRU, and the least number of elements
+ * worth a shard: smaller ones would mostly steal from each other.
+ */
+#define SHARD_NR_CPUS			(8)
+#define SHARD_MIN_ELEMS			(LOCAL_FREE_TARGET * 64)
+
 #define PERCPU_FREE_TARGET		(4)
 #define PERCPU_NR_SCANS			PERCPU_FREE_TARGET
 
@@ -27,6 +35,11 @@ static int get_next_cpu(int cpu)
 	return cpu;
 }
 
+static struct bpf_lru_list *cpu_lru_list(struct bpf_common_lru *clru, int cpu)
+{
+	return &clru->lru_lists[(cpu / SHARD_NR_CPUS) % clru->nr_shards];
+}
+
 /* Local list helpers */
 static struct list_head *local_free_list(struct bpf_lru_locallist *loc_l)
 {
@@ -94,6 +107,7 @@ static void __bpf_lru_node_move_in(struct bpf_lru_list *l,
 
 	bpf_lru_list_count_inc(l, tgt_type);
 	node->type = tgt_type;
+	node->shard = l->shard;
 	bpf_lru_node_clear_ref(node);
 	list_move(&node->list, &l->lists[tgt_type]);
 }
@@ -207,6 +221,11 @@ static void __bpf_lru_list_rotate_inactive(struct bpf_lru *lru,
  * inactive list and only move the nodes without the ref bit
  * set to the designated free list.
  */
+static void bpf_lru_count_evicted(struct bpf_lru *lru, unsigned int n)
+{
+	this_cpu_add(lru->stats->evicted, n);
+}
+
 static unsigned int
 __bpf_lru_list_shrink_inactive(struct bpf_lru *lru,
 			       struct bpf_lru_list *l,
@@ -233,6 +252,7 @@ __bpf_lru_list_shrink_inactive(struct bpf_lru *lru,
 			break;
 	}
 
+	bpf_lru_count_evicted(lru, nshrinked);
 	return nshrinked;
 }
 
@@ -284,6 +304,7 @@ static unsigned int __bpf_lru_list_shrink(struct bpf_lru *lru,
 		if (lru->del_from_htab(lru->del_arg, node)) {
 			__bpf_lru_node_move_to_free(l, node, free_list,
 						    tgt_free_type);
+			bpf_lru_count_evicted(lru, 1);
 			return 1;
 		}
 	}
@@ -320,33 +341,79 @@ static void bpf_lru_list_push_free(struct bpf_lru_list *l,
 	raw_spin_unlock_irqrestore(&l->lock, flags);
 }
 
-static void bpf_lru_list_pop_free_to_local(struct bpf_lru *lru,
-					   struct bpf_lru_locallist *loc_l)
+static unsigned int __bpf_lru_list_pop_free_to_local(struct bpf_lru *lru,
+						      struct bpf_lru_list *l,
+						      struct bpf_lru_locallist *loc_l,
+						      unsigned int tgt_nfree,
+						      bool flush, bool shrink)
 {
-	struct bpf_lru_list *l = &lru->common_lru.lru_list;
 	struct bpf_lru_node *node, *tmp_node;
 	unsigned int nfree = 0;
 
 	raw_spin_lock(&l->lock);
 
-	__local_list_flush(l, loc_l);
+	if (flush)
+		__local_list_flush(l, loc_l);
 
-	__bpf_lru_list_rotate(lru, l);
+	if (shrink)
+		__bpf_lru_list_rotate(lru, l);
 
 	list_for_each_entry_safe(node, tmp_node, &l->lists[BPF_LRU_LIST_T_FREE],
 				 list) {
 		__bpf_lru_node_move_to_free(l, node, local_free_list(loc_l),
 					    BPF_LRU_LOCAL_LIST_T_FREE);
-		if (++nfree == LOCAL_FREE_TARGET)
+		if (++nfree == tgt_nfree)
 			break;
 	}
 
-	if (nfree < LOCAL_FREE_TARGET)
-		__bpf_lru_list_shrink(lru, l, LOCAL_FREE_TARGET - nfree,
-				      local_free_list(loc_l),
-				      BPF_LRU_LOCAL_LIST_T_FREE);
+	if (shrink && nfree < tgt_nfree)
+		nfree += __bpf_lru_list_shrink(lru, l, tgt_nfree - nfree,
+					       local_free_list(loc_l),
+					       BPF_LRU_LOCAL_LIST_T_FREE);
 
 	raw_spin_unlock(&l->lock);
+
+	return nfree;
+}
+
+/* Refill the local free list with the free elements of the shard of @cpu,
+ * then of the other shards: evicting while other shards still have free
+ * elements would leave a CPU with only its shard's share of the map. Free
+ * elements taken from another shard join the shard of @cpu once used.
+ * Only when no shard has free elements left, evict from the shard of @cpu,
+ * or if it has no element left in its lists, from the next shards.
+ */
+static void bpf_lru_list_pop_free_to_local(struct bpf_lru *lru,
+					   struct bpf_lru_locallist *loc_l,
+					   int cpu)
+{
+	struct bpf_common_lru *clru = &lru->common_lru;
+	struct bpf_lru_list *l = cpu_lru_list(clru, cpu);
+	unsigned int i, n, nfree, shard = l->shard;
+
+	nfree = __bpf_lru_list_pop_free_to_local(lru, l, loc_l,
+						 LOCAL_FREE_TARGET, true, false);
+
+	for (i = 1; nfree < LOCAL_FREE_TARGET && i < clru->nr_shards; i++) {
+		l = &clru->lru_lists[(shard + i) % clru->nr_shards];
+		/* racy, but a shard missed here is only evicted from early */
+		if (list_empty(&l->lists[BPF_LRU_LIST_T_FREE]))
+			continue;
+		n = __bpf_lru_list_pop_free_to_local(lru, l, loc_l,
+						     LOCAL_FREE_TARGET - nfree,
+						     false, false);
+		this_cpu_add(lru->stats->stolen, n);
+		nfree += n;
+	}
+
+	for (i = 0; !nfree && i < clru->nr_shards; i++) {
+		l = &clru->lru_lists[(shard + i) % clru->nr_shards];
+		nfree = __bpf_lru_list_pop_free_to_local(lru, l, loc_l,
+							 LOCAL_FREE_TARGET,
+							 false, true);
+		if (i)
+			this_cpu_add(lru->stats->stolen, nfree);
+	}
 }
 
 static void __local_list_add_pending(struct bpf_lru *lru,
@@ -409,6 +476,7 @@ static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
 	struct bpf_lru_list *l;
 	unsigned long flags;
 	int cpu = raw_smp_processor_id();
+	u64 start;
 
 	l = per_cpu_ptr(lru->percpu_lru, cpu);
 
@@ -417,9 +485,13 @@ static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
 	__bpf_lru_list_rotate(lru, l);
 
 	free_list = &l->lists[BPF_LRU_LIST_T_FREE];
-	if (list_empty(free_list))
+	if (list_empty(free_list)) {
+		start = local_clock();
 		__bpf_lru_list_shrink(lru, l, PERCPU_FREE_TARGET, free_list,
 				      BPF_LRU_LIST_T_FREE);
+		this_cpu_inc(lru->stats->refills);
+		this_cpu_add(lru->stats->refill_ns, local_clock() - start);
+	}
 
 	if (!list_empty(free_list)) {
 		node = list_first_entry(free_list, struct bpf_lru_node, list);
@@ -442,24 +514,31 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 	int steal, first_steal;
 	unsigned long flags;
 	int cpu = raw_smp_processor_id();
+	u64 start;
 
 	loc_l = per_cpu_ptr(clru->local_list, cpu);
 
 	raw_spin_lock_irqsave(&loc_l->lock, flags);
 
 	node = __local_list_pop_free(loc_l);
-	if (!node) {
-		bpf_lru_list_pop_free_to_local(lru, loc_l);
-		node = __local_list_pop_free(loc_l);
+	if (node) {
+		__local_list_add_pending(lru, loc_l, cpu, node, hash);
+		raw_spin_unlock_irqrestore(&loc_l->lock, flags);
+		return node;
 	}
 
+	start = local_clock();
+	this_cpu_inc(lru->stats->refills);
+
+	bpf_lru_list_pop_free_to_local(lru, loc_l, cpu);
+	node = __local_list_pop_free(loc_l);
 	if (node)
 		__local_list_add_pending(lru, loc_l, cpu, node, hash);
 
 	raw_spin_unlock_irqrestore(&loc_l->lock, flags);
 
 	if (node)
-		return node;
+		goto out;
 
 	/* No free nodes found from the local free list and
 	 * the global LRU list.
@@ -491,8 +570,11 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 		raw_spin_lock_irqsave(&loc_l->lock, flags);
 		__local_list_add_pending(lru, loc_l, cpu, node, hash);
 		raw_spin_unlock_irqrestore(&loc_l->lock, flags);
+		this_cpu_inc(lru->stats->stolen);
 	}
 
+out:
+	this_cpu_add(lru->stats->refill_ns, local_clock() - start);
 	return node;
 }
 
@@ -535,7 +617,8 @@ static void bpf_common_lru_push_free(struct bpf_lru *lru,
 	}
 
 check_lru_list:
-	bpf_lru_list_push_free(&lru->common_lru.lru_list, node);
+	bpf_lru_list_push_free(&lru->common_lru.lru_lists[READ_ONCE(node->shard)],
+			       node);
 }
 
 static void bpf_percpu_lru_push_free(struct bpf_lru *lru,
@@ -565,14 +648,19 @@ static void bpf_common_lru_populate(struct bpf_lru *lru, void *buf,
 				    u32 node_offset, u32 elem_size,
 				    u32 nr_elems)
 {
-	struct bpf_lru_list *l = &lru->common_lru.lru_list;
+	struct bpf_common_lru *clru = &lru->common_lru;
+	struct bpf_lru_list *l;
 	u32 i;
 
+	clru->nr_shards = clamp(nr_elems / SHARD_MIN_ELEMS, 1U, clru->max_shards);
+
 	for (i = 0; i < nr_elems; i++) {
 		struct bpf_lru_node *node;
 
+		l = &clru->lru_lists[i % clru->nr_shards];
 		node = (struct bpf_lru_node *)(buf + node_offset);
 		node->type = BPF_LRU_LIST_T_FREE;
+		node->shard = l->shard;
 		bpf_lru_node_clear_ref(node);
 		list_add(&node->list, &l->lists[BPF_LRU_LIST_T_FREE]);
 		buf += elem_size;
@@ -633,7 +721,7 @@ static void bpf_lru_locallist_init(struct bpf_lru_locallist *loc_l, int cpu)
 	raw_spin_lock_init(&loc_l->lock);
 }
 
-static void bpf_lru_list_init(struct bpf_lru_list *l)
+static void bpf_lru_list_init(struct bpf_lru_list *l, u16 shard)
 {
 	int i;
 
@@ -644,6 +732,7 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 		l->counts[i] = 0;
 
 	l->next_inactive_rotation = &l->lists[BPF_LRU_LIST_T_INACTIVE];
+	l->shard = shard;
 
 	raw_spin_lock_init(&l->lock);
 }
@@ -651,26 +740,42 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 		 del_from_htab_func del_from_htab, void *del_arg)
 {
-	int cpu;
+	int cpu, i;
+
+	lru->stats = alloc_percpu(struct bpf_lru_stats);
+	if (!lru->stats)
+		return -ENOMEM;
 
 	if (percpu) {
 		lru->percpu_lru = alloc_percpu(struct bpf_lru_list);
 		if (!lru->percpu_lru)
-			return -ENOMEM;
+			goto free_stats;
 
 		for_each_possible_cpu(cpu) {
 			struct bpf_lru_list *l;
 
 			l = per_cpu_ptr(lru->percpu_lru, cpu);
-			bpf_lru_list_init(l);
+			bpf_lru_list_init(l, 0);
 		}
 		lru->nr_scans = PERCPU_NR_SCANS;
 	} else {
 		struct bpf_common_lru *clru = &lru->common_lru;
 
+		/* the actual number of shards depends on the number of
+		 * elements, see bpf_common_lru_populate()
+		 */
+		clru->max_shards = DIV_ROUND_UP(nr_cpu_ids, SHARD_NR_CPUS);
+		clru->nr_shards = 1;
+		clru->lru_lists = kcalloc(clru->max_shards,
+					  sizeof(*clru->lru_lists), GFP_KERNEL);
+		if (!clru->lru_lists)
+			goto free_stats;
+
 		clru->local_list = alloc_percpu(struct bpf_lru_locallist);
-		if (!clru->local_list)
-			return -ENOMEM;
+		if (!clru->local_list) {
+			kfree(clru->lru_lists);
+			goto free_stats;
+		}
 
 		for_each_possible_cpu(cpu) {
 			struct bpf_lru_locallist *loc_l;
@@ -679,7 +784,8 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 			bpf_lru_locallist_init(loc_l, cpu);
 		}
 
-		bpf_lru_list_init(&clru->lru_list);
+		for (i = 0; i < clru->max_shards; i++)
+			bpf_lru_list_init(&clru->lru_lists[i], i);
 		lru->nr_scans = LOCAL_NR_SCANS;
 	}
 
@@ -689,12 +795,35 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 	lru->hash_offset = hash_offset;
 
 	return 0;
+
+free_stats:
+	free_percpu(lru->stats);
+	return -ENOMEM;
 }
 
 void bpf_lru_destroy(struct bpf_lru *lru)
 {
-	if (lru->percpu)
+	if (lru->percpu) {
 		free_percpu(lru->percpu_lru);
-	else
+	} else {
 		free_percpu(lru->common_lru.local_list);
+		kfree(lru->common_lru.lru_lists);
+	}
+	free_percpu(lru->stats);
+}
+
+void bpf_lru_get_stats(struct bpf_lru *lru, struct bpf_lru_stats *stats)
+{
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for_each_possible_cpu(cpu) {
+		const struct bpf_lru_stats *s = per_cpu_ptr(lru->stats, cpu);
+
+		stats->refills += READ_ONCE(s->refills);
+		stats->refill_ns += READ_ONCE(s->refill_ns);
+		stats->evicted += READ_ONCE(s->evicted);
+		stats->stolen += READ_ONCE(s->stolen);
+	}
 }
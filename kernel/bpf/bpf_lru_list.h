@@ -26,6 +26,7 @@ struct bpf_lru_node {
 	u16 cpu;
 	u8 type;
 	u8 ref;
+	u16 shard;
 };
 
 struct bpf_lru_list {
@@ -33,6 +34,7 @@ struct bpf_lru_list {
 	unsigned int counts[NR_BPF_LRU_LIST_COUNT];
 	/* The next inactive list rotation starts from here */
 	struct list_head *next_inactive_rotation;
+	u16 shard;
 
 	raw_spinlock_t lock ____cacheline_aligned_in_smp;
 };
@@ -43,11 +45,26 @@ struct bpf_lru_locallist {
 	raw_spinlock_t lock;
 };
 
+/* The common LRU is split in shards, each one serving a group of CPUs, and
+ * holding its own share of the elements. CPUs use up the free elements of
+ * all shards before evicting from theirs, and only evict from other shards
+ * when theirs has nothing left to evict.
+ */
 struct bpf_common_lru {
-	struct bpf_lru_list lru_list;
+	struct bpf_lru_list *lru_lists;
+	unsigned int nr_shards;
+	unsigned int max_shards;
 	struct bpf_lru_locallist __percpu *local_list;
 };
 
+/* Slow path of bpf_lru_pop_free(), when the local free list is empty */
+struct bpf_lru_stats {
+	u64 refills;	/* times the slow path was taken */
+	u64 refill_ns;	/* total time spent in it */
+	u64 evicted;	/* elements evicted from the LRU lists */
+	u64 stolen;	/* free or pending elements taken from other shards/CPUs */
+};
+
 typedef bool (*del_from_htab_func)(void *arg, struct bpf_lru_node *node);
 
 struct bpf_lru {
@@ -55,6 +72,7 @@ struct bpf_lru {
 		struct bpf_common_lru common_lru;
 		struct bpf_lru_list __percpu *percpu_lru;
 	};
+	struct bpf_lru_stats __percpu *stats;
 	del_from_htab_func del_from_htab;
 	void *del_arg;
 	unsigned int hash_offset;
@@ -76,5 +94,6 @@ void bpf_lru_destroy(struct bpf_lru *lru);
 struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash);
 void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node);
 void bpf_lru_promote(struct bpf_lru *lru, struct bpf_lru_node *node);
+void bpf_lru_get_stats(struct bpf_lru *lru, struct bpf_lru_stats *stats);
 
 #endif
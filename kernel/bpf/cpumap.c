@@ -34,6 +34,7 @@
 
 #include <linux/netdevice.h>   /* netif_receive_skb_list */
 #include <linux/etherdevice.h> /* eth_type_trans */
+#include <net/gro.h>
 
 /* General idea: XDP packets getting XDP redirected to another CPU,
  * will maximum be stored/queued for one driver ->poll() call.  It is
@@ -43,6 +44,13 @@
  */
 
 #define CPU_MAP_BULK_SIZE 8  /* 8 == one cacheline on 64-bit archs */
+
+/* Frames dequeued at once by the kthread: starts at the minimum, doubles
+ * while the queue has a full batch ready, halves when it has less than half.
+ */
+#define CPUMAP_BATCH 8
+#define CPUMAP_BATCH_MAX 64
+
 struct bpf_cpu_map_entry;
 struct bpf_cpu_map;
 
@@ -75,6 +83,17 @@ struct bpf_cpu_map_entry {
 
 	struct work_struct kthread_stop_wq;
 	struct completion kthread_running;
+
+	/* Only used by the kthread */
+	unsigned int batch;
+	void *frames[CPUMAP_BATCH_MAX];
+	void *skbs[CPUMAP_BATCH_MAX];
+
+	/* GRO context for skbs built from frames. It's never scheduled, the
+	 * kthread feeds it directly, and flushes it as the queue runs empty.
+	 */
+	struct napi_struct napi;
+	struct net_device napi_dev;
 };
 
 struct bpf_cpu_map {
@@ -272,8 +291,6 @@ static int cpu_map_bpf_prog_run_xdp(struct bpf_cpu_map_entry *rcpu,
 	return nframes;
 }
 
-#define CPUMAP_BATCH 8
-
 static int cpu_map_bpf_prog_run(struct bpf_cpu_map_entry *rcpu, void **frames,
 				int xdp_n, struct xdp_cpumap_stats *stats,
 				struct list_head *list)
@@ -315,8 +332,8 @@ static int cpu_map_kthread_run(void *data)
 		unsigned int kmem_alloc_drops = 0, sched = 0;
 		gfp_t gfp = __GFP_ZERO | GFP_ATOMIC;
 		int i, n, m, nframes, xdp_n;
-		void *frames[CPUMAP_BATCH];
-		void *skbs[CPUMAP_BATCH];
+		void **frames = rcpu->frames;
+		void **skbs = rcpu->skbs;
 		LIST_HEAD(list);
 
 		/* Release CPU reschedule checks */
@@ -339,7 +356,11 @@ static int cpu_map_kthread_run(void *data)
 		 * consume side valid as no-resize allowed of queue.
 		 */
 		n = __ptr_ring_consume_batched(rcpu->queue, frames,
-					       CPUMAP_BATCH);
+					       rcpu->batch);
+		if (n == rcpu->batch && rcpu->batch < CPUMAP_BATCH_MAX)
+			rcpu->batch *= 2;
+		else if (n < rcpu->batch / 2 && rcpu->batch > CPUMAP_BATCH)
+			rcpu->batch /= 2;
 		for (i = 0, xdp_n = 0; i < n; i++) {
 			void *f = frames[i];
 			struct page *page;
@@ -385,10 +406,17 @@ static int cpu_map_kthread_run(void *data)
 				continue;
 			}
 
-			list_add_tail(&skb->list, &list);
+			napi_gro_receive(&rcpu->napi, skb);
 		}
+		/* skbs from generic XDP went through GRO already */
 		netif_receive_skb_list(&list);
 
+		/* Under load, only flush packets held since the previous
+		 * jiffy, like a NAPI poll running out of budget would.
+		 */
+		napi_gro_flush(&rcpu->napi, !__ptr_ring_empty(rcpu->queue));
+		gro_normal_list(&rcpu->napi);
+
 		/* Feedback loop via tracepoint */
 		trace_xdp_cpumap_kthread(rcpu->map_id, n, kmem_alloc_drops,
 					 sched, &stats);
@@ -397,6 +425,8 @@ static int cpu_map_kthread_run(void *data)
 	}
 	__set_current_state(TASK_RUNNING);
 
+	__netif_napi_del(&rcpu->napi);
+
 	put_cpu_map_entry(rcpu);
 	return 0;
 }
@@ -462,17 +492,23 @@ __cpu_map_entry_alloc(struct bpf_map *map, struct bpf_cpumap_val *value,
 	rcpu->cpu    = cpu;
 	rcpu->map_id = map->id;
 	rcpu->value.qsize  = value->qsize;
+	rcpu->batch  = CPUMAP_BATCH;
 
 	if (fd > 0 && __cpu_map_load_bpf_program(rcpu, map, fd))
 		goto free_ptr_ring;
 
+	init_dummy_netdev(&rcpu->napi_dev);
+	/* keep it out of the NAPI hash, there's nothing to busy poll */
+	set_bit(NAPI_STATE_NO_BUSY_POLL, &rcpu->napi.state);
+	netif_napi_add(&rcpu->napi_dev, &rcpu->napi, NULL);
+
 	/* Setup kthread */
 	init_completion(&rcpu->kthread_running);
 	rcpu->kthread = kthread_create_on_node(cpu_map_kthread_run, rcpu, numa,
 					       "cpumap/%d/map:%d", cpu,
 					       map->id);
 	if (IS_ERR(rcpu->kthread))
-		goto free_prog;
+		goto del_napi;
 
 	get_cpu_map_entry(rcpu); /* 1-refcnt for being in cmap->cpu_map[] */
 	get_cpu_map_entry(rcpu); /* 1-refcnt for kthread */
@@ -489,7 +525,8 @@ __cpu_map_entry_alloc(struct bpf_map *map, struct bpf_cpumap_val *value,
 
 	return rcpu;
 
-free_prog:
+del_napi:
+	__netif_napi_del(&rcpu->napi);
 	if (rcpu->prog)
 		bpf_prog_put(rcpu->prog);
 free_ptr_ring:
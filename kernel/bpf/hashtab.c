@@ -10,7 +10,10 @@
 #include <linux/random.h>
 #include <uapi/linux/btf.h>
 #include <linux/rcupdate_trace.h>
+#include <linux/rcupdate_wait.h>
 #include <linux/btf_ids.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
 #include "percpu_freelist.h"
 #include "bpf_lru_list.h"
 #include "map_in_map.h"
@@ -18,7 +21,7 @@
 
 #define HTAB_CREATE_FLAG_MASK						\
 	(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU | BPF_F_NUMA_NODE |	\
-	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED)
+	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED | BPF_F_RESIZABLE)
 
 #define BATCH_OPS(_name)			\
 	.map_lookup_batch =			\
@@ -80,6 +83,32 @@ struct bucket {
 	raw_spinlock_t raw_lock;
 };
 
+/* Tables of BPF_F_RESIZABLE maps are replaced when the number of elements
+ * gets out of proportion with the number of buckets, rhashtable-style:
+ *
+ * 1) the new table is published as ->future of the old one
+ * 2) buckets of the old table are moved one by one, with the old bucket
+ *    lock held, and ->rehashed tells which ones are already moved. Writers
+ *    locking a moved bucket retry on the future table
+ * 3) the new table replaces the old one, freed after a grace period
+ *
+ * Lockless lookups walk the old table, then the future one, if any. An
+ * element is linked into the future table before being unlinked from the
+ * old one, so it can't be missed. Readers following an element which moved
+ * meanwhile end up on a nulls marker of the other table, as the base of
+ * nulls values alternates between consecutive tables, and start over.
+ */
+struct htab_table {
+	struct htab_table __rcu *future;
+	u32 n_buckets;
+	u32 rehashed;
+	u32 nulls_base;
+	struct bucket buckets[];
+};
+
+#define HTAB_NULLS_TAG		(1U << 30)
+#define HTAB_MIN_BUCKETS	64
+
 #define HASHTAB_MAP_LOCK_COUNT 8
 #define HASHTAB_MAP_LOCK_MASK (HASHTAB_MAP_LOCK_COUNT - 1)
 
@@ -87,7 +116,7 @@ struct bpf_htab {
 	struct bpf_map map;
 	struct bpf_mem_alloc ma;
 	struct bpf_mem_alloc pcpu_ma;
-	struct bucket *buckets;
+	struct htab_table __rcu *tbl;
 	void *elems;
 	union {
 		struct pcpu_freelist freelist;
@@ -100,11 +129,20 @@ struct bpf_htab {
 	struct percpu_counter pcount;
 	atomic_t count;
 	bool use_percpu_counter;
-	u32 n_buckets;	/* number of hash buckets */
+	u32 n_buckets;	/* number of hash buckets in the current table */
+	u32 min_buckets;
+	u32 max_buckets;
+	u32 lock_mask;
 	u32 elem_size;	/* size of each element in bytes */
 	u32 hashrnd;
 	struct lock_class_key lockdep_key;
 	int __percpu *map_locked[HASHTAB_MAP_LOCK_COUNT];
+	/* BPF_F_RESIZABLE: irq_work queues resize_work, as the element count
+	 * changes in any context
+	 */
+	unsigned long resize_pending;
+	struct irq_work resize_irq_work;
+	struct work_struct resize_work;
 };
 
 /* each htab element is struct htab_elem + key + value */
@@ -133,26 +171,45 @@ static inline bool htab_is_prealloc(const struct bpf_htab *htab)
 	return !(htab->map.map_flags & BPF_F_NO_PREALLOC);
 }
 
-static void htab_init_buckets(struct bpf_htab *htab)
+static inline bool htab_is_resizable(const struct bpf_htab *htab)
+{
+	return htab->map.map_flags & BPF_F_RESIZABLE;
+}
+
+static void htab_init_table(struct bpf_htab *htab, struct htab_table *tbl,
+			    u32 n_buckets, u32 nulls_base)
 {
 	unsigned int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		INIT_HLIST_NULLS_HEAD(&htab->buckets[i].head, i);
-		raw_spin_lock_init(&htab->buckets[i].raw_lock);
-		lockdep_set_class(&htab->buckets[i].raw_lock,
+	tbl->n_buckets = n_buckets;
+	tbl->nulls_base = nulls_base;
+	for (i = 0; i < n_buckets; i++) {
+		INIT_HLIST_NULLS_HEAD(&tbl->buckets[i].head, nulls_base | i);
+		raw_spin_lock_init(&tbl->buckets[i].raw_lock);
+		lockdep_set_class(&tbl->buckets[i].raw_lock,
 					  &htab->lockdep_key);
 		cond_resched();
 	}
 }
 
+/* Callers are in RCU (or RCU tasks trace, for sleepable programs) read-side
+ * critical sections, or own the map.
+ */
+static inline struct htab_table *htab_table(const struct bpf_htab *htab)
+{
+	return rcu_dereference_raw(htab->tbl);
+}
+
+/* The lock index only depends on bits of the hash that also select the
+ * bucket in the smallest table, so that elements keep it across resizes.
+ */
 static inline int htab_lock_bucket(const struct bpf_htab *htab,
 				   struct bucket *b, u32 hash,
 				   unsigned long *pflags)
 {
 	unsigned long flags;
 
-	hash = hash & min_t(u32, HASHTAB_MAP_LOCK_MASK, htab->n_buckets - 1);
+	hash = hash & htab->lock_mask;
 
 	preempt_disable();
 	if (unlikely(__this_cpu_inc_return(*(htab->map_locked[hash])) != 1)) {
@@ -171,13 +228,15 @@ static inline void htab_unlock_bucket(const struct bpf_htab *htab,
 				      struct bucket *b, u32 hash,
 				      unsigned long flags)
 {
-	hash = hash & min_t(u32, HASHTAB_MAP_LOCK_MASK, htab->n_buckets - 1);
+	hash = hash & htab->lock_mask;
 	raw_spin_unlock_irqrestore(&b->raw_lock, flags);
 	__this_cpu_dec(*(htab->map_locked[hash]));
 	preempt_enable();
 }
 
 static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node);
+static void htab_resize_irq_work(struct irq_work *work);
+static void htab_resize_work(struct work_struct *work);
 
 static bool htab_is_lru(const struct bpf_htab *htab)
 {
@@ -417,6 +476,7 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
 	bool zero_seed = (attr->map_flags & BPF_F_ZERO_SEED);
+	bool resizable = (attr->map_flags & BPF_F_RESIZABLE);
 	int numa_node = bpf_map_attr_numa_node(attr);
 
 	BUILD_BUG_ON(offsetof(struct htab_elem, fnode.next) !=
@@ -436,6 +496,12 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	if (lru && !prealloc)
 		return -ENOTSUPP;
 
+	/* preallocated elements would defeat the purpose */
+	if (resizable && (prealloc ||
+			  (attr->map_type != BPF_MAP_TYPE_HASH &&
+			   attr->map_type != BPF_MAP_TYPE_PERCPU_HASH)))
+		return -EINVAL;
+
 	if (numa_node != NUMA_NO_NODE && (percpu || percpu_lru))
 		return -EINVAL;
 
@@ -471,6 +537,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
+	struct htab_table *tbl = NULL;
 	struct bpf_htab *htab;
 	int err, i;
 
@@ -495,7 +562,14 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	}
 
 	/* hash table size must be power of 2 */
-	htab->n_buckets = roundup_pow_of_two(htab->map.max_entries);
+	htab->max_buckets = roundup_pow_of_two(htab->map.max_entries);
+	htab->min_buckets = htab->max_buckets;
+	if (htab_is_resizable(htab))
+		htab->min_buckets = min_t(u32, htab->max_buckets,
+					  HTAB_MIN_BUCKETS);
+	htab->n_buckets = htab->min_buckets;
+	htab->lock_mask = min_t(u32, HASHTAB_MAP_LOCK_MASK,
+				htab->min_buckets - 1);
 
 	htab->elem_size = sizeof(struct htab_elem) +
 			  round_up(htab->map.key_size, 8);
@@ -506,15 +580,18 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 
 	err = -E2BIG;
 	/* prevent zero size kmalloc and check for u32 overflow */
-	if (htab->n_buckets == 0 ||
-	    htab->n_buckets > U32_MAX / sizeof(struct bucket))
+	if (htab->max_buckets == 0 ||
+	    htab->max_buckets > (U32_MAX - sizeof(*tbl)) / sizeof(struct bucket))
+		goto free_htab;
+
+	/* nulls values of resized tables need HTAB_NULLS_TAG */
+	if (htab_is_resizable(htab) && htab->max_buckets > HTAB_NULLS_TAG)
 		goto free_htab;
 
 	err = -ENOMEM;
-	htab->buckets = bpf_map_area_alloc(htab->n_buckets *
-					   sizeof(struct bucket),
-					   htab->map.numa_node);
-	if (!htab->buckets)
+	tbl = bpf_map_area_alloc(struct_size(tbl, buckets, htab->n_buckets),
+				 htab->map.numa_node);
+	if (!tbl)
 		goto free_htab;
 
 	for (i = 0; i < HASHTAB_MAP_LOCK_COUNT; i++) {
@@ -531,7 +608,10 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	else
 		htab->hashrnd = get_random_u32();
 
-	htab_init_buckets(htab);
+	htab_init_table(htab, tbl, htab->n_buckets, 0);
+	RCU_INIT_POINTER(htab->tbl, tbl);
+	init_irq_work(&htab->resize_irq_work, htab_resize_irq_work);
+	INIT_WORK(&htab->resize_work, htab_resize_work);
 
 /* compute_batch_value() computes batch value as num_online_cpus() * 2
  * and __percpu_counter_compare() needs
@@ -590,7 +670,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		percpu_counter_destroy(&htab->pcount);
 	for (i = 0; i < HASHTAB_MAP_LOCK_COUNT; i++)
 		free_percpu(htab->map_locked[i]);
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(tbl);
 	bpf_mem_alloc_destroy(&htab->pcpu_ma);
 	bpf_mem_alloc_destroy(&htab->ma);
 free_htab:
@@ -606,14 +686,57 @@ static inline u32 htab_map_hash(const void *key, u32 key_len, u32 hashrnd)
 	return jhash(key, key_len, hashrnd);
 }
 
-static inline struct bucket *__select_bucket(struct bpf_htab *htab, u32 hash)
+static inline struct bucket *__select_bucket(struct htab_table *tbl, u32 hash)
+{
+	return &tbl->buckets[hash & (tbl->n_buckets - 1)];
+}
+
+static inline struct hlist_nulls_head *select_bucket(struct htab_table *tbl, u32 hash)
 {
-	return &htab->buckets[hash & (htab->n_buckets - 1)];
+	return &__select_bucket(tbl, hash)->head;
 }
 
-static inline struct hlist_nulls_head *select_bucket(struct bpf_htab *htab, u32 hash)
+static inline u32 htab_nulls(const struct htab_table *tbl, u32 hash)
 {
-	return &__select_bucket(htab, hash)->head;
+	return tbl->nulls_base | (hash & (tbl->n_buckets - 1));
+}
+
+/* Bucket @i of the current table, NULL past its end. Iterators keep a bucket
+ * index across RCU read-side critical sections, and might see a resized
+ * table at the next one: elements are then missed or seen twice.
+ */
+static struct bucket *htab_bucket(const struct bpf_htab *htab, u32 i)
+{
+	struct htab_table *tbl = htab_table(htab);
+
+	return i < tbl->n_buckets ? &tbl->buckets[i] : NULL;
+}
+
+/* Lock the bucket where elements with @hash live. That's in the future
+ * table if a resize already moved the bucket of the current one.
+ */
+static inline int htab_lock_hash(const struct bpf_htab *htab, u32 hash,
+				 struct bucket **pb, unsigned long *pflags)
+{
+	struct htab_table *tbl = htab_table(htab);
+	struct bucket *b;
+	int ret;
+
+	for (;;) {
+		b = __select_bucket(tbl, hash);
+		ret = htab_lock_bucket(htab, b, hash, pflags);
+		if (ret)
+			return ret;
+
+		if (likely((hash & (tbl->n_buckets - 1)) >= READ_ONCE(tbl->rehashed)))
+			break;
+
+		htab_unlock_bucket(htab, b, hash, *pflags);
+		tbl = rcu_dereference_raw(tbl->future);
+	}
+
+	*pb = b;
+	return 0;
 }
 
 /* this lookup function can only be called with bucket lock taken */
@@ -636,7 +759,7 @@ static struct htab_elem *lookup_elem_raw(struct hlist_nulls_head *head, u32 hash
  */
 static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
 					       u32 hash, void *key,
-					       u32 key_size, u32 n_buckets)
+					       u32 key_size, u32 nulls)
 {
 	struct hlist_nulls_node *n;
 	struct htab_elem *l;
@@ -646,12 +769,35 @@ static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
 		if (l->hash == hash && !memcmp(&l->key, key, key_size))
 			return l;
 
-	if (unlikely(get_nulls_value(n) != (hash & (n_buckets - 1))))
+	if (unlikely(get_nulls_value(n) != nulls))
 		goto again;
 
 	return NULL;
 }
 
+/* can be called without bucket lock, looks up the current table and,
+ * during a resize, the table elements are being moved to
+ */
+static struct htab_elem *lookup_nulls_elem(const struct bpf_htab *htab,
+					   u32 hash, void *key, u32 key_size)
+{
+	struct htab_table *tbl = htab_table(htab);
+	struct htab_elem *l;
+
+	do {
+		l = lookup_nulls_elem_raw(select_bucket(tbl, hash), hash, key,
+					  key_size, htab_nulls(tbl, hash));
+		if (l)
+			return l;
+
+		/* pairs with smp_wmb() in htab_move_elem() */
+		smp_rmb();
+		tbl = rcu_dereference_raw(tbl->future);
+	} while (unlikely(tbl));
+
+	return NULL;
+}
+
 /* Called from syscall or from eBPF program directly, so
  * arguments have to match bpf_map_lookup_elem() exactly.
  * The return value is adjusted by BPF instructions
@@ -660,8 +806,6 @@ static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
 static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
-	struct hlist_nulls_head *head;
-	struct htab_elem *l;
 	u32 hash, key_size;
 
 	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_trace_held() &&
@@ -671,11 +815,7 @@ static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
-
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
-
-	return l;
+	return lookup_nulls_elem(htab, hash, key, key_size);
 }
 
 static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
@@ -793,12 +933,11 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 	int ret;
 
 	tgt_l = container_of(node, struct htab_elem, lru_node);
-	b = __select_bucket(htab, tgt_l->hash);
-	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, tgt_l->hash, &flags);
+	ret = htab_lock_hash(htab, tgt_l->hash, &b, &flags);
 	if (ret)
 		return false;
+	head = &b->head;
 
 	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
 		if (l == tgt_l) {
@@ -818,6 +957,7 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct hlist_nulls_head *head;
 	struct htab_elem *l, *next_l;
+	struct htab_table *tbl;
 	u32 hash, key_size;
 	int i = 0;
 
@@ -825,15 +965,19 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 
 	key_size = map->key_size;
 
+	/* during a resize, keys already moved to the future table are skipped */
+	tbl = htab_table(htab);
+
 	if (!key)
 		goto find_first_elem;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
+	head = select_bucket(tbl, hash);
 
 	/* lookup the key */
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
+	l = lookup_nulls_elem_raw(head, hash, key, key_size,
+				  htab_nulls(tbl, hash));
 
 	if (!l)
 		goto find_first_elem;
@@ -849,13 +993,13 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 	}
 
 	/* no more elements in this hash list, go to the next bucket */
-	i = hash & (htab->n_buckets - 1);
+	i = hash & (tbl->n_buckets - 1);
 	i++;
 
 find_first_elem:
 	/* iterate over buckets */
-	for (; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	for (; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		/* pick first element in the bucket */
 		next_l = hlist_nulls_entry_safe(rcu_dereference_raw(hlist_nulls_first_rcu(head)),
@@ -898,20 +1042,191 @@ static bool is_map_full(struct bpf_htab *htab)
 	return atomic_read(&htab->count) >= htab->map.max_entries;
 }
 
-static void inc_elem_count(struct bpf_htab *htab)
+static int htab_elem_count_cmp(struct bpf_htab *htab, u32 n)
 {
+	s64 count;
+
 	if (htab->use_percpu_counter)
-		percpu_counter_add_batch(&htab->pcount, 1, PERCPU_COUNTER_BATCH);
-	else
-		atomic_inc(&htab->count);
+		return __percpu_counter_compare(&htab->pcount, n,
+						PERCPU_COUNTER_BATCH);
+
+	count = atomic_read(&htab->count);
+	if (count > n)
+		return 1;
+	if (count < n)
+		return -1;
+	return 0;
+}
+
+/* Grow above a load factor of 3/4, shrink below 1/8 */
+static u32 htab_resize_target(struct bpf_htab *htab, u32 n_buckets)
+{
+	if (n_buckets < htab->max_buckets &&
+	    htab_elem_count_cmp(htab, n_buckets / 4 * 3) > 0)
+		return n_buckets * 2;
+	if (n_buckets > htab->min_buckets &&
+	    htab_elem_count_cmp(htab, n_buckets / 8) < 0)
+		return n_buckets / 2;
+	return n_buckets;
+}
+
+/* Called as the element count changes, with @count as seen by the caller,
+ * which is only approximate with a percpu counter. htab_resize_work() checks
+ * the count again, precisely, before resizing.
+ */
+static void htab_resize_check(struct bpf_htab *htab, s64 count)
+{
+	u32 n_buckets = READ_ONCE(htab->n_buckets);
+
+	if (!(n_buckets < htab->max_buckets && count > n_buckets / 4 * 3) &&
+	    !(n_buckets > htab->min_buckets && count < n_buckets / 8))
+		return;
+
+	if (!test_and_set_bit(0, &htab->resize_pending))
+		irq_work_queue(&htab->resize_irq_work);
+}
+
+/* With a percpu counter, only look at the count when a batch was folded into
+ * the shared one: it's the only time it changes, and summing up the per-cpu
+ * deltas on every update would defeat the purpose of the percpu counter.
+ */
+static void htab_elem_count_add(struct bpf_htab *htab, s32 amount)
+{
+	s64 count;
+
+	if (!htab_is_resizable(htab)) {
+		if (htab->use_percpu_counter)
+			percpu_counter_add_batch(&htab->pcount, amount,
+						 PERCPU_COUNTER_BATCH);
+		else
+			atomic_add(amount, &htab->count);
+		return;
+	}
+
+	if (htab->use_percpu_counter) {
+		count = percpu_counter_read(&htab->pcount);
+		percpu_counter_add_batch(&htab->pcount, amount,
+					 PERCPU_COUNTER_BATCH);
+		if (percpu_counter_read(&htab->pcount) == count)
+			return;
+		count = percpu_counter_read(&htab->pcount);
+	} else {
+		count = atomic_add_return(amount, &htab->count);
+	}
+
+	htab_resize_check(htab, count);
+}
+
+static void inc_elem_count(struct bpf_htab *htab)
+{
+	htab_elem_count_add(htab, 1);
 }
 
 static void dec_elem_count(struct bpf_htab *htab)
 {
-	if (htab->use_percpu_counter)
-		percpu_counter_add_batch(&htab->pcount, -1, PERCPU_COUNTER_BATCH);
-	else
-		atomic_dec(&htab->count);
+	htab_elem_count_add(htab, -1);
+}
+
+/* Move @l, the last element of its bucket, to the head of @head. It's linked
+ * there first, so that readers walking the old bucket either see it, or see
+ * the end of the old bucket and then the future table with @l in it.
+ */
+static void htab_move_elem(struct htab_elem *l, struct hlist_nulls_head *head)
+{
+	struct hlist_nulls_node **pprev = l->hash_node.pprev;
+	struct hlist_nulls_node *nulls = l->hash_node.next;
+
+	hlist_nulls_add_head_rcu(&l->hash_node, head);
+	/* pairs with smp_rmb() in lookup_nulls_elem() */
+	smp_wmb();
+	WRITE_ONCE(*pprev, nulls);
+}
+
+static void htab_rehash_bucket(struct bpf_htab *htab, struct htab_table *old,
+			       struct htab_table *new, u32 i)
+{
+	struct bucket *b = &old->buckets[i], *nb;
+	struct hlist_nulls_node *n;
+	struct htab_elem *l, *last;
+	unsigned long flags;
+
+	/* Fails only if a program interrupted us on this CPU in a section
+	 * holding the same lock index, and it won't stay there.
+	 */
+	while (htab_lock_bucket(htab, b, i, &flags))
+		cpu_relax();
+
+	for (;;) {
+		last = NULL;
+		hlist_nulls_for_each_entry(l, n, &b->head, hash_node)
+			last = l;
+		if (!last)
+			break;
+
+		/* same lock index as @b, which we already hold */
+		nb = __select_bucket(new, last->hash);
+		raw_spin_lock_nested(&nb->raw_lock, SINGLE_DEPTH_NESTING);
+		htab_move_elem(last, &nb->head);
+		raw_spin_unlock(&nb->raw_lock);
+	}
+
+	WRITE_ONCE(old->rehashed, i + 1);
+	htab_unlock_bucket(htab, b, i, flags);
+}
+
+static int htab_rehash(struct bpf_htab *htab, u32 n_buckets)
+{
+	struct htab_table *old = rcu_dereference_protected(htab->tbl, 1);
+	struct htab_table *new;
+	u32 i;
+
+	new = bpf_map_kvcalloc(&htab->map, 1, struct_size(new, buckets, n_buckets),
+			       GFP_KERNEL | __GFP_NOWARN);
+	if (!new)
+		return -ENOMEM;
+
+	htab_init_table(htab, new, n_buckets, old->nulls_base ^ HTAB_NULLS_TAG);
+	rcu_assign_pointer(old->future, new);
+
+	for (i = 0; i < old->n_buckets; i++) {
+		htab_rehash_bucket(htab, old, new, i);
+		cond_resched();
+	}
+
+	rcu_assign_pointer(htab->tbl, new);
+	WRITE_ONCE(htab->n_buckets, n_buckets);
+
+	/* wait for lookups, including from sleepable programs, in the old table */
+	synchronize_rcu_mult(call_rcu, call_rcu_tasks_trace);
+	bpf_map_area_free(old);
+
+	return 0;
+}
+
+static void htab_resize_work(struct work_struct *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab, resize_work);
+	u32 n_buckets;
+
+	/* Updates from now on queue the work again if they see a count out
+	 * of range, as we might have read it before their update.
+	 */
+	clear_bit(0, &htab->resize_pending);
+	smp_mb__after_atomic();
+
+	for (;;) {
+		n_buckets = htab_resize_target(htab, htab->n_buckets);
+		if (n_buckets == htab->n_buckets || htab_rehash(htab, n_buckets))
+			break;
+	}
+}
+
+static void htab_resize_irq_work(struct irq_work *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab,
+					     resize_irq_work);
+
+	queue_work(system_unbound_wq, &htab->resize_work);
 }
 
 
@@ -1091,15 +1406,11 @@ static long htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	if (unlikely(map_flags & BPF_F_LOCK)) {
 		if (unlikely(!btf_record_has_field(map->record, BPF_SPIN_LOCK)))
 			return -EINVAL;
 		/* find an element without taking the bucket lock */
-		l_old = lookup_nulls_elem_raw(head, hash, key, key_size,
-					      htab->n_buckets);
+		l_old = lookup_nulls_elem(htab, hash, key, key_size);
 		ret = check_flags(htab, l_old, map_flags);
 		if (ret)
 			return ret;
@@ -1116,9 +1427,10 @@ static long htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 		 */
 	}
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1193,9 +1505,6 @@ static long htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	/* For LRU, we need to alloc before taking bucket's
 	 * spinlock because getting free nodes from LRU may need
 	 * to remove older elements from htab and this removal
@@ -1207,9 +1516,10 @@ static long htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value
 	copy_map_value(&htab->map,
 		       l_new->key + round_up(map->key_size, 8), value);
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		goto err_lock_bucket;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1262,12 +1572,10 @@ static long __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1317,9 +1625,6 @@ static long __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	/* For LRU, we need to alloc before taking bucket's
 	 * spinlock because LRU's elem alloc may need
 	 * to remove older elem from htab and this removal
@@ -1331,9 +1636,10 @@ static long __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 			return -ENOMEM;
 	}
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		goto err_lock_bucket;
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1392,12 +1698,10 @@ static long htab_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1428,12 +1732,10 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
-	ret = htab_lock_bucket(htab, b, hash, &flags);
+	ret = htab_lock_hash(htab, hash, &b, &flags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1450,14 +1752,15 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 
 static void delete_all_elements(struct bpf_htab *htab)
 {
+	struct htab_table *tbl = htab_table(htab);
 	int i;
 
 	/* It's called from a worker thread, so disable migration here,
 	 * since bpf_mem_cache_free() relies on that.
 	 */
 	migrate_disable();
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		struct hlist_nulls_head *head = select_bucket(tbl, i);
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
@@ -1474,12 +1777,15 @@ static void htab_free_malloced_timers(struct bpf_htab *htab)
 	int i;
 
 	rcu_read_lock();
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	for (i = 0; ; i++) {
+		struct bucket *b = htab_bucket(htab, i);
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
-		hlist_nulls_for_each_entry(l, n, head, hash_node) {
+		if (!b)
+			break;
+
+		hlist_nulls_for_each_entry(l, n, &b->head, hash_node) {
 			/* We only free timer on uref dropping to zero */
 			bpf_obj_free_timer(htab->map.record, l->key + round_up(htab->map.key_size, 8));
 		}
@@ -1516,6 +1822,11 @@ static void htab_map_free(struct bpf_map *map)
 	 * underneath and is reponsible for waiting for callbacks to finish
 	 * during bpf_mem_alloc_destroy().
 	 */
+	if (htab_is_resizable(htab)) {
+		irq_work_sync(&htab->resize_irq_work);
+		cancel_work_sync(&htab->resize_work);
+	}
+
 	if (!htab_is_prealloc(htab)) {
 		delete_all_elements(htab);
 	} else {
@@ -1524,7 +1835,7 @@ static void htab_map_free(struct bpf_map *map)
 	}
 
 	free_percpu(htab->extra_elems);
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(rcu_dereference_protected(htab->tbl, 1));
 	bpf_mem_alloc_destroy(&htab->pcpu_ma);
 	bpf_mem_alloc_destroy(&htab->ma);
 	if (htab->use_percpu_counter)
@@ -1571,12 +1882,10 @@ static int __htab_map_lookup_and_delete_elem(struct bpf_map *map, void *key,
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
-	ret = htab_lock_bucket(htab, b, hash, &bflags);
+	ret = htab_lock_hash(htab, hash, &b, &bflags);
 	if (ret)
 		return ret;
+	head = &b->head;
 
 	l = lookup_elem_raw(head, hash, key, key_size);
 	if (!l) {
@@ -1694,7 +2003,7 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	if (ubatch && copy_from_user(&batch, ubatch, sizeof(batch)))
 		return -EFAULT;
 
-	if (batch >= htab->n_buckets)
+	if (batch >= READ_ONCE(htab->n_buckets))
 		return -ENOENT;
 
 	key_size = htab->map.key_size;
@@ -1726,7 +2035,14 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 again_nocopy:
 	dst_key = keys;
 	dst_val = values;
-	b = &htab->buckets[batch];
+	b = htab_bucket(htab, batch);
+	if (!b) {
+		/* the table shrank meanwhile */
+		ret = -ENOENT;
+		rcu_read_unlock();
+		bpf_enable_instrumentation();
+		goto after_loop;
+	}
 	head = &b->head;
 	/* do not grab the lock unless need it (bucket_cnt > 0). */
 	if (locked) {
@@ -1839,7 +2155,7 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	/* If we are not copying data, we can go to next bucket and avoid
 	 * unlocking the rcu.
 	 */
-	if (!bucket_cnt && (batch + 1 < htab->n_buckets)) {
+	if (!bucket_cnt && (batch + 1 < READ_ONCE(htab->n_buckets))) {
 		batch++;
 		goto again_nocopy;
 	}
@@ -1856,7 +2172,7 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 
 	total += bucket_cnt;
 	batch++;
-	if (batch >= htab->n_buckets) {
+	if (batch >= READ_ONCE(htab->n_buckets)) {
 		ret = -ENOENT;
 		goto after_loop;
 	}
@@ -1968,7 +2284,7 @@ bpf_hash_map_seq_find_next(struct bpf_iter_seq_hash_map_info *info,
 	struct bucket *b;
 	u32 i, count;
 
-	if (bucket_id >= htab->n_buckets)
+	if (bucket_id >= READ_ONCE(htab->n_buckets))
 		return NULL;
 
 	/* try to find next elem in the same bucket */
@@ -1982,14 +2298,18 @@ bpf_hash_map_seq_find_next(struct bpf_iter_seq_hash_map_info *info,
 			return elem;
 
 		/* not found, unlock and go to the next bucket */
-		b = &htab->buckets[bucket_id++];
+		bucket_id++;
 		rcu_read_unlock();
 		skip_elems = 0;
 	}
 
-	for (i = bucket_id; i < htab->n_buckets; i++) {
-		b = &htab->buckets[i];
+	for (i = bucket_id; ; i++) {
 		rcu_read_lock();
+		b = htab_bucket(htab, i);
+		if (!b) {
+			rcu_read_unlock();
+			break;
+		}
 
 		count = 0;
 		head = &b->head;
@@ -2158,9 +2478,13 @@ static long bpf_for_each_hash_elem(struct bpf_map *map, bpf_callback_t callback_
 	 */
 	if (is_percpu)
 		migrate_disable();
-	for (i = 0; i < htab->n_buckets; i++) {
-		b = &htab->buckets[i];
+	for (i = 0; ; i++) {
 		rcu_read_lock();
+		b = htab_bucket(htab, i);
+		if (!b) {
+			rcu_read_unlock();
+			break;
+		}
 		head = &b->head;
 		hlist_nulls_for_each_entry_rcu(elem, n, head, hash_node) {
 			key = elem->key;
@@ -2198,7 +2522,8 @@ static u64 htab_map_mem_usage(const struct bpf_map *map)
 	u64 num_entries;
 	u64 usage = sizeof(struct bpf_htab);
 
-	usage += sizeof(struct bucket) * htab->n_buckets;
+	usage += sizeof(struct htab_table) +
+		 sizeof(struct bucket) * READ_ONCE(htab->n_buckets);
 	usage += sizeof(int) * num_possible_cpus() * HASHTAB_MAP_LOCK_COUNT;
 	if (prealloc) {
 		num_entries = map->max_entries;
@@ -2226,6 +2551,23 @@ static u64 htab_map_mem_usage(const struct bpf_map *map)
 	return usage;
 }
 
+static void htab_lru_map_show_fdinfo(struct bpf_map *map, struct seq_file *m)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct bpf_lru_stats stats;
+
+	bpf_lru_get_stats(&htab->lru, &stats);
+
+	if (!htab->lru.percpu)
+		seq_printf(m, "lru_shards:\t%u\n", htab->lru.common_lru.nr_shards);
+	seq_printf(m,
+		   "lru_refills:\t%llu\n"
+		   "lru_refill_ns:\t%llu\n"
+		   "lru_evicted:\t%llu\n"
+		   "lru_stolen:\t%llu\n",
+		   stats.refills, stats.refill_ns, stats.evicted, stats.stolen);
+}
+
 BTF_ID_LIST_SINGLE(htab_map_btf_ids, struct, bpf_htab)
 const struct bpf_map_ops htab_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
@@ -2265,6 +2607,7 @@ const struct bpf_map_ops htab_lru_map_ops = {
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_hash_elem,
 	.map_mem_usage = htab_map_mem_usage,
+	.map_show_fdinfo = htab_lru_map_show_fdinfo,
 	BATCH_OPS(htab_lru),
 	.map_btf_id = &htab_map_btf_ids[0],
 	.iter_seq_info = &iter_seq_info,
@@ -2437,6 +2780,7 @@ const struct bpf_map_ops htab_lru_percpu_map_ops = {
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_hash_elem,
 	.map_mem_usage = htab_map_mem_usage,
+	.map_show_fdinfo = htab_lru_map_show_fdinfo,
 	BATCH_OPS(htab_lru_percpu),
 	.map_btf_id = &htab_map_btf_ids[0],
 	.iter_seq_info = &iter_seq_info,
@@ -2452,13 +2796,14 @@ static int fd_htab_map_alloc_check(union bpf_attr *attr)
 static void fd_htab_map_free(struct bpf_map *map)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct htab_table *tbl = htab_table(htab);
 	struct hlist_nulls_node *n;
 	struct hlist_nulls_head *head;
 	struct htab_elem *l;
 	int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
 			void *ptr = fd_htab_map_get_ptr(map, l);
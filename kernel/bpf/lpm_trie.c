@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <net/ipv6.h>
 #include <uapi/linux/btf.h>
 #include <linux/btf_ids.h>
@@ -29,6 +30,59 @@ struct lpm_trie_node {
 	u8				data[];
 };
 
+#define LPM_MB_SLOTS		256
+#define LPM_MB_DATA_SIZE_MAX	16
+
+union lpm_mb_ptr {
+	struct lpm_mb_node __rcu	*child;
+	struct lpm_trie_node __rcu	*match;
+};
+
+/* Node of the multibit index, covering one byte of the key. @ptrs holds the
+ * children for the slots set in @child_map, then one match for each run of
+ * slots sharing it, @match_map marking the first slot of each run.
+ *
+ * Every prefix longer than 8 bits needs a node at each byte level above it,
+ * so sparse long prefixes are the worst case: an IPv6 /128 sharing no byte
+ * with the other prefixes adds 15 nodes of about 100 bytes each, against a
+ * single trie node. The index memory is charged to the map's memcg and
+ * reported in its memory usage.
+ */
+struct lpm_mb_node {
+	struct rcu_head			rcu;
+	u64				child_map[LPM_MB_SLOTS / 64];
+	u64				match_map[LPM_MB_SLOTS / 64];
+	u32				n_children;
+	u32				n_ptrs;
+	union lpm_mb_ptr		ptrs[];
+};
+
+/* Uncompressed copy of the node being rebuilt, and trie walk stack for full
+ * rebuilds. There are two of them, one for the updates made under trie->lock
+ * and one for the rebuild worker.
+ */
+struct lpm_mb_scratch {
+	struct lpm_mb_node		*child[LPM_MB_SLOTS];
+	struct lpm_trie_node		*match[LPM_MB_SLOTS];
+	struct lpm_trie_node		*stack[LPM_MB_DATA_SIZE_MAX * 8 + 2];
+};
+
+/* An update of the index: either a change to the published index in place,
+ * under trie->lock, or a full rebuild into a private index, from the worker
+ * and without the lock.
+ */
+struct lpm_mb_build {
+	struct lpm_trie			*trie;
+	struct lpm_mb_scratch		*sc;
+	size_t				mem;
+	/* rebuild only: trie->mb_gen when it started */
+	u64				gen;
+	bool				rebuild;
+};
+
+/* The nodes of the index being changed belong to the builder */
+#define lpm_mb_owned(b)		((b)->rebuild || lockdep_is_held(&(b)->trie->lock))
+
 struct lpm_trie {
 	struct bpf_map			map;
 	struct lpm_trie_node __rcu	*root;
@@ -36,6 +90,14 @@ struct lpm_trie {
 	size_t				max_prefixlen;
 	size_t				data_size;
 	spinlock_t			lock;
+	/* BPF_F_LPM_MULTIBIT only */
+	struct lpm_mb_node __rcu	*mb_root;
+	struct lpm_mb_scratch		*mb_scratch;
+	size_t				mb_mem;
+	bool				mb_valid;
+	/* bumped by every change to the trie, under trie->lock */
+	atomic64_t			mb_gen;
+	struct work_struct		mb_rebuild_work;
 };
 
 /* This trie implements a longest prefix match algorithm that can be used to
@@ -147,6 +209,28 @@ struct lpm_trie {
  * is a child that can be used to become more specific, the trie is traversed
  * downwards. The last node in the traversal that is a non-intermediate one is
  * returned.
+ *
+ * With BPF_F_LPM_MULTIBIT, the trie above is still the reference for updates
+ * and iteration, but lookups of full length keys go through a multibit index
+ * instead, which is a trie of 256-ary nodes, one level per key byte. Each slot
+ * of a node at level L holds the longest prefix ending in byte L which covers
+ * it, if any, and the child node for byte L + 1, if any longer prefix goes
+ * through it:
+ *
+ *   level 0    [ ... 192: match -, child ---+ ... ]
+ *                                           |
+ *   level 1    [ ... 168: match /16, child -+ ... ]
+ *                                           |
+ *   level 2    [ 0: match /24   1: match /24 ... 128: match /24 ... ]
+ *
+ * Lookups take one step per key byte, keeping the last match found. Nodes
+ * only store set slots, indexed by population counts of the bitmaps, and runs
+ * of slots with the same match are stored once.
+ *
+ * Updates rebuild the nodes holding the slots covered by the prefix, and the
+ * ones whose set of children changes on the way. New nodes replace old ones
+ * with rcu_assign_pointer(), children are updated in place. If an allocation
+ * fails, the index is dropped, and lookups walk the binary trie from then on.
  */
 
 static inline int extract_bit(const u8 *data, size_t index)
@@ -224,16 +308,15 @@ static size_t longest_prefix_match(const struct lpm_trie *trie,
 	return prefixlen;
 }
 
-/* Called from syscall or from eBPF program */
-static void *trie_lookup_elem(struct bpf_map *map, void *_key)
+static struct lpm_trie_node *trie_lookup_node(struct lpm_trie *trie,
+					      const struct bpf_lpm_trie_key *key)
 {
-	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node *node, *found = NULL;
-	struct bpf_lpm_trie_key *key = _key;
 
 	/* Start walking the trie from the root node ... */
 
-	for (node = rcu_dereference_check(trie->root, rcu_read_lock_bh_held());
+	for (node = rcu_dereference_check(trie->root, rcu_read_lock_bh_held() ||
+					  lockdep_is_held(&trie->lock));
 	     node;) {
 		unsigned int next_bit;
 		size_t matchlen;
@@ -267,15 +350,413 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 		 */
 		next_bit = extract_bit(key->data, node->prefixlen);
 		node = rcu_dereference_check(node->child[next_bit],
+					     rcu_read_lock_bh_held() ||
+					     lockdep_is_held(&trie->lock));
+	}
+
+	return found;
+}
+
+static inline bool lpm_mb_test(const u64 *map, u32 bit)
+{
+	return map[bit / 64] & BIT_ULL(bit % 64);
+}
+
+/* Number of bits set in @map below @bit */
+static inline u32 lpm_mb_rank(const u64 *map, u32 bit)
+{
+	u32 i, n = 0;
+
+	for (i = 0; i < bit / 64; i++)
+		n += hweight64(map[i]);
+
+	return n + hweight64(map[i] & (BIT_ULL(bit % 64) - 1));
+}
+
+static struct lpm_trie_node *lpm_mb_lookup(struct lpm_trie *trie,
+					   const u8 *data)
+{
+	struct lpm_trie_node *match, *found = NULL;
+	struct lpm_mb_node *node;
+	u32 i, s, m;
+
+	node = rcu_dereference_check(trie->mb_root, rcu_read_lock_bh_held());
+
+	for (i = 0; node && i < trie->data_size; i++) {
+		s = data[i];
+
+		/* slot 0 always starts a run */
+		m = lpm_mb_rank(node->match_map, s) +
+		    lpm_mb_test(node->match_map, s) - 1;
+		match = rcu_dereference_check(node->ptrs[node->n_children + m].match,
+					      rcu_read_lock_bh_held());
+		if (match)
+			found = match;
+
+		if (!lpm_mb_test(node->child_map, s))
+			break;
+
+		node = rcu_dereference_check(node->ptrs[lpm_mb_rank(node->child_map, s)].child,
 					     rcu_read_lock_bh_held());
 	}
 
+	return found;
+}
+
+/* Called from syscall or from eBPF program */
+static void *trie_lookup_elem(struct bpf_map *map, void *_key)
+{
+	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
+	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_trie_node *found;
+
+	/* pairs with the release in lpm_mb_rebuild_work(), for mb_root */
+	if (smp_load_acquire(&trie->mb_valid) &&
+	    key->prefixlen >= trie->max_prefixlen)
+		found = lpm_mb_lookup(trie, key->data);
+	else
+		found = trie_lookup_node(trie, key);
+
 	if (!found)
 		return NULL;
 
 	return found->data + trie->data_size;
 }
 
+static void lpm_mb_free(struct lpm_mb_build *b, struct lpm_mb_node *node)
+{
+	b->mem -= struct_size(node, ptrs, node->n_ptrs);
+	kfree_rcu(node, rcu);
+}
+
+/* Free a subtree of the index which was never visible to readers, or when
+ * the map goes away. Returns the memory it used.
+ */
+static size_t lpm_mb_free_tree(struct lpm_mb_node *node)
+{
+	size_t size = struct_size(node, ptrs, node->n_ptrs);
+	u32 i;
+
+	for (i = 0; i < node->n_children; i++)
+		size += lpm_mb_free_tree(rcu_dereference_protected(node->ptrs[i].child,
+								   1));
+
+	kfree(node);
+	return size;
+}
+
+/* Same, for an index which was reachable by readers, once it no longer is */
+static void lpm_mb_drop_tree(struct lpm_mb_node *node)
+{
+	u32 i;
+
+	for (i = 0; i < node->n_children; i++)
+		lpm_mb_drop_tree(rcu_dereference_protected(node->ptrs[i].child, 1));
+
+	kfree_rcu(node, rcu);
+}
+
+static void lpm_mb_expand(struct lpm_mb_build *b, const struct lpm_mb_node *node)
+{
+	struct lpm_mb_scratch *sc = b->sc;
+	struct lpm_trie_node *match = NULL;
+	u32 s, c = 0, m = 0;
+
+	for (s = 0; s < LPM_MB_SLOTS; s++) {
+		sc->child[s] = NULL;
+		if (node && lpm_mb_test(node->child_map, s))
+			sc->child[s] = rcu_dereference_protected(node->ptrs[c++].child,
+								 lpm_mb_owned(b));
+		if (node && lpm_mb_test(node->match_map, s))
+			match = rcu_dereference_protected(node->ptrs[node->n_children + m++].match,
+							  lpm_mb_owned(b));
+		sc->match[s] = match;
+	}
+}
+
+/* Updates under trie->lock can't sleep. A rebuild allocates outside of its
+ * RCU read side section instead: the trie nodes it has kept pointers to can
+ * only have been freed meanwhile if the trie changed, which bumped mb_gen
+ * before leaving trie->lock.
+ */
+static struct lpm_mb_node *lpm_mb_alloc(struct lpm_mb_build *b, size_t size)
+{
+	struct bpf_map *map = &b->trie->map;
+	struct lpm_mb_node *node;
+
+	if (!b->rebuild) {
+		node = bpf_map_kmalloc_node(map, size,
+					    GFP_NOWAIT | __GFP_NOWARN,
+					    map->numa_node);
+		return node ? : ERR_PTR(-ENOMEM);
+	}
+
+	rcu_read_unlock_bh();
+	node = bpf_map_kmalloc_node(map, size, GFP_KERNEL | __GFP_NOWARN,
+				    map->numa_node);
+	rcu_read_lock_bh();
+
+	if (!node)
+		return ERR_PTR(-ENOMEM);
+	if (atomic64_read(&b->trie->mb_gen) != b->gen) {
+		kfree(node);
+		return ERR_PTR(-EAGAIN);
+	}
+
+	return node;
+}
+
+/* Build a node from the scratch copy, NULL if it would be empty */
+static struct lpm_mb_node *lpm_mb_compress(struct lpm_mb_build *b)
+{
+	struct lpm_mb_scratch *sc = b->sc;
+	u32 s, c = 0, m, n_children = 0, n_ptrs = 0;
+	struct lpm_mb_node *node;
+	bool empty = true;
+	size_t size;
+
+	for (s = 0; s < LPM_MB_SLOTS; s++) {
+		if (sc->child[s] || sc->match[s])
+			empty = false;
+		if (sc->child[s])
+			n_children++;
+		if (!s || sc->match[s] != sc->match[s - 1])
+			n_ptrs++;
+	}
+
+	if (empty)
+		return NULL;
+
+	n_ptrs += n_children;
+	size = struct_size(node, ptrs, n_ptrs);
+	node = lpm_mb_alloc(b, size);
+	if (IS_ERR(node))
+		return node;
+
+	memset(node->child_map, 0, sizeof(node->child_map));
+	memset(node->match_map, 0, sizeof(node->match_map));
+	node->n_children = n_children;
+	node->n_ptrs = n_ptrs;
+
+	for (s = 0, m = n_children; s < LPM_MB_SLOTS; s++) {
+		if (sc->child[s]) {
+			node->child_map[s / 64] |= BIT_ULL(s % 64);
+			RCU_INIT_POINTER(node->ptrs[c++].child, sc->child[s]);
+		}
+		if (!s || sc->match[s] != sc->match[s - 1]) {
+			node->match_map[s / 64] |= BIT_ULL(s % 64);
+			RCU_INIT_POINTER(node->ptrs[m++].match, sc->match[s]);
+		}
+	}
+
+	b->mem += size;
+	return node;
+}
+
+/* Longest prefix ending in byte @level of the key which covers slot @s */
+static struct lpm_trie_node *lpm_mb_best(struct lpm_trie *trie,
+					 const struct bpf_lpm_trie_key *key,
+					 u32 level, u32 s)
+{
+	u8 buf[sizeof(struct bpf_lpm_trie_key) + LPM_MB_DATA_SIZE_MAX] __aligned(8);
+	struct bpf_lpm_trie_key *k = (void *)buf;
+	struct lpm_trie_node *node;
+
+	k->prefixlen = (level + 1) * 8;
+	memcpy(k->data, key->data, trie->data_size);
+	k->data[level] = s;
+
+	node = trie_lookup_node(trie, k);
+	if (node && level && node->prefixlen <= level * 8)
+		return NULL;
+
+	return node;
+}
+
+/* Recompute the slots of the index covered by @key, which was just added to,
+ * replaced in or removed from the trie, in the subtree at *@pnode, @level.
+ */
+static int lpm_mb_update(struct lpm_mb_build *b, struct lpm_mb_node __rcu **pnode,
+			 u32 level, const struct bpf_lpm_trie_key *key)
+{
+	u32 target = key->prefixlen ? (key->prefixlen - 1) / 8 : 0;
+	struct lpm_mb_scratch *sc = b->sc;
+	struct lpm_mb_node __rcu *built = NULL;
+	struct lpm_mb_node *node, *new, *child;
+	u32 s = key->data[level];
+	int err;
+
+	node = rcu_dereference_protected(*pnode, lpm_mb_owned(b));
+
+	if (level < target) {
+		if (node && lpm_mb_test(node->child_map, s)) {
+			union lpm_mb_ptr *ptr;
+
+			ptr = &node->ptrs[lpm_mb_rank(node->child_map, s)];
+			err = lpm_mb_update(b, &ptr->child, level + 1, key);
+			/* unless the child went away, it was updated in place */
+			if (err || rcu_access_pointer(ptr->child))
+				return err;
+		} else {
+			err = lpm_mb_update(b, &built, level + 1, key);
+			if (err || !rcu_access_pointer(built))
+				return err;
+		}
+
+		lpm_mb_expand(b, node);
+		sc->child[s] = rcu_dereference_protected(built, 1);
+	} else {
+		u32 bits = key->prefixlen - level * 8;
+		u32 lo = 0, hi = LPM_MB_SLOTS - 1;
+
+		if (key->prefixlen) {
+			lo = s & (0xff << (8 - bits)) & 0xff;
+			hi = lo | (0xff >> bits);
+		}
+
+		lpm_mb_expand(b, node);
+		for (s = lo; s <= hi; s++)
+			sc->match[s] = lpm_mb_best(b->trie, key, level, s);
+	}
+
+	new = lpm_mb_compress(b);
+	if (IS_ERR(new)) {
+		child = rcu_dereference_protected(built, 1);
+		if (child)
+			b->mem -= lpm_mb_free_tree(child);
+		return PTR_ERR(new);
+	}
+
+	rcu_assign_pointer(*pnode, new);
+	if (node)
+		lpm_mb_free(b, node);
+
+	return 0;
+}
+
+/* Build a new index in *@proot from the whole trie, one prefix at a time.
+ * Called under rcu_read_lock_bh(), which lpm_mb_alloc() drops to sleep.
+ */
+static int lpm_mb_rebuild(struct lpm_mb_build *b,
+			  struct lpm_mb_node __rcu **proot)
+{
+	u8 buf[sizeof(struct bpf_lpm_trie_key) + LPM_MB_DATA_SIZE_MAX] __aligned(8);
+	struct lpm_mb_scratch *sc = b->sc;
+	struct lpm_trie *trie = b->trie;
+	struct bpf_lpm_trie_key *key = (void *)buf;
+	struct lpm_trie_node *node, *child;
+	int err, sp = 0, i;
+
+	node = rcu_dereference_check(trie->root, rcu_read_lock_bh_held());
+	if (node)
+		sc->stack[sp++] = node;
+
+	while (sp) {
+		node = sc->stack[--sp];
+
+		for (i = 0; i < 2; i++) {
+			child = rcu_dereference_check(node->child[i],
+						      rcu_read_lock_bh_held());
+			if (child)
+				sc->stack[sp++] = child;
+		}
+
+		if (node->flags & LPM_TREE_NODE_FLAG_IM)
+			continue;
+
+		key->prefixlen = node->prefixlen;
+		memcpy(key->data, node->data, trie->data_size);
+		err = lpm_mb_update(b, proot, 0, key);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static void lpm_mb_rebuild_work(struct work_struct *work)
+{
+	struct lpm_trie *trie = container_of(work, struct lpm_trie,
+					     mb_rebuild_work);
+	struct lpm_mb_build b = {
+		.trie = trie,
+		.sc = &trie->mb_scratch[1],
+		.rebuild = true,
+	};
+	struct lpm_mb_node __rcu *root = NULL;
+	struct lpm_mb_node *old, *new;
+	unsigned long irq_flags;
+	int err;
+
+	if (smp_load_acquire(&trie->mb_valid))
+		return;
+
+	/* pairs with the release in lpm_mb_sync(), for the trie */
+	b.gen = atomic64_read_acquire(&trie->mb_gen);
+	rcu_read_lock_bh();
+	err = lpm_mb_rebuild(&b, &root);
+	rcu_read_unlock_bh();
+	new = rcu_dereference_protected(root, 1);
+
+	spin_lock_irqsave(&trie->lock, irq_flags);
+	/* Changes to the trie made meanwhile requeued the work, which builds
+	 * again from the current trie. Allocation failures are retried on the
+	 * next change.
+	 */
+	if (err || trie->mb_valid || atomic64_read(&trie->mb_gen) != b.gen) {
+		spin_unlock_irqrestore(&trie->lock, irq_flags);
+		if (new)
+			lpm_mb_free_tree(new);
+		return;
+	}
+
+	old = rcu_dereference_protected(trie->mb_root,
+					lockdep_is_held(&trie->lock));
+	rcu_assign_pointer(trie->mb_root, new);
+	trie->mb_mem = b.mem;
+	smp_store_release(&trie->mb_valid, true);
+	spin_unlock_irqrestore(&trie->lock, irq_flags);
+
+	/* Only readers which saw mb_valid before the failure can still walk
+	 * the old index, the trie nodes it points to can't be freed before
+	 * they are done.
+	 */
+	if (old)
+		lpm_mb_drop_tree(old);
+}
+
+/* Keep the index in sync with a change to the trie, before any trie node it
+ * might point to is freed. An allocation failure leaves it out of date:
+ * lookups fall back to the binary trie until a full rebuild, from process
+ * context, succeeds. Later changes to the trie retry it if it fails too.
+ */
+static void lpm_mb_sync(struct lpm_trie *trie,
+			const struct bpf_lpm_trie_key *key)
+{
+	struct lpm_mb_build b = {
+		.trie = trie,
+		.mem = trie->mb_mem,
+	};
+	int err;
+
+	if (!trie->mb_scratch)
+		return;
+
+	/* a rebuild in progress missed this change */
+	atomic64_inc_return_release(&trie->mb_gen);
+
+	if (trie->mb_valid) {
+		b.sc = &trie->mb_scratch[0];
+		err = lpm_mb_update(&b, &trie->mb_root, 0, key);
+		trie->mb_mem = b.mem;
+		if (!err)
+			return;
+	}
+
+	WRITE_ONCE(trie->mb_valid, false);
+	schedule_work(&trie->mb_rebuild_work);
+}
+
 static struct lpm_trie_node *lpm_trie_node_alloc(const struct lpm_trie *trie,
 						 const void *value)
 {
@@ -305,6 +786,7 @@ static long trie_update_elem(struct bpf_map *map,
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node *node, *im_node = NULL, *new_node = NULL;
+	struct lpm_trie_node *free_node = NULL;
 	struct lpm_trie_node __rcu **slot;
 	struct bpf_lpm_trie_key *key = _key;
 	unsigned long irq_flags;
@@ -379,7 +861,7 @@ static long trie_update_elem(struct bpf_map *map,
 			trie->n_entries--;
 
 		rcu_assign_pointer(*slot, new_node);
-		kfree_rcu(node, rcu);
+		free_node = node;
 
 		goto out;
 	}
@@ -423,8 +905,14 @@ static long trie_update_elem(struct bpf_map *map,
 
 		kfree(new_node);
 		kfree(im_node);
+	} else {
+		lpm_mb_sync(trie, key);
 	}
 
+	/* only once the index no longer points to it */
+	if (free_node)
+		kfree_rcu(free_node, rcu);
+
 	spin_unlock_irqrestore(&trie->lock, irq_flags);
 
 	return ret;
@@ -436,7 +924,7 @@ static long trie_delete_elem(struct bpf_map *map, void *_key)
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct bpf_lpm_trie_key *key = _key;
 	struct lpm_trie_node __rcu **trim, **trim2;
-	struct lpm_trie_node *node, *parent;
+	struct lpm_trie_node *node, *parent, *free_node = NULL;
 	unsigned long irq_flags;
 	unsigned int next_bit;
 	size_t matchlen = 0;
@@ -504,7 +992,7 @@ static long trie_delete_elem(struct bpf_map *map, void *_key)
 			rcu_assign_pointer(
 				*trim2, rcu_access_pointer(parent->child[0]));
 		kfree_rcu(parent, rcu);
-		kfree_rcu(node, rcu);
+		free_node = node;
 		goto out;
 	}
 
@@ -518,9 +1006,16 @@ static long trie_delete_elem(struct bpf_map *map, void *_key)
 		rcu_assign_pointer(*trim, rcu_access_pointer(node->child[1]));
 	else
 		RCU_INIT_POINTER(*trim, NULL);
-	kfree_rcu(node, rcu);
+	free_node = node;
 
 out:
+	if (!ret)
+		lpm_mb_sync(trie, key);
+
+	/* Readers starting from now on can't find it in the index either */
+	if (free_node)
+		kfree_rcu(free_node, rcu);
+
 	spin_unlock_irqrestore(&trie->lock, irq_flags);
 
 	return ret;
@@ -538,7 +1033,7 @@ static long trie_delete_elem(struct bpf_map *map, void *_key)
 #define LPM_KEY_SIZE_MIN	LPM_KEY_SIZE(LPM_DATA_SIZE_MIN)
 
 #define LPM_CREATE_FLAG_MASK	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE |	\
-				 BPF_F_ACCESS_MASK)
+				 BPF_F_ACCESS_MASK | BPF_F_LPM_MULTIBIT)
 
 static struct bpf_map *trie_alloc(union bpf_attr *attr)
 {
@@ -555,6 +1050,10 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 	    attr->value_size > LPM_VAL_SIZE_MAX)
 		return ERR_PTR(-EINVAL);
 
+	if (attr->map_flags & BPF_F_LPM_MULTIBIT &&
+	    attr->key_size > LPM_KEY_SIZE(LPM_MB_DATA_SIZE_MAX))
+		return ERR_PTR(-EINVAL);
+
 	trie = bpf_map_area_alloc(sizeof(*trie), NUMA_NO_NODE);
 	if (!trie)
 		return ERR_PTR(-ENOMEM);
@@ -567,6 +1066,17 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 
 	spin_lock_init(&trie->lock);
 
+	if (attr->map_flags & BPF_F_LPM_MULTIBIT) {
+		trie->mb_scratch = bpf_map_area_alloc(2 * sizeof(*trie->mb_scratch),
+						      NUMA_NO_NODE);
+		if (!trie->mb_scratch) {
+			bpf_map_area_free(trie);
+			return ERR_PTR(-ENOMEM);
+		}
+		trie->mb_valid = true;
+		INIT_WORK(&trie->mb_rebuild_work, lpm_mb_rebuild_work);
+	}
+
 	return &trie->map;
 }
 
@@ -574,8 +1084,16 @@ static void trie_free(struct bpf_map *map)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node __rcu **slot;
+	struct lpm_mb_node *mb_root;
 	struct lpm_trie_node *node;
 
+	if (trie->mb_scratch)
+		cancel_work_sync(&trie->mb_rebuild_work);
+	mb_root = rcu_dereference_protected(trie->mb_root, 1);
+	if (mb_root)
+		lpm_mb_free_tree(mb_root);
+	bpf_map_area_free(trie->mb_scratch);
+
 	/* Always start at the root and walk down to a node that has no
 	 * children. Then free that node, nullify its reference in the parent
 	 * and start over.
@@ -720,11 +1238,14 @@ static int trie_check_btf(const struct bpf_map *map,
 static u64 trie_mem_usage(const struct bpf_map *map)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
-	u64 elem_size;
+	u64 elem_size, usage;
 
 	elem_size = sizeof(struct lpm_trie_node) + trie->data_size +
 			    trie->map.value_size;
-	return elem_size * READ_ONCE(trie->n_entries);
+	usage = elem_size * READ_ONCE(trie->n_entries);
+	if (trie->mb_scratch)
+		usage += 2 * sizeof(*trie->mb_scratch) + READ_ONCE(trie->mb_mem);
+	return usage;
 }
 
 BTF_ID_LIST_SINGLE(trie_map_btf_ids, struct, lpm_trie)
@@ -9,6 +9,8 @@
 #include <linux/wait.h>
 #include <linux/poll.h>
 #include <linux/kmemleak.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
 #include <uapi/linux/btf.h>
 #include <linux/btf_ids.h>
 
@@ -38,12 +40,22 @@ struct bpf_ringbuf {
 	u64 mask;
 	struct page **pages;
 	int nr_pages;
-	spinlock_t spinlock ____cacheline_aligned_in_smp;
+	/* records which couldn't be reserved for lack of space */
+	unsigned long __percpu *drops;
+	/* Kernel producers reserve space by moving reserve_pos forward with
+	 * cmpxchg, then write the record header. Records are only made
+	 * visible to the consumer through producer_pos once all of them have
+	 * a header, by the last producer leaving __bpf_ringbuf_reserve(), as
+	 * counted by writers. No producer ever waits for another one, which
+	 * keeps NMI context from dropping records on a busy lock.
+	 */
+	unsigned long reserve_pos ____cacheline_aligned_in_smp;
+	atomic_t writers;
 	/* For user-space producer ring buffers, an atomic_t busy bit is used
 	 * to synchronize access to the ring buffers in the kernel, rather than
-	 * the spinlock that is used for kernel-producer ring buffers. This is
-	 * done because the ring buffer must hold a lock across a BPF program's
-	 * callback:
+	 * the lockless reservation used for kernel-producer ring buffers. This
+	 * is done because the ring buffer must hold a lock across a BPF
+	 * program's callback:
 	 *
 	 *    __bpf_user_ringbuf_peek() // lock acquired
 	 * -> program callback_fn()
@@ -161,6 +173,21 @@ static void bpf_ringbuf_notify(struct irq_work *work)
 	wake_up_all(&rb->waitq);
 }
 
+static void bpf_ringbuf_free(struct bpf_ringbuf *rb)
+{
+	/* copy pages pointer and nr_pages to local variable, as we are going
+	 * to unmap rb itself with vunmap() below
+	 */
+	struct page **pages = rb->pages;
+	int i, nr_pages = rb->nr_pages;
+
+	free_percpu(rb->drops);
+	vunmap(rb);
+	for (i = 0; i < nr_pages; i++)
+		__free_page(pages[i]);
+	bpf_map_area_free(pages);
+}
+
 static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 {
 	struct bpf_ringbuf *rb;
@@ -169,7 +196,13 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	if (!rb)
 		return NULL;
 
-	spin_lock_init(&rb->spinlock);
+	rb->drops = alloc_percpu_gfp(unsigned long, GFP_KERNEL_ACCOUNT);
+	if (!rb->drops) {
+		bpf_ringbuf_free(rb);
+		return NULL;
+	}
+
+	atomic_set(&rb->writers, 0);
 	atomic_set(&rb->busy, 0);
 	init_waitqueue_head(&rb->waitq);
 	init_irq_work(&rb->work, bpf_ringbuf_notify);
@@ -177,6 +210,7 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	rb->mask = data_sz - 1;
 	rb->consumer_pos = 0;
 	rb->producer_pos = 0;
+	rb->reserve_pos = 0;
 
 	return rb;
 }
@@ -214,20 +248,6 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 	return &rb_map->map;
 }
 
-static void bpf_ringbuf_free(struct bpf_ringbuf *rb)
-{
-	/* copy pages pointer and nr_pages to local variable, as we are going
-	 * to unmap rb itself with vunmap() below
-	 */
-	struct page **pages = rb->pages;
-	int i, nr_pages = rb->nr_pages;
-
-	vunmap(rb);
-	for (i = 0; i < nr_pages; i++)
-		__free_page(pages[i]);
-	bpf_map_area_free(pages);
-}
-
 static void ringbuf_map_free(struct bpf_map *map)
 {
 	struct bpf_ringbuf_map *rb_map;
@@ -349,9 +369,37 @@ static u64 ringbuf_map_mem_usage(const struct bpf_map *map)
 	nr_meta_pages = RINGBUF_NR_META_PAGES;
 	nr_data_pages = map->max_entries >> PAGE_SHIFT;
 	usage += (nr_meta_pages + 2 * nr_data_pages) * sizeof(struct page *);
+	usage += sizeof(unsigned long) * num_possible_cpus();
 	return usage;
 }
 
+static unsigned long bpf_ringbuf_drops(struct bpf_ringbuf *rb)
+{
+	unsigned long drops = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		drops += READ_ONCE(*per_cpu_ptr(rb->drops, cpu));
+
+	return drops;
+}
+
+static void ringbuf_map_show_fdinfo(struct bpf_map *map, struct seq_file *m)
+{
+	struct bpf_ringbuf *rb;
+	unsigned long drops;
+	int cpu;
+
+	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+	seq_printf(m, "drops:\t%lu\n", bpf_ringbuf_drops(rb));
+	/* only the CPUs which dropped records, there may be thousands */
+	for_each_possible_cpu(cpu) {
+		drops = READ_ONCE(*per_cpu_ptr(rb->drops, cpu));
+		if (drops)
+			seq_printf(m, "drops_cpu%d:\t%lu\n", cpu, drops);
+	}
+}
+
 BTF_ID_LIST_SINGLE(ringbuf_map_btf_ids, struct, bpf_ringbuf_map)
 const struct bpf_map_ops ringbuf_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
@@ -364,6 +412,7 @@ const struct bpf_map_ops ringbuf_map_ops = {
 	.map_delete_elem = ringbuf_map_delete_elem,
 	.map_get_next_key = ringbuf_map_get_next_key,
 	.map_mem_usage = ringbuf_map_mem_usage,
+	.map_show_fdinfo = ringbuf_map_show_fdinfo,
 	.map_btf_id = &ringbuf_map_btf_ids[0],
 };
 
@@ -406,6 +455,54 @@ bpf_ringbuf_restore_from_rec(struct bpf_ringbuf_hdr *hdr)
 	return (void*)((addr & PAGE_MASK) - off);
 }
 
+/* Called by each producer leaving __bpf_ringbuf_reserve(). If it's the last
+ * one, all records up to reserve_pos have a header, and can be published.
+ * A producer reserving space right after that read of reserve_pos doesn't
+ * know it has to publish for us, hence the check for it at the end.
+ */
+static void bpf_ringbuf_publish(struct bpf_ringbuf *rb)
+{
+	unsigned long pos, prod_pos, cons_pos;
+	struct bpf_ringbuf_hdr *hdr;
+
+again:
+	pos = READ_ONCE(rb->reserve_pos);
+	if (!atomic_dec_and_test(&rb->writers))
+		return;
+
+	/* a later publisher might have got there first */
+	prod_pos = READ_ONCE(rb->producer_pos);
+	while ((long)(pos - prod_pos) > 0) {
+		/* pairs with consumer's smp_load_acquire() */
+		if (!try_cmpxchg_release(&rb->producer_pos, &prod_pos, pos))
+			continue;
+
+		/* Order the producer_pos update against the reads below. The
+		 * consumer stores consumer_pos, then loads producer_pos: without
+		 * a full barrier on both sides, each could miss the other's
+		 * store, and the wakeup would be lost.
+		 */
+		smp_mb();
+
+		/* Records of other producers might have been committed
+		 * before they were published, and the consumer notified for
+		 * nothing. Notify it again if it's waiting on one of them.
+		 */
+		cons_pos = smp_load_acquire(&rb->consumer_pos);
+		if (cons_pos - prod_pos < pos - prod_pos) {
+			hdr = (void *)rb->data + (cons_pos & rb->mask);
+			if (!(smp_load_acquire(&hdr->len) & BPF_RINGBUF_BUSY_BIT))
+				irq_work_queue(&rb->work);
+		}
+		break;
+	}
+
+	if (unlikely(pos != READ_ONCE(rb->reserve_pos))) {
+		atomic_inc(&rb->writers);
+		goto again;
+	}
+}
+
 static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 {
 	unsigned long cons_pos, prod_pos, new_prod_pos, flags;
@@ -421,33 +518,36 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 
 	cons_pos = smp_load_acquire(&rb->consumer_pos);
 
-	if (in_nmi()) {
-		if (!spin_trylock_irqsave(&rb->spinlock, flags))
-			return NULL;
-	} else {
-		spin_lock_irqsave(&rb->spinlock, flags);
-	}
+	/* keep the window where other producers depend on us short */
+	local_irq_save(flags);
+	atomic_inc(&rb->writers);
 
-	prod_pos = rb->producer_pos;
-	new_prod_pos = prod_pos + len;
-
-	/* check for out of ringbuf space by ensuring producer position
-	 * doesn't advance more than (ringbuf_size - 1) ahead
+	/* the successful cmpxchg orders the increment of writers before
+	 * the reservation becomes visible
 	 */
-	if (new_prod_pos - cons_pos > rb->mask) {
-		spin_unlock_irqrestore(&rb->spinlock, flags);
-		return NULL;
-	}
+	prod_pos = READ_ONCE(rb->reserve_pos);
+	do {
+		new_prod_pos = prod_pos + len;
+
+		/* check for out of ringbuf space by ensuring producer
+		 * position doesn't advance more than (ringbuf_size - 1)
+		 * ahead
+		 */
+		if (new_prod_pos - cons_pos > rb->mask) {
+			this_cpu_inc(*rb->drops);
+			bpf_ringbuf_publish(rb);
+			local_irq_restore(flags);
+			return NULL;
+		}
+	} while (!try_cmpxchg(&rb->reserve_pos, &prod_pos, new_prod_pos));
 
 	hdr = (void *)rb->data + (prod_pos & rb->mask);
 	pg_off = bpf_ringbuf_rec_pg_off(rb, hdr);
 	hdr->len = size | BPF_RINGBUF_BUSY_BIT;
 	hdr->pg_off = pg_off;
 
-	/* pairs with consumer's smp_load_acquire() */
-	smp_store_release(&rb->producer_pos, new_prod_pos);
-
-	spin_unlock_irqrestore(&rb->spinlock, flags);
+	bpf_ringbuf_publish(rb);
+	local_irq_restore(flags);
 
 	return (void *)hdr + BPF_RINGBUF_HDR_SZ;
 }
@@ -568,6 +668,8 @@ BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
 		return smp_load_acquire(&rb->consumer_pos);
 	case BPF_RB_PROD_POS:
 		return smp_load_acquire(&rb->producer_pos);
+	case BPF_RB_DROPS:
+		return bpf_ringbuf_drops(rb);
 	default:
 		return 0;
 	}
@@ -805,6 +805,8 @@ static void bpf_map_show_fdinfo(struct seq_file *m, struct file *filp)
 		seq_printf(m, "owner_prog_type:\t%u\n", type);
 		seq_printf(m, "owner_jited:\t%u\n", jited);
 	}
+	if (map->ops->map_show_fdinfo)
+		map->ops->map_show_fdinfo(map, m);
 }
 #endif
 
@@ -25,6 +25,8 @@
 #include <linux/btf_ids.h>
 #include <linux/poison.h>
 #include <linux/module.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
 
 #include "disasm.h"
 
@@ -14452,14 +14454,14 @@ static u32 state_htab_size(struct bpf_verifier_env *env)
 	return env->prog->len;
 }
 
+/* States are hashed by insn and state_sig(), states which can't be equal
+ * to each other mostly end up in different lists.
+ */
 static struct bpf_verifier_state_list **explored_state(
 					struct bpf_verifier_env *env,
-					int idx)
+					int idx, u32 sig)
 {
-	struct bpf_verifier_state *cur = env->cur_state;
-	struct bpf_func_state *state = cur->frame[cur->curframe];
-
-	return &env->explored_states[(idx ^ state->callsite) % state_htab_size(env)];
+	return &env->explored_states[jhash_2words(idx, sig, 0) % state_htab_size(env)];
 }
 
 static void mark_prune_point(struct bpf_verifier_env *env, int idx)
@@ -15254,16 +15256,16 @@ static void clean_verifier_state(struct bpf_verifier_env *env,
  * the callsites
  */
 static void clean_live_states(struct bpf_verifier_env *env, int insn,
-			      struct bpf_verifier_state *cur)
+			      struct bpf_verifier_state *cur, u32 sig)
 {
 	struct bpf_verifier_state_list *sl;
 	int i;
 
-	sl = *explored_state(env, insn);
+	sl = *explored_state(env, insn, sig);
 	while (sl) {
 		if (sl->state.branches)
 			goto next;
-		if (sl->state.insn_idx != insn ||
+		if (sl->state.insn_idx != insn || sl->sig != sig ||
 		    sl->state.curframe != cur->curframe)
 			goto next;
 		for (i = 0; i <= cur->curframe; i++)
@@ -15613,6 +15615,36 @@ static bool states_equal(struct bpf_verifier_env *env,
 	return true;
 }
 
+/* Hash of the parts of a state which states_equal() requires to be exactly
+ * the same in both states: call chain, locks and number of references held.
+ * Register and stack types can't be part of it, an old register which isn't
+ * read or is NOT_INIT matches any type, and read marks are only complete
+ * once all the branches of a state are explored.
+ */
+static u32 state_sig(const struct bpf_verifier_state *st)
+{
+	u32 i, sig;
+
+	sig = jhash_3words(st->curframe,
+			   st->active_rcu_lock | !!st->active_lock.id << 1,
+			   hash_ptr(st->active_lock.ptr, 32), 0);
+	for (i = 0; i <= st->curframe; i++)
+		sig = jhash_2words(st->frame[i]->callsite,
+				   st->frame[i]->acquired_refs, sig);
+
+	return sig;
+}
+
+static bool sl_states_equal(struct bpf_verifier_env *env,
+			    struct bpf_verifier_state_list *sl,
+			    struct bpf_verifier_state *cur)
+{
+	if (env->insn_prof)
+		env->insn_prof[sl->state.insn_idx].compared++;
+
+	return states_equal(env, &sl->state, cur);
+}
+
 /* Return 0 if no propagation happened. Return negative error code if error
  * happened. Otherwise, return the propagated bit.
  */
@@ -15857,7 +15889,7 @@ static bool iter_active_depths_differ(struct bpf_verifier_state *old, struct bpf
 	return false;
 }
 
-static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
+static int __is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 {
 	struct bpf_verifier_state_list *new_sl;
 	struct bpf_verifier_state_list *sl, **pprev;
@@ -15865,6 +15897,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	int i, j, err, states_cnt = 0;
 	bool force_new_state = env->test_state_freq || is_force_checkpoint(env, insn_idx);
 	bool add_new_state = force_new_state;
+	u32 sig = state_sig(cur);
 
 	/* bpf progs typically have pruning point every 4 instructions
 	 * http://vger.kernel.org/bpfconf2019.html#session-1
@@ -15878,15 +15911,20 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	    env->insn_processed - env->prev_insn_processed >= 8)
 		add_new_state = true;
 
-	pprev = explored_state(env, insn_idx);
+	pprev = explored_state(env, insn_idx, sig);
 	sl = *pprev;
 
-	clean_live_states(env, insn_idx, cur);
+	clean_live_states(env, insn_idx, cur, sig);
 
 	while (sl) {
 		states_cnt++;
 		if (sl->state.insn_idx != insn_idx)
 			goto next;
+		/* can't be equal, and isn't a miss of the state either */
+		if (sl->sig != sig) {
+			env->sig_skipped++;
+			goto next;
+		}
 
 		if (sl->state.branches) {
 			struct bpf_func_state *frame = sl->state.frame[sl->state.curframe];
@@ -15919,7 +15957,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 			 * sticky NULL result.
 			 */
 			if (is_iter_next_insn(env, insn_idx)) {
-				if (states_equal(env, &sl->state, cur)) {
+				if (sl_states_equal(env, sl, cur)) {
 					struct bpf_func_state *cur_frame;
 					struct bpf_reg_state *iter_state, *iter_reg;
 					int spi;
@@ -15942,7 +15980,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 			}
 			/* attempt to detect infinite loop to avoid unnecessary doomed work */
 			if (states_maybe_looping(&sl->state, cur) &&
-			    states_equal(env, &sl->state, cur) &&
+			    sl_states_equal(env, sl, cur) &&
 			    !iter_active_depths_differ(&sl->state, cur)) {
 				verbose_linfo(env, insn_idx, "; ");
 				verbose(env, "infinite loop detected at insn %d\n", insn_idx);
@@ -15967,7 +16005,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 				add_new_state = false;
 			goto miss;
 		}
-		if (states_equal(env, &sl->state, cur)) {
+		if (sl_states_equal(env, sl, cur)) {
 hit:
 			sl->hit_cnt++;
 			/* reached equivalent register/stack state,
@@ -16076,14 +16114,15 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 		return err;
 	}
 	new->insn_idx = insn_idx;
+	new_sl->sig = sig;
 	WARN_ONCE(new->branches != 1,
 		  "BUG is_state_visited:branches_to_explore=%d insn %d\n", new->branches, insn_idx);
 
 	cur->parent = new;
 	cur->first_insn_idx = insn_idx;
 	clear_jmp_history(cur);
-	new_sl->next = *explored_state(env, insn_idx);
-	*explored_state(env, insn_idx) = new_sl;
+	new_sl->next = *explored_state(env, insn_idx, sig);
+	*explored_state(env, insn_idx, sig) = new_sl;
 	/* connect new state to parentage chain. Current frame needs all
 	 * registers connected. Only r6 - r9 of the callers are alive (pushed
 	 * to the stack implicitly by JITs) so in callers' frames connect just
@@ -16118,6 +16157,26 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	return 0;
 }
 
+static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
+{
+	struct bpf_insn_prof *prof;
+	u64 start;
+	int err;
+
+	if (!env->insn_prof)
+		return __is_state_visited(env, insn_idx);
+
+	prof = &env->insn_prof[insn_idx];
+	start = ktime_get_ns();
+	err = __is_state_visited(env, insn_idx);
+	prof->time_ns += ktime_get_ns() - start;
+	prof->visits++;
+	if (err == 1)
+		prof->pruned++;
+
+	return err;
+}
+
 /* Return true if it's OK to have the same insn return a different type. */
 static bool reg_type_mismatch_ok(enum bpf_reg_type type)
 {
@@ -16222,6 +16281,9 @@ static int do_check(struct bpf_verifier_env *env)
 			return -E2BIG;
 		}
 
+		if (env->insn_prof)
+			env->insn_prof[env->insn_idx].processed++;
+
 		state->last_insn_idx = env->prev_insn_idx;
 
 		if (is_prune_point(env, env->insn_idx)) {
@@ -18884,10 +18946,46 @@ static int do_check_main(struct bpf_verifier_env *env)
 }
 
 
+#define INSN_PROF_TOP	16
+
+/* Prune points where the most time was spent looking for equivalent states.
+ * Insn indices are the ones of the program as loaded.
+ */
+static void print_insn_profile(struct bpf_verifier_env *env)
+{
+	const struct bpf_insn_prof *prof = env->insn_prof, *p;
+	u32 top[INSN_PROF_TOP], n = 0, i, j;
+
+	for (i = 0; i < env->insn_prof_cnt; i++) {
+		if (!prof[i].visits)
+			continue;
+
+		for (j = n; j > 0 && prof[top[j - 1]].time_ns < prof[i].time_ns; j--)
+			if (j < INSN_PROF_TOP)
+				top[j] = top[j - 1];
+		if (j < INSN_PROF_TOP) {
+			top[j] = i;
+			if (n < INSN_PROF_TOP)
+				n++;
+		}
+	}
+
+	verbose(env, "states skipped by signature %u\n", env->sig_skipped);
+	for (i = 0; i < n; i++) {
+		p = &prof[top[i]];
+		verbose(env, "insn %u: processed %u visits %u compared %u pruned %u time %llu usec\n",
+			top[i], p->processed, p->visits, p->compared, p->pruned,
+			div_u64(p->time_ns, 1000));
+	}
+}
+
 static void print_verification_stats(struct bpf_verifier_env *env)
 {
 	int i;
 
+	if (env->insn_prof)
+		print_insn_profile(env);
+
 	if (env->log.level & BPF_LOG_STATS) {
 		verbose(env, "verification time %lld usec\n",
 			div_u64(env->verification_time, 1000));
@@ -19470,6 +19568,14 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr, bpfptr_t uattr, __u3
 	if (!env->explored_states)
 		goto skip_full_check;
 
+	if (env->log.level & BPF_LOG_PROFILE) {
+		env->insn_prof_cnt = env->prog->len;
+		env->insn_prof = kvcalloc(env->insn_prof_cnt,
+					  sizeof(*env->insn_prof), GFP_USER);
+		if (!env->insn_prof)
+			goto skip_full_check;
+	}
+
 	ret = add_subprog_and_kfunc(env);
 	if (ret < 0)
 		goto skip_full_check;
@@ -19549,6 +19655,7 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr, bpfptr_t uattr, __u3
 
 	env->verification_time = ktime_get_ns() - start_time;
 	print_verification_stats(env);
+	kvfree(env->insn_prof);
 	env->prog->aux->verified_insns = env->insn_processed;
 
 	/* preserve original error even if log finalization is successful */
@@ -649,6 +649,7 @@ static __latent_entropy int dup_mmap(struct mm_struct *mm,
 	struct vm_area_struct *mpnt, *tmp;
 	int retval;
 	unsigned long charge = 0;
+	u64 start = ktime_get_ns();
 	LIST_HEAD(uf);
 	VMA_ITERATOR(old_vmi, oldmm, 0);
 	VMA_ITERATOR(vmi, mm, 0);
@@ -772,6 +773,10 @@ static __latent_entropy int dup_mmap(struct mm_struct *mm,
 out:
 	mmap_write_unlock(mm);
 	flush_tlb_mm(oldmm);
+	if (!retval) {
+		oldmm->nr_forks++;
+		oldmm->fork_time_ns += ktime_get_ns() - start;
+	}
 	mmap_write_unlock(oldmm);
 	dup_userfaultfd_complete(&uf);
 fail_uprobe_end:
@@ -1282,6 +1287,8 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	mm->pmd_huge_pte = NULL;
 #endif
 	mm_init_uprobes_state(mm);
+	mm->nr_forks = 0;
+	mm->fork_time_ns = 0;
 	hugetlb_count_init(mm);
 
 	if (current->mm) {
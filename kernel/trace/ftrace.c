@@ -2682,6 +2682,16 @@ unsigned long ftrace_get_addr_curr(struct dyn_ftrace *rec)
 		return (unsigned long)FTRACE_ADDR;
 }
 
+/* Protected by ftrace_lock */
+static struct ftrace_patch_stats ftrace_patch_stats;
+
+void ftrace_get_patch_stats(struct ftrace_patch_stats *stats)
+{
+	mutex_lock(&ftrace_lock);
+	*stats = ftrace_patch_stats;
+	mutex_unlock(&ftrace_lock);
+}
+
 static int
 __ftrace_replace_code(struct dyn_ftrace *rec, bool enable)
 {
@@ -2946,6 +2956,12 @@ void __weak arch_ftrace_update_code(int command)
 
 static void ftrace_run_update_code(int command)
 {
+	struct ftrace_patch_stats *stats = &ftrace_patch_stats;
+	u64 start, delta;
+
+	/* not ftrace_now(), which follows trace_clock, maybe a mere counter */
+	start = ktime_get_ns();
+
 	ftrace_arch_code_modify_prepare();
 
 	/*
@@ -2957,6 +2973,14 @@ static void ftrace_run_update_code(int command)
 	arch_ftrace_update_code(command);
 
 	ftrace_arch_code_modify_post_process();
+
+	delta = ktime_get_ns() - start;
+
+	stats->updates++;
+	stats->last_ns = delta;
+	stats->total_ns += delta;
+	if (delta > stats->max_ns)
+		stats->max_ns = delta;
 }
 
 static void ftrace_run_modify_code(struct ftrace_ops *ops, int command,
@@ -8,6 +8,7 @@
 #include <linux/trace_events.h>
 #include <linux/ring_buffer.h>
 #include <linux/trace_clock.h>
+#include <linux/trace_mmap.h>
 #include <linux/sched/clock.h>
 #include <linux/trace_seq.h>
 #include <linux/spinlock.h>
@@ -331,6 +332,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	u32		 id;		/* ID for user space mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -532,6 +534,12 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user space mapping, see ring_buffer_map() */
+	struct mutex			mapping_lock;
+	int				mapped;
+	unsigned long			*subbuf_ids;	/* ID to data page */
+	struct trace_buffer_meta	*meta_page;
 };
 
 struct trace_buffer {
@@ -1729,6 +1737,7 @@ rb_allocate_cpu_buffer(struct trace_buffer *buffer, long nr_pages, int cpu)
 	init_irq_work(&cpu_buffer->irq_work.work, rb_wake_up_waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.full_waiters);
+	mutex_init(&cpu_buffer->mapping_lock);
 
 	bpage = kzalloc_node(ALIGN(sizeof(*bpage), cache_line_size()),
 			    GFP_KERNEL, cpu_to_node(cpu));
@@ -4536,6 +4545,25 @@ rb_update_iter_read_stamp(struct ring_buffer_iter *iter,
 	}
 }
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	if (!meta)
+		return;
+
+	meta->reader.read = cpu_buffer->reader_page->read;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.lost_events = cpu_buffer->lost_events;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	/* Some archs do not have data cache coherency with user space */
+	flush_dcache_folio(virt_to_folio(cpu_buffer->meta_page));
+}
+
 static struct buffer_page *
 rb_get_reader_page(struct ring_buffer_per_cpu *cpu_buffer)
 {
@@ -4658,6 +4686,8 @@ rb_get_reader_page(struct ring_buffer_per_cpu *cpu_buffer)
 		cpu_buffer->last_overrun = overwrite;
 	}
 
+	rb_update_meta_page(cpu_buffer);
+
 	goto again;
 
  out:
@@ -5300,6 +5330,8 @@ rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 
 	rb_head_page_activate(cpu_buffer);
 	cpu_buffer->pages_removed = 0;
+
+	rb_update_meta_page(cpu_buffer);
 }
 
 /* Must have disabled the cpu buffer then done a synchronize_rcu */
@@ -5554,6 +5586,10 @@ int ring_buffer_swap_cpu(struct trace_buffer *buffer_a,
 	if (atomic_read(&buffer_b->resizing))
 		goto out_dec;
 
+	/* Nor if user space has a mapping of either of them */
+	if (READ_ONCE(cpu_buffer_a->mapped) || READ_ONCE(cpu_buffer_b->mapped))
+		goto out_dec;
+
 	buffer_a->buffers[cpu] = cpu_buffer_b;
 	buffer_b->buffers[cpu] = cpu_buffer_a;
 
@@ -5749,12 +5785,14 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 	/*
 	 * If this page has been partially read or
 	 * if len is not big enough to read the rest of the page or
-	 * a writer is still on the page, then
+	 * a writer is still on the page or
+	 * the buffer pages are mapped to user space, then
 	 * we must copy the data from the page to the buffer.
 	 * Otherwise, we can simply swap the page with the one passed in.
 	 */
 	if (read || (len < (commit - read)) ||
-	    cpu_buffer->reader_page == cpu_buffer->commit_page) {
+	    cpu_buffer->reader_page == cpu_buffer->commit_page ||
+	    cpu_buffer->mapped) {
 		struct buffer_data_page *rpage = cpu_buffer->reader_page->page;
 		unsigned int rpos = read;
 		unsigned int pos = 0;
@@ -5767,7 +5805,7 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 		 * the reader page.
 		 */
 		if (full &&
-		    (!read || (len < (commit - read)) ||
+		    ((!read && !cpu_buffer->mapped) || (len < (commit - read)) ||
 		     cpu_buffer->reader_page == cpu_buffer->commit_page))
 			goto out_unlock;
 
@@ -5871,6 +5909,346 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+/*
+ * Data pages of a per CPU buffer, plus its reader page, can be mapped to
+ * user space, after a meta page describing the buffer:
+ *
+ *   page 0:		struct trace_buffer_meta
+ *   page 1 + id:	data page with ID @id, 0 <= id < nr_subbufs
+ *
+ * IDs are assigned to the buffer_page structures, which keep their data
+ * page while mapped (ring_buffer_read_page() copies instead of swapping).
+ * The reader page moves around the ring, the meta page tells user space
+ * which ID it currently has, and how much of it was consumed.
+ * ring_buffer_map_get_reader() consumes what is left on the reader page,
+ * and swaps in the next one if it was already consumed entirely.
+ */
+static void rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				   unsigned long *subbuf_ids)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+	unsigned int nr_subbufs = cpu_buffer->nr_pages + 1;
+	struct buffer_page *first, *bpage;
+	int id = 0;
+
+	subbuf_ids[id] = (unsigned long)cpu_buffer->reader_page->page;
+	cpu_buffer->reader_page->id = id++;
+
+	first = bpage = rb_set_head_page(cpu_buffer);
+	do {
+		if (RB_WARN_ON(cpu_buffer, id >= nr_subbufs))
+			break;
+
+		subbuf_ids[id] = (unsigned long)bpage->page;
+		bpage->id = id++;
+
+		rb_inc_page(&bpage);
+	} while (bpage != first);
+
+	cpu_buffer->subbuf_ids = subbuf_ids;
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = nr_subbufs;
+
+	rb_update_meta_page(cpu_buffer);
+}
+
+static int __rb_map_vma(struct ring_buffer_per_cpu *cpu_buffer,
+			struct vm_area_struct *vma)
+{
+	unsigned long nr_pages, nr_vma_pages, pgoff = vma->vm_pgoff;
+	struct page **pages;
+	int p = 0, s = 0;
+	int err;
+
+	/* Only read-only shared mappings */
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC) ||
+	    !(vma->vm_flags & VM_MAYSHARE))
+		return -EPERM;
+
+	/* Make sure it can't become writable later, and leave it alone */
+	vm_flags_mod(vma, VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP,
+		     VM_MAYWRITE);
+
+	lockdep_assert_held(&cpu_buffer->mapping_lock);
+
+	/* meta page, reader page and ring pages */
+	nr_pages = cpu_buffer->nr_pages + 2;
+	if (pgoff >= nr_pages)
+		return -EINVAL;
+	nr_pages -= pgoff;
+
+	nr_vma_pages = vma_pages(vma);
+	if (!nr_vma_pages || nr_vma_pages > nr_pages)
+		return -EINVAL;
+	nr_pages = nr_vma_pages;
+
+	pages = kcalloc(nr_pages, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	if (!pgoff)
+		pages[p++] = virt_to_page(cpu_buffer->meta_page);
+	else
+		s = pgoff - 1;
+
+	while (p < nr_pages)
+		pages[p++] = virt_to_page((void *)cpu_buffer->subbuf_ids[s++]);
+
+	err = vm_insert_pages(vma, vma->vm_start, pages, &nr_pages);
+
+	kfree(pages);
+
+	return err;
+}
+
+/**
+ * ring_buffer_map - map a per CPU buffer to user space
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer to map
+ * @vma: The user space mapping, see __rb_map_vma() for the layout
+ *
+ * The buffer can't be resized or swapped while it's mapped.
+ *
+ * Returns 0 on success, a negative error code otherwise.
+ */
+int ring_buffer_map(struct trace_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long flags, *subbuf_ids;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (cpu_buffer->mapped) {
+		err = __rb_map_vma(cpu_buffer, vma);
+		if (!err)
+			cpu_buffer->mapped++;
+		goto out;
+	}
+
+	/* prevent another thread from changing buffer sizes */
+	mutex_lock(&buffer->mutex);
+
+	cpu_buffer->meta_page = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!cpu_buffer->meta_page) {
+		err = -ENOMEM;
+		goto unlock;
+	}
+
+	/* subbuf_ids include the reader page, nr_pages doesn't */
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!subbuf_ids) {
+		err = -ENOMEM;
+		goto free_meta;
+	}
+
+	atomic_inc(&cpu_buffer->resize_disabled);
+
+	/* Block reader page swaps until the IDs are assigned */
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	rb_setup_ids_meta_page(cpu_buffer, subbuf_ids);
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	err = __rb_map_vma(cpu_buffer, vma);
+	if (err) {
+		atomic_dec(&cpu_buffer->resize_disabled);
+		kfree(cpu_buffer->subbuf_ids);
+		cpu_buffer->subbuf_ids = NULL;
+		goto free_meta;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	goto unlock;
+
+ free_meta:
+	free_page((unsigned long)cpu_buffer->meta_page);
+	cpu_buffer->meta_page = NULL;
+ unlock:
+	mutex_unlock(&buffer->mutex);
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+
+	return err;
+}
+
+/**
+ * ring_buffer_map_dup - account for a copy of a user space mapping
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer mapped by ring_buffer_map()
+ *
+ * A mapping copied by the mm, as mremap() does when moving it, is released
+ * with ring_buffer_unmap() just like the original one.
+ */
+void ring_buffer_map_dup(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+
+	if (WARN_ON(!cpumask_test_cpu(cpu, buffer->cpumask)))
+		return;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (!WARN_ON(!cpu_buffer->mapped))
+		cpu_buffer->mapped++;
+
+	mutex_unlock(&cpu_buffer->mapping_lock);
+}
+
+/**
+ * ring_buffer_unmap - release a user space mapping of a per CPU buffer
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer mapped by ring_buffer_map()
+ *
+ * Returns 0 on success, -ENODEV if the buffer wasn't mapped.
+ */
+int ring_buffer_unmap(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long flags;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	} else if (cpu_buffer->mapped > 1) {
+		cpu_buffer->mapped--;
+		goto out;
+	}
+
+	mutex_lock(&buffer->mutex);
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 0;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	/* The pages themselves are kept alive by the zapped mapping */
+	free_page((unsigned long)cpu_buffer->meta_page);
+	cpu_buffer->meta_page = NULL;
+	kfree(cpu_buffer->subbuf_ids);
+	cpu_buffer->subbuf_ids = NULL;
+
+	atomic_dec(&cpu_buffer->resize_disabled);
+
+	mutex_unlock(&buffer->mutex);
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+
+	return err;
+}
+
+/**
+ * ring_buffer_map_get_reader - hand over the next reader page to user space
+ * @buffer: The ring buffer
+ * @cpu: The mapped CPU buffer
+ *
+ * Events left on the current reader page are handed over to user space.
+ * If there are none, the next page is swapped in first, with the events
+ * lost since the previous swap flagged in its commit field, as
+ * ring_buffer_read_page() does. The meta page is then updated with the
+ * reader page ID and the offset of the first event handed over, so that
+ * user space can parse the page directly. Those events are considered
+ * consumed from here on.
+ *
+ * Returns 0 on success, -ENODEV if the buffer isn't mapped.
+ */
+int ring_buffer_map_get_reader(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long missed_events = 0;
+	struct buffer_page *reader;
+	unsigned int size, read;
+	unsigned long flags;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+ consume:
+	read = cpu_buffer->reader_page->read;
+	if (rb_per_cpu_empty(cpu_buffer))
+		goto update;
+
+	size = rb_page_size(cpu_buffer->reader_page);
+	if (read < size) {
+		while (cpu_buffer->reader_page->read < size)
+			rb_advance_reader(cpu_buffer);
+		goto update;
+	}
+
+	reader = rb_get_reader_page(cpu_buffer);
+	if (RB_WARN_ON(cpu_buffer, !reader))
+		goto update;
+
+	missed_events = cpu_buffer->lost_events;
+	if (missed_events && cpu_buffer->reader_page != cpu_buffer->commit_page) {
+		struct buffer_data_page *bpage = reader->page;
+		unsigned int commit;
+
+		if (reader->real_end)
+			local_set(&bpage->commit, reader->real_end);
+
+		commit = rb_page_size(reader);
+		if (BUF_PAGE_SIZE - commit >= sizeof(missed_events)) {
+			memcpy(&bpage->data[commit], &missed_events,
+			       sizeof(missed_events));
+			local_add(RB_MISSED_STORED, &bpage->commit);
+		}
+		local_add(RB_MISSED_EVENTS, &bpage->commit);
+	}
+
+	cpu_buffer->lost_events = 0;
+
+	goto consume;
+
+ update:
+	rb_update_meta_page(cpu_buffer);
+	cpu_buffer->meta_page->reader.read = read;
+	cpu_buffer->meta_page->reader.lost_events = missed_events;
+
+	/* Some archs do not have data cache coherency with user space */
+	flush_dcache_folio(virt_to_folio(cpu_buffer->reader_page->page));
+	flush_dcache_folio(virt_to_folio(cpu_buffer->meta_page));
+
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+
+	return err;
+}
+
 /*
  * We only allocate new buffers, never free them if the CPU goes down.
  * If we were to free the buffer, then the user would lose any trace that was in
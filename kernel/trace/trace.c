@@ -48,6 +48,7 @@
 #include <linux/fsnotify.h>
 #include <linux/irq_work.h>
 #include <linux/workqueue.h>
+#include <linux/trace_mmap.h>
 
 #include <asm/setup.h> /* COMMAND_LINE_SIZE */
 
@@ -1266,6 +1267,10 @@ int tracing_alloc_snapshot_instance(struct trace_array *tr)
 
 	if (!tr->allocated_snapshot) {
 
+		/* swapping buffers would pull them from under the mapping */
+		if (tr->mapped)
+			return -EBUSY;
+
 		/* allocate spare buffer */
 		ret = resize_buffer_duplicate_size(&tr->max_buffer,
 				   &tr->array_buffer, RING_BUFFER_ALL_CPUS);
@@ -2918,6 +2923,13 @@ trace_event_buffer_lock_reserve(struct trace_buffer **current_rb,
 
 	entry = __trace_buffer_lock_reserve(*current_rb, type, len,
 					    trace_ctx);
+	/*
+	 * Account the loss to the event when recording is on, the per CPU
+	 * counters of the ring buffer can't tell which events were dropped.
+	 */
+	if (unlikely(!entry) && ring_buffer_record_is_on(*current_rb))
+		atomic_long_inc(&trace_file->dropped);
+
 	/*
 	 * If tracing is off, but we have triggers enabled
 	 * we still need to look at the event data. Use the temp_buffer
@@ -5802,6 +5814,7 @@ static const char readme_msg[] =
 	"\t            [:pause][:continue][:clear]\n"
 	"\t            [:name=histname1]\n"
 	"\t            [:nohitcount]\n"
+	"\t            [:percpu]\n"
 	"\t            [:<handler>.<action>]\n"
 	"\t            [if <filter>]\n\n"
 	"\t    Note, special fields can be used as well:\n"
@@ -5860,6 +5873,12 @@ static const char readme_msg[] =
 	"\t    unchanged.\n\n"
 	"\t    The 'nohitcount' (or NOHC) parameter will suppress display of\n"
 	"\t    raw hitcount in the histogram.\n\n"
+	"\t    The 'percpu' parameter makes each CPU update its own hash\n"
+	"\t    table, merged when the histogram is read.  It can't be used\n"
+	"\t    with variables or actions.  'size' is then shared out between\n"
+	"\t    the CPUs, each one holding up to four times its even share,\n"
+	"\t    at least 128 and at most 'size' entries.  Events on a CPU\n"
+	"\t    whose table is full are dropped, even if others have room.\n\n"
 	"\t    The enable_hist and disable_hist triggers can be used to\n"
 	"\t    have one event conditionally start and stop another event's\n"
 	"\t    already-attached hist trigger.  The syntax is analogous to\n"
@@ -8540,11 +8559,31 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 	return ret;
 }
 
-/* An ioctl call with cmd 0 to the ring buffer file will wake up all waiters */
+/*
+ * An ioctl call with cmd 0 to the ring buffer file will wake up all waiters.
+ * TRACE_MMAP_IOCTL_GET_READER hands the next events over to a mapping of
+ * the buffer, see struct trace_buffer_meta.
+ */
 static long tracing_buffers_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct ftrace_buffer_info *info = file->private_data;
 	struct trace_iterator *iter = &info->iter;
+	int err;
+
+	if (cmd == TRACE_MMAP_IOCTL_GET_READER) {
+		if (!(file->f_flags & O_NONBLOCK)) {
+			err = wait_on_pipe(iter, iter->tr->buffer_percent);
+			if (err)
+				return err;
+		}
+
+		trace_access_lock(iter->cpu_file);
+		err = ring_buffer_map_get_reader(iter->array_buffer->buffer,
+						 iter->cpu_file);
+		trace_access_unlock(iter->cpu_file);
+
+		return err;
+	}
 
 	if (cmd)
 		return -ENOIOCTLCMD;
@@ -8561,6 +8600,79 @@ static long tracing_buffers_ioctl(struct file *file, unsigned int cmd, unsigned
 	return 0;
 }
 
+/* The mm copied the mapping, e.g. to move it on mremap() */
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	ring_buffer_map_dup(iter->array_buffer->buffer, iter->cpu_file);
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	mutex_lock(&trace_types_lock);
+	iter->tr->mapped++;
+	mutex_unlock(&trace_types_lock);
+#endif
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	WARN_ON(ring_buffer_unmap(iter->array_buffer->buffer, iter->cpu_file));
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	mutex_lock(&trace_types_lock);
+	iter->tr->mapped--;
+	mutex_unlock(&trace_types_lock);
+#endif
+}
+
+/* Partial unmaps would leave the mapping count off */
+static int tracing_buffers_may_split(struct vm_area_struct *vma,
+				     unsigned long addr)
+{
+	return -EINVAL;
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+	.may_split	= tracing_buffers_may_split,
+};
+
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	mutex_lock(&trace_types_lock);
+	if (iter->tr->allocated_snapshot) {
+		mutex_unlock(&trace_types_lock);
+		return -EBUSY;
+	}
+	iter->tr->mapped++;
+	mutex_unlock(&trace_types_lock);
+#endif
+
+	ret = ring_buffer_map(iter->array_buffer->buffer, iter->cpu_file, vma);
+	if (ret) {
+#ifdef CONFIG_TRACER_MAX_TRACE
+		mutex_lock(&trace_types_lock);
+		iter->tr->mapped--;
+		mutex_unlock(&trace_types_lock);
+#endif
+		return ret;
+	}
+
+	vma->vm_ops = &tracing_buffers_vmops;
+
+	return 0;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
@@ -8568,6 +8680,7 @@ static const struct file_operations tracing_buffers_fops = {
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
 	.unlocked_ioctl = tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
@@ -8672,6 +8785,31 @@ static const struct file_operations tracing_dyn_info_fops = {
 	.read		= tracing_read_dyn_info,
 	.llseek		= generic_file_llseek,
 };
+
+static ssize_t
+tracing_read_dyn_patch_stats(struct file *filp, char __user *ubuf,
+			     size_t cnt, loff_t *ppos)
+{
+	struct ftrace_patch_stats stats;
+	char buf[128];
+	int r;
+
+	ftrace_get_patch_stats(&stats);
+
+	r = scnprintf(buf, sizeof(buf),
+		      "updates: %lu\nlast_ns: %llu\nmax_ns: %llu\n"
+		      "total_ns: %llu\n",
+		      stats.updates, stats.last_ns, stats.max_ns,
+		      stats.total_ns);
+
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, r);
+}
+
+static const struct file_operations tracing_dyn_patch_stats_fops = {
+	.open		= tracing_open_generic,
+	.read		= tracing_read_dyn_patch_stats,
+	.llseek		= generic_file_llseek,
+};
 #endif /* CONFIG_DYNAMIC_FTRACE */
 
 #if defined(CONFIG_TRACER_SNAPSHOT) && defined(CONFIG_DYNAMIC_FTRACE)
@@ -9999,6 +10137,8 @@ static __init void tracer_init_tracefs_work_func(struct work_struct *work)
 #ifdef CONFIG_DYNAMIC_FTRACE
 	trace_create_file("dyn_ftrace_total_info", TRACE_MODE_READ, NULL,
 			NULL, &tracing_dyn_info_fops);
+	trace_create_file("dyn_ftrace_patch_stats", TRACE_MODE_READ, NULL,
+			NULL, &tracing_dyn_patch_stats_fops);
 #endif
 
 	create_trace_instances(NULL);
@@ -324,6 +324,8 @@ struct trace_array {
 	 */
 	struct array_buffer	max_buffer;
 	bool			allocated_snapshot;
+	/* per CPU buffers mapped to user space, can't snapshot then */
+	int			mapped;
 #endif
 #ifdef CONFIG_TRACER_MAX_TRACE
 	unsigned long		max_latency;
@@ -742,6 +744,16 @@ extern void trace_event_follow_fork(struct trace_array *tr, bool enable);
 extern unsigned long ftrace_update_tot_cnt;
 extern unsigned long ftrace_number_of_pages;
 extern unsigned long ftrace_number_of_groups;
+
+/* Text updates of ftrace_run_update_code(), see dyn_ftrace_patch_stats */
+struct ftrace_patch_stats {
+	unsigned long		updates;
+	u64			last_ns;
+	u64			max_ns;
+	u64			total_ns;
+};
+void ftrace_get_patch_stats(struct ftrace_patch_stats *stats);
+
 void ftrace_init_trace_array(struct trace_array *tr);
 #else
 static inline void ftrace_init_trace_array(struct trace_array *tr) { }
@@ -1674,6 +1674,29 @@ event_id_read(struct file *filp, char __user *ubuf, size_t cnt, loff_t *ppos)
 	return simple_read_from_buffer(ubuf, cnt, ppos, buf, len);
 }
 
+static ssize_t
+event_dropped_read(struct file *filp, char __user *ubuf, size_t cnt,
+		   loff_t *ppos)
+{
+	struct trace_event_file *file;
+	unsigned long dropped = 0;
+	char buf[32];
+	int len;
+
+	mutex_lock(&event_mutex);
+	file = event_file_data(filp);
+	if (likely(file))
+		dropped = atomic_long_read(&file->dropped);
+	mutex_unlock(&event_mutex);
+
+	if (!file)
+		return -ENODEV;
+
+	len = sprintf(buf, "%lu\n", dropped);
+
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, len);
+}
+
 static ssize_t
 event_filter_read(struct file *filp, char __user *ubuf, size_t cnt,
 		  loff_t *ppos)
@@ -2121,6 +2144,12 @@ static const struct file_operations ftrace_event_id_fops = {
 	.llseek = default_llseek,
 };
 
+static const struct file_operations ftrace_event_dropped_fops = {
+	.open = tracing_open_generic,
+	.read = event_dropped_read,
+	.llseek = default_llseek,
+};
+
 static const struct file_operations ftrace_event_filter_fops = {
 	.open = tracing_open_generic,
 	.read = event_filter_read,
@@ -2463,6 +2492,9 @@ event_create_dir(struct dentry *parent, struct trace_event_file *file)
 
 		trace_create_file("trigger", TRACE_MODE_WRITE, file->dir,
 				  file, &event_trigger_fops);
+
+		trace_create_file("dropped", TRACE_MODE_READ, file->dir,
+				  file, &ftrace_event_dropped_fops);
 	}
 
 #ifdef CONFIG_HIST_TRIGGERS
@@ -2805,6 +2837,7 @@ trace_create_new_event(struct trace_event_call *call,
 	file->tr = tr;
 	atomic_set(&file->sm_ref, 0);
 	atomic_set(&file->tm_ref, 0);
+	atomic_long_set(&file->dropped, 0);
 	INIT_LIST_HEAD(&file->triggers);
 	list_add(&file->list, &tr->events);
 
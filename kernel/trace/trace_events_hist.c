@@ -70,7 +70,8 @@
 	C(EXPECT_NUMBER,	"Expecting numeric literal"),		\
 	C(UNARY_MINUS_SUBEXPR,	"Unary minus not supported in sub-expressions"), \
 	C(DIVISION_BY_ZERO,	"Division by zero"),			\
-	C(NEED_NOHC_VAL,	"Non-hitcount value is required for 'nohitcount'"),
+	C(NEED_NOHC_VAL,	"Non-hitcount value is required for 'nohitcount'"), \
+	C(PERCPU_VARS,		"Variables and actions can't be used with 'percpu'"),
 
 #undef C
 #define C(a, b)		HIST_ERR_##a
@@ -525,6 +526,7 @@ struct hist_trigger_attrs {
 	bool		clear;
 	bool		ts_in_usecs;
 	bool		no_hitcount;
+	bool		percpu;
 	unsigned int	map_bits;
 
 	char		*assignment_str[TRACING_MAP_VARS_MAX];
@@ -1560,6 +1562,8 @@ parse_hist_trigger_attrs(struct trace_array *tr, char *trigger_str)
 		} else if (strcmp(str, "nohitcount") == 0 ||
 			   strcmp(str, "NOHC") == 0)
 			attrs->no_hitcount = true;
+		else if (strcmp(str, "percpu") == 0)
+			attrs->percpu = true;
 		else if (strcmp(str, "pause") == 0)
 			attrs->pause = true;
 		else if ((strcmp(str, "cont") == 0) ||
@@ -1693,10 +1697,21 @@ static void hist_trigger_elt_data_init(struct tracing_map_elt *elt)
 		save_comm(elt_data->comm, current);
 }
 
+static void hist_trigger_elt_data_copy(struct tracing_map_elt *to,
+				       struct tracing_map_elt *from)
+{
+	struct hist_elt_data *to_data = to->private_data;
+	struct hist_elt_data *from_data = from->private_data;
+
+	if (to_data->comm)
+		strscpy(to_data->comm, from_data->comm, TASK_COMM_LEN);
+}
+
 static const struct tracing_map_ops hist_trigger_elt_data_ops = {
 	.elt_alloc	= hist_trigger_elt_data_alloc,
 	.elt_free	= hist_trigger_elt_data_free,
 	.elt_init	= hist_trigger_elt_data_init,
+	.elt_copy	= hist_trigger_elt_data_copy,
 };
 
 static const char *get_hist_field_flags(struct hist_field *hist_field)
@@ -5124,6 +5139,14 @@ create_hist_data(unsigned int map_bits,
 	if (ret)
 		goto free;
 
+	/* Per CPU elements are merged on read, variables need them live */
+	if (attrs->percpu && (attrs->var_defs.n_vars || attrs->n_actions ||
+			      hist_data->n_var_refs)) {
+		hist_err(file->tr, HIST_ERR_PERCPU_VARS, 0);
+		ret = -EINVAL;
+		goto free;
+	}
+
 	map_ops = &hist_trigger_elt_data_ops;
 
 	hist_data->map = tracing_map_create(map_bits, hist_data->key_size,
@@ -5134,6 +5157,9 @@ create_hist_data(unsigned int map_bits,
 		goto free;
 	}
 
+	if (attrs->percpu)
+		tracing_map_set_percpu(hist_data->map);
+
 	ret = create_tracing_map_fields(hist_data);
 	if (ret)
 		goto free;
@@ -5597,8 +5623,8 @@ static void hist_trigger_show(struct seq_file *m,
 	track_data_snapshot_print(m, hist_data);
 
 	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n    Dropped: %llu\n",
-		   (u64)atomic64_read(&hist_data->map->hits),
-		   n_entries, (u64)atomic64_read(&hist_data->map->drops));
+		   tracing_map_read_hits(hist_data->map),
+		   n_entries, tracing_map_read_drops(hist_data->map));
 }
 
 static int hist_show(struct seq_file *m, void *v)
@@ -6057,6 +6083,8 @@ static int event_hist_trigger_print(struct seq_file *m,
 		seq_printf(m, ":clock=%s", hist_data->attrs->clock);
 	if (hist_data->attrs->no_hitcount)
 		seq_puts(m, ":nohitcount");
+	if (hist_data->attrs->percpu)
+		seq_puts(m, ":percpu");
 
 	print_actions_spec(m, hist_data);
 
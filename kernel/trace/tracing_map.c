@@ -16,6 +16,7 @@
 #include <linux/slab.h>
 #include <linux/sort.h>
 #include <linux/kmemleak.h>
+#include <linux/log2.h>
 
 #include "tracing_map.h"
 #include "trace.h"
@@ -449,11 +450,51 @@ static struct tracing_map_elt *tracing_map_elt_alloc(struct tracing_map *map)
 	return ERR_PTR(err);
 }
 
+/*
+ * A per CPU map is only inserted into by its CPU, but an insertion can be
+ * interrupted by another one, hence the cmpxchg. Unlike for shared maps,
+ * an index is only consumed if an element is there for it, since the pool
+ * may grow later on. Growth is requested once three quarters of the pool
+ * are used, the elements are allocated by tracing_map_grow_work().
+ */
+static struct tracing_map_elt *get_free_cpu_elt(struct tracing_map *map)
+{
+	/* Pairs with smp_store_release() in tracing_map_grow_elts() */
+	unsigned int nr_elts = smp_load_acquire(&map->nr_elts);
+	struct tracing_map_elt *elt;
+	int idx, next;
+
+	idx = atomic_read(&map->next_elt);
+	do {
+		next = idx + 1;
+		if (next >= nr_elts)
+			break;
+	} while (!atomic_try_cmpxchg(&map->next_elt, &idx, next));
+
+	if (nr_elts < map->max_elts && next >= nr_elts - nr_elts / 4 &&
+	    !READ_ONCE(map->grow_pending)) {
+		WRITE_ONCE(map->grow_pending, true);
+		irq_work_queue(&map->parent->grow_irq_work);
+	}
+
+	if (next >= nr_elts)
+		return NULL;
+
+	elt = *(TRACING_MAP_ELT(map->elts, next));
+	if (map->ops && map->ops->elt_init)
+		map->ops->elt_init(elt);
+
+	return elt;
+}
+
 static struct tracing_map_elt *get_free_elt(struct tracing_map *map)
 {
 	struct tracing_map_elt *elt = NULL;
 	int idx;
 
+	if (map->parent)
+		return get_free_cpu_elt(map);
+
 	idx = atomic_inc_return(&map->next_elt);
 	if (idx < map->max_elts) {
 		elt = *(TRACING_MAP_ELT(map->elts, idx));
@@ -471,37 +512,78 @@ static void tracing_map_free_elts(struct tracing_map *map)
 	if (!map->elts)
 		return;
 
-	for (i = 0; i < map->max_elts; i++) {
+	for (i = 0; i < map->nr_elts; i++) {
 		tracing_map_elt_free(*(TRACING_MAP_ELT(map->elts, i)));
 		*(TRACING_MAP_ELT(map->elts, i)) = NULL;
 	}
 
 	tracing_map_array_free(map->elts);
 	map->elts = NULL;
+	map->nr_elts = 0;
 }
 
-static int tracing_map_alloc_elts(struct tracing_map *map)
+static int tracing_map_grow_elts(struct tracing_map *map, unsigned int n)
 {
+	struct tracing_map_elt *elt;
 	unsigned int i;
 
+	for (i = map->nr_elts; i < n; i++) {
+		elt = tracing_map_elt_alloc(map);
+		if (IS_ERR(elt))
+			return -ENOMEM;
+
+		*(TRACING_MAP_ELT(map->elts, i)) = elt;
+		/* Pairs with smp_load_acquire() in get_free_cpu_elt() */
+		smp_store_release(&map->nr_elts, i + 1);
+	}
+
+	return 0;
+}
+
+static int tracing_map_alloc_elts(struct tracing_map *map, unsigned int n)
+{
 	map->elts = tracing_map_array_alloc(map->max_elts,
 					    sizeof(struct tracing_map_elt *));
 	if (!map->elts)
 		return -ENOMEM;
 
-	for (i = 0; i < map->max_elts; i++) {
-		*(TRACING_MAP_ELT(map->elts, i)) = tracing_map_elt_alloc(map);
-		if (IS_ERR(*(TRACING_MAP_ELT(map->elts, i)))) {
-			*(TRACING_MAP_ELT(map->elts, i)) = NULL;
-			tracing_map_free_elts(map);
+	if (tracing_map_grow_elts(map, n)) {
+		tracing_map_free_elts(map);
 
-			return -ENOMEM;
-		}
+		return -ENOMEM;
 	}
 
 	return 0;
 }
 
+static void tracing_map_grow_irq_work(struct irq_work *work)
+{
+	struct tracing_map *map = container_of(work, struct tracing_map,
+					       grow_irq_work);
+
+	schedule_work(&map->grow_work);
+}
+
+/* Double the element pool of the CPU maps which asked for it */
+static void tracing_map_grow_work(struct work_struct *work)
+{
+	struct tracing_map *map = container_of(work, struct tracing_map,
+					       grow_work);
+	struct tracing_map *cpu_map;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		cpu_map = map->cpu_maps[cpu];
+		if (!READ_ONCE(cpu_map->grow_pending))
+			continue;
+
+		/* On failure, what was allocated is used, drops tell the rest */
+		tracing_map_grow_elts(cpu_map, min(cpu_map->nr_elts * 2,
+						   cpu_map->max_elts));
+		WRITE_ONCE(cpu_map->grow_pending, false);
+	}
+}
+
 static inline bool keys_match(void *key, void *test_key, unsigned key_size)
 {
 	bool match = true;
@@ -633,6 +715,9 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
  */
 struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
 {
+	if (map->percpu)
+		map = map->cpu_maps[raw_smp_processor_id()];
+
 	return __tracing_map_insert(map, key, false);
 }
 
@@ -655,6 +740,9 @@ struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
  */
 struct tracing_map_elt *tracing_map_lookup(struct tracing_map *map, void *key)
 {
+	if (map->percpu)
+		map = map->cpu_maps[raw_smp_processor_id()];
+
 	return __tracing_map_insert(map, key, true);
 }
 
@@ -670,9 +758,20 @@ struct tracing_map_elt *tracing_map_lookup(struct tracing_map *map, void *key)
  */
 void tracing_map_destroy(struct tracing_map *map)
 {
+	int cpu;
+
 	if (!map)
 		return;
 
+	if (map->cpu_maps) {
+		irq_work_sync(&map->grow_irq_work);
+		cancel_work_sync(&map->grow_work);
+
+		for_each_possible_cpu(cpu)
+			tracing_map_destroy(map->cpu_maps[cpu]);
+		kfree(map->cpu_maps);
+	}
+
 	tracing_map_free_elts(map);
 
 	tracing_map_array_free(map->map);
@@ -693,6 +792,13 @@ void tracing_map_destroy(struct tracing_map *map)
 void tracing_map_clear(struct tracing_map *map)
 {
 	unsigned int i;
+	int cpu;
+
+	if (map->percpu) {
+		for_each_possible_cpu(cpu)
+			tracing_map_clear(map->cpu_maps[cpu]);
+		return;
+	}
 
 	atomic_set(&map->next_elt, -1);
 	atomic64_set(&map->hits, 0);
@@ -700,10 +806,48 @@ void tracing_map_clear(struct tracing_map *map)
 
 	tracing_map_array_clear(map->map);
 
-	for (i = 0; i < map->max_elts; i++)
+	for (i = 0; i < map->nr_elts; i++)
 		tracing_map_elt_clear(*(TRACING_MAP_ELT(map->elts, i)));
 }
 
+/**
+ * tracing_map_read_hits - Return the number of hits of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: The number of successful insertions and retrievals, summed
+ * over all CPUs in per CPU mode.
+ */
+u64 tracing_map_read_hits(struct tracing_map *map)
+{
+	u64 hits = atomic64_read(&map->hits);
+	int cpu;
+
+	if (map->cpu_maps)
+		for_each_possible_cpu(cpu)
+			hits += atomic64_read(&map->cpu_maps[cpu]->hits);
+
+	return hits;
+}
+
+/**
+ * tracing_map_read_drops - Return the number of drops of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: The number of failed insertions, summed over all CPUs in per
+ * CPU mode.
+ */
+u64 tracing_map_read_drops(struct tracing_map *map)
+{
+	u64 drops = atomic64_read(&map->drops);
+	int cpu;
+
+	if (map->cpu_maps)
+		for_each_possible_cpu(cpu)
+			drops += atomic64_read(&map->cpu_maps[cpu]->drops);
+
+	return drops;
+}
+
 static void set_sort_key(struct tracing_map *map,
 			 struct tracing_map_sort_key *sort_key)
 {
@@ -802,6 +946,94 @@ struct tracing_map *tracing_map_create(unsigned int map_bits,
 	goto out;
 }
 
+/* Initial element pool of each CPU map in per CPU mode */
+#define TRACING_MAP_PERCPU_ELTS		(1 << TRACING_MAP_BITS_MIN)
+/* How many times its even share of the map size a CPU map can hold */
+#define TRACING_MAP_PERCPU_SHARE_BITS	2
+
+static int tracing_map_init_percpu(struct tracing_map *map)
+{
+	struct tracing_map *cpu_map;
+	int cpu, err, cpu_bits;
+
+	/*
+	 * Bound the memory of all CPU maps together to a few times the one
+	 * of a shared map, whatever the number of CPUs, but let a CPU take
+	 * more than its even share: events are rarely spread evenly.
+	 */
+	cpu_bits = map->map_bits + TRACING_MAP_PERCPU_SHARE_BITS -
+		   order_base_2(num_possible_cpus());
+	cpu_bits = clamp_t(int, cpu_bits, TRACING_MAP_BITS_MIN, map->map_bits);
+
+	init_irq_work(&map->grow_irq_work, tracing_map_grow_irq_work);
+	INIT_WORK(&map->grow_work, tracing_map_grow_work);
+
+	map->cpu_maps = kcalloc(nr_cpu_ids, sizeof(*map->cpu_maps),
+				GFP_KERNEL);
+	if (!map->cpu_maps)
+		return -ENOMEM;
+
+	/* Elements only live in the CPU maps, merged ones are allocated */
+	tracing_map_array_free(map->map);
+	map->map = NULL;
+
+	for_each_possible_cpu(cpu) {
+		cpu_map = kzalloc_node(sizeof(*cpu_map), GFP_KERNEL,
+				       cpu_to_node(cpu));
+		if (!cpu_map)
+			return -ENOMEM;
+		map->cpu_maps[cpu] = cpu_map;
+
+		cpu_map->key_size = map->key_size;
+		cpu_map->map_bits = cpu_bits;
+		cpu_map->map_size = 1 << (cpu_bits + 1);
+		cpu_map->max_elts = 1 << cpu_bits;
+		cpu_map->ops = map->ops;
+		cpu_map->private_data = map->private_data;
+		memcpy(cpu_map->fields, map->fields, sizeof(map->fields));
+		cpu_map->n_fields = map->n_fields;
+		memcpy(cpu_map->key_idx, map->key_idx, sizeof(map->key_idx));
+		cpu_map->n_keys = map->n_keys;
+		cpu_map->n_vars = map->n_vars;
+		cpu_map->parent = map;
+
+		cpu_map->map = tracing_map_array_alloc(cpu_map->map_size,
+					sizeof(struct tracing_map_entry));
+		if (!cpu_map->map)
+			return -ENOMEM;
+
+		err = tracing_map_alloc_elts(cpu_map,
+				min_t(unsigned int, cpu_map->max_elts,
+				      TRACING_MAP_PERCPU_ELTS));
+		if (err)
+			return err;
+
+		tracing_map_clear(cpu_map);
+	}
+
+	return 0;
+}
+
+/**
+ * tracing_map_set_percpu - Make each CPU insert into its own map
+ * @map: The tracing_map, not initialized yet
+ *
+ * Insertions then don't share any cacheline between CPUs, and the
+ * element pool of each CPU starts small and grows as it's used. Each CPU
+ * can hold up to four times its even share of 2 ** map_bits elements, at
+ * least 2 ** TRACING_MAP_BITS_MIN and at most 2 ** map_bits: insertions
+ * on a CPU whose map is full are dropped, even if the others have room
+ * left. Elements with the same key on different CPUs are merged by
+ * tracing_map_sort_entries(), with their sums added up.
+ *
+ * As an element only exists on the CPU it was inserted on, variables
+ * can't be used in this mode.
+ */
+void tracing_map_set_percpu(struct tracing_map *map)
+{
+	map->percpu = true;
+}
+
 /**
  * tracing_map_init - Allocate and clear a map's tracing_map_elts
  * @map: The tracing_map to initialize
@@ -828,7 +1060,10 @@ int tracing_map_init(struct tracing_map *map)
 	if (map->n_fields < 2)
 		return -EINVAL; /* need at least 1 key and 1 val */
 
-	err = tracing_map_alloc_elts(map);
+	if (map->percpu)
+		return tracing_map_init_percpu(map);
+
+	err = tracing_map_alloc_elts(map, map->max_elts);
 	if (err)
 		return err;
 
@@ -1041,6 +1276,122 @@ static void sort_secondary(struct tracing_map *map,
 	}
 }
 
+static int cmp_elts_key(const void *A, const void *B, const void *priv)
+{
+	const struct tracing_map_elt *a = *(const struct tracing_map_elt **)A;
+	const struct tracing_map_elt *b = *(const struct tracing_map_elt **)B;
+	const struct tracing_map *map = priv;
+
+	return memcmp(a->key, b->key, map->key_size);
+}
+
+static struct tracing_map_elt *
+merge_elts(struct tracing_map *map, struct tracing_map_elt **elts,
+	   unsigned int n_elts)
+{
+	struct tracing_map_elt *elt;
+	unsigned int i, j;
+
+	elt = tracing_map_elt_alloc(map);
+	if (IS_ERR(elt))
+		return NULL;
+
+	memcpy(elt->key, elts[0]->key, map->key_size);
+	if (map->ops && map->ops->elt_copy)
+		map->ops->elt_copy(elt, elts[0]);
+
+	for (i = 0; i < map->n_fields; i++) {
+		if (elt->fields[i].cmp_fn != tracing_map_cmp_atomic64)
+			continue;
+
+		for (j = 0; j < n_elts; j++)
+			atomic64_add(tracing_map_read_sum(elts[j], i),
+				     &elt->fields[i].sum);
+	}
+
+	return elt;
+}
+
+/*
+ * Gather the elements of all CPU maps, sorted by key so that the ones
+ * with the same key are next to each other, and merge each such run
+ * into a new element.
+ */
+static int merge_cpu_entries(struct tracing_map *map,
+			     struct tracing_map_sort_entry ***merged)
+{
+	struct tracing_map_sort_entry **entries = NULL;
+	unsigned int i, j, n = 0, n_elts = 0;
+	struct tracing_map_elt **elts;
+	struct tracing_map_elt *elt;
+	int cpu, n_entries = 0;
+	int ret;
+
+	for_each_possible_cpu(cpu)
+		n += min_t(unsigned int, map->cpu_maps[cpu]->max_elts,
+			   atomic_read(&map->cpu_maps[cpu]->next_elt) + 1);
+	if (!n)
+		return 0;
+
+	elts = vmalloc(array_size(sizeof(*elts), n));
+	if (!elts)
+		return -ENOMEM;
+
+	/* Insertions may go on, don't take more than was counted */
+	for_each_possible_cpu(cpu) {
+		struct tracing_map *cpu_map = map->cpu_maps[cpu];
+
+		for (i = 0; i < cpu_map->map_size && n_elts < n; i++) {
+			struct tracing_map_entry *entry;
+
+			entry = TRACING_MAP_ENTRY(cpu_map->map, i);
+			elt = READ_ONCE(entry->val);
+			if (!entry->key || !elt)
+				continue;
+
+			elts[n_elts++] = elt;
+		}
+	}
+
+	sort_r(elts, n_elts, sizeof(*elts), cmp_elts_key, NULL, map);
+
+	entries = vmalloc(array_size(sizeof(*entries), n));
+	if (!entries) {
+		ret = -ENOMEM;
+		goto free;
+	}
+
+	for (i = 0; i < n_elts; i = j) {
+		for (j = i + 1; j < n_elts; j++)
+			if (cmp_elts_key(&elts[i], &elts[j], map))
+				break;
+
+		elt = merge_elts(map, &elts[i], j - i);
+		if (!elt) {
+			ret = -ENOMEM;
+			goto free;
+		}
+
+		entries[n_entries] = create_sort_entry(elt->key, elt);
+		if (!entries[n_entries]) {
+			tracing_map_elt_free(elt);
+			ret = -ENOMEM;
+			goto free;
+		}
+		entries[n_entries++]->elt_copied = true;
+	}
+
+	vfree(elts);
+	*merged = entries;
+
+	return n_entries;
+ free:
+	vfree(elts);
+	tracing_map_destroy_sort_entries(entries, n_entries);
+
+	return ret;
+}
+
 /**
  * tracing_map_sort_entries - Sort the current set of tracing_map_elts in a map
  * @map: The tracing_map
@@ -1063,6 +1414,9 @@ static void sort_secondary(struct tracing_map *map,
  * The client should not hold on to the returned array but should use
  * it and call tracing_map_destroy_sort_entries() when done.
  *
+ * In per CPU mode, the returned entries are copies of the elements,
+ * merged over all CPUs.
+ *
  * Return: the number of sort_entries in the struct tracing_map_sort_entry
  * array, negative on error
  */
@@ -1075,6 +1429,13 @@ int tracing_map_sort_entries(struct tracing_map *map,
 	struct tracing_map_sort_entry *sort_entry, **entries;
 	int i, n_entries, ret;
 
+	if (map->percpu) {
+		n_entries = merge_cpu_entries(map, &entries);
+		if (n_entries <= 0)
+			return n_entries;
+		goto sort;
+	}
+
 	entries = vmalloc(array_size(sizeof(sort_entry), map->max_elts));
 	if (!entries)
 		return -ENOMEM;
@@ -1099,7 +1460,7 @@ int tracing_map_sort_entries(struct tracing_map *map,
 		ret = 0;
 		goto free;
 	}
-
+ sort:
 	if (n_entries == 1) {
 		*sort_entries = entries;
 		return 1;
@@ -2,6 +2,9 @@
 #ifndef __TRACING_MAP_H
 #define __TRACING_MAP_H
 
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
+
 #define TRACING_MAP_BITS_DEFAULT	11
 #define TRACING_MAP_BITS_MAX		17
 #define TRACING_MAP_BITS_MIN		7
@@ -198,6 +201,19 @@ struct tracing_map {
 	unsigned int			n_vars;
 	atomic64_t			hits;
 	atomic64_t			drops;
+
+	/*
+	 * Per CPU mode, see tracing_map_set_percpu(): each CPU inserts
+	 * into its own map, which has 'nr_elts' elements allocated so
+	 * far, and asks 'parent' to grow it as it fills up.
+	 */
+	bool				percpu;
+	bool				grow_pending;
+	unsigned int			nr_elts;
+	struct tracing_map		*parent;
+	struct tracing_map		**cpu_maps;
+	struct irq_work			grow_irq_work;
+	struct work_struct		grow_work;
 };
 
 /**
@@ -229,12 +245,18 @@ struct tracing_map {
  *	be initialized when used i.e. when the element is actually
  *	claimed by tracing_map_insert() in the context of the map
  *	insertion.
+ *
+ * @elt_copy: In per CPU mode, the elements of all CPUs with the same
+ *	key are merged into a new element when the map is read.  This
+ *	callback copies client-defined data from one of them.
  */
 struct tracing_map_ops {
 	int			(*elt_alloc)(struct tracing_map_elt *elt);
 	void			(*elt_free)(struct tracing_map_elt *elt);
 	void			(*elt_clear)(struct tracing_map_elt *elt);
 	void			(*elt_init)(struct tracing_map_elt *elt);
+	void			(*elt_copy)(struct tracing_map_elt *to,
+					    struct tracing_map_elt *from);
 };
 
 extern struct tracing_map *
@@ -243,6 +265,7 @@ tracing_map_create(unsigned int map_bits,
 		   const struct tracing_map_ops *ops,
 		   void *private_data);
 extern int tracing_map_init(struct tracing_map *map);
+extern void tracing_map_set_percpu(struct tracing_map *map);
 
 extern int tracing_map_add_sum_field(struct tracing_map *map);
 extern int tracing_map_add_var(struct tracing_map *map);
@@ -253,6 +276,9 @@ extern int tracing_map_add_key_field(struct tracing_map *map,
 extern void tracing_map_destroy(struct tracing_map *map);
 extern void tracing_map_clear(struct tracing_map *map);
 
+extern u64 tracing_map_read_hits(struct tracing_map *map);
+extern u64 tracing_map_read_drops(struct tracing_map *map);
+
 extern struct tracing_map_elt *
 tracing_map_insert(struct tracing_map *map, void *key);
 extern struct tracing_map_elt *
@@ -53,6 +53,9 @@
 #include <linux/nmi.h>
 #include <linux/kvm_para.h>
 #include <linux/delay.h>
+#include <linux/cacheinfo.h>
+#include <linux/topology.h>
+#include <linux/sched/topology.h>
 
 #include "workqueue_internal.h"
 
@@ -199,6 +202,15 @@ struct worker_pool {
 	struct hlist_node	hash_node;	/* PL: unbound_pool_hash node */
 	int			refcnt;		/* PL: refcnt for unbound pools */
 
+	/*
+	 * Locality of unbound pools: where work items were started relative
+	 * to attrs->__pod_cpumask, and how many times an idle worker was
+	 * woken up back in the pod.  Shown in the "locality" sysfs file.
+	 */
+	u64			nr_pod_local;	/* L: started in the pod */
+	u64			nr_pod_remote;	/* L: started outside of it */
+	u64			nr_repatriated;	/* L: workers moved back */
+
 	/*
 	 * Destruction of pool is RCU protected to allow dereferences
 	 * from get_work_pool().
@@ -327,13 +339,34 @@ struct workqueue_struct {
 	/* hot fields used during command issue, aligned to cacheline */
 	unsigned int		flags ____cacheline_aligned; /* WQ: WQ_* flags */
 	struct pool_workqueue __percpu *cpu_pwqs; /* I: per-cpu pwqs */
-	struct pool_workqueue __rcu *numa_pwq_tbl[]; /* PWR: unbound pwqs indexed by node */
+	struct pool_workqueue __rcu *unbound_pwq_tbl[]; /* PWR: unbound pwqs indexed by CPU */
 };
 
 static struct kmem_cache *pwq_cache;
 
-static cpumask_var_t *wq_numa_possible_cpumask;
-					/* possible CPUs of each node */
+/*
+ * Each affinity scope of unbound workqueues groups the possible CPUs into
+ * pods, see enum wq_affn_scope.  All the CPUs of a pod share the pwq of a
+ * workqueue.
+ */
+struct wq_pod_type {
+	int			nr_pods;	/* number of pods */
+	cpumask_var_t		*pod_cpus;	/* pod -> cpus */
+	int			*pod_node;	/* pod -> node */
+	int			*cpu_pod;	/* cpu -> pod */
+};
+
+static struct wq_pod_type wq_pod_types[WQ_AFFN_NR_TYPES];
+static enum wq_affn_scope wq_affn_dfl = WQ_AFFN_CACHE;	/* PL: default scope */
+
+static const char * const wq_affn_names[WQ_AFFN_NR_TYPES] = {
+	[WQ_AFFN_DFL]		= "default",
+	[WQ_AFFN_CPU]		= "cpu",
+	[WQ_AFFN_SMT]		= "smt",
+	[WQ_AFFN_CACHE]		= "cache",
+	[WQ_AFFN_NUMA]		= "numa",
+	[WQ_AFFN_SYSTEM]	= "system",
+};
 
 /*
  * Per-cpu work items which run for longer than the following threshold are
@@ -356,8 +389,8 @@ static bool wq_online;			/* can kworkers be created yet? */
 
 static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
 
-/* buf for wq_update_unbound_numa_attrs(), protected by CPU hotplug exclusion */
-static struct workqueue_attrs *wq_update_unbound_numa_attrs_buf;
+/* buf for wq_update_pod(), protected by CPU hotplug exclusion */
+static struct workqueue_attrs *wq_update_pod_attrs_buf;
 
 static DEFINE_MUTEX(wq_pool_mutex);	/* protects pools and workqueues list */
 static DEFINE_MUTEX(wq_pool_attach_mutex); /* protects worker attach/detach */
@@ -607,32 +640,22 @@ static int worker_pool_assign_id(struct worker_pool *pool)
 }
 
 /**
- * unbound_pwq_by_node - return the unbound pool_workqueue for the given node
+ * unbound_pwq - return the unbound pool_workqueue for the given CPU
  * @wq: the target workqueue
- * @node: the node ID
+ * @cpu: the CPU ID
  *
  * This must be called with any of wq_pool_mutex, wq->mutex or RCU
  * read locked.
  * If the pwq needs to be used beyond the locking in effect, the caller is
  * responsible for guaranteeing that the pwq stays online.
  *
- * Return: The unbound pool_workqueue for @node.
+ * Return: The unbound pool_workqueue of the pod @cpu belongs to.
  */
-static struct pool_workqueue *unbound_pwq_by_node(struct workqueue_struct *wq,
-						  int node)
+static struct pool_workqueue *unbound_pwq(struct workqueue_struct *wq, int cpu)
 {
 	assert_rcu_or_wq_mutex_or_pool_mutex(wq);
 
-	/*
-	 * XXX: @node can be NUMA_NO_NODE if CPU goes offline while a
-	 * delayed item is pending.  The plan is to keep CPU -> NODE
-	 * mapping valid and stable across CPU on/offlines.  Once that
-	 * happens, this workaround can be removed.
-	 */
-	if (unlikely(node == NUMA_NO_NODE))
-		return wq->dfl_pwq;
-
-	return rcu_dereference_raw(wq->numa_pwq_tbl[node]);
+	return rcu_dereference_raw(wq->unbound_pwq_tbl[cpu]);
 }
 
 static unsigned int work_color_to_flags(int color)
@@ -897,8 +920,30 @@ static void wake_up_worker(struct worker_pool *pool)
 {
 	struct worker *worker = first_idle_worker(pool);
 
-	if (likely(worker))
-		wake_up_process(worker->task);
+	if (unlikely(!worker))
+		return;
+
+#ifdef CONFIG_SMP
+	/*
+	 * Workers of unbound pools in preferred affinity mode may run on
+	 * any CPU of the workqueue, and the scheduler may have moved this
+	 * one out of its pod.  Waking it up is the cheapest time to move it
+	 * back, point the wakeup at the pod and let the scheduler pick the
+	 * CPU from there.
+	 */
+	if (pool->cpu < 0 &&
+	    !cpumask_test_cpu(worker->task->wake_cpu,
+			      pool->attrs->__pod_cpumask)) {
+		int cpu = cpumask_any_and_distribute(pool->attrs->__pod_cpumask,
+						     cpu_online_mask);
+
+		if (cpu < nr_cpu_ids) {
+			worker->task->wake_cpu = cpu;
+			pool->nr_repatriated++;
+		}
+	}
+#endif
+	wake_up_process(worker->task);
 }
 
 /**
@@ -1643,7 +1688,7 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 	if (wq->flags & WQ_UNBOUND) {
 		if (req_cpu == WORK_CPU_UNBOUND)
 			cpu = wq_select_unbound_cpu(raw_smp_processor_id());
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq(wq, cpu);
 	} else {
 		if (req_cpu == WORK_CPU_UNBOUND)
 			cpu = raw_smp_processor_id();
@@ -1678,7 +1723,7 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 	 * pwq is determined and locked.  For unbound pools, we could have
 	 * raced with pwq release and it could already be dead.  If its
 	 * refcnt is zero, repeat pwq selection.  Note that pwqs never die
-	 * without another pwq replacing it in the numa_pwq_tbl or while
+	 * without another pwq replacing it in the unbound_pwq_tbl or while
 	 * work items are executing on it, so the retrying is guaranteed to
 	 * make forward-progress.
 	 */
@@ -2561,6 +2606,14 @@ __acquires(&pool->lock)
 	if (need_more_worker(pool))
 		wake_up_worker(pool);
 
+	if (pool->cpu < 0) {
+		if (cpumask_test_cpu(raw_smp_processor_id(),
+				     pool->attrs->__pod_cpumask))
+			pool->nr_pod_local++;
+		else
+			pool->nr_pod_remote++;
+	}
+
 	/*
 	 * Record the last pool and clear PENDING which should be the last
 	 * update to @work.  Also, do this inside @pool->lock so that
@@ -3691,6 +3744,7 @@ void free_workqueue_attrs(struct workqueue_attrs *attrs)
 {
 	if (attrs) {
 		free_cpumask_var(attrs->cpumask);
+		free_cpumask_var(attrs->__pod_cpumask);
 		kfree(attrs);
 	}
 }
@@ -3712,8 +3766,12 @@ struct workqueue_attrs *alloc_workqueue_attrs(void)
 		goto fail;
 	if (!alloc_cpumask_var(&attrs->cpumask, GFP_KERNEL))
 		goto fail;
+	if (!alloc_cpumask_var(&attrs->__pod_cpumask, GFP_KERNEL))
+		goto fail;
 
 	cpumask_copy(attrs->cpumask, cpu_possible_mask);
+	cpumask_copy(attrs->__pod_cpumask, cpu_possible_mask);
+	attrs->affn_scope = WQ_AFFN_DFL;
 	return attrs;
 fail:
 	free_workqueue_attrs(attrs);
@@ -3725,12 +3783,15 @@ static void copy_workqueue_attrs(struct workqueue_attrs *to,
 {
 	to->nice = from->nice;
 	cpumask_copy(to->cpumask, from->cpumask);
+	cpumask_copy(to->__pod_cpumask, from->__pod_cpumask);
 	/*
 	 * Unlike hash and equality test, this function doesn't ignore
-	 * ->no_numa as it is used for both pool and wq attrs.  Instead,
-	 * get_unbound_pool() explicitly clears ->no_numa after copying.
+	 * ->affn_scope and ->affn_strict as they're used for both pool and
+	 * wq attrs.  Instead, get_unbound_pool() explicitly clears them
+	 * after copying.
 	 */
-	to->no_numa = from->no_numa;
+	to->affn_scope = from->affn_scope;
+	to->affn_strict = from->affn_strict;
 }
 
 /* hash value of the content of @attr */
@@ -3741,6 +3802,8 @@ static u32 wqattrs_hash(const struct workqueue_attrs *attrs)
 	hash = jhash_1word(attrs->nice, hash);
 	hash = jhash(cpumask_bits(attrs->cpumask),
 		     BITS_TO_LONGS(nr_cpumask_bits) * sizeof(long), hash);
+	hash = jhash(cpumask_bits(attrs->__pod_cpumask),
+		     BITS_TO_LONGS(nr_cpumask_bits) * sizeof(long), hash);
 	return hash;
 }
 
@@ -3752,9 +3815,45 @@ static bool wqattrs_equal(const struct workqueue_attrs *a,
 		return false;
 	if (!cpumask_equal(a->cpumask, b->cpumask))
 		return false;
+	if (!cpumask_equal(a->__pod_cpumask, b->__pod_cpumask))
+		return false;
 	return true;
 }
 
+/*
+ * Restrict the cpumask of @attrs to @unbound_cpumask, falling back to the
+ * latter if they don't overlap, and make the pod span all of it.
+ */
+static void wqattrs_actualize_cpumask(struct workqueue_attrs *attrs,
+				      const cpumask_t *unbound_cpumask)
+{
+	cpumask_and(attrs->cpumask, attrs->cpumask, unbound_cpumask);
+	if (unlikely(cpumask_empty(attrs->cpumask)))
+		cpumask_copy(attrs->cpumask, unbound_cpumask);
+	cpumask_copy(attrs->__pod_cpumask, attrs->cpumask);
+}
+
+/* find the pod type of @attrs, resolving the default scope */
+static const struct wq_pod_type *
+wqattrs_pod_type(const struct workqueue_attrs *attrs)
+{
+	enum wq_affn_scope scope = attrs->affn_scope;
+	const struct wq_pod_type *pt;
+
+	/* to synchronize access to wq_affn_dfl */
+	lockdep_assert_held(&wq_pool_mutex);
+
+	if (scope == WQ_AFFN_DFL)
+		scope = wq_affn_dfl;
+
+	/* only the system pod exists before workqueue_init_topology() */
+	pt = &wq_pod_types[scope];
+	if (likely(pt->nr_pods))
+		return pt;
+
+	return &wq_pod_types[WQ_AFFN_SYSTEM];
+}
+
 /**
  * init_worker_pool - initialize a newly zalloc'd worker_pool
  * @pool: worker_pool to initialize
@@ -3961,7 +4060,7 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 {
 	u32 hash = wqattrs_hash(attrs);
 	struct worker_pool *pool;
-	int node;
+	int pod;
 	int target_node = NUMA_NO_NODE;
 
 	lockdep_assert_held(&wq_pool_mutex);
@@ -3976,10 +4075,12 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 
 	/* if cpumask is contained inside a NUMA node, we belong to that node */
 	if (wq_numa_enabled) {
-		for_each_node(node) {
-			if (cpumask_subset(attrs->cpumask,
-					   wq_numa_possible_cpumask[node])) {
-				target_node = node;
+		const struct wq_pod_type *pt = &wq_pod_types[WQ_AFFN_NUMA];
+
+		for (pod = 0; pod < pt->nr_pods; pod++) {
+			if (cpumask_subset(attrs->__pod_cpumask,
+					   pt->pod_cpus[pod])) {
+				target_node = pt->pod_node[pod];
 				break;
 			}
 		}
@@ -3995,10 +4096,11 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 	pool->node = target_node;
 
 	/*
-	 * no_numa isn't a worker_pool attribute, always clear it.  See
-	 * 'struct workqueue_attrs' comments for detail.
+	 * affn_scope and affn_strict aren't worker_pool attributes, always
+	 * clear them.  See 'struct workqueue_attrs' comments for detail.
 	 */
-	pool->attrs->no_numa = false;
+	pool->attrs->affn_scope = WQ_AFFN_DFL;
+	pool->attrs->affn_strict = false;
 
 	if (worker_pool_assign_id(pool) < 0)
 		goto fail;
@@ -4183,61 +4285,59 @@ static struct pool_workqueue *alloc_unbound_pwq(struct workqueue_struct *wq,
 }
 
 /**
- * wq_calc_node_cpumask - calculate a wq_attrs' cpumask for the specified node
+ * wq_calc_pod_cpumask - calculate a wq_attrs' cpumasks for a pod
  * @attrs: the wq_attrs of the default pwq of the target workqueue
- * @node: the target NUMA node
+ * @cpu: the target CPU
  * @cpu_going_down: if >= 0, the CPU to consider as offline
- * @cpumask: outarg, the resulting cpumask
  *
- * Calculate the cpumask a workqueue with @attrs should use on @node.  If
- * @cpu_going_down is >= 0, that cpu is considered offline during
- * calculation.  The result is stored in @cpumask.
+ * Calculate the cpumasks a workqueue with @attrs should use on the pod of
+ * @cpu, according to the affinity scope of @attrs.  If @cpu_going_down is
+ * >= 0, that cpu is considered offline during calculation.
  *
- * If NUMA affinity is not enabled, @attrs->cpumask is always used.  If
- * enabled and @node has online CPUs requested by @attrs, the returned
- * cpumask is the intersection of the possible CPUs of @node and
- * @attrs->cpumask.
+ * If the pod has online CPUs requested by @attrs, @attrs->__pod_cpumask is
+ * set to the intersection of the possible CPUs of the pod and
+ * @attrs->cpumask.  In strict mode, @attrs->cpumask is restricted to it as
+ * well, otherwise the workers may still run anywhere in @attrs->cpumask.
  *
- * The caller is responsible for ensuring that the cpumask of @node stays
- * stable.
+ * The caller is responsible for ensuring that the pods stay stable.
  *
- * Return: %true if the resulting @cpumask is different from @attrs->cpumask,
- * %false if equal.
+ * Return: %true if the pod needs its own pwq, %false if the default pwq
+ * should be used, in which case @attrs is left unchanged.
  */
-static bool wq_calc_node_cpumask(const struct workqueue_attrs *attrs, int node,
-				 int cpu_going_down, cpumask_t *cpumask)
+static bool wq_calc_pod_cpumask(struct workqueue_attrs *attrs, int cpu,
+				int cpu_going_down)
 {
-	if (!wq_numa_enabled || attrs->no_numa)
-		goto use_dfl;
+	const struct wq_pod_type *pt = wqattrs_pod_type(attrs);
+	struct cpumask *pod_cpumask = attrs->__pod_cpumask;
+	int pod = pt->cpu_pod[cpu];
 
-	/* does @node have any online CPUs @attrs wants? */
-	cpumask_and(cpumask, cpumask_of_node(node), attrs->cpumask);
+	/* does @pod have any online CPUs @attrs wants? */
+	cpumask_and(pod_cpumask, pt->pod_cpus[pod], attrs->cpumask);
+	cpumask_and(pod_cpumask, pod_cpumask, cpu_online_mask);
 	if (cpu_going_down >= 0)
-		cpumask_clear_cpu(cpu_going_down, cpumask);
+		cpumask_clear_cpu(cpu_going_down, pod_cpumask);
 
-	if (cpumask_empty(cpumask))
+	if (cpumask_empty(pod_cpumask))
 		goto use_dfl;
 
-	/* yeap, return possible CPUs in @node that @attrs wants */
-	cpumask_and(cpumask, attrs->cpumask, wq_numa_possible_cpumask[node]);
-
-	if (cpumask_empty(cpumask)) {
-		pr_warn_once("WARNING: workqueue cpumask: online intersect > "
-				"possible intersect\n");
+	/* yeap, use possible CPUs in @pod that @attrs wants */
+	cpumask_and(pod_cpumask, pt->pod_cpus[pod], attrs->cpumask);
+	if (cpumask_equal(pod_cpumask, attrs->cpumask))
 		return false;
-	}
 
-	return !cpumask_equal(cpumask, attrs->cpumask);
+	if (attrs->affn_strict)
+		cpumask_copy(attrs->cpumask, pod_cpumask);
+	return true;
 
 use_dfl:
-	cpumask_copy(cpumask, attrs->cpumask);
+	cpumask_copy(pod_cpumask, attrs->cpumask);
 	return false;
 }
 
-/* install @pwq into @wq's numa_pwq_tbl[] for @node and return the old pwq */
-static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
-						   int node,
-						   struct pool_workqueue *pwq)
+/* install @pwq into @wq's unbound_pwq_tbl[] for @cpu and return the old pwq */
+static struct pool_workqueue *install_unbound_pwq(struct workqueue_struct *wq,
+						  int cpu,
+						  struct pool_workqueue *pwq)
 {
 	struct pool_workqueue *old_pwq;
 
@@ -4247,8 +4347,8 @@ static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
 	/* link_pwq() can handle duplicate calls */
 	link_pwq(pwq);
 
-	old_pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-	rcu_assign_pointer(wq->numa_pwq_tbl[node], pwq);
+	old_pwq = rcu_access_pointer(wq->unbound_pwq_tbl[cpu]);
+	rcu_assign_pointer(wq->unbound_pwq_tbl[cpu], pwq);
 	return old_pwq;
 }
 
@@ -4258,17 +4358,17 @@ struct apply_wqattrs_ctx {
 	struct workqueue_attrs	*attrs;		/* attrs to apply */
 	struct list_head	list;		/* queued for batching commit */
 	struct pool_workqueue	*dfl_pwq;
-	struct pool_workqueue	*pwq_tbl[];
+	struct pool_workqueue	*pwq_tbl[];	/* indexed by CPU */
 };
 
 /* free the resources after success or abort */
 static void apply_wqattrs_cleanup(struct apply_wqattrs_ctx *ctx)
 {
 	if (ctx) {
-		int node;
+		int cpu;
 
-		for_each_node(node)
-			put_pwq_unlocked(ctx->pwq_tbl[node]);
+		for_each_possible_cpu(cpu)
+			put_pwq_unlocked(ctx->pwq_tbl[cpu]);
 		put_pwq_unlocked(ctx->dfl_pwq);
 
 		free_workqueue_attrs(ctx->attrs);
@@ -4285,11 +4385,12 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 {
 	struct apply_wqattrs_ctx *ctx;
 	struct workqueue_attrs *new_attrs, *tmp_attrs;
-	int node;
+	const struct wq_pod_type *pt;
+	int cpu, tcpu;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
-	ctx = kzalloc(struct_size(ctx, pwq_tbl, nr_node_ids), GFP_KERNEL);
+	ctx = kzalloc(struct_size(ctx, pwq_tbl, nr_cpu_ids), GFP_KERNEL);
 
 	new_attrs = alloc_workqueue_attrs();
 	tmp_attrs = alloc_workqueue_attrs();
@@ -4303,16 +4404,7 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 	 * wq_unbound_cpumask, we fallback to the wq_unbound_cpumask.
 	 */
 	copy_workqueue_attrs(new_attrs, attrs);
-	cpumask_and(new_attrs->cpumask, new_attrs->cpumask, unbound_cpumask);
-	if (unlikely(cpumask_empty(new_attrs->cpumask)))
-		cpumask_copy(new_attrs->cpumask, unbound_cpumask);
-
-	/*
-	 * We may create multiple pwqs with differing cpumasks.  Make a
-	 * copy of @new_attrs which will be modified and used to obtain
-	 * pools.
-	 */
-	copy_workqueue_attrs(tmp_attrs, new_attrs);
+	wqattrs_actualize_cpumask(new_attrs, unbound_cpumask);
 
 	/*
 	 * If something goes wrong during CPU up/down, we'll fall back to
@@ -4323,14 +4415,34 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 	if (!ctx->dfl_pwq)
 		goto out_free;
 
-	for_each_node(node) {
-		if (wq_calc_node_cpumask(new_attrs, node, -1, tmp_attrs->cpumask)) {
-			ctx->pwq_tbl[node] = alloc_unbound_pwq(wq, tmp_attrs);
-			if (!ctx->pwq_tbl[node])
+	/*
+	 * The first CPU of each pod sets up the pwq of the whole pod.  We
+	 * may create multiple pwqs with differing cpumasks, @tmp_attrs is
+	 * a copy of @new_attrs modified for each and used to obtain pools.
+	 * Each slot of the table holds a reference.
+	 */
+	pt = wqattrs_pod_type(new_attrs);
+
+	for_each_possible_cpu(cpu) {
+		struct pool_workqueue *pwq;
+		int pod = pt->cpu_pod[cpu];
+
+		if (ctx->pwq_tbl[cpu])
+			continue;
+
+		copy_workqueue_attrs(tmp_attrs, new_attrs);
+		if (wq_calc_pod_cpumask(tmp_attrs, cpu, -1)) {
+			pwq = alloc_unbound_pwq(wq, tmp_attrs);
+			if (!pwq)
 				goto out_free;
+			pwq->refcnt--;
 		} else {
-			ctx->dfl_pwq->refcnt++;
-			ctx->pwq_tbl[node] = ctx->dfl_pwq;
+			pwq = ctx->dfl_pwq;
+		}
+
+		for_each_cpu(tcpu, pt->pod_cpus[pod]) {
+			pwq->refcnt++;
+			ctx->pwq_tbl[tcpu] = pwq;
 		}
 	}
 
@@ -4353,7 +4465,7 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 /* set attrs and install prepared pwqs, @ctx points to old pwqs on return */
 static void apply_wqattrs_commit(struct apply_wqattrs_ctx *ctx)
 {
-	int node;
+	int cpu;
 
 	/* all pwqs have been created successfully, let's install'em */
 	mutex_lock(&ctx->wq->mutex);
@@ -4361,9 +4473,9 @@ static void apply_wqattrs_commit(struct apply_wqattrs_ctx *ctx)
 	copy_workqueue_attrs(ctx->wq->unbound_attrs, ctx->attrs);
 
 	/* save the previous pwq and install the new one */
-	for_each_node(node)
-		ctx->pwq_tbl[node] = numa_pwq_tbl_install(ctx->wq, node,
-							  ctx->pwq_tbl[node]);
+	for_each_possible_cpu(cpu)
+		ctx->pwq_tbl[cpu] = install_unbound_pwq(ctx->wq, cpu,
+							ctx->pwq_tbl[cpu]);
 
 	/* @dfl_pwq might not have been used, ensure it's linked */
 	link_pwq(ctx->dfl_pwq);
@@ -4418,12 +4530,12 @@ static int apply_workqueue_attrs_locked(struct workqueue_struct *wq,
  * @wq: the target workqueue
  * @attrs: the workqueue_attrs to apply, allocated with alloc_workqueue_attrs()
  *
- * Apply @attrs to an unbound workqueue @wq.  Unless disabled, on NUMA
- * machines, this function maps a separate pwq to each NUMA node with
- * possibles CPUs in @attrs->cpumask so that work items are affine to the
- * NUMA node it was issued on.  Older pwqs are released as in-flight work
- * items finish.  Note that a work item which repeatedly requeues itself
- * back-to-back will stay on its current pwq.
+ * Apply @attrs to an unbound workqueue @wq.  The possible CPUs are split
+ * into pods according to @attrs->affn_scope, and this function maps a
+ * separate pwq to each pod with possible CPUs in @attrs->cpumask so that
+ * work items are affine to the pod they were issued on.  Older pwqs are
+ * released as in-flight work items finish.  Note that a work item which
+ * repeatedly requeues itself back-to-back will stay on its current pwq.
  *
  * Performs GFP_KERNEL allocations.
  *
@@ -4446,40 +4558,39 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 }
 
 /**
- * wq_update_unbound_numa - update NUMA affinity of a wq for CPU hot[un]plug
+ * wq_update_pod - update the pod of a wq for CPU hot[un]plug
  * @wq: the target workqueue
  * @cpu: the CPU coming up or going down
  * @online: whether @cpu is coming up or going down
  *
  * This function is to be called from %CPU_DOWN_PREPARE, %CPU_ONLINE and
- * %CPU_DOWN_FAILED.  @cpu is being hot[un]plugged, update NUMA affinity of
- * @wq accordingly.
+ * %CPU_DOWN_FAILED.  @cpu is being hot[un]plugged, update the pwq of the
+ * pod @cpu belongs to accordingly.  It's also used to switch to new pods
+ * once the topology is known or the default affinity scope changes.
  *
- * If NUMA affinity can't be adjusted due to memory allocation failure, it
+ * If the pod's pwq can't be created due to memory allocation failure, it
  * falls back to @wq->dfl_pwq which may not be optimal but is always
  * correct.
  *
- * Note that when the last allowed CPU of a NUMA node goes offline for a
- * workqueue with a cpumask spanning multiple nodes, the workers which were
- * already executing the work items for the workqueue will lose their CPU
- * affinity and may execute on any CPU.  This is similar to how per-cpu
- * workqueues behave on CPU_DOWN.  If a workqueue user wants strict
- * affinity, it's the user's responsibility to flush the work item from
- * CPU_DOWN_PREPARE.
+ * Note that when the last allowed CPU of a pod goes offline for a workqueue
+ * with a cpumask spanning multiple pods, the workers which were already
+ * executing the work items for the workqueue will lose their CPU affinity
+ * and may execute on any CPU.  This is similar to how per-cpu workqueues
+ * behave on CPU_DOWN.  If a workqueue user wants strict affinity, it's the
+ * user's responsibility to flush the work item from CPU_DOWN_PREPARE.
  */
-static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
-				   bool online)
+static void wq_update_pod(struct workqueue_struct *wq, int cpu, bool online)
 {
-	int node = cpu_to_node(cpu);
 	int cpu_off = online ? -1 : cpu;
-	struct pool_workqueue *old_pwq = NULL, *pwq;
+	struct pool_workqueue *old_pwq, *pwq;
 	struct workqueue_attrs *target_attrs;
-	cpumask_t *cpumask;
+	const struct wq_pod_type *pt;
+	bool need_pwq;
+	int tcpu;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
-	if (!wq_numa_enabled || !(wq->flags & WQ_UNBOUND) ||
-	    wq->unbound_attrs->no_numa)
+	if (!(wq->flags & WQ_UNBOUND))
 		return;
 
 	/*
@@ -4487,49 +4598,114 @@ static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 	 * Let's use a preallocated one.  The following buf is protected by
 	 * CPU hotplug exclusion.
 	 */
-	target_attrs = wq_update_unbound_numa_attrs_buf;
-	cpumask = target_attrs->cpumask;
+	target_attrs = wq_update_pod_attrs_buf;
 
 	copy_workqueue_attrs(target_attrs, wq->unbound_attrs);
-	pwq = unbound_pwq_by_node(wq, node);
+	wqattrs_actualize_cpumask(target_attrs, wq_unbound_cpumask);
+	pt = wqattrs_pod_type(target_attrs);
+	need_pwq = wq_calc_pod_cpumask(target_attrs, cpu, cpu_off);
 
 	/*
-	 * Let's determine what needs to be done.  If the target cpumask is
-	 * different from the default pwq's, we need to compare it to @pwq's
-	 * and create a new one if they don't match.  If the target cpumask
-	 * equals the default pwq's, the default pwq should be used.
+	 * Nothing to do if the whole pod already uses the default pwq or a
+	 * pwq with the target attributes, as needed.
 	 */
-	if (wq_calc_node_cpumask(wq->dfl_pwq->pool->attrs, node, cpu_off, cpumask)) {
-		if (cpumask_equal(cpumask, pwq->pool->attrs->cpumask))
-			return;
+	pwq = rcu_dereference_protected(wq->unbound_pwq_tbl[cpu],
+					lockdep_is_held(&wq_pool_mutex));
+	if (need_pwq ? (pwq != wq->dfl_pwq &&
+			wqattrs_equal(target_attrs, pwq->pool->attrs)) :
+		       pwq == wq->dfl_pwq) {
+		for_each_cpu(tcpu, pt->pod_cpus[pt->cpu_pod[cpu]]) {
+			if (rcu_access_pointer(wq->unbound_pwq_tbl[tcpu]) != pwq)
+				goto update;
+		}
+		return;
+	}
+update:
+	if (need_pwq) {
+		/* create a new pwq */
+		pwq = alloc_unbound_pwq(wq, target_attrs);
+		if (!pwq)
+			pr_warn("workqueue: allocation failed while updating CPU pod affinity of \"%s\"\n",
+				wq->name);
 	} else {
-		goto use_dfl_pwq;
+		pwq = NULL;
 	}
 
-	/* create a new pwq */
-	pwq = alloc_unbound_pwq(wq, target_attrs);
+	/* Install @pwq, or the default pwq, for all the CPUs of the pod. */
+	mutex_lock(&wq->mutex);
 	if (!pwq) {
-		pr_warn("workqueue: allocation failed while updating NUMA affinity of \"%s\"\n",
-			wq->name);
-		goto use_dfl_pwq;
+		pwq = wq->dfl_pwq;
+		raw_spin_lock_irq(&pwq->pool->lock);
+		get_pwq(pwq);
+		raw_spin_unlock_irq(&pwq->pool->lock);
 	}
 
-	/* Install the new pwq. */
-	mutex_lock(&wq->mutex);
-	old_pwq = numa_pwq_tbl_install(wq, node, pwq);
-	goto out_unlock;
+	for_each_cpu(tcpu, pt->pod_cpus[pt->cpu_pod[cpu]]) {
+		raw_spin_lock_irq(&pwq->pool->lock);
+		get_pwq(pwq);
+		raw_spin_unlock_irq(&pwq->pool->lock);
 
-use_dfl_pwq:
-	mutex_lock(&wq->mutex);
-	raw_spin_lock_irq(&wq->dfl_pwq->pool->lock);
-	get_pwq(wq->dfl_pwq);
-	raw_spin_unlock_irq(&wq->dfl_pwq->pool->lock);
-	old_pwq = numa_pwq_tbl_install(wq, node, wq->dfl_pwq);
-out_unlock:
+		old_pwq = install_unbound_pwq(wq, tcpu, pwq);
+		put_pwq_unlocked(old_pwq);
+	}
 	mutex_unlock(&wq->mutex);
-	put_pwq_unlocked(old_pwq);
+
+	/* each CPU holds its own reference now */
+	put_pwq_unlocked(pwq);
+}
+
+static int wq_affn_dfl_set(const char *val, const struct kernel_param *kp)
+{
+	struct workqueue_struct *wq;
+	int affn, cpu;
+
+	affn = sysfs_match_string(wq_affn_names, val);
+	if (affn < 0)
+		return affn;
+	if (affn == WQ_AFFN_DFL)
+		return -EINVAL;
+
+	cpus_read_lock();
+	mutex_lock(&wq_pool_mutex);
+
+	wq_affn_dfl = affn;
+
+	/* move the workqueues using the default scope to its pods */
+	list_for_each_entry(wq, &workqueues, list) {
+		for_each_online_cpu(cpu)
+			wq_update_pod(wq, cpu, true);
+	}
+
+	mutex_unlock(&wq_pool_mutex);
+	cpus_read_unlock();
+
+	return 0;
+}
+
+static int wq_affn_dfl_get(char *buffer, const struct kernel_param *kp)
+{
+	return scnprintf(buffer, PAGE_SIZE, "%s\n",
+			 wq_affn_names[READ_ONCE(wq_affn_dfl)]);
 }
 
+static const struct kernel_param_ops wq_affn_dfl_ops = {
+	.set	= wq_affn_dfl_set,
+	.get	= wq_affn_dfl_get,
+};
+
+/*
+ * workqueue.default_affinity_scope=cpu|smt|cache|numa|system
+ *
+ * Affinity scope of the unbound workqueues which don't pick their own
+ * through their affinity_scope sysfs file, "cache" by default.  Work items
+ * are started on a worker of the pod of the CPU they were queued on: the
+ * CPU itself, its SMT siblings, the CPUs sharing its last level cache, its
+ * NUMA node, or any CPU.  It can also be changed at runtime through
+ * /sys/module/workqueue/parameters/default_affinity_scope, which moves the
+ * workqueues following the default to the pods of the new scope.
+ */
+module_param_cb(default_affinity_scope, &wq_affn_dfl_ops, NULL, 0644);
+
 static int alloc_and_link_pwqs(struct workqueue_struct *wq)
 {
 	bool highpri = wq->flags & WQ_HIGHPRI;
@@ -4644,7 +4820,7 @@ struct workqueue_struct *alloc_workqueue(const char *fmt,
 
 	/* allocate wq and format name */
 	if (flags & WQ_UNBOUND)
-		tbl_size = nr_node_ids * sizeof(wq->numa_pwq_tbl[0]);
+		tbl_size = nr_cpu_ids * sizeof(wq->unbound_pwq_tbl[0]);
 
 	wq = kzalloc(sizeof(*wq) + tbl_size, GFP_KERNEL);
 	if (!wq)
@@ -4741,7 +4917,7 @@ static bool pwq_busy(struct pool_workqueue *pwq)
 void destroy_workqueue(struct workqueue_struct *wq)
 {
 	struct pool_workqueue *pwq;
-	int node;
+	int cpu;
 
 	/*
 	 * Remove it from sysfs first so that sanity check failure doesn't
@@ -4810,12 +4986,12 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	} else {
 		/*
 		 * We're the sole accessor of @wq at this point.  Directly
-		 * access numa_pwq_tbl[] and dfl_pwq to put the base refs.
+		 * access unbound_pwq_tbl[] and dfl_pwq to put the base refs.
 		 * @wq will be freed when the last pwq is released.
 		 */
-		for_each_node(node) {
-			pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-			RCU_INIT_POINTER(wq->numa_pwq_tbl[node], NULL);
+		for_each_possible_cpu(cpu) {
+			pwq = rcu_access_pointer(wq->unbound_pwq_tbl[cpu]);
+			RCU_INIT_POINTER(wq->unbound_pwq_tbl[cpu], NULL);
 			put_pwq_unlocked(pwq);
 		}
 
@@ -4925,7 +5101,7 @@ bool workqueue_congested(int cpu, struct workqueue_struct *wq)
 	if (!(wq->flags & WQ_UNBOUND))
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq(wq, cpu);
 
 	ret = !list_empty(&pwq->inactive_works);
 	preempt_enable();
@@ -5529,9 +5705,9 @@ int workqueue_online_cpu(unsigned int cpu)
 		mutex_unlock(&wq_pool_attach_mutex);
 	}
 
-	/* update NUMA affinity of unbound workqueues */
+	/* update pod affinity of unbound workqueues */
 	list_for_each_entry(wq, &workqueues, list)
-		wq_update_unbound_numa(wq, cpu, true);
+		wq_update_pod(wq, cpu, true);
 
 	mutex_unlock(&wq_pool_mutex);
 	return 0;
@@ -5547,10 +5723,10 @@ int workqueue_offline_cpu(unsigned int cpu)
 
 	unbind_workers(cpu);
 
-	/* update NUMA affinity of unbound workqueues */
+	/* update pod affinity of unbound workqueues */
 	mutex_lock(&wq_pool_mutex);
 	list_for_each_entry(wq, &workqueues, list)
-		wq_update_unbound_numa(wq, cpu, false);
+		wq_update_pod(wq, cpu, false);
 	mutex_unlock(&wq_pool_mutex);
 
 	return 0;
@@ -5816,10 +5992,25 @@ int workqueue_set_unbound_cpumask(cpumask_var_t cpumask)
  *
  * Unbound workqueues have the following extra attributes.
  *
- *  pool_ids	RO int	: the associated pool IDs for each node
+ *  pool_ids	RO int	: the associated pool IDs for each CPU
  *  nice	RW int	: nice value of the workers
  *  cpumask	RW mask	: bitmask of allowed CPUs for the workers
- *  numa	RW bool	: whether enable NUMA affinity
+ *  numa	RW bool	: whether enable NUMA affinity, sets affinity_scope
+ *  affinity_scope	RW str	: cpu, smt, cache, numa, system or default
+ *  affinity_strict	RW bool	: whether workers are confined to their pod
+ *  locality	RO	: per pool count of work items started in and out
+ *		  of the pod, and of workers woken up back in it
+ *
+ * affinity_scope picks the CPU pods work items are kept in: the CPU they
+ * were queued on, its SMT siblings, the CPUs sharing its last level cache,
+ * its NUMA node, or all CPUs.  "default" follows
+ * workqueue.default_affinity_scope, and reads back as "default (<scope>)".
+ * Writing 1 to numa sets the numa scope, 0 the system one.
+ *
+ * With affinity_strict clear, the default, pods are a preference: workers
+ * may run on any CPU in cpumask, but idle ones are woken up back in their
+ * pod to start work items.  With it set, workers never leave their pod,
+ * which trades work conservation for isolation.
  */
 struct wq_device {
 	struct workqueue_struct		*wq;
@@ -5877,14 +6068,14 @@ static ssize_t wq_pool_ids_show(struct device *dev,
 {
 	struct workqueue_struct *wq = dev_to_wq(dev);
 	const char *delim = "";
-	int node, written = 0;
+	int cpu, written = 0;
 
 	cpus_read_lock();
 	rcu_read_lock();
-	for_each_node(node) {
+	for_each_possible_cpu(cpu) {
 		written += scnprintf(buf + written, PAGE_SIZE - written,
-				     "%s%d:%d", delim, node,
-				     unbound_pwq_by_node(wq, node)->pool->id);
+				     "%s%d:%d", delim, cpu,
+				     unbound_pwq(wq, cpu)->pool->id);
 		delim = " ";
 	}
 	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
@@ -5992,7 +6183,7 @@ static ssize_t wq_numa_show(struct device *dev, struct device_attribute *attr,
 
 	mutex_lock(&wq->mutex);
 	written = scnprintf(buf, PAGE_SIZE, "%d\n",
-			    !wq->unbound_attrs->no_numa);
+			    wq->unbound_attrs->affn_scope != WQ_AFFN_SYSTEM);
 	mutex_unlock(&wq->mutex);
 
 	return written;
@@ -6013,7 +6204,7 @@ static ssize_t wq_numa_store(struct device *dev, struct device_attribute *attr,
 
 	ret = -EINVAL;
 	if (sscanf(buf, "%d", &v) == 1) {
-		attrs->no_numa = !v;
+		attrs->affn_scope = v ? WQ_AFFN_NUMA : WQ_AFFN_SYSTEM;
 		ret = apply_workqueue_attrs_locked(wq, attrs);
 	}
 
@@ -6023,11 +6214,130 @@ static ssize_t wq_numa_store(struct device *dev, struct device_attribute *attr,
 	return ret ?: count;
 }
 
+static ssize_t wq_affn_scope_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq->mutex);
+	if (wq->unbound_attrs->affn_scope == WQ_AFFN_DFL)
+		written = scnprintf(buf, PAGE_SIZE, "%s (%s)\n",
+				    wq_affn_names[WQ_AFFN_DFL],
+				    wq_affn_names[READ_ONCE(wq_affn_dfl)]);
+	else
+		written = scnprintf(buf, PAGE_SIZE, "%s\n",
+				    wq_affn_names[wq->unbound_attrs->affn_scope]);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_affn_scope_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int affn, ret = -ENOMEM;
+
+	affn = sysfs_match_string(wq_affn_names, buf);
+	if (affn < 0)
+		return affn;
+
+	apply_wqattrs_lock();
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	attrs->affn_scope = affn;
+	ret = apply_workqueue_attrs_locked(wq, attrs);
+
+out_unlock:
+	apply_wqattrs_unlock();
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_affn_strict_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n",
+			 READ_ONCE(wq->unbound_attrs->affn_strict));
+}
+
+static ssize_t wq_affn_strict_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int v, ret = -ENOMEM;
+
+	if (sscanf(buf, "%d", &v) != 1)
+		return -EINVAL;
+
+	apply_wqattrs_lock();
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	attrs->affn_strict = (bool)v;
+	ret = apply_workqueue_attrs_locked(wq, attrs);
+
+out_unlock:
+	apply_wqattrs_unlock();
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+/*
+ * One line per pool currently or formerly used by the workqueue: pool ID,
+ * CPUs of its pod, work items started in and out of the pod, and idle
+ * workers woken up back in the pod.  Pools may be shared with other
+ * workqueues with the same attributes, the counts then cover all of them.
+ */
+static ssize_t wq_locality_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct pool_workqueue *pwq;
+	int written = 0;
+
+	mutex_lock(&wq->mutex);
+	for_each_pwq(pwq, wq) {
+		struct worker_pool *pool = pwq->pool;
+		u64 local, remote, repatriated;
+
+		raw_spin_lock_irq(&pool->lock);
+		local = pool->nr_pod_local;
+		remote = pool->nr_pod_remote;
+		repatriated = pool->nr_repatriated;
+		raw_spin_unlock_irq(&pool->lock);
+
+		written += scnprintf(buf + written, PAGE_SIZE - written,
+				     "pool=%d pod=%*pbl local=%llu remote=%llu repatriated=%llu\n",
+				     pool->id,
+				     cpumask_pr_args(pool->attrs->__pod_cpumask),
+				     local, remote, repatriated);
+	}
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
 static struct device_attribute wq_sysfs_unbound_attrs[] = {
 	__ATTR(pool_ids, 0444, wq_pool_ids_show, NULL),
 	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
 	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
 	__ATTR(numa, 0644, wq_numa_show, wq_numa_store),
+	__ATTR(affinity_scope, 0644, wq_affn_scope_show, wq_affn_scope_store),
+	__ATTR(affinity_strict, 0644, wq_affn_strict_show, wq_affn_strict_store),
+	__ATTR(locality, 0444, wq_locality_show, NULL),
 	__ATTR_NULL,
 };
 
@@ -6393,48 +6703,106 @@ static inline void wq_watchdog_init(void) { }
 
 #endif	/* CONFIG_WQ_WATCHDOG */
 
+static void __init init_pod_type(struct wq_pod_type *pt,
+				 bool (*cpus_share_pod)(int, int))
+{
+	int cur, pre, cpu, pod;
+
+	pt->nr_pods = 0;
+
+	/* init @pt->cpu_pod[] according to @cpus_share_pod() */
+	pt->cpu_pod = kcalloc(nr_cpu_ids, sizeof(pt->cpu_pod[0]), GFP_KERNEL);
+	BUG_ON(!pt->cpu_pod);
+
+	for_each_possible_cpu(cur) {
+		for_each_possible_cpu(pre) {
+			if (pre >= cur) {
+				pt->cpu_pod[cur] = pt->nr_pods++;
+				break;
+			}
+			if (cpus_share_pod(cur, pre)) {
+				pt->cpu_pod[cur] = pt->cpu_pod[pre];
+				break;
+			}
+		}
+	}
+
+	/* init the rest to match @pt->cpu_pod[] */
+	pt->pod_cpus = kcalloc(pt->nr_pods, sizeof(pt->pod_cpus[0]), GFP_KERNEL);
+	pt->pod_node = kcalloc(pt->nr_pods, sizeof(pt->pod_node[0]), GFP_KERNEL);
+	BUG_ON(!pt->pod_cpus || !pt->pod_node);
+
+	for (pod = 0; pod < pt->nr_pods; pod++)
+		BUG_ON(!zalloc_cpumask_var(&pt->pod_cpus[pod], GFP_KERNEL));
+
+	for_each_possible_cpu(cpu) {
+		cpumask_set_cpu(cpu, pt->pod_cpus[pt->cpu_pod[cpu]]);
+		pt->pod_node[pt->cpu_pod[cpu]] = cpu_to_node(cpu);
+	}
+}
+
+static bool __init cpus_dont_share(int cpu0, int cpu1)
+{
+	return false;
+}
+
+static bool __init cpus_share_all(int cpu0, int cpu1)
+{
+	return true;
+}
+
+static bool __init cpus_share_smt(int cpu0, int cpu1)
+{
+	return cpumask_test_cpu(cpu0, topology_sibling_cpumask(cpu1));
+}
+
+/*
+ * Use the last level cache sharing reported by cacheinfo, and the
+ * scheduler's view of it on architectures which don't provide cacheinfo.
+ */
+static bool __init cpus_share_llc(int cpu0, int cpu1)
+{
+	if (last_level_cache_is_valid(cpu0) && last_level_cache_is_valid(cpu1))
+		return last_level_cache_is_shared(cpu0, cpu1);
+
+	return cpus_share_cache(cpu0, cpu1);
+}
+
+static bool __init cpus_share_numa(int cpu0, int cpu1)
+{
+	return cpu_to_node(cpu0) == cpu_to_node(cpu1);
+}
+
+/*
+ * Build the NUMA pod type.  Without usable NUMA information, or if NUMA
+ * affinity is disabled, it has a single pod like the system one.
+ */
 static void __init wq_numa_init(void)
 {
-	cpumask_var_t *tbl;
-	int node, cpu;
+	struct wq_pod_type *pt = &wq_pod_types[WQ_AFFN_NUMA];
+	int cpu;
 
 	if (num_possible_nodes() <= 1)
-		return;
+		goto single_pod;
 
 	if (wq_disable_numa) {
 		pr_info("workqueue: NUMA affinity support disabled\n");
-		return;
+		goto single_pod;
 	}
 
 	for_each_possible_cpu(cpu) {
 		if (WARN_ON(cpu_to_node(cpu) == NUMA_NO_NODE)) {
 			pr_warn("workqueue: NUMA node mapping not available for cpu%d, disabling NUMA support\n", cpu);
-			return;
+			goto single_pod;
 		}
 	}
 
-	wq_update_unbound_numa_attrs_buf = alloc_workqueue_attrs();
-	BUG_ON(!wq_update_unbound_numa_attrs_buf);
-
-	/*
-	 * We want masks of possible CPUs of each node which isn't readily
-	 * available.  Build one from cpu_to_node() which should have been
-	 * fully initialized by now.
-	 */
-	tbl = kcalloc(nr_node_ids, sizeof(tbl[0]), GFP_KERNEL);
-	BUG_ON(!tbl);
-
-	for_each_node(node)
-		BUG_ON(!zalloc_cpumask_var_node(&tbl[node], GFP_KERNEL,
-				node_online(node) ? node : NUMA_NO_NODE));
-
-	for_each_possible_cpu(cpu) {
-		node = cpu_to_node(cpu);
-		cpumask_set_cpu(cpu, tbl[node]);
-	}
-
-	wq_numa_possible_cpumask = tbl;
+	init_pod_type(pt, cpus_share_numa);
 	wq_numa_enabled = true;
+	return;
+
+single_pod:
+	init_pod_type(pt, cpus_share_all);
 }
 
 /**
@@ -6460,6 +6828,15 @@ void __init workqueue_init_early(void)
 
 	pwq_cache = KMEM_CACHE(pool_workqueue, SLAB_PANIC);
 
+	BUG_ON(!(wq_update_pod_attrs_buf = alloc_workqueue_attrs()));
+
+	/*
+	 * The CPU and system pods don't depend on the topology, the others
+	 * are set up by wq_numa_init() and workqueue_init_topology().
+	 */
+	init_pod_type(&wq_pod_types[WQ_AFFN_CPU], cpus_dont_share);
+	init_pod_type(&wq_pod_types[WQ_AFFN_SYSTEM], cpus_share_all);
+
 	/* initialize CPU pools */
 	for_each_possible_cpu(cpu) {
 		struct worker_pool *pool;
@@ -6469,6 +6846,7 @@ void __init workqueue_init_early(void)
 			BUG_ON(init_worker_pool(pool));
 			pool->cpu = cpu;
 			cpumask_copy(pool->attrs->cpumask, cpumask_of(cpu));
+			cpumask_copy(pool->attrs->__pod_cpumask, cpumask_of(cpu));
 			pool->attrs->nice = std_nice[i++];
 			pool->node = cpu_to_node(cpu);
 
@@ -6489,12 +6867,12 @@ void __init workqueue_init_early(void)
 
 		/*
 		 * An ordered wq should have only one pwq as ordering is
-		 * guaranteed by max_active which is enforced by pwqs.
-		 * Turn off NUMA so that dfl_pwq is used for all nodes.
+		 * guaranteed by max_active which is enforced by pwqs.  Use
+		 * the system scope so that dfl_pwq is used for all CPUs.
 		 */
 		BUG_ON(!(attrs = alloc_workqueue_attrs()));
 		attrs->nice = std_nice[i];
-		attrs->no_numa = true;
+		attrs->affn_scope = WQ_AFFN_SYSTEM;
 		ordered_wq_attrs[i] = attrs;
 	}
 
@@ -6573,8 +6951,8 @@ void __init workqueue_init(void)
 	 * It'd be simpler to initialize NUMA in workqueue_init_early() but
 	 * CPU to node mapping may not be available that early on some
 	 * archs such as power and arm64.  As per-cpu pools created
-	 * previously could be missing node hint and unbound pools NUMA
-	 * affinity, fix them up.
+	 * previously could be missing node hint, fix them up.  Unbound
+	 * pools get their pods in workqueue_init_topology().
 	 *
 	 * Also, while iterating workqueues, create rescuers if requested.
 	 */
@@ -6589,7 +6967,6 @@ void __init workqueue_init(void)
 	}
 
 	list_for_each_entry(wq, &workqueues, list) {
-		wq_update_unbound_numa(wq, smp_processor_id(), true);
 		WARN(init_rescuer(wq),
 		     "workqueue: failed to create early rescuer for %s",
 		     wq->name);
@@ -6612,6 +6989,36 @@ void __init workqueue_init(void)
 	wq_watchdog_init();
 }
 
+/**
+ * workqueue_init_topology - initialize CPU pods for unbound workqueues
+ *
+ * This is the third step of workqueue subsystem initialization, invoked
+ * once all the boot CPUs are up and the scheduler and cache topologies
+ * are known.  It builds the SMT and cache pods, and moves the workqueues
+ * created so far to the pods of their affinity scope.
+ */
+void __init workqueue_init_topology(void)
+{
+	struct workqueue_struct *wq;
+	int cpu;
+
+	init_pod_type(&wq_pod_types[WQ_AFFN_SMT], cpus_share_smt);
+	init_pod_type(&wq_pod_types[WQ_AFFN_CACHE], cpus_share_llc);
+
+	mutex_lock(&wq_pool_mutex);
+
+	/*
+	 * Workqueues allocated earlier have all CPUs sharing the default
+	 * pwq.  Update the pod of each online CPU to apply per-pod pwqs.
+	 */
+	list_for_each_entry(wq, &workqueues, list) {
+		for_each_online_cpu(cpu)
+			wq_update_pod(wq, cpu, true);
+	}
+
+	mutex_unlock(&wq_pool_mutex);
+}
+
 /*
  * Despite the naming, this is a no-op function which is here only for avoiding
  * link error. Since compile-time warning may fail to catch, we will need to
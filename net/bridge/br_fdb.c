@@ -52,12 +52,23 @@ void br_fdb_fini(void)
 
 int br_fdb_hash_init(struct net_bridge *br)
 {
-	return rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	int err;
+
+	br->fdb_lookup_cache = alloc_percpu(struct br_fdb_lookup_cache);
+	if (!br->fdb_lookup_cache)
+		return -ENOMEM;
+
+	err = rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	if (err)
+		free_percpu(br->fdb_lookup_cache);
+
+	return err;
 }
 
 void br_fdb_hash_fini(struct net_bridge *br)
 {
 	rhashtable_destroy(&br->fdb_hash_tbl);
+	free_percpu(br->fdb_lookup_cache);
 }
 
 /* if topology_changing then use forward_delay (default 15 sec)
@@ -68,6 +79,15 @@ static inline unsigned long hold_time(const struct net_bridge *br)
 	return br->topology_change ? br->forward_delay : br->ageing_time;
 }
 
+/* Minimum interval between two refreshes of fdb->updated by learning: ageing
+ * doesn't need a finer resolution, and each refresh dirties a cache line that
+ * all CPUs forwarding to that address have to read.
+ */
+static inline unsigned long fdb_refresh_interval(const struct net_bridge *br)
+{
+	return min_t(unsigned long, HZ, hold_time(br) / 16);
+}
+
 static inline int has_expired(const struct net_bridge *br,
 				  const struct net_bridge_fdb_entry *fdb)
 {
@@ -266,11 +286,70 @@ struct net_device *br_fdb_find_port(const struct net_device *br_dev,
 }
 EXPORT_SYMBOL_GPL(br_fdb_find_port);
 
+static unsigned int br_fdb_cache_index(const unsigned char *addr, u16 vid)
+{
+	return (get_unaligned((const u16 *)(addr + 4)) ^ vid) &
+	       (BR_FDB_CACHE_SIZE - 1);
+}
+
+/* Lookups from the datapath go through a small per-CPU direct-mapped cache
+ * first, saving the rhashtable walk for the usual few hot addresses. Slots are
+ * only written with BHs disabled on the local CPU, hence the context check.
+ *
+ * Entries are invalidated all at once by bumping br->fdb_lookup_gen whenever
+ * one is deleted, before it can be freed, see fdb_delete(). The generation is
+ * read, with acquire semantics pairing with the release there, before the
+ * rhashtable lookup, so that an entry unlinked meanwhile is never cached as
+ * valid. It is 64 bits wide so that it can't wrap back to the value of a
+ * slot left stale since, which would revive a freed entry.
+ */
 struct net_bridge_fdb_entry *br_fdb_find_rcu(struct net_bridge *br,
 					     const unsigned char *addr,
 					     __u16 vid)
 {
-	return fdb_find_rcu(&br->fdb_hash_tbl, addr, vid);
+	struct net_bridge_fdb_entry *fdb;
+	struct br_fdb_lookup_cache *cache;
+	struct br_fdb_cache_slot *slot;
+	u64 gen;
+
+	if (!in_softirq() || in_hardirq() || in_nmi())
+		return fdb_find_rcu(&br->fdb_hash_tbl, addr, vid);
+
+	cache = this_cpu_ptr(br->fdb_lookup_cache);
+	slot = &cache->slot[br_fdb_cache_index(addr, vid)];
+	gen = atomic64_read_acquire(&br->fdb_lookup_gen);
+
+	fdb = slot->fdb;
+	if (fdb && slot->gen == gen && fdb->key.vlan_id == vid &&
+	    ether_addr_equal(fdb->key.addr.addr, addr)) {
+		cache->hits++;
+		return fdb;
+	}
+
+	cache->misses++;
+	fdb = fdb_find_rcu(&br->fdb_hash_tbl, addr, vid);
+	if (fdb) {
+		slot->fdb = fdb;
+		slot->gen = gen;
+	}
+
+	return fdb;
+}
+
+void br_fdb_cache_stats(const struct net_bridge *br, u64 *hits, u64 *misses,
+			u64 *refresh_skipped)
+{
+	int cpu;
+
+	*hits = *misses = *refresh_skipped = 0;
+	for_each_possible_cpu(cpu) {
+		const struct br_fdb_lookup_cache *cache;
+
+		cache = per_cpu_ptr(br->fdb_lookup_cache, cpu);
+		*hits += READ_ONCE(cache->hits);
+		*misses += READ_ONCE(cache->misses);
+		*refresh_skipped += READ_ONCE(cache->refresh_skipped);
+	}
 }
 
 /* When a static FDB entry is added, the mac address from the entry is
@@ -329,6 +408,8 @@ static void fdb_delete(struct net_bridge *br, struct net_bridge_fdb_entry *f,
 	hlist_del_init_rcu(&f->fdb_node);
 	rhashtable_remove_fast(&br->fdb_hash_tbl, &f->rhnode,
 			       br_fdb_rht_params);
+	/* drop cached lookups, which might point to this entry */
+	atomic64_inc_return_release(&br->fdb_lookup_gen);
 	fdb_notify(br, f, RTM_DELNEIGH, swdev_notify);
 	call_rcu(&f->rcu, fdb_rcu_free);
 }
@@ -859,7 +940,7 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 	if (hold_time(br) == 0)
 		return;
 
-	fdb = fdb_find_rcu(&br->fdb_hash_tbl, addr, vid);
+	fdb = br_fdb_find_rcu(br, addr, vid);
 	if (likely(fdb)) {
 		/* attempt to update an entry for a local interface */
 		if (unlikely(test_bit(BR_FDB_LOCAL, &fdb->flags))) {
@@ -870,7 +951,12 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 			unsigned long now = jiffies;
 			bool fdb_modified = false;
 
-			if (now != fdb->updated) {
+			if (time_before(now, fdb->updated +
+					    fdb_refresh_interval(br)) &&
+			    likely(!test_bit(BR_FDB_ADDED_BY_USER, &flags))) {
+				this_cpu_inc(br->fdb_lookup_cache->
+					     refresh_skipped);
+			} else if (now != fdb->updated) {
 				fdb->updated = now;
 				fdb_modified = __fdb_mark_active(fdb);
 			}
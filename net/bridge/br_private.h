@@ -296,6 +296,21 @@ struct net_bridge_fdb_entry {
 	struct rcu_head			rcu;
 };
 
+/* Per-CPU direct-mapped cache of FDB lookups, see br_fdb_find_rcu() */
+#define BR_FDB_CACHE_SIZE		64
+
+struct br_fdb_cache_slot {
+	struct net_bridge_fdb_entry	*fdb;
+	u64				gen;
+};
+
+struct br_fdb_lookup_cache {
+	struct br_fdb_cache_slot	slot[BR_FDB_CACHE_SIZE];
+	unsigned long			hits;
+	unsigned long			misses;
+	unsigned long			refresh_skipped;
+};
+
 struct net_bridge_fdb_flush_desc {
 	unsigned long			flags;
 	unsigned long			flags_mask;
@@ -495,6 +510,8 @@ struct net_bridge {
 #endif
 
 	struct rhashtable		fdb_hash_tbl;
+	struct br_fdb_lookup_cache __percpu *fdb_lookup_cache;
+	atomic64_t			fdb_lookup_gen;
 	struct list_head		port_list;
 #if IS_ENABLED(CONFIG_BRIDGE_NETFILTER)
 	union {
@@ -833,6 +850,8 @@ void br_fdb_delete_by_port(struct net_bridge *br,
 struct net_bridge_fdb_entry *br_fdb_find_rcu(struct net_bridge *br,
 					     const unsigned char *addr,
 					     __u16 vid);
+void br_fdb_cache_stats(const struct net_bridge *br, u64 *hits, u64 *misses,
+			u64 *refresh_skipped);
 int br_fdb_test_addr(struct net_device *dev, unsigned char *addr);
 int br_fdb_fillbuf(struct net_bridge *br, void *buf, unsigned long count,
 		   unsigned long off);
@@ -295,6 +295,37 @@ static ssize_t gc_timer_show(struct device *d, struct device_attribute *attr,
 }
 static DEVICE_ATTR_RO(gc_timer);
 
+static ssize_t fdb_cache_hits_show(struct device *d,
+				   struct device_attribute *attr, char *buf)
+{
+	u64 hits, misses, refresh_skipped;
+
+	br_fdb_cache_stats(to_bridge(d), &hits, &misses, &refresh_skipped);
+	return sprintf(buf, "%llu\n", hits);
+}
+static DEVICE_ATTR_RO(fdb_cache_hits);
+
+static ssize_t fdb_cache_misses_show(struct device *d,
+				     struct device_attribute *attr, char *buf)
+{
+	u64 hits, misses, refresh_skipped;
+
+	br_fdb_cache_stats(to_bridge(d), &hits, &misses, &refresh_skipped);
+	return sprintf(buf, "%llu\n", misses);
+}
+static DEVICE_ATTR_RO(fdb_cache_misses);
+
+static ssize_t fdb_refresh_skipped_show(struct device *d,
+					struct device_attribute *attr,
+					char *buf)
+{
+	u64 hits, misses, refresh_skipped;
+
+	br_fdb_cache_stats(to_bridge(d), &hits, &misses, &refresh_skipped);
+	return sprintf(buf, "%llu\n", refresh_skipped);
+}
+static DEVICE_ATTR_RO(fdb_refresh_skipped);
+
 static ssize_t group_addr_show(struct device *d,
 			       struct device_attribute *attr, char *buf)
 {
@@ -951,6 +982,9 @@ static struct attribute *bridge_attrs[] = {
 	&dev_attr_tcn_timer.attr,
 	&dev_attr_topology_change_timer.attr,
 	&dev_attr_gc_timer.attr,
+	&dev_attr_fdb_cache_hits.attr,
+	&dev_attr_fdb_cache_misses.attr,
+	&dev_attr_fdb_refresh_skipped.attr,
 	&dev_attr_group_addr.attr,
 	&dev_attr_flush.attr,
 	&dev_attr_no_linklocal_learn.attr,
@@ -4269,6 +4269,241 @@ int __dev_direct_xmit(struct sk_buff *skb, u16 queue_id)
 }
 EXPORT_SYMBOL(__dev_direct_xmit);
 
+/**
+ * __dev_direct_xmit_batch - transmit buffers on a given queue, bypassing qdisc
+ * @skbs: buffers to transmit, all for the same device
+ * @n: number of buffers in @skbs
+ * @queue_id: transmit queue to use
+ * @ret: filled with the outcome for the last buffer handled
+ *
+ * Batched version of __dev_direct_xmit(): buffers are validated upfront, then
+ * passed to the driver under a single queue lock, with xmit_more set for all
+ * but the last one. Processing stops at the first buffer that's not sent.
+ *
+ * Return: count of buffers consumed, from the start of @skbs. Remaining ones
+ * are untouched. *@ret is %NETDEV_TX_BUSY if the queue is full, and the driver
+ * return code for the last consumed buffer otherwise, or %NET_XMIT_DROP if it
+ * failed validation: in that case, buffers before it are all consumed, and
+ * dropped if the queue filled up before they could be sent.
+ */
+u32 __dev_direct_xmit_batch(struct sk_buff **skbs, u32 n, u16 queue_id,
+			    int *ret)
+{
+	struct net_device *dev = skbs[0]->dev;
+	struct netdev_queue *txq;
+	u32 i, valid = n;
+	bool again = false;
+	int rc = NETDEV_TX_OK;
+
+	if (unlikely(!netif_running(dev) ||
+		     !netif_carrier_ok(dev))) {
+		dev_core_stats_tx_dropped_inc(dev);
+		kfree_skb(skbs[0]);
+		*ret = NET_XMIT_DROP;
+		return 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct sk_buff *skb;
+
+		skb = validate_xmit_skb_list(skbs[i], dev, &again);
+		if (skb != skbs[i]) {
+			dev_core_stats_tx_dropped_inc(dev);
+			kfree_skb_list(skb);
+			valid = i;
+			break;
+		}
+
+		skb_set_queue_mapping(skb, queue_id);
+	}
+
+	if (!valid)
+		goto out;
+
+	txq = skb_get_tx_queue(dev, skbs[0]);
+
+	local_bh_disable();
+
+	dev_xmit_recursion_inc();
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	for (i = 0; i < valid; i++) {
+		if (netif_xmit_frozen_or_drv_stopped(txq)) {
+			rc = NETDEV_TX_BUSY;
+			break;
+		}
+
+		rc = netdev_start_xmit(skbs[i], dev, txq, i + 1 < valid);
+		if (rc == NETDEV_TX_BUSY)
+			break;
+		if (rc != NETDEV_TX_OK) {
+			i++;
+			break;
+		}
+	}
+	HARD_TX_UNLOCK(dev, txq);
+	dev_xmit_recursion_dec();
+
+	local_bh_enable();
+
+	if (i < valid && valid == n) {
+		*ret = rc;
+		return i;
+	}
+
+	/* The buffer failing validation is gone, those before it can't be
+	 * handed back to the caller
+	 */
+	for (; i < valid; i++) {
+		dev_core_stats_tx_dropped_inc(dev);
+		kfree_skb(skbs[i]);
+	}
+out:
+	if (valid < n) {
+		*ret = NET_XMIT_DROP;
+		return valid + 1;
+	}
+
+	*ret = rc;
+	return n;
+}
+EXPORT_SYMBOL(__dev_direct_xmit_batch);
+
+/* Upper bound for buffers held back by dev_queue_xmit_batch() */
+#define NAPI_XMIT_BATCH	64
+
+/* Same checks and header handling as __dev_queue_xmit(), for buffers that can
+ * be handed to the driver directly: the device is up and has no qdisc, and
+ * there are no egress hooks to run. Return the selected queue, NULL if the
+ * buffer needs to go through __dev_queue_xmit() instead.
+ */
+static struct netdev_queue *dev_xmit_batch_prepare(struct sk_buff *skb)
+{
+	struct net_device *dev = skb->dev;
+	struct netdev_queue *txq;
+
+#ifdef CONFIG_NET_EGRESS
+	if (static_branch_unlikely(&egress_needed_key))
+		return NULL;
+#endif
+	if (unlikely(skb_shinfo(skb)->tx_flags & SKBTX_SCHED_TSTAMP) ||
+	    !(dev->flags & IFF_UP))
+		return NULL;
+
+	txq = netdev_core_pick_tx(dev, skb, NULL);
+	if (rcu_dereference_bh(txq->qdisc)->enqueue)
+		return NULL;
+
+	skb_reset_mac_header(skb);
+	skb_assert_len(skb);
+#ifdef CONFIG_NET_CLS_ACT
+	skb->tc_at_ingress = 0;
+#endif
+	if (dev->priv_flags & IFF_XMIT_DST_RELEASE)
+		skb_dst_drop(skb);
+	else
+		skb_dst_force(skb);
+
+	trace_net_dev_queue(skb);
+
+	return txq;
+}
+
+/* Transmit a list of buffers for the same queue in one go: the driver sees
+ * xmit_more set for all but the last one.
+ */
+static void dev_xmit_batch_burst(struct sk_buff *head, struct net_device *dev,
+				 struct netdev_queue *txq)
+{
+	int cpu = smp_processor_id();
+	int rc = NETDEV_TX_BUSY;
+	bool again = false;
+
+	if (READ_ONCE(txq->xmit_lock_owner) == cpu || dev_xmit_recursion()) {
+		net_crit_ratelimited("Dead loop on virtual device %s, fix it urgently!\n",
+				     dev->name);
+		goto drop;
+	}
+
+	head = validate_xmit_skb_list(head, dev, &again);
+	if (!head)
+		return;
+
+	HARD_TX_LOCK(dev, txq, cpu);
+	if (!netif_xmit_stopped(txq)) {
+		dev_xmit_recursion_inc();
+		head = dev_hard_start_xmit(head, dev, txq, &rc);
+		dev_xmit_recursion_dec();
+	}
+	HARD_TX_UNLOCK(dev, txq);
+
+	if (!head)
+		return;
+drop:
+	dev_core_stats_tx_dropped_inc(dev);
+	kfree_skb_list(head);
+}
+
+static void dev_xmit_batch_flush(struct softnet_data *sd)
+{
+	struct sk_buff *skb, *head = NULL, **tail = &head;
+	struct netdev_queue *txq = NULL;
+	struct net_device *dev = NULL;
+
+	while ((skb = __skb_dequeue(&sd->xmit_batch))) {
+		struct netdev_queue *t = dev_xmit_batch_prepare(skb);
+
+		if (head && (!t || skb->dev != dev || t != txq)) {
+			dev_xmit_batch_burst(head, dev, txq);
+			head = NULL;
+			tail = &head;
+		}
+
+		if (!t) {
+			__dev_queue_xmit(skb, NULL);
+			continue;
+		}
+
+		dev = skb->dev;
+		txq = t;
+		*tail = skb;
+		tail = &skb->next;
+	}
+
+	if (head)
+		dev_xmit_batch_burst(head, dev, txq);
+}
+
+/**
+ * dev_queue_xmit_batch - transmit a buffer, possibly together with others
+ * @skb: buffer to transmit, link layer header already in place
+ *
+ * Meant for forwarding fast paths. From NAPI poll context, buffers are held
+ * back until the poll routine returns, or until %NAPI_XMIT_BATCH of them are
+ * pending, then passed in bursts to drivers of devices without qdisc, with
+ * xmit_more hints. Devices with a qdisc get buffers from the same flush via
+ * __dev_queue_xmit(), and the qdisc can then dequeue them in bulk. Outside of
+ * NAPI poll context, this is the same as dev_queue_xmit().
+ *
+ * Buffers can still reference a dst without holding it until they are
+ * flushed, as this happens before bottom halves are enabled again.
+ */
+void dev_queue_xmit_batch(struct sk_buff *skb)
+{
+	struct softnet_data *sd;
+
+	/* Only set, for the local CPU, with bottom halves disabled */
+	if (!this_cpu_read(softnet_data.xmit_batching)) {
+		dev_queue_xmit(skb);
+		return;
+	}
+
+	sd = this_cpu_ptr(&softnet_data);
+	__skb_queue_tail(&sd->xmit_batch, skb);
+	if (skb_queue_len(&sd->xmit_batch) >= NAPI_XMIT_BATCH)
+		dev_xmit_batch_flush(sd);
+}
+EXPORT_SYMBOL(dev_queue_xmit_batch);
+
 /*************************************************************************
  *			Receiver routines
  *************************************************************************/
@@ -6598,7 +6833,10 @@ static int napi_threaded_poll(void *data)
 			sd->in_napi_threaded_poll = true;
 
 			have = netpoll_poll_lock(napi);
+			sd->xmit_batching = true;
 			__napi_poll(napi, &repoll);
+			sd->xmit_batching = false;
+			dev_xmit_batch_flush(sd);
 			netpoll_poll_unlock(have);
 
 			sd->in_napi_threaded_poll = false;
@@ -6657,7 +6895,10 @@ static __latent_entropy void net_rx_action(struct softirq_action *h)
 		}
 
 		n = list_first_entry(&list, struct napi_struct, poll_list);
+		sd->xmit_batching = true;
 		budget -= napi_poll(n, &repoll);
+		sd->xmit_batching = false;
+		dev_xmit_batch_flush(sd);
 
 		/* If softirq window is exhausted then punt.
 		 * Allow this to run for 2 jiffies since which will allow
@@ -11406,6 +11647,7 @@ static int __init net_dev_init(void)
 
 		skb_queue_head_init(&sd->input_pkt_queue);
 		skb_queue_head_init(&sd->process_queue);
+		__skb_queue_head_init(&sd->xmit_batch);
 #ifdef CONFIG_XFRM_OFFLOAD
 		skb_queue_head_init(&sd->xfrm_backlog);
 #endif
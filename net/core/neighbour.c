@@ -284,6 +284,8 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 
 	write_unlock_bh(&tbl->lock);
 
+	NEIGH_CACHE_STAT_ADD(tbl, forced_gc_removed, shrunk);
+
 	return shrunk;
 }
 
@@ -935,16 +937,31 @@ static void neigh_connect(struct neighbour *neigh)
 	neigh->output = neigh->ops->connected_output;
 }
 
+/* Each run of the periodic work walks a slice of the hash table, at least
+ * NEIGH_GC_SLICE_MIN buckets, and the whole table in NEIGH_GC_SLICES runs at
+ * most.
+ */
+#define NEIGH_GC_SLICE_MIN	256
+#define NEIGH_GC_SLICES		16
+
 static void neigh_periodic_work(struct work_struct *work)
 {
 	struct neigh_table *tbl = container_of(work, struct neigh_table, gc_work.work);
+	unsigned int i, first, end, nbuckets, slice, removed = 0;
+	unsigned long delay, walk_us;
 	struct neighbour *n;
 	struct neighbour __rcu **np;
-	unsigned int i;
 	struct neigh_hash_table *nht;
+	u64 start;
 
 	NEIGH_CACHE_STAT_INC(tbl, periodic_gc_runs);
 
+	/* Cycle through all hash buckets every BASE_REACHABLE_TIME/2 ticks.
+	 * ARP entry timeouts range from 1/2 BASE_REACHABLE_TIME to 3/2
+	 * BASE_REACHABLE_TIME.
+	 */
+	delay = NEIGH_VAR(&tbl->parms, BASE_REACHABLE_TIME) >> 1;
+
 	write_lock_bh(&tbl->lock);
 	nht = rcu_dereference_protected(tbl->nht,
 					lockdep_is_held(&tbl->lock));
@@ -964,7 +981,24 @@ static void neigh_periodic_work(struct work_struct *work)
 	if (atomic_read(&tbl->entries) < tbl->gc_thresh1)
 		goto out;
 
-	for (i = 0 ; i < (1 << nht->hash_shift); i++) {
+	/* Walk only the next slice of buckets, and come back earlier, so that
+	 * a large table is still covered in the same time, without a single
+	 * walk of all of it. The table only grows, so a resize while the lock
+	 * is dropped below can't leave us past its end.
+	 */
+	nbuckets = 1 << nht->hash_shift;
+	slice = max_t(unsigned int, nbuckets / NEIGH_GC_SLICES,
+		      NEIGH_GC_SLICE_MIN);
+	if (slice < nbuckets)
+		delay = max_t(unsigned long, delay * slice / nbuckets, 1);
+
+	first = tbl->gc_bucket;
+	if (first >= nbuckets)
+		first = 0;
+	end = min(first + slice, nbuckets);
+	start = ktime_get_ns();
+
+	for (i = first; i < end; i++) {
 		np = &nht->hash_buckets[i];
 
 		while ((n = rcu_dereference_protected(*np,
@@ -992,6 +1026,7 @@ static void neigh_periodic_work(struct work_struct *work)
 				neigh_mark_dead(n);
 				write_unlock(&n->lock);
 				neigh_cleanup_and_release(n);
+				removed++;
 				continue;
 			}
 			write_unlock(&n->lock);
@@ -1009,13 +1044,16 @@ static void neigh_periodic_work(struct work_struct *work)
 		nht = rcu_dereference_protected(tbl->nht,
 						lockdep_is_held(&tbl->lock));
 	}
+	tbl->gc_bucket = i < (1 << nht->hash_shift) ? i : 0;
+
+	walk_us = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
+	NEIGH_CACHE_STAT_ADD(tbl, periodic_gc_removed, removed);
+	NEIGH_CACHE_STAT_ADD(tbl, periodic_gc_buckets, end - first);
+	NEIGH_CACHE_STAT_ADD(tbl, periodic_gc_walk_us, walk_us);
+	if (walk_us > this_cpu_read(tbl->stats->periodic_gc_walk_max_us))
+		this_cpu_write(tbl->stats->periodic_gc_walk_max_us, walk_us);
 out:
-	/* Cycle through all hash buckets every BASE_REACHABLE_TIME/2 ticks.
-	 * ARP entry timeouts range from 1/2 BASE_REACHABLE_TIME to 3/2
-	 * BASE_REACHABLE_TIME.
-	 */
-	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work,
-			      NEIGH_VAR(&tbl->parms, BASE_REACHABLE_TIME) >> 1);
+	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work, delay);
 	write_unlock_bh(&tbl->lock);
 }
 
@@ -1264,6 +1302,53 @@ static void neigh_update_hhs(struct neighbour *neigh)
 	}
 }
 
+/* Confirming a reachable entry with an unchanged link layer address only
+ * refreshes neigh->confirmed, which neigh_confirm() already does without the
+ * lock. Do the same here, so that repeated replies from busy neighbours don't
+ * contend on neigh->lock. Racing with the timer moving the entry to
+ * NUD_STALE is harmless: the fresh timestamp brings it back to NUD_REACHABLE
+ * from NUD_DELAY, without probes.
+ *
+ * Neighbour advertisements always come with NEIGH_UPDATE_F_OVERRIDE_ISROUTER,
+ * which is fine as long as the router flag they carry is the one already set.
+ */
+static bool neigh_update_confirm_lockless(struct neighbour *neigh,
+					  const u8 *lladdr, u8 new, u32 flags)
+{
+	const struct net_device *dev = neigh->dev;
+	unsigned int seq;
+	bool same;
+
+	if (new != NUD_REACHABLE ||
+	    (flags & ~(NEIGH_UPDATE_F_OVERRIDE | NEIGH_UPDATE_F_WEAK_OVERRIDE |
+		       NEIGH_UPDATE_F_OVERRIDE_ISROUTER |
+		       NEIGH_UPDATE_F_ISROUTER)) ||
+	    READ_ONCE(neigh->nud_state) != NUD_REACHABLE ||
+	    READ_ONCE(neigh->dead))
+		return false;
+
+	if ((flags & NEIGH_UPDATE_F_OVERRIDE_ISROUTER) &&
+	    !(flags & NEIGH_UPDATE_F_ISROUTER) !=
+	    !(READ_ONCE(neigh->flags) & NTF_ROUTER))
+		return false;
+
+	if (lladdr && dev->addr_len) {
+		do {
+			seq = read_seqbegin(&neigh->ha_lock);
+			same = !memcmp(lladdr, neigh->ha, dev->addr_len);
+		} while (read_seqretry(&neigh->ha_lock, seq));
+
+		if (!same)
+			return false;
+	}
+
+	if (READ_ONCE(neigh->confirmed) != jiffies)
+		WRITE_ONCE(neigh->confirmed, jiffies);
+	NEIGH_CACHE_STAT_INC(neigh->tbl, lockless_confirms);
+
+	return true;
+}
+
 /* Generic update routine.
    -- lladdr is new lladdr or NULL, if it is not supplied.
    -- new    is new state.
@@ -1295,6 +1380,11 @@ static int __neigh_update(struct neighbour *neigh, const u8 *lladdr,
 
 	trace_neigh_update(neigh, lladdr, new, flags, nlmsg_pid);
 
+	if (neigh_update_confirm_lockless(neigh, lladdr, new, flags)) {
+		trace_neigh_update_done(neigh, 0);
+		return 0;
+	}
+
 	write_lock_bh(&neigh->lock);
 
 	dev    = neigh->dev;
@@ -3454,13 +3544,15 @@ static int neigh_stat_seq_show(struct seq_file *seq, void *v)
 	struct neigh_statistics *st = v;
 
 	if (v == SEQ_START_TOKEN) {
-		seq_puts(seq, "entries  allocs   destroys hash_grows lookups  hits     res_failed rcv_probes_mcast rcv_probes_ucast periodic_gc_runs forced_gc_runs unresolved_discards table_fulls\n");
+		seq_puts(seq, "entries  allocs   destroys hash_grows lookups  hits     res_failed rcv_probes_mcast rcv_probes_ucast periodic_gc_runs forced_gc_runs unresolved_discards table_fulls periodic_gc_removed forced_gc_removed periodic_gc_buckets periodic_gc_walk_us periodic_gc_walk_max_us lockless_confirms\n");
 		return 0;
 	}
 
 	seq_printf(seq, "%08x %08lx %08lx %08lx   %08lx %08lx %08lx   "
 			"%08lx         %08lx         %08lx         "
-			"%08lx       %08lx            %08lx\n",
+			"%08lx       %08lx            %08lx    "
+			"%08lx            %08lx          %08lx            "
+			"%08lx            %08lx                %08lx\n",
 		   atomic_read(&tbl->entries),
 
 		   st->allocs,
@@ -3478,7 +3570,14 @@ static int neigh_stat_seq_show(struct seq_file *seq, void *v)
 		   st->periodic_gc_runs,
 		   st->forced_gc_runs,
 		   st->unres_discards,
-		   st->table_fulls
+		   st->table_fulls,
+
+		   st->periodic_gc_removed,
+		   st->forced_gc_removed,
+		   st->periodic_gc_buckets,
+		   st->periodic_gc_walk_us,
+		   st->periodic_gc_walk_max_us,
+		   st->lockless_confirms
 		   );
 
 	return 0;
@@ -37,6 +37,28 @@ void reuseport_has_conns_set(struct sock *sk)
 }
 EXPORT_SYMBOL(reuseport_has_conns_set);
 
+/* Invalidate the lookup results cached for the group of @sk, see
+ * __udp4_lib_lookup().  Returns false if @sk is not in a group.
+ */
+bool reuseport_invalidate(struct sock *sk)
+{
+	struct sock_reuseport *reuse;
+	bool ret = false;
+
+	rcu_read_lock();
+	reuse = rcu_dereference(sk->sk_reuseport_cb);
+	if (reuse) {
+		atomic64_inc(&reuse->gen);
+		/* Paired with smp_rmb() in reuseport_cache_gen() */
+		smp_mb__after_atomic();
+		ret = true;
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+EXPORT_SYMBOL(reuseport_invalidate);
+
 static void __reuseport_get_incoming_cpu(struct sock_reuseport *reuse)
 {
 	/* Paired with READ_ONCE() in reuseport_select_sock_by_hash(). */
@@ -49,6 +71,49 @@ static void __reuseport_put_incoming_cpu(struct sock_reuseport *reuse)
 	WRITE_ONCE(reuse->incoming_cpu, reuse->incoming_cpu - 1);
 }
 
+/* Rebuild the CPU -> listening sk map consulted by
+ * reuseport_select_sock_by_hash() so that SO_INCOMING_CPU steering does
+ * not need to walk reuse->socks[] for every packet.
+ *
+ * Called under reuseport_lock whenever the listening section or the
+ * sk_incoming_cpu of one of its members changes.  Readers may briefly
+ * observe a NULL slot while the map is rebuilt, in which case they fall
+ * back to plain hash selection.
+ */
+static void reuseport_update_cpu_socks(struct sock_reuseport *reuse)
+{
+	struct sock **cpu_socks = reuse->cpu_socks;
+	int i, cpu;
+
+	if (!reuse->incoming_cpu)
+		return;
+
+	if (!cpu_socks) {
+		cpu_socks = kcalloc(nr_cpu_ids, sizeof(*cpu_socks), GFP_ATOMIC);
+		if (!cpu_socks)
+			return;
+
+		/* Paired with smp_load_acquire() in
+		 * reuseport_select_sock_by_hash().
+		 */
+		smp_store_release(&reuse->cpu_socks, cpu_socks);
+	}
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		WRITE_ONCE(cpu_socks[cpu], NULL);
+
+	for (i = 0; i < reuse->num_socks; i++) {
+		struct sock *sk = reuse->socks[i];
+
+		cpu = sk->sk_incoming_cpu;
+		if (cpu < 0 || cpu >= nr_cpu_ids)
+			continue;
+
+		WRITE_ONCE(cpu_socks[cpu],
+			   cpu_socks[cpu] ? REUSEPORT_CPU_SHARED : sk);
+	}
+}
+
 static void reuseport_get_incoming_cpu(struct sock *sk, struct sock_reuseport *reuse)
 {
 	if (sk->sk_incoming_cpu >= 0)
@@ -97,6 +162,8 @@ void reuseport_update_incoming_cpu(struct sock *sk, int val)
 	else if (old_sk_incoming_cpu >= 0 && val < 0)
 		__reuseport_put_incoming_cpu(reuse);
 
+	reuseport_update_cpu_socks(reuse);
+
 out:
 	spin_unlock_bh(&reuseport_lock);
 }
@@ -129,6 +196,7 @@ static void __reuseport_add_sock(struct sock *sk,
 	smp_wmb();
 	reuse->num_socks++;
 	reuseport_get_incoming_cpu(sk, reuse);
+	reuseport_update_cpu_socks(reuse);
 }
 
 static bool __reuseport_detach_sock(struct sock *sk,
@@ -142,6 +210,7 @@ static bool __reuseport_detach_sock(struct sock *sk,
 	reuse->socks[i] = reuse->socks[reuse->num_socks - 1];
 	reuse->num_socks--;
 	reuseport_put_incoming_cpu(sk, reuse);
+	reuseport_update_cpu_socks(reuse);
 
 	return true;
 }
@@ -235,6 +304,7 @@ int reuseport_alloc(struct sock *sk, bool bind_inany)
 	reuse->socks[0] = sk;
 	reuse->num_socks = 1;
 	reuseport_get_incoming_cpu(sk, reuse);
+	reuseport_update_cpu_socks(reuse);
 	rcu_assign_pointer(sk->sk_reuseport_cb, reuse);
 
 out:
@@ -278,7 +348,9 @@ static struct sock_reuseport *reuseport_grow(struct sock_reuseport *reuse)
 	more_reuse->reuseport_id = reuse->reuseport_id;
 	more_reuse->bind_inany = reuse->bind_inany;
 	more_reuse->has_conns = reuse->has_conns;
+	atomic64_set(&more_reuse->gen, atomic64_read(&reuse->gen));
 	more_reuse->incoming_cpu = reuse->incoming_cpu;
+	more_reuse->cpu_socks = reuse->cpu_socks;
 
 	memcpy(more_reuse->socks, reuse->socks,
 	       reuse->num_socks * sizeof(struct sock *));
@@ -294,7 +366,7 @@ static struct sock_reuseport *reuseport_grow(struct sock_reuseport *reuse)
 
 	/* Note: we use kfree_rcu here instead of reuseport_free_rcu so
 	 * that reuse and more_reuse can temporarily share a reference
-	 * to prog.
+	 * to prog and cpu_socks.
 	 */
 	kfree_rcu(reuse, rcu);
 	return more_reuse;
@@ -307,6 +379,7 @@ static void reuseport_free_rcu(struct rcu_head *head)
 	reuse = container_of(head, struct sock_reuseport, rcu);
 	sk_reuseport_prog_free(rcu_dereference_protected(reuse->prog, 1));
 	ida_free(&reuseport_ida, reuse->reuseport_id);
+	kfree(reuse->cpu_socks);
 	kfree(reuse);
 }
 
@@ -529,15 +602,36 @@ static struct sock *reuseport_select_sock_by_hash(struct sock_reuseport *reuse,
 						  u32 hash, u16 num_socks)
 {
 	struct sock *first_valid_sk = NULL;
+	struct sock **cpu_socks;
+	bool match_cpu;
 	int i, j;
 
+	/* Paired with WRITE_ONCE() in __reuseport_(get|put)_incoming_cpu(). */
+	match_cpu = READ_ONCE(reuse->incoming_cpu);
+	if (match_cpu) {
+		/* Paired with smp_store_release() in reuseport_update_cpu_socks(). */
+		cpu_socks = smp_load_acquire(&reuse->cpu_socks);
+		if (cpu_socks) {
+			int cpu = raw_smp_processor_id();
+			struct sock *sk = READ_ONCE(cpu_socks[cpu]);
+
+			if (!sk) {
+				/* No listener is bound to this CPU. */
+				match_cpu = false;
+			} else if (sk != REUSEPORT_CPU_SHARED &&
+				   sk->sk_state != TCP_ESTABLISHED &&
+				   READ_ONCE(sk->sk_incoming_cpu) == cpu) {
+				return sk;
+			}
+		}
+	}
+
 	i = j = reciprocal_scale(hash, num_socks);
 	do {
 		struct sock *sk = reuse->socks[i];
 
 		if (sk->sk_state != TCP_ESTABLISHED) {
-			/* Paired with WRITE_ONCE() in __reuseport_(get|put)_incoming_cpu(). */
-			if (!READ_ONCE(reuse->incoming_cpu))
+			if (!match_cpu)
 				return sk;
 
 			/* Paired with WRITE_ONCE() in reuseport_update_incoming_cpu(). */
@@ -138,6 +138,17 @@ static struct udp_table *udp_get_table_prot(struct sock *sk)
 	return sk->sk_prot->h.udp_table ? : sock_net(sk)->ipv4.udp_table;
 }
 
+/* Called when @sk connects or disconnects.  Only the cached results
+ * pointing to its reuseport group can change, unless it is not in a
+ * group and may now take over some 4-tuples from one.
+ */
+void udp_lib_invalidate(struct sock *sk)
+{
+	if (!reuseport_invalidate(sk))
+		udp_table_invalidate(udp_get_table_prot(sk));
+}
+EXPORT_SYMBOL(udp_lib_invalidate);
+
 static int udp_lib_lport_inuse(struct net *net, __u16 num,
 			       const struct udp_hslot *hslot,
 			       unsigned long *bitmap,
@@ -341,6 +352,7 @@ int udp_lib_get_port(struct sock *sk, unsigned short snum,
 					   &hslot2->head);
 		hslot2->count++;
 		spin_unlock(&hslot2->lock);
+		udp_table_invalidate(udptable);
 	}
 	sock_set_flag(sk, SOCK_RCU_FREE);
 	error = 0;
@@ -435,6 +447,88 @@ static struct sock *lookup_reuseport(struct net *net, struct sock *sk,
 	return reuse_sk;
 }
 
+/* Per-CPU cache of reuseport lookup results, enabled per netns through
+ * the udp_reuseport_lookup_cache sysctl.  A hit skips the hslot2 chain
+ * walk and goes straight to reuseport selection.
+ *
+ * Entries are only read and written from softirq context on the owning
+ * CPU.  They are validated against udp_table->reuseport_gen, which is
+ * bumped whenever a socket is hashed, unhashed or rehashed, and then
+ * against the gen of the cached socket's reuseport group, which is bumped
+ * when one of its members connects or disconnects.  Sockets are
+ * SOCK_RCU_FREE, so a cached sk whose table generation still matches
+ * cannot have been freed under rcu_read_lock().
+ */
+#define UDP_REUSEPORT_CACHE_SIZE	64
+
+struct udp_reuseport_cache_entry {
+	const struct net	*net;
+	struct sock		*sk;
+	u64			gen;
+	u64			reuse_gen;
+	__be32			saddr;
+	__be32			daddr;
+	__be16			sport;
+	__be16			dport;
+	int			dif;
+	int			sdif;
+};
+
+static DEFINE_PER_CPU(struct udp_reuseport_cache_entry [UDP_REUSEPORT_CACHE_SIZE],
+		      udp_reuseport_cache);
+
+static bool udp4_reuseport_cache_enabled(struct net *net,
+					 struct udp_table *udptable)
+{
+	return READ_ONCE(net->ipv4.sysctl_udp_reuseport_lookup_cache) &&
+	       udptable == net->ipv4.udp_table &&
+	       in_serving_softirq() &&
+	       !static_branch_unlikely(&bpf_sk_lookup_enabled);
+}
+
+static struct sock *
+udp4_reuseport_cache_lookup(const struct udp_reuseport_cache_entry *entry,
+			    u64 gen, struct net *net,
+			    __be32 saddr, __be16 sport,
+			    __be32 daddr, __be16 dport,
+			    int dif, int sdif, u32 hash, struct sk_buff *skb)
+{
+	if (entry->gen != gen || entry->net != net ||
+	    entry->saddr != saddr || entry->sport != sport ||
+	    entry->daddr != daddr || entry->dport != dport ||
+	    entry->dif != dif || entry->sdif != sdif || !entry->sk)
+		return NULL;
+
+	if (!reuseport_cache_valid(entry->sk, entry->reuse_gen))
+		return NULL;
+
+	return reuseport_select_sock(entry->sk, hash, skb,
+				     sizeof(struct udphdr));
+}
+
+static void udp4_reuseport_cache_store(struct udp_reuseport_cache_entry *entry,
+				       u64 gen, struct net *net,
+				       __be32 saddr, __be16 sport,
+				       __be32 daddr, __be16 dport,
+				       int dif, int sdif, struct sock *sk)
+{
+	u64 reuse_gen;
+
+	if (!reuseport_cache_gen(sk, &reuse_gen))
+		return;
+
+	entry->net = net;
+	entry->sk = sk;
+	entry->gen = gen;
+	entry->reuse_gen = reuse_gen;
+	entry->saddr = saddr;
+	entry->sport = sport;
+	entry->daddr = daddr;
+	entry->dport = dport;
+	entry->dif = dif;
+	entry->sdif = sdif;
+}
+
 /* called with rcu_read_lock() */
 static struct sock *udp4_lib_lookup2(struct net *net,
 				     __be32 saddr, __be16 sport,
@@ -495,11 +589,29 @@ struct sock *__udp4_lib_lookup(struct net *net, __be32 saddr,
 		__be16 sport, __be32 daddr, __be16 dport, int dif,
 		int sdif, struct udp_table *udptable, struct sk_buff *skb)
 {
+	struct udp_reuseport_cache_entry *entry = NULL;
 	unsigned short hnum = ntohs(dport);
 	unsigned int hash2, slot2;
+	u64 gen = 0;
 	struct udp_hslot *hslot2;
 	struct sock *result, *sk;
 
+	if (udp4_reuseport_cache_enabled(net, udptable)) {
+		u32 hash = udp_ehashfn(net, daddr, hnum, saddr, sport);
+
+		entry = this_cpu_ptr(udp_reuseport_cache) +
+			(hash & (UDP_REUSEPORT_CACHE_SIZE - 1));
+		gen = atomic64_read(&udptable->reuseport_gen);
+		/* Paired with smp_mb__after_atomic() in udp_table_invalidate() */
+		smp_rmb();
+
+		result = udp4_reuseport_cache_lookup(entry, gen, net,
+						     saddr, sport, daddr, dport,
+						     dif, sdif, hash, skb);
+		if (result)
+			return result;
+	}
+
 	hash2 = ipv4_portaddr_hash(net, daddr, hnum);
 	slot2 = hash2 & udptable->mask;
 	hslot2 = &udptable->hash2[slot2];
@@ -536,6 +648,9 @@ struct sock *__udp4_lib_lookup(struct net *net, __be32 saddr,
 done:
 	if (IS_ERR(result))
 		return NULL;
+	if (entry && result)
+		udp4_reuseport_cache_store(entry, gen, net, saddr, sport,
+					   daddr, dport, dif, sdif, result);
 	return result;
 }
 EXPORT_SYMBOL_GPL(__udp4_lib_lookup);
@@ -1927,6 +2042,16 @@ int udp_pre_connect(struct sock *sk, struct sockaddr *uaddr, int addr_len)
 }
 EXPORT_SYMBOL(udp_pre_connect);
 
+int udp_connect(struct sock *sk, struct sockaddr *uaddr, int addr_len)
+{
+	int res;
+
+	res = ip4_datagram_connect(sk, uaddr, addr_len);
+	udp_lib_invalidate(sk);
+	return res;
+}
+EXPORT_SYMBOL(udp_connect);
+
 int __udp_disconnect(struct sock *sk, int flags)
 {
 	struct inet_sock *inet = inet_sk(sk);
@@ -1959,6 +2084,7 @@ int udp_disconnect(struct sock *sk, int flags)
 {
 	lock_sock(sk);
 	__udp_disconnect(sk, flags);
+	udp_lib_invalidate(sk);
 	release_sock(sk);
 	return 0;
 }
@@ -1988,6 +2114,7 @@ void udp_lib_unhash(struct sock *sk)
 			spin_unlock(&hslot2->lock);
 		}
 		spin_unlock_bh(&hslot->lock);
+		udp_table_invalidate(udptable);
 	}
 }
 EXPORT_SYMBOL(udp_lib_unhash);
@@ -2029,6 +2156,7 @@ void udp_lib_rehash(struct sock *sk, u16 newhash)
 
 			spin_unlock_bh(&hslot->lock);
 		}
+		udp_table_invalidate(udptable);
 	}
 }
 EXPORT_SYMBOL(udp_lib_rehash);
@@ -2899,6 +3027,7 @@ int udp_abort(struct sock *sk, int err)
 	sk->sk_err = err;
 	sk_error_report(sk);
 	__udp_disconnect(sk, 0);
+	udp_lib_invalidate(sk);
 
 out:
 	if (!has_current_bpf_ctx())
@@ -2913,7 +3042,7 @@ struct proto udp_prot = {
 	.owner			= THIS_MODULE,
 	.close			= udp_lib_close,
 	.pre_connect		= udp_pre_connect,
-	.connect		= ip4_datagram_connect,
+	.connect		= udp_connect,
 	.disconnect		= udp_disconnect,
 	.ioctl			= udp_ioctl,
 	.init			= udp_init_sock,
@@ -3426,6 +3555,7 @@ void __init udp_table_init(struct udp_table *table, const char *name)
 		table->hash2[i].count = 0;
 		spin_lock_init(&table->hash2[i].lock);
 	}
+	atomic64_set(&table->reuseport_gen, get_random_u64());
 }
 
 u32 udp_flow_hashrnd(void)
@@ -3446,6 +3576,7 @@ static void __net_init udp_sysctl_init(struct net *net)
 #ifdef CONFIG_NET_L3_MASTER_DEV
 	net->ipv4.sysctl_udp_l3mdev_accept = 0;
 #endif
+	net->ipv4.sysctl_udp_reuseport_lookup_cache = 0;
 }
 
 static struct udp_table __net_init *udp_pernet_table_alloc(unsigned int hash_entries)
@@ -3476,6 +3607,11 @@ static struct udp_table __net_init *udp_pernet_table_alloc(unsigned int hash_ent
 		spin_lock_init(&udptable->hash2[i].lock);
 	}
 
+	/* Start from a random generation so that stale per-CPU cache
+	 * entries left by a previous table at this address never match.
+	 */
+	atomic64_set(&udptable->reuseport_gen, get_random_u64());
+
 	return udptable;
 
 free_table:
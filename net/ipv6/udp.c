@@ -233,6 +233,80 @@ static inline struct sock *udp6_lookup_run_bpf(struct net *net,
 	return sk;
 }
 
+/* IPv6 counterpart of the per-CPU reuseport lookup cache in
+ * net/ipv4/udp.c, enabled by the same sysctl and validated the same way.
+ */
+#define UDP6_REUSEPORT_CACHE_SIZE	64
+
+struct udp6_reuseport_cache_entry {
+	const struct net	*net;
+	struct sock		*sk;
+	u64			gen;
+	u64			reuse_gen;
+	struct in6_addr		saddr;
+	struct in6_addr		daddr;
+	__be16			sport;
+	__be16			dport;
+	int			dif;
+	int			sdif;
+};
+
+static DEFINE_PER_CPU(struct udp6_reuseport_cache_entry [UDP6_REUSEPORT_CACHE_SIZE],
+		      udp6_reuseport_cache);
+
+static bool udp6_reuseport_cache_enabled(struct net *net,
+					 struct udp_table *udptable)
+{
+	return READ_ONCE(net->ipv4.sysctl_udp_reuseport_lookup_cache) &&
+	       udptable == net->ipv4.udp_table &&
+	       in_serving_softirq() &&
+	       !static_branch_unlikely(&bpf_sk_lookup_enabled);
+}
+
+static struct sock *
+udp6_reuseport_cache_lookup(const struct udp6_reuseport_cache_entry *entry,
+			    u64 gen, struct net *net,
+			    const struct in6_addr *saddr, __be16 sport,
+			    const struct in6_addr *daddr, __be16 dport,
+			    int dif, int sdif, u32 hash, struct sk_buff *skb)
+{
+	if (entry->gen != gen || entry->net != net ||
+	    entry->sport != sport || entry->dport != dport ||
+	    !ipv6_addr_equal(&entry->saddr, saddr) ||
+	    !ipv6_addr_equal(&entry->daddr, daddr) ||
+	    entry->dif != dif || entry->sdif != sdif || !entry->sk)
+		return NULL;
+
+	if (!reuseport_cache_valid(entry->sk, entry->reuse_gen))
+		return NULL;
+
+	return reuseport_select_sock(entry->sk, hash, skb,
+				     sizeof(struct udphdr));
+}
+
+static void udp6_reuseport_cache_store(struct udp6_reuseport_cache_entry *entry,
+				       u64 gen, struct net *net,
+				       const struct in6_addr *saddr, __be16 sport,
+				       const struct in6_addr *daddr, __be16 dport,
+				       int dif, int sdif, struct sock *sk)
+{
+	u64 reuse_gen;
+
+	if (!reuseport_cache_gen(sk, &reuse_gen))
+		return;
+
+	entry->net = net;
+	entry->sk = sk;
+	entry->gen = gen;
+	entry->reuse_gen = reuse_gen;
+	entry->saddr = *saddr;
+	entry->sport = sport;
+	entry->daddr = *daddr;
+	entry->dport = dport;
+	entry->dif = dif;
+	entry->sdif = sdif;
+}
+
 /* rcu_read_lock() must be held */
 struct sock *__udp6_lib_lookup(struct net *net,
 			       const struct in6_addr *saddr, __be16 sport,
@@ -240,11 +314,29 @@ struct sock *__udp6_lib_lookup(struct net *net,
 			       int dif, int sdif, struct udp_table *udptable,
 			       struct sk_buff *skb)
 {
+	struct udp6_reuseport_cache_entry *entry = NULL;
 	unsigned short hnum = ntohs(dport);
 	unsigned int hash2, slot2;
+	u64 gen = 0;
 	struct udp_hslot *hslot2;
 	struct sock *result, *sk;
 
+	if (udp6_reuseport_cache_enabled(net, udptable)) {
+		u32 hash = udp6_ehashfn(net, daddr, hnum, saddr, sport);
+
+		entry = this_cpu_ptr(udp6_reuseport_cache) +
+			(hash & (UDP6_REUSEPORT_CACHE_SIZE - 1));
+		gen = atomic64_read(&udptable->reuseport_gen);
+		/* Paired with smp_mb__after_atomic() in udp_table_invalidate() */
+		smp_rmb();
+
+		result = udp6_reuseport_cache_lookup(entry, gen, net,
+						     saddr, sport, daddr, dport,
+						     dif, sdif, hash, skb);
+		if (result)
+			return result;
+	}
+
 	hash2 = ipv6_portaddr_hash(net, daddr, hnum);
 	slot2 = hash2 & udptable->mask;
 	hslot2 = &udptable->hash2[slot2];
@@ -281,6 +373,9 @@ struct sock *__udp6_lib_lookup(struct net *net,
 done:
 	if (IS_ERR(result))
 		return NULL;
+	if (entry && result)
+		udp6_reuseport_cache_store(entry, gen, net, saddr, sport,
+					   daddr, dport, dif, sdif, result);
 	return result;
 }
 EXPORT_SYMBOL_GPL(__udp6_lib_lookup);
@@ -1178,6 +1273,16 @@ static int udpv6_pre_connect(struct sock *sk, struct sockaddr *uaddr,
 	return BPF_CGROUP_RUN_PROG_INET6_CONNECT_LOCK(sk, uaddr);
 }
 
+static int udpv6_connect(struct sock *sk, struct sockaddr *uaddr,
+			 int addr_len)
+{
+	int res;
+
+	res = ip6_datagram_connect(sk, uaddr, addr_len);
+	udp_lib_invalidate(sk);
+	return res;
+}
+
 /**
  *	udp6_hwcsum_outgoing  -  handle outgoing HW checksumming
  *	@sk:	socket we are sending on
@@ -1775,7 +1880,7 @@ struct proto udpv6_prot = {
 	.owner			= THIS_MODULE,
 	.close			= udp_lib_close,
 	.pre_connect		= udpv6_pre_connect,
-	.connect		= ip6_datagram_connect,
+	.connect		= udpv6_connect,
 	.disconnect		= udp_disconnect,
 	.ioctl			= udp_ioctl,
 	.init			= udpv6_init_sock,
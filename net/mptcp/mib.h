@@ -65,6 +65,7 @@ enum linux_mptcp_mib_field {
 					 * conflict with another subflow while updating msk rcv wnd
 					 */
 	MPTCP_MIB_RCVWNDCONFLICT,	/* Conflict with while updating msk rcv wnd */
+	MPTCP_MIB_SCHEDSUBFLOW,		/* Subflow picked by a non-default packet scheduler */
 	__MPTCP_MIB_MAX
 };
 
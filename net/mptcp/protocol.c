@@ -1364,6 +1364,43 @@ bool mptcp_subflow_active(struct mptcp_subflow_context *subflow)
 #define SSK_MODE_BACKUP	1
 #define SSK_MODE_MAX	2
 
+/* hand the active subflows to the scheduler selected for this msk, at most
+ * MPTCP_SUBFLOWS_MAX of them; still updates the rtx timeout
+ */
+static struct sock *mptcp_sched_get_send(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+	struct sock *sk = (struct sock *)msk;
+	struct mptcp_sched_data data;
+	struct sock *ssk;
+	long tout = 0;
+	int i;
+
+	data.subflows = 0;
+	mptcp_for_each_subflow(msk, subflow) {
+		trace_mptcp_subflow_get_send(subflow);
+		if (!mptcp_subflow_active(subflow))
+			continue;
+
+		tout = max(tout, mptcp_timeout_from_subflow(subflow));
+		if (data.subflows < MPTCP_SUBFLOWS_MAX)
+			data.contexts[data.subflows++] = subflow;
+	}
+	__mptcp_set_timeout(sk, tout);
+
+	if (!data.subflows)
+		return NULL;
+
+	i = msk->sched->get_subflow(msk, &data);
+	if (i < 0 || i >= data.subflows)
+		return NULL;
+
+	MPTCP_INC_STATS(sock_net(sk), MPTCP_MIB_SCHEDSUBFLOW);
+
+	ssk = mptcp_subflow_tcp_sock(data.contexts[i]);
+	return sk_stream_memory_free(ssk) ? ssk : NULL;
+}
+
 /* implement the mptcp packet scheduler;
  * returns the subflow that will transmit the next DSS
  * additionally updates the rtx timeout
@@ -1388,6 +1425,9 @@ static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 		       sk_stream_memory_free(msk->first) ? msk->first : NULL;
 	}
 
+	if (msk->sched && msk->sched->get_subflow)
+		return mptcp_sched_get_send(msk);
+
 	/* re-use last subflow, if the burst allow that */
 	if (msk->last_snd && msk->snd_burst > 0 &&
 	    sk_stream_memory_free(msk->last_snd) &&
@@ -2721,6 +2761,13 @@ static int mptcp_init_sock(struct sock *sk)
 	if (unlikely(!net->mib.mptcp_statistics) && !mptcp_mib_alloc(net))
 		return -ENOMEM;
 
+	rcu_read_lock();
+	ret = mptcp_init_sched(mptcp_sk(sk),
+			       mptcp_sched_find(mptcp_get_scheduler(net)));
+	rcu_read_unlock();
+	if (ret)
+		return ret;
+
 	set_bit(SOCK_CUSTOM_SOCKOPT, &sk->sk_socket->flags);
 
 	/* fetch the ca name; do it outside __mptcp_init_sock(), so that clone will
@@ -3109,6 +3156,7 @@ struct sock *mptcp_sk_clone_init(const struct sock *sk,
 	__mptcp_init_sock(nsk);
 
 	msk = mptcp_sk(nsk);
+	mptcp_init_sched(msk, mptcp_sk(sk)->sched);
 	msk->local_key = subflow_req->local_key;
 	msk->token = subflow_req->token;
 	WRITE_ONCE(msk->subflow, NULL);
@@ -3258,6 +3306,7 @@ static void mptcp_destroy(struct sock *sk)
 	 */
 	mptcp_dispose_initial_subflow(msk);
 	mptcp_destroy_common(msk, 0);
+	mptcp_release_sched(msk);
 	sk_sockets_allocated_dec(sk);
 }
 
@@ -3934,6 +3983,7 @@ void __init mptcp_proto_init(void)
 
 	mptcp_subflow_init();
 	mptcp_pm_init();
+	mptcp_sched_init();
 	mptcp_token_init();
 
 	if (proto_register(&mptcp_prot, 1) != 0)
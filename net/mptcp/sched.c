@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP
+ *
+ * Packet scheduler registration and built-in schedulers.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/bpf.h>
+#include "protocol.h"
+
+static DEFINE_SPINLOCK(mptcp_sched_list_lock);
+static LIST_HEAD(mptcp_sched_list);
+
+/* The historical scheduler, picking the subflow with the shortest estimated
+ * time to flush its queue. It's implemented directly in
+ * mptcp_subflow_get_send(), hence no get_subflow() here.
+ */
+static struct mptcp_sched_ops mptcp_sched_default = {
+	.name		= "default",
+	.owner		= THIS_MODULE,
+};
+
+/* Send on the subflow where new data is expected to reach the peer first:
+ * half the SRTT, plus the time needed to drain what's queued ahead of it at
+ * the current pacing rate. Without cwnd headroom, the data also has to wait
+ * for acks, a full SRTT more. Backup subflows are only used if no other one
+ * is available.
+ */
+static int mptcp_sched_latency_get_subflow(struct mptcp_sock *msk,
+					   struct mptcp_sched_data *data)
+{
+	u64 best_delay[2] = { U64_MAX, U64_MAX };
+	int i, best[2] = { -1, -1 };
+
+	for (i = 0; i < data->subflows; i++) {
+		struct mptcp_subflow_context *subflow = data->contexts[i];
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		const struct tcp_sock *tp = tcp_sk(ssk);
+		unsigned long pace;
+		u32 srtt, queued;
+		u64 delay;
+
+		if (!sk_stream_memory_free(ssk))
+			continue;
+
+		srtt = READ_ONCE(tp->srtt_us) >> 3;
+		queued = READ_ONCE(tp->write_seq) - READ_ONCE(tp->snd_nxt);
+		pace = READ_ONCE(ssk->sk_pacing_rate);
+
+		delay = srtt / 2;
+		if (queued && pace && pace != ~0UL)
+			delay += div64_u64((u64)queued * USEC_PER_SEC, pace);
+		if (tcp_packets_in_flight(tp) >= tcp_snd_cwnd(tp))
+			delay += srtt;
+
+		if (delay < best_delay[subflow->backup]) {
+			best_delay[subflow->backup] = delay;
+			best[subflow->backup] = i;
+		}
+	}
+
+	return best[0] >= 0 ? best[0] : best[1];
+}
+
+static struct mptcp_sched_ops mptcp_sched_latency = {
+	.get_subflow	= mptcp_sched_latency_get_subflow,
+	.name		= "latency",
+	.owner		= THIS_MODULE,
+};
+
+/* Must be called with rcu read lock held */
+struct mptcp_sched_ops *mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list) {
+		if (!strcmp(sched->name, name))
+			return sched;
+	}
+
+	return NULL;
+}
+
+int mptcp_validate_scheduler(struct mptcp_sched_ops *sched)
+{
+	if (!sched->get_subflow) {
+		pr_err("%s does not implement required ops\n", sched->name);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void __mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	list_add_tail_rcu(&sched->list, &mptcp_sched_list);
+	pr_debug("%s registered", sched->name);
+}
+
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	int ret;
+
+	ret = mptcp_validate_scheduler(sched);
+	if (ret)
+		return ret;
+
+	spin_lock(&mptcp_sched_list_lock);
+	if (mptcp_sched_find(sched->name)) {
+		spin_unlock(&mptcp_sched_list_lock);
+		return -EEXIST;
+	}
+	__mptcp_register_scheduler(sched);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_scheduler);
+
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
+{
+	if (sched == &mptcp_sched_default)
+		return;
+
+	spin_lock(&mptcp_sched_list_lock);
+	list_del_rcu(&sched->list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	/* Wait for outstanding readers to complete before the module or the
+	 * struct_ops map gets removed entirely.
+	 */
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_scheduler);
+
+/* Fall back to the default scheduler if @sched is NULL, or going away */
+int mptcp_init_sched(struct mptcp_sock *msk, struct mptcp_sched_ops *sched)
+{
+	if (!sched || !bpf_try_module_get(sched, sched->owner))
+		sched = &mptcp_sched_default;
+
+	msk->sched = sched;
+	if (sched->init)
+		sched->init(msk);
+
+	pr_debug("msk=%p sched=%s", msk, sched->name);
+
+	return 0;
+}
+
+void mptcp_release_sched(struct mptcp_sock *msk)
+{
+	struct mptcp_sched_ops *sched = msk->sched;
+
+	if (!sched)
+		return;
+
+	msk->sched = NULL;
+	if (sched->release)
+		sched->release(msk);
+
+	if (sched != &mptcp_sched_default)
+		bpf_module_put(sched, sched->owner);
+}
+
+void __init mptcp_sched_init(void)
+{
+	__mptcp_register_scheduler(&mptcp_sched_default);
+	__mptcp_register_scheduler(&mptcp_sched_latency);
+}
@@ -65,10 +65,20 @@ EXPORT_SYMBOL_GPL(nf_conntrack_hash);
 
 struct conntrack_gc_work {
 	struct delayed_work	dwork;
+	unsigned int		id;
 	u32			next_bucket;
 	u32			avg_timeout;
 	u32			count;
 	u32			start_time;
+	/* evictions per second, moving average over full passes */
+	u32			expire_rate;
+	/* progress of the pass in flight */
+	u32			scanned;
+	u32			evicted;
+	/* result of the last full pass over this worker's buckets */
+	u32			last_scanned;
+	u32			last_evicted;
+	u32			last_duration;
 	bool			exiting;
 	bool			early_drop;
 };
@@ -96,10 +106,22 @@ static DEFINE_MUTEX(nf_conntrack_mutex);
 #define GC_SCAN_MAX_DURATION	msecs_to_jiffies(10)
 #define GC_SCAN_EXPIRED_MAX	(64000u / HZ)
 
+/* Once entries expire at a measurable rate, aim at finding about this many
+ * expired entries per pass rather than waiting for the timeout average,
+ * but never rescan a bucket range more often than GC_SCAN_INTERVAL_RATE_MIN.
+ */
+#define GC_SCAN_RATE_TARGET		4096u
+#define GC_SCAN_INTERVAL_RATE_MIN	msecs_to_jiffies(20)
+
+/* Each worker owns a contiguous range of at least this many buckets. */
+#define GC_WORKERS_MAX		8
+#define GC_WORKER_MIN_BUCKETS	16384u
+
 #define MIN_CHAINLEN	50u
 #define MAX_CHAINLEN	(80u - MIN_CHAINLEN)
 
-static struct conntrack_gc_work conntrack_gc_work;
+static struct conntrack_gc_work conntrack_gc_work[GC_WORKERS_MAX];
+static unsigned int conntrack_gc_nr_workers __read_mostly = 1;
 
 void nf_conntrack_lock(spinlock_t *lock) __acquires(lock)
 {
@@ -1452,13 +1474,35 @@ static bool gc_worker_can_early_drop(const struct nf_conn *ct)
 	return false;
 }
 
+static void gc_worker_range(const struct conntrack_gc_work *gc_work,
+			    unsigned int hashsz, u32 *first, u32 *last)
+{
+	unsigned int nr = conntrack_gc_nr_workers;
+
+	*first = (u64)hashsz * gc_work->id / nr;
+	*last = (u64)hashsz * (gc_work->id + 1) / nr;
+}
+
+static unsigned long gc_worker_rate_interval(struct conntrack_gc_work *gc_work,
+					     s32 duration)
+{
+	u32 rate = div_u64((u64)gc_work->evicted * HZ, duration);
+
+	gc_work->expire_rate = (gc_work->expire_rate * 3 + rate) / 4;
+	if (!gc_work->expire_rate)
+		return GC_SCAN_INTERVAL_MAX;
+
+	return max_t(unsigned long, GC_SCAN_INTERVAL_RATE_MIN,
+		     GC_SCAN_RATE_TARGET * HZ / gc_work->expire_rate);
+}
+
 static void gc_worker(struct work_struct *work)
 {
-	unsigned int i, hashsz, nf_conntrack_max95 = 0;
-	u32 end_time, start_time = nfct_time_stamp;
+	unsigned int hashsz, nf_conntrack_max95 = 0;
+	u32 i, first, last, end_time, start_time = nfct_time_stamp;
 	struct conntrack_gc_work *gc_work;
 	unsigned int expired_count = 0;
-	unsigned long next_run;
+	unsigned long next_run, rate_run;
 	s32 delta_time;
 	long count;
 
@@ -1472,6 +1516,8 @@ static void gc_worker(struct work_struct *work)
 		gc_work->avg_timeout = GC_SCAN_INTERVAL_INIT;
 		gc_work->count = GC_SCAN_INITIAL_COUNT;
 		gc_work->start_time = start_time;
+		gc_work->scanned = 0;
+		gc_work->evicted = 0;
 	}
 
 	next_run = gc_work->avg_timeout;
@@ -1488,7 +1534,11 @@ static void gc_worker(struct work_struct *work)
 		rcu_read_lock();
 
 		nf_conntrack_get_ht(&ct_hash, &hashsz);
-		if (i >= hashsz) {
+		/* The range moves if the table was resized meanwhile. */
+		gc_worker_range(gc_work, hashsz, &first, &last);
+		if (i < first)
+			i = first;
+		if (i >= last) {
 			rcu_read_unlock();
 			break;
 		}
@@ -1499,6 +1549,7 @@ static void gc_worker(struct work_struct *work)
 			long expires;
 
 			tmp = nf_ct_tuplehash_to_ctrack(h);
+			gc_work->scanned++;
 
 			if (test_bit(IPS_OFFLOAD_BIT, &tmp->status)) {
 				nf_ct_offload_timeout(tmp);
@@ -1523,6 +1574,7 @@ static void gc_worker(struct work_struct *work)
 			if (nf_ct_is_expired(tmp)) {
 				nf_ct_gc_expired(tmp);
 				expired_count++;
+				gc_work->evicted++;
 				continue;
 			}
 
@@ -1553,6 +1605,7 @@ static void gc_worker(struct work_struct *work)
 			if (gc_worker_can_early_drop(tmp)) {
 				nf_ct_kill(tmp);
 				expired_count++;
+				gc_work->evicted++;
 			}
 
 			nf_ct_put(tmp);
@@ -1567,20 +1620,32 @@ static void gc_worker(struct work_struct *work)
 		i++;
 
 		delta_time = nfct_time_stamp - end_time;
-		if (delta_time > 0 && i < hashsz) {
+		if (delta_time > 0 && i < last) {
 			gc_work->avg_timeout = next_run;
 			gc_work->count = count;
 			gc_work->next_bucket = i;
 			next_run = 0;
 			goto early_exit;
 		}
-	} while (i < hashsz);
+	} while (i < last);
 
 	gc_work->next_bucket = 0;
 
 	next_run = clamp(next_run, GC_SCAN_INTERVAL_MIN, GC_SCAN_INTERVAL_MAX);
 
 	delta_time = max_t(s32, nfct_time_stamp - gc_work->start_time, 1);
+
+	WRITE_ONCE(gc_work->last_scanned, gc_work->scanned);
+	WRITE_ONCE(gc_work->last_evicted, gc_work->evicted);
+	WRITE_ONCE(gc_work->last_duration, jiffies_to_msecs(delta_time));
+
+	/* Under churn, pace the next pass by how fast entries expire
+	 * rather than by the average remaining timeout.
+	 */
+	rate_run = gc_worker_rate_interval(gc_work, delta_time);
+	if (rate_run < next_run)
+		next_run = rate_run;
+
 	if (next_run > (unsigned long)delta_time)
 		next_run -= delta_time;
 	else
@@ -1593,15 +1658,73 @@ static void gc_worker(struct work_struct *work)
 	if (next_run)
 		gc_work->early_drop = false;
 
-	queue_delayed_work(system_power_efficient_wq, &gc_work->dwork, next_run);
+	queue_delayed_work(system_unbound_wq, &gc_work->dwork, next_run);
 }
 
-static void conntrack_gc_work_init(struct conntrack_gc_work *gc_work)
+static void conntrack_gc_work_init(struct conntrack_gc_work *gc_work,
+				   unsigned int id)
 {
+	memset(gc_work, 0, sizeof(*gc_work));
 	INIT_DELAYED_WORK(&gc_work->dwork, gc_worker);
-	gc_work->exiting = false;
+	gc_work->id = id;
 }
 
+static void conntrack_gc_work_start(void)
+{
+	unsigned int id;
+
+	conntrack_gc_nr_workers = clamp(nf_conntrack_htable_size / GC_WORKER_MIN_BUCKETS,
+					1u, min_t(unsigned int, GC_WORKERS_MAX,
+						  num_online_cpus()));
+
+	for (id = 0; id < conntrack_gc_nr_workers; id++) {
+		conntrack_gc_work_init(&conntrack_gc_work[id], id);
+		queue_delayed_work(system_unbound_wq,
+				   &conntrack_gc_work[id].dwork, HZ);
+	}
+}
+
+static void conntrack_gc_work_stop(void)
+{
+	unsigned int id;
+
+	for (id = 0; id < conntrack_gc_nr_workers; id++)
+		cancel_delayed_work_sync(&conntrack_gc_work[id].dwork);
+}
+
+static void conntrack_gc_work_early_drop(void)
+{
+	unsigned int id;
+
+	for (id = 0; id < conntrack_gc_nr_workers; id++) {
+		if (!READ_ONCE(conntrack_gc_work[id].early_drop))
+			WRITE_ONCE(conntrack_gc_work[id].early_drop, true);
+	}
+}
+
+/**
+ * nf_conntrack_gc_stats - summarize the last pass of the conntrack gc
+ * @stats: filled with the sum of scanned and evicted entries over all gc
+ *	workers, and the duration of the slowest one in milliseconds
+ */
+void nf_conntrack_gc_stats(struct nf_conntrack_gc_stats *stats)
+{
+	unsigned int id;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->workers = conntrack_gc_nr_workers;
+
+	for (id = 0; id < conntrack_gc_nr_workers; id++) {
+		const struct conntrack_gc_work *gc_work = &conntrack_gc_work[id];
+
+		stats->scanned += READ_ONCE(gc_work->last_scanned);
+		stats->evicted += READ_ONCE(gc_work->last_evicted);
+		stats->duration = max(stats->duration,
+				      READ_ONCE(gc_work->last_duration));
+	}
+}
+EXPORT_SYMBOL_GPL(nf_conntrack_gc_stats);
+
 static struct nf_conn *
 __nf_conntrack_alloc(struct net *net,
 		     const struct nf_conntrack_zone *zone,
@@ -1618,8 +1741,7 @@ __nf_conntrack_alloc(struct net *net,
 
 	if (nf_conntrack_max && unlikely(ct_count > nf_conntrack_max)) {
 		if (!early_drop(net, hash)) {
-			if (!conntrack_gc_work.early_drop)
-				conntrack_gc_work.early_drop = true;
+			conntrack_gc_work_early_drop();
 			atomic_dec(&cnet->count);
 			net_warn_ratelimited("nf_conntrack: table full, dropping packet\n");
 			return ERR_PTR(-ENOMEM);
@@ -2500,14 +2622,17 @@ static int kill_all(struct nf_conn *i, void *data)
 
 void nf_conntrack_cleanup_start(void)
 {
+	unsigned int id;
+
 	cleanup_nf_conntrack_bpf();
-	conntrack_gc_work.exiting = true;
+	for (id = 0; id < conntrack_gc_nr_workers; id++)
+		conntrack_gc_work[id].exiting = true;
 }
 
 void nf_conntrack_cleanup_end(void)
 {
 	RCU_INIT_POINTER(nf_ct_hook, NULL);
-	cancel_delayed_work_sync(&conntrack_gc_work.dwork);
+	conntrack_gc_work_stop();
 	kvfree(nf_conntrack_hash);
 
 	nf_conntrack_proto_fini();
@@ -2726,8 +2851,7 @@ int nf_conntrack_init_start(void)
 	if (ret < 0)
 		goto err_proto;
 
-	conntrack_gc_work_init(&conntrack_gc_work);
-	queue_delayed_work(system_power_efficient_wq, &conntrack_gc_work.dwork, HZ);
+	conntrack_gc_work_start();
 
 	ret = register_nf_conntrack_bpf();
 	if (ret < 0)
@@ -2736,7 +2860,7 @@ int nf_conntrack_init_start(void)
 	return 0;
 
 err_kfunc:
-	cancel_delayed_work_sync(&conntrack_gc_work.dwork);
+	conntrack_gc_work_stop();
 	nf_conntrack_proto_fini();
 err_proto:
 	nf_conntrack_helper_fini();
@@ -547,12 +547,34 @@ nf_conntrack_hash_sysctl(struct ctl_table *table, int write,
 	return ret;
 }
 
+/* workers, scanned, evicted, duration (ms) of the last full gc pass */
+static int nf_conntrack_gc_stats_sysctl(struct ctl_table *table, int write,
+					void *buffer, size_t *lenp, loff_t *ppos)
+{
+	struct nf_conntrack_gc_stats stats;
+	int vals[4];
+	struct ctl_table tmp = {
+		.data	= vals,
+		.maxlen	= sizeof(vals),
+		.mode	= table->mode,
+	};
+
+	nf_conntrack_gc_stats(&stats);
+	vals[0] = stats.workers;
+	vals[1] = min_t(u32, stats.scanned, INT_MAX);
+	vals[2] = min_t(u32, stats.evicted, INT_MAX);
+	vals[3] = min_t(u32, stats.duration, INT_MAX);
+
+	return proc_dointvec(&tmp, write, buffer, lenp, ppos);
+}
+
 static struct ctl_table_header *nf_ct_netfilter_header;
 
 enum nf_ct_sysctl_index {
 	NF_SYSCTL_CT_MAX,
 	NF_SYSCTL_CT_COUNT,
 	NF_SYSCTL_CT_BUCKETS,
+	NF_SYSCTL_CT_GC_STATS,
 	NF_SYSCTL_CT_CHECKSUM,
 	NF_SYSCTL_CT_LOG_INVALID,
 	NF_SYSCTL_CT_EXPECT_MAX,
@@ -642,6 +664,12 @@ static struct ctl_table nf_ct_sysctl_table[] = {
 		.mode           = 0644,
 		.proc_handler   = nf_conntrack_hash_sysctl,
 	},
+	[NF_SYSCTL_CT_GC_STATS] = {
+		.procname	= "nf_conntrack_gc_stats",
+		.maxlen		= 4 * sizeof(int),
+		.mode		= 0444,
+		.proc_handler	= nf_conntrack_gc_stats_sysctl,
+	},
 	[NF_SYSCTL_CT_CHECKSUM] = {
 		.procname	= "nf_conntrack_checksum",
 		.data		= &init_net.ct.sysctl_checksum,
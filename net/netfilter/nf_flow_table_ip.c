@@ -8,10 +8,12 @@
 #include <linux/ipv6.h>
 #include <linux/netdevice.h>
 #include <linux/if_ether.h>
+#include <net/arp.h>
 #include <net/gso.h>
 #include <net/ip.h>
 #include <net/ipv6.h>
 #include <net/ip6_route.h>
+#include <net/ndisc.h>
 #include <net/neighbour.h>
 #include <net/netfilter/nf_flow_table.h>
 #include <net/netfilter/nf_conntrack_acct.h>
@@ -337,11 +339,43 @@ static unsigned int nf_flow_queue_xmit(struct net *net, struct sk_buff *skb,
 	skb->dev = outdev;
 	dev_hard_header(skb, skb->dev, type, tuplehash->tuple.out.h_dest,
 			tuplehash->tuple.out.h_source, skb->len);
-	dev_queue_xmit(skb);
+	dev_queue_xmit_batch(skb);
 
 	return NF_STOLEN;
 }
 
+/* With a resolved neighbour, build the link layer header as
+ * neigh_connected_output() would, and let the packet be transmitted in a burst
+ * with the others forwarded from the same NAPI poll. Anything else goes
+ * through the neighbour output path.
+ */
+static void nf_flow_neigh_xmit(struct sk_buff *skb, struct neighbour *neigh,
+			       int index, const void *nexthop,
+			       unsigned short type)
+{
+	unsigned int seq;
+	int err;
+
+	if (!neigh || !(READ_ONCE(neigh->nud_state) & NUD_CONNECTED)) {
+		neigh_xmit(index, skb->dev, nexthop, skb);
+		return;
+	}
+
+	do {
+		__skb_pull(skb, skb_network_offset(skb));
+		seq = read_seqbegin(&neigh->ha_lock);
+		err = dev_hard_header(skb, skb->dev, type, neigh->ha, NULL,
+				      skb->len);
+	} while (read_seqretry(&neigh->ha_lock, seq));
+
+	if (err < 0) {
+		kfree_skb(skb);
+		return;
+	}
+
+	dev_queue_xmit_batch(skb);
+}
+
 static struct flow_offload_tuple_rhash *
 nf_flow_offload_lookup(struct nf_flowtable_ctx *ctx,
 		       struct nf_flowtable *flow_table, struct sk_buff *skb)
@@ -449,7 +483,10 @@ nf_flow_offload_ip_hook(void *priv, struct sk_buff *skb,
 		skb->dev = outdev;
 		nexthop = rt_nexthop(rt, flow->tuplehash[!dir].tuple.src_v4.s_addr);
 		skb_dst_set_noref(skb, &rt->dst);
-		neigh_xmit(NEIGH_ARP_TABLE, outdev, &nexthop, skb);
+		nf_flow_neigh_xmit(skb,
+				   __ipv4_neigh_lookup_noref(outdev,
+							     (__force u32)nexthop),
+				   NEIGH_ARP_TABLE, &nexthop, ETH_P_IP);
 		ret = NF_STOLEN;
 		break;
 	case FLOW_OFFLOAD_XMIT_DIRECT:
@@ -744,7 +781,11 @@ nf_flow_offload_ipv6_hook(void *priv, struct sk_buff *skb,
 		skb->dev = outdev;
 		nexthop = rt6_nexthop(rt, &flow->tuplehash[!dir].tuple.src_v6);
 		skb_dst_set_noref(skb, &rt->dst);
-		neigh_xmit(NEIGH_ND_TABLE, outdev, nexthop, skb);
+		nf_flow_neigh_xmit(skb,
+				   IS_REACHABLE(CONFIG_IPV6) ?
+				   __ipv6_neigh_lookup_noref(outdev, nexthop) :
+				   NULL,
+				   NEIGH_ND_TABLE, nexthop, ETH_P_IPV6);
 		ret = NF_STOLEN;
 		break;
 	case FLOW_OFFLOAD_XMIT_DIRECT:
@@ -4112,7 +4112,11 @@ static const struct nft_set_type *nft_set_types[] = {
 	&nft_set_bitmap_type,
 	&nft_set_rbtree_type,
 #if defined(CONFIG_X86_64) && !defined(CONFIG_UML)
+	&nft_set_pipapo_avx512_type,
 	&nft_set_pipapo_avx2_type,
+#endif
+#if defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON)
+	&nft_set_pipapo_neon_type,
 #endif
 	&nft_set_pipapo_type,
 };
@@ -9210,7 +9214,7 @@ static int nf_tables_commit_chain_prepare(struct net *net, struct nft_chain *cha
 {
 	const struct nft_expr *expr, *last;
 	struct nft_regs_track track = {};
-	unsigned int size, data_size;
+	unsigned int size, data_size, nmatch;
 	void *data, *data_boundary;
 	struct nft_rule_dp *prule;
 	struct nft_rule *rule;
@@ -9222,7 +9226,9 @@ static int nf_tables_commit_chain_prepare(struct net *net, struct nft_chain *cha
 	data_size = 0;
 	list_for_each_entry(rule, &chain->rules, list) {
 		if (nft_is_active_next(net, rule)) {
-			data_size += sizeof(*prule) + rule->dlen;
+			data_size += sizeof(*prule) + rule->dlen +
+				     nft_rule_dp_match_max(rule) *
+				     sizeof(struct nft_rule_dp_match);
 			if (data_size > INT_MAX)
 				return -ENOMEM;
 		}
@@ -9261,6 +9267,18 @@ static int nf_tables_commit_chain_prepare(struct net *net, struct nft_chain *cha
 			memcpy(data + size, expr, expr->ops->size);
 			size += expr->ops->size;
 		}
+
+		/* Rules are only limited to 1 << 12 bytes of expressions, use
+		 * fewer or no precompiled matches rather than overflow dlen.
+		 */
+		nmatch = min_t(unsigned int, nft_rule_dp_match_max(rule),
+			       ((1 << 12) - 1 - size) /
+			       sizeof(struct nft_rule_dp_match));
+		if (WARN_ON_ONCE(data + size + nmatch * sizeof(struct nft_rule_dp_match) >
+				 data_boundary))
+			return -ENOMEM;
+
+		size += nft_rule_dp_compile(prule, size, nmatch);
 		if (WARN_ON_ONCE(size >= 1 << 12))
 			return -ENOMEM;
 
@@ -242,12 +242,135 @@ static void expr_call_ops_eval(const struct nft_expr *expr,
 
 #define nft_rule_expr_first(rule)	(struct nft_expr *)&rule->data[0]
 #define nft_rule_expr_next(expr)	((void *)expr) + expr->ops->size
-#define nft_rule_expr_last(rule)	(struct nft_expr *)&rule->data[rule->dlen]
+#define nft_rule_expr_last(rule)	\
+	(struct nft_expr *)&rule->data[rule->dlen - \
+				       rule->nmatch * sizeof(struct nft_rule_dp_match)]
 
-#define nft_rule_dp_for_each_expr(expr, last, rule) \
-        for ((expr) = nft_rule_expr_first(rule), (last) = nft_rule_expr_last(rule); \
-             (expr) != (last); \
-             (expr) = nft_rule_expr_next(expr))
+/**
+ *	nft_rule_dp_match_max - upper bound of precompiled matches for a rule
+ *
+ *	@rule: rule about to be copied into the datapath blob
+ *
+ *	Every match consumes one fast payload expression, so their number
+ *	bounds what nft_rule_dp_compile() can emit even after register
+ *	tracking has elided some of the expressions.
+ */
+unsigned int nft_rule_dp_match_max(const struct nft_rule *rule)
+{
+	const struct nft_expr *expr, *last;
+	unsigned int n = 0;
+
+	nft_rule_for_each_expr(expr, last, rule) {
+		if (expr->ops == &nft_payload_fast_ops)
+			n++;
+	}
+
+	return min_t(unsigned int, n, NFT_RULE_DP_MATCH_MAX);
+}
+
+/**
+ *	nft_rule_dp_compile - lower leading payload/cmp pairs of a rule
+ *
+ *	@prule: rule in the datapath blob, expressions already copied
+ *	@size: length of the copied expressions
+ *	@max: room for this many matches was reserved after the expressions
+ *
+ *	Turns the leading run of fast payload loads that are immediately
+ *	compared by a fast cmp on the same register into struct
+ *	nft_rule_dp_match entries stored after the expressions.  nft_do_chain()
+ *	evaluates those with a single direct check each and skips the rule
+ *	without dispatching any expression when one of them does not match.
+ *	Anything else is left to the expression interpreter.
+ *
+ *	Returns the number of bytes appended to the rule data.
+ */
+unsigned int nft_rule_dp_compile(struct nft_rule_dp *prule, unsigned int size,
+				 unsigned int max)
+{
+	struct nft_rule_dp_match *match = (void *)prule->data + size;
+	const struct nft_expr *expr = (void *)prule->data;
+	const struct nft_expr *last = (void *)prule->data + size;
+	unsigned int n = 0;
+
+	while (expr != last && n < max) {
+		const struct nft_expr *next = nft_expr_next(expr);
+		const struct nft_cmp_fast_expr *cmp;
+		const struct nft_payload *payload;
+
+		if (expr->ops != &nft_payload_fast_ops ||
+		    next == last || next->ops != &nft_cmp_fast_ops)
+			break;
+
+		payload = nft_expr_priv(expr);
+		cmp = nft_expr_priv(next);
+		if (cmp->sreg != payload->dreg)
+			break;
+
+		expr = nft_expr_next(next);
+
+		match[n].base	= payload->base;
+		match[n].len	= payload->len;
+		match[n].dreg	= payload->dreg;
+		match[n].inv	= cmp->inv;
+		match[n].offset	= payload->offset;
+		match[n].next	= (void *)expr - (void *)prule->data;
+		match[n].mask	= cmp->mask;
+		match[n].data	= cmp->data;
+		n++;
+	}
+
+	prule->nmatch = n;
+
+	return n * sizeof(*match);
+}
+
+/* Evaluate the precompiled matches of @rule.  Returns false if the rule
+ * cannot match.  Otherwise *expr is set to the first expression that
+ * still needs to be interpreted: past all covered expressions if every
+ * match succeeded, or the payload expression of the match that could not
+ * be evaluated from the linear area.
+ */
+static bool nft_rule_dp_match_eval(const struct nft_rule_dp *rule,
+				   const struct nft_expr *last,
+				   struct nft_regs *regs,
+				   const struct nft_pktinfo *pkt,
+				   const struct nft_expr **expr)
+{
+	const struct nft_rule_dp_match *match = (const void *)last;
+	const struct sk_buff *skb = pkt->skb;
+	unsigned int i;
+
+	for (i = 0; i < rule->nmatch; i++) {
+		u32 *dest = &regs->data[match[i].dreg];
+		unsigned char *ptr;
+
+		ptr = skb_network_header(skb);
+		if (match[i].base != NFT_PAYLOAD_NETWORK_HEADER) {
+			if (!(pkt->flags & NFT_PKTINFO_L4PROTO))
+				goto interpret;
+			ptr += nft_thoff(pkt);
+		}
+
+		ptr += match[i].offset;
+		if (unlikely(ptr + match[i].len > skb_tail_pointer(skb)))
+			goto interpret;
+
+		*dest = 0;
+		if (match[i].len == 2)
+			*(u16 *)dest = *(u16 *)ptr;
+		else if (match[i].len == 4)
+			*(u32 *)dest = *(u32 *)ptr;
+		else
+			*(u8 *)dest = *(u8 *)ptr;
+
+		if (!(((*dest & match[i].mask) == match[i].data) ^ match[i].inv))
+			return false;
+	}
+interpret:
+	if (i)
+		*expr = (const void *)rule->data + match[i - 1].next;
+	return true;
+}
 
 unsigned int
 nft_do_chain(struct nft_pktinfo *pkt, void *priv)
@@ -276,7 +399,16 @@ nft_do_chain(struct nft_pktinfo *pkt, void *priv)
 next_rule:
 	regs.verdict.code = NFT_CONTINUE;
 	for (; !rule->is_last ; rule = nft_rule_next(rule)) {
-		nft_rule_dp_for_each_expr(expr, last, rule) {
+		expr = nft_rule_expr_first(rule);
+		last = nft_rule_expr_last(rule);
+
+		if (rule->nmatch &&
+		    !nft_rule_dp_match_eval(rule, last, &regs, pkt, &expr)) {
+			nft_trace_copy_nftrace(pkt, &info);
+			continue;
+		}
+
+		for (; expr != last; expr = nft_rule_expr_next(expr)) {
 			if (expr->ops == &nft_cmp_fast_ops)
 				nft_cmp_fast_eval(expr, &regs);
 			else if (expr->ops == &nft_cmp16_fast_ops)
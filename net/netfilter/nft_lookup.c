@@ -42,6 +42,8 @@ bool nft_set_do_lookup(const struct net *net, const struct nft_set *set,
 	if (set->ops == &nft_set_pipapo_type.ops)
 		return nft_pipapo_lookup(net, set, key, ext);
 #if defined(CONFIG_X86_64) && !defined(CONFIG_UML)
+	if (set->ops == &nft_set_pipapo_avx512_type.ops)
+		return nft_pipapo_avx512_lookup(net, set, key, ext);
 	if (set->ops == &nft_set_pipapo_avx2_type.ops)
 		return nft_pipapo_avx2_lookup(net, set, key, ext);
 #endif
@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: AVX-512 packet lookup routines
+ *
+ * Bucket intersection is done 512 bits at a time, with the remainder of a
+ * bucket handled by a masked load and store, so that no separate code path is
+ * needed for any given amount of groups or bucket size. Result bitmaps are then
+ * scanned by the same pipapo_refill() used by the generic implementation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <uapi/linux/netfilter/nf_tables.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+
+#include <linux/compiler.h>
+#include <asm/fpu/api.h>
+#include <asm/fpu/xstate.h>
+
+#include "nft_set_pipapo_avx2.h"
+#include "nft_set_pipapo_avx512.h"
+#include "nft_set_pipapo.h"
+
+#define NFT_PIPAPO_LONGS_PER_M512	(512 / BITS_PER_LONG)
+
+/* Maximum number of groups in a single field: 16 bytes, 4-bit groups */
+#define NFT_PIPAPO_AVX512_GROUPS_MAX	(NFT_PIPAPO_MAX_BYTES * 2)
+
+/* Load 512 bits from memory into ZMM register. Bucket rows aren't aligned to
+ * 64 bytes, so this can't use the non-temporal loads of the AVX2 version.
+ */
+#define NFT_PIPAPO_AVX512_LOAD(reg, loc)				\
+	asm volatile("vmovdqu64 %0, %%zmm" #reg : : "m" (loc))
+
+/* Same, loading only longs selected by the k1 mask, zeroing the others */
+#define NFT_PIPAPO_AVX512_LOAD_MASKED(reg, loc)				\
+	asm volatile("vmovdqu64 %0, %%zmm" #reg "%{%%k1%}%{z%}" : : "m" (loc))
+
+/* Bitwise AND of two ZMM registers */
+#define NFT_PIPAPO_AVX512_AND(dst, a, b)				\
+	asm volatile("vpandq %zmm" #a ", %zmm" #b ", %zmm" #dst)
+
+/* Store 512 bits from ZMM register into memory */
+#define NFT_PIPAPO_AVX512_STORE(loc, reg)				\
+	asm volatile("vmovdqu64 %%zmm" #reg ", %0" : "=m" (loc))
+
+/* Same, storing only longs selected by the k1 mask */
+#define NFT_PIPAPO_AVX512_STORE_MASKED(loc, reg)			\
+	asm volatile("vmovdqu64 %%zmm" #reg ", %0%{%%k1%}" : "=m" (loc))
+
+/* Set k1 to select the first @n longs of a ZMM register */
+#define NFT_PIPAPO_AVX512_MASK(n)					\
+	asm volatile("kmovw %0, %%k1" : : "r" ((u32)GENMASK((n) - 1, 0)))
+
+/* Current working bitmap index, toggled between field matches */
+static DEFINE_PER_CPU(bool, nft_pipapo_avx512_scratch_index);
+
+/**
+ * nft_pipapo_avx512_and() - Intersect buckets selected by packet data
+ * @res:	Result bitmap, also input for all fields but the first one
+ * @f:		Field including lookup table
+ * @data:	Packet data for this field
+ * @first:	If this is the first field, @res is overwritten, not intersected
+ *
+ * Bucket addresses for all groups are computed upfront, then each 512-bit
+ * slice of the result is obtained in a single pass over all the buckets,
+ * instead of a full pass over the result bitmap for each group.
+ */
+static void nft_pipapo_avx512_and(unsigned long *res,
+				  const struct nft_pipapo_field *f,
+				  const u8 *data, bool first)
+{
+	const unsigned long *bkt[NFT_PIPAPO_AVX512_GROUPS_MAX];
+	unsigned long *lt = NFT_PIPAPO_LT_ALIGN(f->lt);
+	int g, i, rem, step = f->bsize * NFT_PIPAPO_BUCKETS(f->bb);
+
+	if (likely(f->bb == 8)) {
+		for (g = 0; g < f->groups; g++, lt += step)
+			bkt[g] = lt + data[g] * f->bsize;
+	} else {
+		for (g = 0; g < f->groups; g++, lt += step) {
+			u8 v = data[g / 2];
+
+			v = (g % 2) ? v & 0x0f : v >> 4;
+			bkt[g] = lt + v * f->bsize;
+		}
+	}
+	NFT_PIPAPO_GROUP_BITS_ARE_8_OR_4;
+
+	for (i = 0; i + NFT_PIPAPO_LONGS_PER_M512 <= f->bsize;
+	     i += NFT_PIPAPO_LONGS_PER_M512) {
+		NFT_PIPAPO_AVX512_LOAD(0, bkt[0][i]);
+		for (g = 1; g < f->groups; g++) {
+			NFT_PIPAPO_AVX512_LOAD(1, bkt[g][i]);
+			NFT_PIPAPO_AVX512_AND(0, 0, 1);
+		}
+		if (!first) {
+			NFT_PIPAPO_AVX512_LOAD(1, res[i]);
+			NFT_PIPAPO_AVX512_AND(0, 0, 1);
+		}
+		NFT_PIPAPO_AVX512_STORE(res[i], 0);
+	}
+
+	rem = f->bsize - i;
+	if (!rem)
+		return;
+
+	NFT_PIPAPO_AVX512_MASK(rem);
+	NFT_PIPAPO_AVX512_LOAD_MASKED(0, bkt[0][i]);
+	for (g = 1; g < f->groups; g++) {
+		NFT_PIPAPO_AVX512_LOAD_MASKED(1, bkt[g][i]);
+		NFT_PIPAPO_AVX512_AND(0, 0, 1);
+	}
+	if (!first) {
+		NFT_PIPAPO_AVX512_LOAD_MASKED(1, res[i]);
+		NFT_PIPAPO_AVX512_AND(0, 0, 1);
+	}
+	NFT_PIPAPO_AVX512_STORE_MASKED(res[i], 0);
+}
+
+/**
+ * nft_pipapo_avx512_estimate() - Set size, space and lookup complexity
+ * @desc:	Set description, element count and field description used
+ * @features:	Flags: NFT_SET_INTERVAL needs to be there
+ * @est:	Storage for estimation data
+ *
+ * This set type is listed before the AVX2 one, so that it's picked on CPUs
+ * where the AVX-512 state is available, and skipped otherwise.
+ *
+ * Return: true if set is compatible and AVX-512 available, false otherwise.
+ */
+bool nft_pipapo_avx512_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est)
+{
+	if (!(features & NFT_SET_INTERVAL) ||
+	    desc->field_count < NFT_PIPAPO_MIN_FIELDS)
+		return false;
+
+	if (!boot_cpu_has(X86_FEATURE_AVX512F) ||
+	    !cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM |
+			       XFEATURE_MASK_AVX512, NULL))
+		return false;
+
+	est->size = pipapo_estimate_size(desc);
+	if (!est->size)
+		return false;
+
+	est->lookup = NFT_SET_CLASS_O_LOG_N;
+
+	est->space = NFT_SET_CLASS_O_N;
+
+	return true;
+}
+
+/**
+ * nft_pipapo_avx512_lookup() - Lookup function for AVX-512 implementation
+ * @net:	Network namespace
+ * @set:	nftables API set representation
+ * @key:	nftables API element representation containing key data
+ * @ext:	nftables API extension pointer, filled with matching reference
+ *
+ * For more details, see DOC: Theory of Operation in nft_set_pipapo.c.
+ *
+ * Return: true on match, false otherwise.
+ */
+bool nft_pipapo_avx512_lookup(const struct net *net, const struct nft_set *set,
+			      const u32 *key, const struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	unsigned long *res, *fill, *scratch;
+	u8 genmask = nft_genmask_cur(net);
+	const u8 *rp = (const u8 *)key;
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	bool map_index;
+	int i, b = -1;
+
+	if (unlikely(!irq_fpu_usable()))
+		return nft_pipapo_lookup(net, set, key, ext);
+
+	m = rcu_dereference(priv->match);
+
+	/* This also protects access to all data related to scratch maps, see
+	 * nft_pipapo_avx2_lookup().
+	 */
+	kernel_fpu_begin_mask(0);
+
+	scratch = *raw_cpu_ptr(m->scratch_aligned);
+	if (unlikely(!scratch)) {
+		kernel_fpu_end();
+		return false;
+	}
+	map_index = raw_cpu_read(nft_pipapo_avx512_scratch_index);
+
+	res  = scratch + (map_index ? m->bsize_max : 0);
+	fill = scratch + (map_index ? 0 : m->bsize_max);
+
+	nft_pipapo_for_each_field(f, i, m) {
+		bool last = i == m->field_count - 1;
+
+		nft_pipapo_avx512_and(res, f, rp, !i);
+
+next_match:
+		b = pipapo_refill(res, f->bsize, f->rules, fill, f->mt, last);
+		if (b < 0)
+			break;
+
+		if (last) {
+			*ext = &f->mt[b].e->ext;
+			if (unlikely(nft_set_elem_expired(*ext) ||
+				     !nft_set_elem_active(*ext, genmask)))
+				goto next_match;
+
+			break;
+		}
+
+		/* res is clean now, and becomes the next fill bitmap */
+		map_index = !map_index;
+		swap(res, fill);
+		rp += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
+	}
+
+	raw_cpu_write(nft_pipapo_avx512_scratch_index, map_index);
+	kernel_fpu_end();
+
+	return b >= 0;
+}
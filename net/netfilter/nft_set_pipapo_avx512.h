@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef _NFT_SET_PIPAPO_AVX512_H
+#define _NFT_SET_PIPAPO_AVX512_H
+
+#if defined(CONFIG_X86_64) && !defined(CONFIG_UML)
+bool nft_pipapo_avx512_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est);
+#endif /* defined(CONFIG_X86_64) && !defined(CONFIG_UML) */
+
+#endif /* _NFT_SET_PIPAPO_AVX512_H */
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: arm64 NEON packet lookup routines
+ *
+ * Bucket addresses for all the groups of a field are resolved here, and
+ * intersected 128 bits at a time by nft_pipapo_neon_and(), which lives in
+ * nft_set_pipapo_neon_inner.c as it's built with NEON intrinsics enabled.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <uapi/linux/netfilter/nf_tables.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+
+#include <asm/cpufeature.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+
+#include "nft_set_pipapo.h"
+#include "nft_set_pipapo_neon.h"
+
+/* Maximum number of groups in a single field: 16 bytes, 4-bit groups */
+#define NFT_PIPAPO_NEON_GROUPS_MAX	(NFT_PIPAPO_MAX_BYTES * 2)
+
+/* Current working bitmap index, toggled between field matches */
+static DEFINE_PER_CPU(bool, nft_pipapo_neon_scratch_index);
+
+/**
+ * nft_pipapo_neon_buckets() - Resolve buckets selected by packet data
+ * @f:		Field including lookup table
+ * @data:	Packet data for this field
+ * @bkt:	Filled with one bucket address for each group
+ */
+static void nft_pipapo_neon_buckets(const struct nft_pipapo_field *f,
+				    const u8 *data, const unsigned long **bkt)
+{
+	int g, step = f->bsize * NFT_PIPAPO_BUCKETS(f->bb);
+	const unsigned long *lt = NFT_PIPAPO_LT_ALIGN(f->lt);
+
+	if (likely(f->bb == 8)) {
+		for (g = 0; g < f->groups; g++, lt += step)
+			bkt[g] = lt + data[g] * f->bsize;
+	} else {
+		for (g = 0; g < f->groups; g++, lt += step) {
+			u8 v = data[g / 2];
+
+			v = (g % 2) ? v & 0x0f : v >> 4;
+			bkt[g] = lt + v * f->bsize;
+		}
+	}
+	NFT_PIPAPO_GROUP_BITS_ARE_8_OR_4;
+}
+
+/**
+ * nft_pipapo_neon_estimate() - Set size, space and lookup complexity
+ * @desc:	Set description, element count and field description used
+ * @features:	Flags: NFT_SET_INTERVAL needs to be there
+ * @est:	Storage for estimation data
+ *
+ * Return: true if set is compatible and Advanced SIMD available, false
+ *	   otherwise.
+ */
+bool nft_pipapo_neon_estimate(const struct nft_set_desc *desc, u32 features,
+			      struct nft_set_estimate *est)
+{
+	if (!(features & NFT_SET_INTERVAL) ||
+	    desc->field_count < NFT_PIPAPO_MIN_FIELDS)
+		return false;
+
+	if (!cpu_have_named_feature(ASIMD))
+		return false;
+
+	est->size = pipapo_estimate_size(desc);
+	if (!est->size)
+		return false;
+
+	est->lookup = NFT_SET_CLASS_O_LOG_N;
+
+	est->space = NFT_SET_CLASS_O_N;
+
+	return true;
+}
+
+/**
+ * nft_pipapo_neon_lookup() - Lookup function for NEON implementation
+ * @net:	Network namespace
+ * @set:	nftables API set representation
+ * @key:	nftables API element representation containing key data
+ * @ext:	nftables API extension pointer, filled with matching reference
+ *
+ * For more details, see DOC: Theory of Operation in nft_set_pipapo.c.
+ *
+ * Return: true on match, false otherwise.
+ */
+bool nft_pipapo_neon_lookup(const struct net *net, const struct nft_set *set,
+			    const u32 *key, const struct nft_set_ext **ext)
+{
+	const unsigned long *bkt[NFT_PIPAPO_NEON_GROUPS_MAX];
+	struct nft_pipapo *priv = nft_set_priv(set);
+	unsigned long *res, *fill, *scratch;
+	u8 genmask = nft_genmask_cur(net);
+	const u8 *rp = (const u8 *)key;
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	bool map_index;
+	int i, b = -1;
+
+	if (unlikely(!may_use_simd()))
+		return nft_pipapo_lookup(net, set, key, ext);
+
+	m = rcu_dereference(priv->match);
+
+	/* Disables preemption and softirqs: this also protects access to all
+	 * data related to scratch maps.
+	 */
+	kernel_neon_begin();
+
+	scratch = *raw_cpu_ptr(m->scratch);
+	if (unlikely(!scratch)) {
+		kernel_neon_end();
+		return false;
+	}
+	map_index = raw_cpu_read(nft_pipapo_neon_scratch_index);
+
+	res  = scratch + (map_index ? m->bsize_max : 0);
+	fill = scratch + (map_index ? 0 : m->bsize_max);
+
+	nft_pipapo_for_each_field(f, i, m) {
+		bool last = i == m->field_count - 1;
+
+		nft_pipapo_neon_buckets(f, rp, bkt);
+		nft_pipapo_neon_and(res, bkt, f->groups, f->bsize, !i);
+
+next_match:
+		b = pipapo_refill(res, f->bsize, f->rules, fill, f->mt, last);
+		if (b < 0)
+			break;
+
+		if (last) {
+			*ext = &f->mt[b].e->ext;
+			if (unlikely(nft_set_elem_expired(*ext) ||
+				     !nft_set_elem_active(*ext, genmask)))
+				goto next_match;
+
+			break;
+		}
+
+		/* res is clean now, and becomes the next fill bitmap */
+		map_index = !map_index;
+		swap(res, fill);
+		rp += NFT_PIPAPO_GROUPS_PADDED_SIZE(f);
+	}
+
+	raw_cpu_write(nft_pipapo_neon_scratch_index, map_index);
+	kernel_neon_end();
+
+	return b >= 0;
+}
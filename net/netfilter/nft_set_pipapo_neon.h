@@ -0,0 +1,8 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef _NFT_SET_PIPAPO_NEON_H
+#define _NFT_SET_PIPAPO_NEON_H
+
+void nft_pipapo_neon_and(unsigned long *res, const unsigned long * const *bkt,
+			 int groups, int bsize, int first);
+
+#endif /* _NFT_SET_PIPAPO_NEON_H */
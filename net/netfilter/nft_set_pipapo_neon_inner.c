@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: NEON bucket intersection
+ *
+ * Built with NEON intrinsics enabled, hence kept apart from the rest of the
+ * implementation: it must only be called between kernel_neon_begin() and
+ * kernel_neon_end().
+ */
+
+#include <asm/neon-intrinsics.h>
+
+#include "nft_set_pipapo_neon.h"
+
+/**
+ * nft_pipapo_neon_and() - Intersect buckets into result bitmap
+ * @res:	Result bitmap, also input if @first is not set
+ * @bkt:	Bucket selected by packet data, for each group
+ * @groups:	Count of groups, and of buckets in @bkt
+ * @bsize:	Size of buckets and of @res, in longs
+ * @first:	Overwrite @res instead of intersecting it with the buckets
+ *
+ * Four 128-bit accumulators are kept in flight per iteration, so that loads
+ * from different buckets overlap, then pairs of longs, then a scalar tail, as
+ * bucket sizes are not padded on this architecture.
+ */
+void nft_pipapo_neon_and(unsigned long *res, const unsigned long * const *bkt,
+			 int groups, int bsize, int first)
+{
+	uint64_t *r = (uint64_t *)res;
+	int g, i = 0;
+
+	for (; i + 8 <= bsize; i += 8) {
+		const uint64_t *p = (const uint64_t *)bkt[0] + i;
+		uint64x2_t a0 = vld1q_u64(p), a1 = vld1q_u64(p + 2);
+		uint64x2_t a2 = vld1q_u64(p + 4), a3 = vld1q_u64(p + 6);
+
+		for (g = 1; g < groups; g++) {
+			p = (const uint64_t *)bkt[g] + i;
+
+			a0 = vandq_u64(a0, vld1q_u64(p));
+			a1 = vandq_u64(a1, vld1q_u64(p + 2));
+			a2 = vandq_u64(a2, vld1q_u64(p + 4));
+			a3 = vandq_u64(a3, vld1q_u64(p + 6));
+		}
+
+		if (!first) {
+			a0 = vandq_u64(a0, vld1q_u64(r + i));
+			a1 = vandq_u64(a1, vld1q_u64(r + i + 2));
+			a2 = vandq_u64(a2, vld1q_u64(r + i + 4));
+			a3 = vandq_u64(a3, vld1q_u64(r + i + 6));
+		}
+
+		vst1q_u64(r + i, a0);
+		vst1q_u64(r + i + 2, a1);
+		vst1q_u64(r + i + 4, a2);
+		vst1q_u64(r + i + 6, a3);
+	}
+
+	for (; i + 2 <= bsize; i += 2) {
+		uint64x2_t a = vld1q_u64((const uint64_t *)bkt[0] + i);
+
+		for (g = 1; g < groups; g++)
+			a = vandq_u64(a, vld1q_u64((const uint64_t *)bkt[g] + i));
+
+		if (!first)
+			a = vandq_u64(a, vld1q_u64(r + i));
+
+		vst1q_u64(r + i, a);
+	}
+
+	for (; i < bsize; i++) {
+		uint64_t v = bkt[0][i];
+
+		for (g = 1; g < groups; g++)
+			v &= bkt[g][i];
+
+		r[i] = first ? v : v & r[i];
+	}
+}
@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: KUnit tests for lookup implementations
+ *
+ * Sets with an "ipv4_addr . inet_service" concatenation are filled with
+ * non-overlapping address ranges, then the same pseudo-random keys, half of
+ * them matching, are looked up with every implementation usable on this CPU.
+ * Results must be the same as the ones from the generic implementation, and
+ * lookup rates are reported for comparison.
+ */
+
+#include <kunit/test.h>
+#include <kunit/visibility.h>
+#include <linux/bottom_half.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <net/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
+
+#define NFT_PIPAPO_TEST_KEYS		4096
+#define NFT_PIPAPO_TEST_LOOKUPS		(1 << 16)
+
+/* Key layout: IPv4 address, then port padded to 32 bits */
+#define NFT_PIPAPO_TEST_KLEN		8
+
+static const struct nft_set_type *nft_pipapo_test_types[] = {
+	&nft_set_pipapo_type,
+#if defined(CONFIG_X86_64) && !defined(CONFIG_UML)
+	&nft_set_pipapo_avx2_type,
+	&nft_set_pipapo_avx512_type,
+#endif
+#if defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON)
+	&nft_set_pipapo_neon_type,
+#endif
+};
+
+static const char * const nft_pipapo_test_names[] = {
+	"generic",
+#if defined(CONFIG_X86_64) && !defined(CONFIG_UML)
+	"avx2",
+	"avx512",
+#endif
+#if defined(CONFIG_ARM64) && defined(CONFIG_KERNEL_MODE_NEON)
+	"neon",
+#endif
+};
+
+static const struct nft_set_desc nft_pipapo_test_desc = {
+	.klen		= NFT_PIPAPO_TEST_KLEN,
+	.field_len	= { sizeof(__be32), sizeof(__be16) },
+	.field_count	= 2,
+};
+
+static void nft_pipapo_test_key(u32 *key, u32 addr, u16 port)
+{
+	__be32 a = htonl(addr);
+	__be16 p = htons(port);
+
+	memset(key, 0, NFT_PIPAPO_TEST_KLEN);
+	memcpy(key, &a, sizeof(a));
+	memcpy(key + 1, &p, sizeof(p));
+}
+
+/* Entry @i: 10.0.0.0 + 4 * @i to 10.0.0.0 + 4 * @i + 3, port 1024 + @i % 1024 */
+static void nft_pipapo_test_entry(u32 *start, u32 *end, unsigned int i)
+{
+	nft_pipapo_test_key(start, 0x0a000000 + i * 4, 1024 + i % 1024);
+	nft_pipapo_test_key(end, 0x0a000000 + i * 4 + 3, 1024 + i % 1024);
+}
+
+/* Sets are only handled through the operations of the generic type, so
+ * that this test doesn't depend on the internals of nft_set_pipapo.c.
+ */
+static const struct nft_set_ops *nft_pipapo_test_ops = &nft_set_pipapo_type.ops;
+
+static struct nft_set *nft_pipapo_test_set(struct kunit *test,
+					   unsigned int entries)
+{
+	const struct nft_set_ops *ops = nft_pipapo_test_ops;
+	struct nft_set_ext_tmpl tmpl;
+	struct nft_set *set;
+	unsigned int i;
+	int err;
+
+	set = kunit_kzalloc(test, sizeof(*set) +
+			    ops->privsize(NULL, &nft_pipapo_test_desc),
+			    GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, set);
+
+	write_pnet(&set->net, &init_net);
+	set->ops = ops;
+	set->klen = NFT_PIPAPO_TEST_KLEN;
+	set->field_count = nft_pipapo_test_desc.field_count;
+	memcpy(set->field_len, nft_pipapo_test_desc.field_len,
+	       sizeof(set->field_len));
+	/* Don't let commits run garbage collection, there's no transaction
+	 * to queue expired elements to.
+	 */
+	set->gc_int = U32_MAX;
+
+	err = ops->init(set, &nft_pipapo_test_desc, NULL);
+	KUNIT_ASSERT_EQ(test, err, 0);
+	ops->gc_init(set);
+
+	nft_set_ext_prepare(&tmpl);
+	nft_set_ext_add_length(&tmpl, NFT_SET_EXT_KEY, set->klen);
+	nft_set_ext_add_length(&tmpl, NFT_SET_EXT_KEY_END, set->klen);
+
+	for (i = 0; i < entries; i++) {
+		struct nft_set_elem elem = { 0 };
+		struct nft_set_ext *ext, *ext2;
+		void *e;
+
+		e = kzalloc(ops->elemsize + tmpl.len, GFP_KERNEL);
+		if (!e) {
+			err = -ENOMEM;
+			break;
+		}
+
+		ext = nft_set_elem_ext(set, e);
+		nft_set_ext_init(ext, &tmpl);
+		nft_pipapo_test_entry(elem.key.val.data,
+				      elem.key_end.val.data, i);
+		memcpy(nft_set_ext_key(ext), elem.key.val.data, set->klen);
+		memcpy(nft_set_ext_key_end(ext), elem.key_end.val.data,
+		       set->klen);
+
+		elem.priv = e;
+		err = ops->insert(&init_net, set, &elem, &ext2);
+		if (err) {
+			kfree(e);
+			break;
+		}
+	}
+
+	ops->commit(set);
+
+	if (err) {
+		struct nft_ctx ctx = { .net = &init_net };
+
+		ops->destroy(&ctx, set);
+		KUNIT_FAIL(test, "insertion of entry %u failed: %d", i, err);
+		return NULL;
+	}
+
+	return set;
+}
+
+static void nft_pipapo_test_lookup(struct kunit *test, unsigned int entries)
+{
+	const struct nft_set_ext *ext, **ref;
+	struct nft_ctx ctx = { .net = &init_net };
+	struct nft_set_estimate est;
+	unsigned int i, t, hits;
+	struct nft_set *set;
+	u32 (*keys)[2];
+	bool found;
+
+	keys = kunit_kmalloc_array(test, NFT_PIPAPO_TEST_KEYS, sizeof(*keys),
+				   GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, keys);
+
+	ref = kunit_kcalloc(test, NFT_PIPAPO_TEST_KEYS, sizeof(*ref),
+			    GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ref);
+
+	for (i = 0; i < NFT_PIPAPO_TEST_KEYS; i++) {
+		unsigned int n = get_random_u32_below(entries);
+		u32 addr = 0x0a000000 + n * 4 + get_random_u32_below(4);
+		u16 port = 1024 + n % 1024;
+
+		/* Every other key has a port not matching its address range */
+		if (i % 2)
+			port += 1 + get_random_u32_below(1023);
+
+		nft_pipapo_test_key(keys[i], addr, port);
+	}
+
+	set = nft_pipapo_test_set(test, entries);
+	if (!set)
+		return;
+
+	/* Lookups run from the packet path: BHs off, under RCU */
+	local_bh_disable();
+	rcu_read_lock();
+	for (i = 0, hits = 0; i < NFT_PIPAPO_TEST_KEYS; i++) {
+		if (nft_pipapo_test_ops->lookup(&init_net, set, keys[i],
+						&ref[i]))
+			hits++;
+		else
+			ref[i] = NULL;
+	}
+	rcu_read_unlock();
+	local_bh_enable();
+
+	KUNIT_EXPECT_EQ(test, hits, NFT_PIPAPO_TEST_KEYS / 2);
+
+	for (t = 0; t < ARRAY_SIZE(nft_pipapo_test_types); t++) {
+		const struct nft_set_ops *ops = &nft_pipapo_test_types[t]->ops;
+		u64 start, elapsed;
+
+		if (!ops->estimate(&nft_pipapo_test_desc, NFT_SET_INTERVAL,
+				   &est)) {
+			kunit_info(test, "%s: not usable, skipped",
+				   nft_pipapo_test_names[t]);
+			continue;
+		}
+
+		local_bh_disable();
+		rcu_read_lock();
+		for (i = 0; i < NFT_PIPAPO_TEST_KEYS; i++) {
+			ext = NULL;
+			found = ops->lookup(&init_net, set, keys[i], &ext);
+			KUNIT_EXPECT_EQ(test, found, !!ref[i]);
+			if (found)
+				KUNIT_EXPECT_PTR_EQ(test, ext, ref[i]);
+		}
+
+		start = ktime_get_ns();
+		for (i = 0; i < NFT_PIPAPO_TEST_LOOKUPS; i++)
+			ops->lookup(&init_net, set,
+				    keys[i % NFT_PIPAPO_TEST_KEYS], &ext);
+		elapsed = ktime_get_ns() - start;
+		rcu_read_unlock();
+		local_bh_enable();
+
+		kunit_info(test, "%s: %u entries: %llu lookups/s",
+			   nft_pipapo_test_names[t], entries,
+			   div64_u64((u64)NFT_PIPAPO_TEST_LOOKUPS * NSEC_PER_SEC,
+				     elapsed ? : 1));
+	}
+
+	nft_pipapo_test_ops->destroy(&ctx, set);
+}
+
+static void nft_pipapo_test_1k(struct kunit *test)
+{
+	nft_pipapo_test_lookup(test, 1024);
+}
+
+static void nft_pipapo_test_16k(struct kunit *test)
+{
+	nft_pipapo_test_lookup(test, 16384);
+}
+
+static void nft_pipapo_test_64k(struct kunit *test)
+{
+	nft_pipapo_test_lookup(test, 65536);
+}
+
+static struct kunit_case nft_pipapo_test_cases[] = {
+	KUNIT_CASE(nft_pipapo_test_1k),
+	KUNIT_CASE_SLOW(nft_pipapo_test_16k),
+	KUNIT_CASE_SLOW(nft_pipapo_test_64k),
+	{}
+};
+
+static struct kunit_suite nft_pipapo_test_suite = {
+	.name = "nft-set-pipapo",
+	.test_cases = nft_pipapo_test_cases,
+};
+
+kunit_test_suite(nft_pipapo_test_suite);
+
+MODULE_DESCRIPTION("KUnit tests for the nf_tables pipapo set lookups");
+MODULE_LICENSE("GPL");
@@ -42,6 +42,8 @@
 #define MC_HASH_SHIFT		8
 #define MC_HASH_SEGS		((sizeof(uint32_t) * 8) / MC_HASH_SHIFT)
 
+#define MICROFLOW_CACHE_ENTRIES	1024
+
 static struct kmem_cache *flow_cache;
 struct kmem_cache *flow_stats_cache __read_mostly;
 
@@ -421,9 +423,16 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	if (!mc)
 		return -ENOMEM;
 
+	table->microflow_cache = __alloc_percpu(
+		array_size(sizeof(struct microflow_cache_entry),
+			   MICROFLOW_CACHE_ENTRIES),
+		__alignof__(struct microflow_cache_entry));
+	if (!table->microflow_cache)
+		goto free_mask_cache;
+
 	ma = tbl_mask_array_alloc(MASK_ARRAY_SIZE_MIN);
 	if (!ma)
-		goto free_mask_cache;
+		goto free_microflow_cache;
 
 	ti = table_instance_alloc(TBL_MIN_BUCKETS);
 	if (!ti)
@@ -437,6 +446,7 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	rcu_assign_pointer(table->ufid_ti, ufid_ti);
 	rcu_assign_pointer(table->mask_array, ma);
 	rcu_assign_pointer(table->mask_cache, mc);
+	atomic64_set(&table->microflow_gen, 0);
 	table->last_rehash = jiffies;
 	table->count = 0;
 	table->ufid_count = 0;
@@ -446,6 +456,8 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	__table_instance_destroy(ti);
 free_mask_array:
 	__mask_array_destroy(ma);
+free_microflow_cache:
+	free_percpu(table->microflow_cache);
 free_mask_cache:
 	__mask_cache_destroy(mc);
 	return -ENOMEM;
@@ -467,6 +479,11 @@ static void table_instance_flow_free(struct flow_table *table,
 	hlist_del_rcu(&flow->flow_table.node[ti->node_ver]);
 	table->count--;
 
+	/* Invalidate all microflow cache entries, some might point to this
+	 * flow. Pairs with the acquire in ovs_flow_tbl_lookup_stats().
+	 */
+	atomic64_inc_return_release(&table->microflow_gen);
+
 	if (ovs_identifier_is_ufid(&flow->id)) {
 		hlist_del_rcu(&flow->ufid_table.node[ufid_ti->node_ver]);
 		table->ufid_count--;
@@ -520,6 +537,7 @@ void ovs_flow_tbl_destroy(struct flow_table *table)
 	struct mask_cache *mc = rcu_dereference_raw(table->mask_cache);
 	struct mask_array *ma = rcu_dereference_raw(table->mask_array);
 
+	free_percpu(table->microflow_cache);
 	call_rcu(&mc->rcu, mask_cache_rcu_cb);
 	call_rcu(&ma->rcu, mask_array_rcu_cb);
 	table_instance_destroy(ti, ufid_ti);
@@ -783,36 +801,20 @@ static struct sw_flow *flow_lookup(struct flow_table *tbl,
  * This is per cpu cache and is divided in MC_HASH_SEGS segments.
  * In case of a hash collision the entry is hashed in next segment.
  * */
-struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
-					  const struct sw_flow_key *key,
-					  u32 skb_hash,
-					  u32 *n_mask_hit,
-					  u32 *n_cache_hit)
+static struct sw_flow *flow_tbl_lookup_mask_cache(struct flow_table *tbl,
+						  struct mask_cache *mc,
+						  struct mask_array *ma,
+						  struct table_instance *ti,
+						  const struct sw_flow_key *key,
+						  u32 skb_hash,
+						  u32 *n_mask_hit,
+						  u32 *n_cache_hit)
 {
-	struct mask_cache *mc = rcu_dereference(tbl->mask_cache);
-	struct mask_array *ma = rcu_dereference(tbl->mask_array);
-	struct table_instance *ti = rcu_dereference(tbl->ti);
 	struct mask_cache_entry *entries, *ce;
 	struct sw_flow *flow;
 	u32 hash;
 	int seg;
 
-	*n_mask_hit = 0;
-	*n_cache_hit = 0;
-	if (unlikely(!skb_hash || mc->cache_size == 0)) {
-		u32 mask_index = 0;
-		u32 cache = 0;
-
-		return flow_lookup(tbl, ti, ma, key, n_mask_hit, &cache,
-				   &mask_index);
-	}
-
-	/* Pre and post recirulation flows usually have the same skb_hash
-	 * value. To avoid hash collisions, rehash the 'skb_hash' with
-	 * 'recirc_id'.  */
-	if (key->recirc_id)
-		skb_hash = jhash_1word(skb_hash, key->recirc_id);
-
 	ce = NULL;
 	hash = skb_hash;
 	entries = this_cpu_ptr(mc->mask_cache);
@@ -847,6 +849,80 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 	return flow;
 }
 
+/*
+ * The microflow cache sits in front of the mask cache, and maps the packet
+ * hash straight to the flow it matched last time, so that with a hit only
+ * the key of that flow needs to be compared, under its own mask.
+ *
+ * Entries are direct-mapped, per cpu, and tagged with the generation of the
+ * table they were filled at. Removing any flow bumps the generation, which
+ * makes all the entries stale before the flow can be freed. The generation
+ * is 64 bits wide, so it never wraps back to the tag of a stale entry.
+ *
+ * Megaflows never overlap, so a cached flow matching the key is the one a
+ * full lookup would find.
+ *
+ * Both caches are disabled together by setting the mask cache size to zero.
+ */
+struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
+					  const struct sw_flow_key *key,
+					  u32 skb_hash,
+					  u32 *n_mask_hit,
+					  u32 *n_cache_hit,
+					  u32 *n_microflow_hit)
+{
+	struct mask_cache *mc = rcu_dereference(tbl->mask_cache);
+	struct mask_array *ma = rcu_dereference(tbl->mask_array);
+	struct table_instance *ti = rcu_dereference(tbl->ti);
+	struct microflow_cache_entry *me;
+	struct sw_flow *flow;
+	u64 gen;
+
+	*n_mask_hit = 0;
+	*n_cache_hit = 0;
+	*n_microflow_hit = 0;
+	if (unlikely(!skb_hash || mc->cache_size == 0)) {
+		u32 mask_index = 0;
+		u32 cache = 0;
+
+		return flow_lookup(tbl, ti, ma, key, n_mask_hit, &cache,
+				   &mask_index);
+	}
+
+	/* Pre and post recirulation flows usually have the same skb_hash
+	 * value. To avoid hash collisions, rehash the 'skb_hash' with
+	 * 'recirc_id'.  */
+	if (key->recirc_id)
+		skb_hash = jhash_1word(skb_hash, key->recirc_id);
+
+	me = this_cpu_ptr(tbl->microflow_cache) +
+	     (skb_hash & (MICROFLOW_CACHE_ENTRIES - 1));
+	gen = atomic64_read_acquire(&tbl->microflow_gen);
+
+	if (me->skb_hash == skb_hash && me->gen == gen && me->flow) {
+		const struct sw_flow_mask *mask = me->flow->mask;
+		struct sw_flow_key masked_key;
+
+		ovs_flow_mask_key(&masked_key, key, false, mask);
+		if (flow_cmp_masked_key(me->flow, &masked_key, &mask->range)) {
+			*n_mask_hit = 1;
+			*n_cache_hit = 1;
+			*n_microflow_hit = 1;
+			return me->flow;
+		}
+	}
+
+	flow = flow_tbl_lookup_mask_cache(tbl, mc, ma, ti, key, skb_hash,
+					  n_mask_hit, n_cache_hit);
+	if (flow) {
+		me->skb_hash = skb_hash;
+		me->gen = gen;
+		me->flow = flow;
+	}
+
+	return flow;
+}
+
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *tbl,
 				    const struct sw_flow_key *key)
 {
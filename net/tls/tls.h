@@ -49,6 +49,8 @@
 	SNMP_INC_STATS((net)->mib.tls_statistics, field)
 #define TLS_DEC_STATS(net, field)				\
 	SNMP_DEC_STATS((net)->mib.tls_statistics, field)
+#define TLS_ADD_STATS(net, field, val)				\
+	SNMP_ADD_STATS((net)->mib.tls_statistics, field, val)
 
 /* TLS records are maintained in 'struct tls_rec'. It stores the memory pages
  * allocated or mapped for each TLS record. After encryption, the records are
@@ -22,6 +22,11 @@ static const struct snmp_mib tls_mib_list[] = {
 	SNMP_MIB_ITEM("TlsRxDeviceResync", LINUX_MIB_TLSRXDEVICERESYNC),
 	SNMP_MIB_ITEM("TlsDecryptRetry", LINUX_MIB_TLSDECRYPTRETRY),
 	SNMP_MIB_ITEM("TlsRxNoPadViolation", LINUX_MIB_TLSRXNOPADVIOL),
+	SNMP_MIB_ITEM("TlsTxBatch", LINUX_MIB_TLSTXBATCH),
+	SNMP_MIB_ITEM("TlsTxBatchRecords", LINUX_MIB_TLSTXBATCHRECORDS),
+	SNMP_MIB_ITEM("TlsRxZeroCopy", LINUX_MIB_TLSRXZEROCOPY),
+	SNMP_MIB_ITEM("TlsRxZeroCopyPartial", LINUX_MIB_TLSRXZEROCOPYPARTIAL),
+	SNMP_MIB_ITEM("TlsRxCopy", LINUX_MIB_TLSRXCOPY),
 	SNMP_MIB_SENTINEL
 };
 
@@ -48,11 +48,15 @@
 
 #include "tls.h"
 
+/* Smallest read worth decrypting a longer record's head into user pages */
+#define TLS_RX_ZC_PART_MIN	1024
+
 struct tls_decrypt_arg {
 	struct_group(inargs,
 	bool zc;
 	bool async;
 	u8 tail;
+	u32 zc_part;
 	);
 
 	struct sk_buff *skb;
@@ -372,7 +376,7 @@ static void tls_free_open_rec(struct sock *sk)
 	}
 }
 
-int tls_tx_records(struct sock *sk, int flags)
+static int __tls_tx_records(struct sock *sk, int flags, bool batch)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_tx *ctx = tls_sw_ctx_tx(tls_ctx);
@@ -409,6 +413,13 @@ int tls_tx_records(struct sock *sk, int flags)
 			else
 				tx_flags = flags;
 
+			/* Let TCP coalesce a batch of records into full sized
+			 * segments; only the last ready record may push.
+			 */
+			if (batch && !list_is_last(&rec->list, &ctx->tx_list) &&
+			    READ_ONCE(tmp->tx_ready))
+				tx_flags |= MSG_MORE;
+
 			msg_en = &rec->msg_encrypted;
 			rc = tls_push_sg(sk, tls_ctx,
 					 &msg_en->sg.data[msg_en->sg.curr],
@@ -431,6 +442,29 @@ int tls_tx_records(struct sock *sk, int flags)
 	return rc;
 }
 
+int tls_tx_records(struct sock *sk, int flags)
+{
+	return __tls_tx_records(sk, flags, false);
+}
+
+/* Maximum number of full records sealed before they're pushed to TCP at once */
+#define TLS_SW_TX_BATCH		8
+
+static int tls_tx_records_batch(struct sock *sk, int flags)
+{
+	struct tls_context *tls_ctx = tls_get_ctx(sk);
+	struct tls_sw_context_tx *ctx = tls_sw_ctx_tx(tls_ctx);
+
+	if (ctx->tx_batched > 1) {
+		TLS_INC_STATS(sock_net(sk), LINUX_MIB_TLSTXBATCH);
+		TLS_ADD_STATS(sock_net(sk), LINUX_MIB_TLSTXBATCHRECORDS,
+			      ctx->tx_batched);
+	}
+	ctx->tx_batched = 0;
+
+	return __tls_tx_records(sk, flags, true);
+}
+
 static void tls_encrypt_done(void *data, int err)
 {
 	struct tls_sw_context_tx *ctx;
@@ -796,7 +830,14 @@ static int tls_push_record(struct sock *sk, int flags,
 		ctx->open_rec = tmp;
 	}
 
-	return tls_tx_records(sk, flags);
+	/* Sealed records stay on tx_list, ready, until the batch is full or
+	 * the last record of this sendmsg() is pushed, so that TCP gets them
+	 * in one go.
+	 */
+	if (ctx->tx_defer && ++ctx->tx_batched < TLS_SW_TX_BATCH)
+		return 0;
+
+	return tls_tx_records_batch(sk, flags);
 }
 
 static int bpf_exec_tx_verdict(struct sk_msg *msg, struct sock *sk,
@@ -1064,9 +1105,11 @@ static int tls_sw_sendmsg_locked(struct sock *sk, struct msghdr *msg,
 			copied += try_to_copy;
 
 			sk_msg_sg_copy_set(msg_pl, first);
+			ctx->tx_defer = full_record && msg_data_left(msg);
 			ret = bpf_exec_tx_verdict(msg_pl, sk, full_record,
 						  record_type, &copied,
 						  msg->msg_flags);
+			ctx->tx_defer = 0;
 			if (ret) {
 				if (ret == -EINPROGRESS)
 					num_async++;
@@ -1118,9 +1161,11 @@ static int tls_sw_sendmsg_locked(struct sock *sk, struct msghdr *msg,
 		copied += try_to_copy;
 copied:
 		if (full_record || eor) {
+			ctx->tx_defer = full_record && msg_data_left(msg);
 			ret = bpf_exec_tx_verdict(msg_pl, sk, full_record,
 						  record_type, &copied,
 						  msg->msg_flags);
+			ctx->tx_defer = 0;
 			if (ret) {
 				if (ret == -EINPROGRESS)
 					num_async++;
@@ -1139,6 +1184,9 @@ static int tls_sw_sendmsg_locked(struct sock *sk, struct msghdr *msg,
 wait_for_sndbuf:
 		set_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
 wait_for_memory:
+		/* Don't sit on sealed records while waiting for memory */
+		if (ctx->tx_batched)
+			tls_tx_records_batch(sk, msg->msg_flags);
 		ret = sk_stream_wait_memory(sk, &timeo);
 		if (ret) {
 trim_sgl:
@@ -1183,6 +1231,8 @@ static int tls_sw_sendmsg_locked(struct sock *sk, struct msghdr *msg,
 	}
 
 send_end:
+	if (ctx->tx_batched)
+		tls_tx_records_batch(sk, msg->msg_flags);
 	ret = sk_stream_error(sk, msg->msg_flags, ret);
 	return copied > 0 ? copied : ret;
 }
@@ -1422,6 +1472,10 @@ tls_alloc_clrtxt_skb(struct sock *sk, struct sk_buff *skb,
  *   skb |            *              | Output skb
  *
  * If ZC decryption was performed darg.skb will point to the input skb.
+ *
+ * With zc_part set instead of zc, the first zc_part bytes of the record are
+ * decrypted into the user buffer and the rest into the output skb, whose first
+ * zc_part bytes are left unused.
  */
 
 /* This function decrypts the input skb into either out_iov or in out_sg
@@ -1467,12 +1521,17 @@ static int tls_decrypt_sg(struct sock *sk, struct iov_iter *out_iov,
 			n_sgout = sg_nents(out_sg);
 	} else {
 		darg->zc = false;
+		if (!out_iov)
+			darg->zc_part = 0;
 
 		clear_skb = tls_alloc_clrtxt_skb(sk, skb, rxm->full_len);
 		if (!clear_skb)
 			return -ENOMEM;
 
 		n_sgout = 1 + skb_shinfo(clear_skb)->nr_frags;
+		if (darg->zc_part)
+			n_sgout += iov_iter_npages_cap(out_iov, INT_MAX,
+						       darg->zc_part);
 	}
 
 	/* Increment to accommodate AAD */
@@ -1543,10 +1602,21 @@ static int tls_decrypt_sg(struct sock *sk, struct iov_iter *out_iov,
 		sg_init_table(sgout, n_sgout);
 		sg_set_buf(&sgout[0], dctx->aad, prot->aad_size);
 
-		err = skb_to_sgvec(clear_skb, &sgout[1], prot->prepend_size,
-				   data_len + prot->tail_size);
+		if (darg->zc_part) {
+			err = tls_setup_from_iter(out_iov, darg->zc_part,
+						  &pages, &sgout[1],
+						  n_sgout - 1 -
+						  skb_shinfo(clear_skb)->nr_frags);
+			if (err < 0)
+				goto exit_free_pages;
+			sg_unmark_end(&sgout[pages]);
+		}
+
+		err = skb_to_sgvec(clear_skb, &sgout[1 + pages],
+				   prot->prepend_size + darg->zc_part,
+				   data_len + prot->tail_size - darg->zc_part);
 		if (err < 0)
-			goto exit_free;
+			goto exit_free_pages;
 	} else if (out_iov) {
 		sg_init_table(sgout, n_sgout);
 		sg_set_buf(&sgout[0], dctx->aad, prot->aad_size);
@@ -1657,6 +1727,7 @@ tls_decrypt_device(struct sock *sk, struct msghdr *msg,
 		return pad;
 
 	darg->async = false;
+	darg->zc_part = 0;
 	darg->skb = tls_strp_msg(ctx);
 	/* ->zc downgrade check, in case TLS 1.3 gets here */
 	darg->zc &= !(prot->version == TLS_1_3_VERSION &&
@@ -1978,12 +2049,23 @@ int tls_sw_recvmsg(struct sock *sk,
 
 		to_decrypt = rxm->full_len - prot->overhead_size;
 
-		if (zc_capable && to_decrypt <= len &&
-		    tlm->control == TLS_RECORD_TYPE_DATA)
-			darg.zc = true;
+		if (zc_capable && tlm->control == TLS_RECORD_TYPE_DATA) {
+			/* The head of a record longer than the read can still
+			 * go straight to the user buffer, the rest is kept on
+			 * rx_list. TLS 1.3 needs the whole record to find the
+			 * content type, and data from earlier async records
+			 * must be copied out first.
+			 */
+			if (to_decrypt <= len)
+				darg.zc = true;
+			else if (len >= TLS_RX_ZC_PART_MIN &&
+				 !prot->tail_size && !async)
+				darg.zc_part = len;
+		}
 
 		/* Do not use async mode if record is non-data */
-		if (tlm->control == TLS_RECORD_TYPE_DATA && !bpf_strp_enabled)
+		if (tlm->control == TLS_RECORD_TYPE_DATA && !bpf_strp_enabled &&
+		    !darg.zc_part)
 			darg.async = ctx->async_capable;
 		else
 			darg.async = false;
@@ -1994,6 +2076,17 @@ int tls_sw_recvmsg(struct sock *sk,
 			goto recv_end;
 		}
 
+		if (tlm->control == TLS_RECORD_TYPE_DATA) {
+			if (darg.zc)
+				TLS_INC_STATS(sock_net(sk),
+					      LINUX_MIB_TLSRXZEROCOPY);
+			else if (darg.zc_part)
+				TLS_INC_STATS(sock_net(sk),
+					      LINUX_MIB_TLSRXZEROCOPYPARTIAL);
+			else
+				TLS_INC_STATS(sock_net(sk), LINUX_MIB_TLSRXCOPY);
+		}
+
 		async |= darg.async;
 
 		/* If the type of records being processed is not known yet,
@@ -2028,6 +2121,14 @@ int tls_sw_recvmsg(struct sock *sk,
 
 			DEBUG_NET_WARN_ON_ONCE(darg.skb == ctx->strp.anchor);
 
+			if (darg.zc_part) {
+				/* Head already decrypted into the user buffer */
+				chunk = darg.zc_part;
+				rxm->offset += chunk;
+				rxm->full_len -= chunk;
+				goto put_on_rx_list;
+			}
+
 			if (async) {
 				/* TLS 1.2-only, to_decrypt must be text len */
 				chunk = min_t(int, to_decrypt, len);
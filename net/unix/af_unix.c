@@ -581,6 +581,7 @@ static void unix_sock_destructor(struct sock *sk)
 	struct unix_sock *u = unix_sk(sk);
 
 	skb_queue_purge(&sk->sk_receive_queue);
+	skb_queue_purge(&sk->sk_error_queue);
 
 	DEBUG_NET_WARN_ON_ONCE(refcount_read(&sk->sk_wmem_alloc));
 	DEBUG_NET_WARN_ON_ONCE(!sk_unhashed(sk));
@@ -2113,6 +2114,9 @@ static int unix_dgram_sendmsg(struct socket *sock, struct msghdr *msg,
  */
 #define UNIX_SKB_FRAGS_SZ (PAGE_SIZE << get_order(32768))
 
+/* MSG_ZEROCOPY sends shorter than this are copied, pinning isn't worth it */
+#define UNIX_ZEROCOPY_MIN 16384
+
 #if IS_ENABLED(CONFIG_AF_UNIX_OOB)
 static int queue_oob(struct socket *sock, struct msghdr *msg, struct sock *other,
 		     struct scm_cookie *scm, bool fds_sent)
@@ -2166,16 +2170,41 @@ static int queue_oob(struct socket *sock, struct msghdr *msg, struct sock *other
 }
 #endif
 
+/* Build @skb out of references to the pages behind @msg, up to @size bytes.
+ * Pages are released, and the completion is queued to the sender's error
+ * queue, once the receiver has consumed the data.
+ */
+static int unix_stream_zerocopy_from_iter(struct sk_buff *skb,
+					  struct msghdr *msg, int size,
+					  struct ubuf_info *uarg)
+{
+	int err;
+
+	/* No socket here: memory is charged to sk_wmem_alloc of skb->sk,
+	 * which is what sock_wfree() releases.
+	 */
+	err = __zerocopy_sg_from_iter(NULL, NULL, skb, &msg->msg_iter, size);
+	if (err == -EFAULT || (err == -EMSGSIZE && !skb->len)) {
+		iov_iter_revert(&msg->msg_iter, skb->len);
+		return err;
+	}
+
+	skb_zcopy_set(skb, uarg, NULL);
+	return skb->len;
+}
+
 static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			       size_t len)
 {
 	struct sock *sk = sock->sk;
+	struct ubuf_info *uarg = NULL;
 	struct sock *other = NULL;
 	int err, size;
 	struct sk_buff *skb;
 	int sent = 0;
 	struct scm_cookie scm;
 	bool fds_sent = false;
+	bool zc = false;
 	int data_len;
 
 	wait_for_unix_gc();
@@ -2206,10 +2235,32 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (sk->sk_shutdown & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if ((msg->msg_flags & MSG_ZEROCOPY) && len &&
+	    sock_flag(sk, SOCK_ZEROCOPY) &&
+	    !(msg->msg_flags & MSG_SPLICE_PAGES)) {
+		uarg = msg_zerocopy_realloc(sk, len, NULL);
+		if (!uarg) {
+			err = -ENOBUFS;
+			goto out_err;
+		}
+		/* Still notified, as copied, once this function is done */
+		if (len < UNIX_ZEROCOPY_MIN)
+			uarg_to_msgzc(uarg)->zerocopy = 0;
+		else
+			zc = true;
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
 		if (unlikely(msg->msg_flags & MSG_SPLICE_PAGES)) {
+			skb = sock_alloc_send_pskb(sk, 0, 0,
+						   msg->msg_flags & MSG_DONTWAIT,
+						   &err, 0);
+		} else if (zc) {
+			/* Keep two messages in the pipe so it schedules better */
+			size = min_t(int, size, (sk->sk_sndbuf >> 1) - 64);
+
 			skb = sock_alloc_send_pskb(sk, 0, 0,
 						   msg->msg_flags & MSG_DONTWAIT,
 						   &err, 0);
@@ -2248,6 +2299,13 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			}
 			size = err;
 			refcount_add(size, &sk->sk_wmem_alloc);
+		} else if (zc) {
+			err = unix_stream_zerocopy_from_iter(skb, msg, size, uarg);
+			if (err < 0) {
+				kfree_skb(skb);
+				goto out_err;
+			}
+			size = err;
 		} else {
 			skb_put(skb, size - data_len);
 			skb->data_len = data_len;
@@ -2282,6 +2340,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	}
 #endif
 
+	net_zcopy_put(uarg);
 	scm_destroy(&scm);
 
 	return sent;
@@ -2294,6 +2353,10 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		send_sig(SIGPIPE, current, 0);
 	err = -EPIPE;
 out_err:
+	if (sent)
+		net_zcopy_put(uarg);
+	else
+		net_zcopy_put_abort(uarg, true);
 	scm_destroy(&scm);
 	return sent ? : err;
 }
@@ -2471,6 +2534,12 @@ static int unix_read_skb(struct sock *sk, skb_read_actor_t recv_actor)
 	if (!skb)
 		return err;
 
+	/* MSG_ZEROCOPY pages must not outlive the sender's completion */
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_KERNEL))) {
+		kfree_skb(skb);
+		return -ENOMEM;
+	}
+
 	return recv_actor(sk, skb);
 }
 
@@ -2859,11 +2928,18 @@ static int unix_stream_recvmsg(struct socket *sock, struct msghdr *msg,
 		.size = size,
 		.flags = flags
 	};
-
-#ifdef CONFIG_BPF_SYSCALL
 	struct sock *sk = sock->sk;
-	const struct proto *prot = READ_ONCE(sk->sk_prot);
+#ifdef CONFIG_BPF_SYSCALL
+	const struct proto *prot;
+#endif
+
+	/* MSG_ZEROCOPY completions, there is no SOL_UNIX cmsg level */
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sk, msg, size, SOL_SOCKET,
+					  SO_ZEROCOPY);
 
+#ifdef CONFIG_BPF_SYSCALL
+	prot = READ_ONCE(sk->sk_prot);
 	if (prot != &unix_stream_proto)
 		return prot->recvmsg(sk, msg, size, flags, NULL);
 #endif
@@ -2874,6 +2950,15 @@ static int unix_stream_splice_actor(struct sk_buff *skb,
 				    int skip, int chunk,
 				    struct unix_stream_read_state *state)
 {
+	int err;
+
+	/* The pipe holds on to the pages after the skb is consumed and the
+	 * MSG_ZEROCOPY completion has told the sender it may reuse them.
+	 */
+	err = skb_orphan_frags_rx(skb, GFP_KERNEL);
+	if (unlikely(err))
+		return err;
+
 	return skb_splice_bits(skb, state->socket->sk,
 			       UNIXCB(skb).consumed + skip,
 			       state->pipe, chunk, state->splice_flags);
@@ -3075,7 +3160,8 @@ static __poll_t unix_poll(struct file *file, struct socket *sock, poll_table *wa
 	shutdown = READ_ONCE(sk->sk_shutdown);
 
 	/* exceptional events? */
-	if (READ_ONCE(sk->sk_err))
+	if (READ_ONCE(sk->sk_err) ||
+	    !skb_queue_empty_lockless(&sk->sk_error_queue))
 		mask |= EPOLLERR;
 	if (shutdown == SHUTDOWN_MASK)
 		mask |= EPOLLHUP;
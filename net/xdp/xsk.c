@@ -515,12 +515,14 @@ static struct sk_buff *xsk_build_skb(struct xdp_sock *xs,
 static int __xsk_generic_xmit(struct sock *sk)
 {
 	struct xdp_sock *xs = xdp_sk(sk);
-	u32 max_batch = TX_BATCH_SIZE;
+	struct sk_buff *skbs[TX_BATCH_SIZE];
+	u32 pos[TX_BATCH_SIZE];
+	u32 i, nb, built, sent;
 	bool sent_frame = false;
 	struct xdp_desc desc;
 	struct sk_buff *skb;
 	unsigned long flags;
-	int err = 0;
+	int err = 0, ret;
 
 	mutex_lock(&xs->mutex);
 
@@ -533,58 +535,82 @@ static int __xsk_generic_xmit(struct sock *sk)
 	if (xs->queue_id >= xs->dev->real_num_tx_queues)
 		goto out;
 
-	while (xskq_cons_peek_desc(xs->tx, &desc, xs->pool)) {
-		if (max_batch-- == 0) {
-			err = -EAGAIN;
-			goto out;
-		}
+	/* Don't refresh the consumer pointer while building the batch, so that
+	 * descriptors for frames we can't send can still be given back.
+	 */
+	nb = xskq_cons_nb_entries(xs->tx, TX_BATCH_SIZE);
+	if (!nb) {
+		xs->tx->queue_empty_descs++;
+		goto out;
+	}
 
-		/* This is the backpressure mechanism for the Tx path.
-		 * Reserve space in the completion queue and only proceed
-		 * if there is space in it. This avoids having to implement
-		 * any buffering in the Tx path.
-		 */
-		spin_lock_irqsave(&xs->pool->cq_lock, flags);
-		if (xskq_prod_reserve(xs->pool->cq)) {
-			spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
-			goto out;
-		}
-		spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
+	/* This is the backpressure mechanism for the Tx path.
+	 * Reserve space in the completion queue and only proceed
+	 * if there is space in it. This avoids having to implement
+	 * any buffering in the Tx path.
+	 */
+	spin_lock_irqsave(&xs->pool->cq_lock, flags);
+	nb = xskq_prod_reserve_n(xs->pool->cq, nb);
+	spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
+	if (!nb)
+		goto out;
+
+	for (built = 0; built < nb; built++) {
+		if (!xskq_cons_read_desc(xs->tx, &desc, xs->pool))
+			break;
 
 		skb = xsk_build_skb(xs, &desc);
 		if (IS_ERR(skb)) {
 			err = PTR_ERR(skb);
-			spin_lock_irqsave(&xs->pool->cq_lock, flags);
-			xskq_prod_cancel(xs->pool->cq);
-			spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
-			goto out;
-		}
-
-		err = __dev_direct_xmit(skb, xs->queue_id);
-		if  (err == NETDEV_TX_BUSY) {
-			/* Tell user-space to retry the send */
-			skb->destructor = sock_wfree;
-			spin_lock_irqsave(&xs->pool->cq_lock, flags);
-			xskq_prod_cancel(xs->pool->cq);
-			spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
-			/* Free skb without triggering the perf drop trace */
-			consume_skb(skb);
-			err = -EAGAIN;
-			goto out;
+			break;
 		}
 
+		pos[built] = xs->tx->cached_cons;
+		skbs[built] = skb;
 		xskq_cons_release(xs->tx);
-		/* Ignore NET_XMIT_CN as packet might have been sent */
-		if (err == NET_XMIT_DROP) {
-			/* SKB completed but not sent */
-			err = -EBUSY;
-			goto out;
-		}
+	}
 
-		sent_frame = true;
+	sent = built ? __dev_direct_xmit_batch(skbs, built, xs->queue_id,
+					       &ret) : 0;
+
+	for (i = sent; i < built; i++) {
+		/* Free skb without triggering the perf drop trace, nor
+		 * completing the descriptor, which is given back.
+		 */
+		skbs[i]->destructor = sock_wfree;
+		consume_skb(skbs[i]);
+	}
+	if (sent < built)
+		xskq_cons_cancel_n(xs->tx, xs->tx->cached_cons - pos[sent]);
+
+	if (sent < nb) {
+		spin_lock_irqsave(&xs->pool->cq_lock, flags);
+		xskq_prod_cancel_n(xs->pool->cq, nb - sent);
+		spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
 	}
 
-	xs->tx->queue_empty_descs++;
+	__xskq_cons_release(xs->tx);
+
+	if (sent)
+		sent_frame = true;
+
+	if (err || !built)
+		goto out;
+
+	if (ret == NETDEV_TX_BUSY) {
+		/* Tell user-space to retry the send */
+		err = -EAGAIN;
+	} else if (ret == NET_XMIT_DROP) {
+		/* SKB completed but not sent */
+		err = -EBUSY;
+	} else if (sent < built) {
+		err = -EAGAIN;
+	} else if (xskq_cons_nb_entries(xs->tx, 1)) {
+		if (built == TX_BATCH_SIZE)
+			err = -EAGAIN;
+	} else {
+		xs->tx->queue_empty_descs++;
+	}
 
 out:
 	if (sent_frame)
@@ -292,6 +292,12 @@ static inline void xskq_cons_release(struct xsk_queue *q)
 	q->cached_cons++;
 }
 
+/* Give back entries released, but not yet reflected to global state */
+static inline void xskq_cons_cancel_n(struct xsk_queue *q, u32 cnt)
+{
+	q->cached_cons -= cnt;
+}
+
 static inline u32 xskq_cons_present_entries(struct xsk_queue *q)
 {
 	/* No barriers needed since data is not accessed */
@@ -324,6 +330,11 @@ static inline void xskq_prod_cancel(struct xsk_queue *q)
 	q->cached_prod--;
 }
 
+static inline void xskq_prod_cancel_n(struct xsk_queue *q, u32 cnt)
+{
+	q->cached_prod -= cnt;
+}
+
 static inline int xskq_prod_reserve(struct xsk_queue *q)
 {
 	if (xskq_prod_is_full(q))
@@ -334,6 +345,16 @@ static inline int xskq_prod_reserve(struct xsk_queue *q)
 	return 0;
 }
 
+/* Reserve up to @max entries, return how many could be reserved */
+static inline u32 xskq_prod_reserve_n(struct xsk_queue *q, u32 max)
+{
+	u32 nb = xskq_prod_nb_free(q, max);
+
+	/* A, matches D */
+	q->cached_prod += nb;
+	return nb;
+}
+
 static inline int xskq_prod_reserve_addr(struct xsk_queue *q, u64 addr)
 {
 	struct xdp_umem_ring *ring = (struct xdp_umem_ring *)q->ring;
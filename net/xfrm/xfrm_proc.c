@@ -41,6 +41,10 @@ static const struct snmp_mib xfrm_mib_list[] = {
 	SNMP_MIB_ITEM("XfrmFwdHdrError", LINUX_MIB_XFRMFWDHDRERROR),
 	SNMP_MIB_ITEM("XfrmOutStateInvalid", LINUX_MIB_XFRMOUTSTATEINVALID),
 	SNMP_MIB_ITEM("XfrmAcquireError", LINUX_MIB_XFRMACQUIREERROR),
+	SNMP_MIB_ITEM("XfrmInStateCacheHit", LINUX_MIB_XFRMINSTATECACHEHIT),
+	SNMP_MIB_ITEM("XfrmInStateCacheMiss", LINUX_MIB_XFRMINSTATECACHEMISS),
+	SNMP_MIB_ITEM("XfrmInStateRuns", LINUX_MIB_XFRMINSTATERUNS),
+	SNMP_MIB_ITEM("XfrmInStateRunPackets", LINUX_MIB_XFRMINSTATERUNPACKETS),
 	SNMP_MIB_SENTINEL
 };
 
@@ -84,6 +84,29 @@ static unsigned int xfrm_seq_hash(struct net *net, u32 seq)
 	return __xfrm_seq_hash(seq, net->xfrm.state_hmask);
 }
 
+#define XFRM_STATE_CACHE_SIZE	16
+
+struct xfrm_state_cache_slot {
+	struct xfrm_state	*x;
+	u32			mark;
+	u64			gen;
+};
+
+struct xfrm_state_cache {
+	struct xfrm_state_cache_slot	slot[XFRM_STATE_CACHE_SIZE];
+	/* run of back to back packets for the same SA, only compared */
+	const struct xfrm_state		*last;
+	unsigned int			run;
+};
+
+/* Called with xfrm_state_lock held, after any change to the byspi table.
+ * Pairs with the acquire in xfrm_input_state_lookup().
+ */
+static void xfrm_state_cache_invalidate(struct net *net)
+{
+	atomic64_inc_return_release(&net->xfrm.state_cache_gen);
+}
+
 #define XFRM_STATE_INSERT(by, _n, _h, _type)                               \
 	{                                                                  \
 		struct xfrm_state *_x = NULL;                              \
@@ -196,6 +219,7 @@ static void xfrm_hash_resize(struct work_struct *work)
 	rcu_assign_pointer(net->xfrm.state_byspi, nspi);
 	rcu_assign_pointer(net->xfrm.state_byseq, nseq);
 	net->xfrm.state_hmask = nhashmask;
+	xfrm_state_cache_invalidate(net);
 
 	write_seqcount_end(&net->xfrm.xfrm_state_hash_generation);
 	spin_unlock_bh(&net->xfrm.xfrm_state_lock);
@@ -712,8 +736,10 @@ int __xfrm_state_delete(struct xfrm_state *x)
 		hlist_del_rcu(&x->bysrc);
 		if (x->km.seq)
 			hlist_del_rcu(&x->byseq);
-		if (x->id.spi)
+		if (x->id.spi) {
 			hlist_del_rcu(&x->byspi);
+			xfrm_state_cache_invalidate(net);
+		}
 		net->xfrm.state_num--;
 		spin_unlock(&net->xfrm.xfrm_state_lock);
 
@@ -1305,6 +1331,7 @@ xfrm_state_find(const xfrm_address_t *daddr, const xfrm_address_t *saddr,
 				XFRM_STATE_INSERT(byspi, &x->byspi,
 						  net->xfrm.state_byspi + h,
 						  x->xso.type);
+				xfrm_state_cache_invalidate(net);
 			}
 			if (x->km.seq) {
 				h = xfrm_seq_hash(net, x->km.seq);
@@ -1436,6 +1463,7 @@ static void __xfrm_state_insert(struct xfrm_state *x)
 
 		XFRM_STATE_INSERT(byspi, &x->byspi, net->xfrm.state_byspi + h,
 				  x->xso.type);
+		xfrm_state_cache_invalidate(net);
 	}
 
 	if (x->km.seq) {
@@ -1970,6 +1998,87 @@ xfrm_state_lookup(struct net *net, u32 mark, const xfrm_address_t *daddr, __be32
 }
 EXPORT_SYMBOL(xfrm_state_lookup);
 
+static void xfrm_state_cache_account(struct net *net,
+				     struct xfrm_state_cache *cache,
+				     const struct xfrm_state *x)
+{
+	if (x == cache->last) {
+		cache->run++;
+		return;
+	}
+
+	if (cache->run) {
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATERUNS);
+		XFRM_ADD_STATS(net, LINUX_MIB_XFRMINSTATERUNPACKETS,
+			       cache->run);
+	}
+	cache->last = x;
+	cache->run = 1;
+}
+
+/*
+ * Inbound variant of xfrm_state_lookup(), for the per-packet path.
+ *
+ * A small per-cpu direct-mapped cache, indexed by SPI, is checked before the
+ * byspi hash table. Cached states are only valid for the generation they were
+ * looked up at: any change to the byspi table bumps it, before a state can go
+ * away or the result of a lookup can change, so that a hit never needs more
+ * than comparing the key. The generation is 64 bits wide so that it can't
+ * wrap back to the one of a stale slot.
+ *
+ * Several states may match the same key under different masked marks, and
+ * the first one in the hash chain wins. A slot is therefore keyed by the
+ * packet mark too, not just checked against the mark of the cached state,
+ * so that a hit returns what __xfrm_state_lookup() would.
+ *
+ * Runs of back to back packets for the same SA on a CPU are counted when
+ * they end, their average length is XfrmInStateRunPackets / XfrmInStateRuns.
+ * Packets are still decrypted one at a time, these only tell how long the
+ * runs are.
+ */
+struct xfrm_state *xfrm_input_state_lookup(struct net *net, u32 mark,
+					   const xfrm_address_t *daddr,
+					   __be32 spi, u8 proto,
+					   unsigned short family)
+{
+	struct xfrm_state_cache_slot *slot;
+	struct xfrm_state_cache *cache;
+	struct xfrm_state *x;
+	u64 gen;
+
+	if (!in_softirq() || in_hardirq())
+		return xfrm_state_lookup(net, mark, daddr, spi, proto, family);
+
+	rcu_read_lock();
+	cache = this_cpu_ptr(net->xfrm.state_cache_input);
+	slot = &cache->slot[(__force u32)spi % XFRM_STATE_CACHE_SIZE];
+	gen = atomic64_read_acquire(&net->xfrm.state_cache_gen);
+
+	x = slot->x;
+	if (x && slot->gen == gen && slot->mark == mark &&
+	    x->id.spi == spi && x->id.proto == proto &&
+	    x->props.family == family &&
+	    xfrm_addr_equal(&x->id.daddr, daddr, family) &&
+	    xfrm_state_hold_rcu(x)) {
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATECACHEHIT);
+	} else {
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMINSTATECACHEMISS);
+		x = __xfrm_state_lookup(net, mark, daddr, spi, proto, family);
+		if (x) {
+			slot->x = x;
+			slot->mark = mark;
+			slot->gen = gen;
+		}
+	}
+
+	if (x)
+		xfrm_state_cache_account(net, cache, x);
+	rcu_read_unlock();
+
+	return x;
+}
+EXPORT_SYMBOL(xfrm_input_state_lookup);
+
 struct xfrm_state *
 xfrm_state_lookup_byaddr(struct net *net, u32 mark,
 			 const xfrm_address_t *daddr, const xfrm_address_t *saddr,
@@ -2247,6 +2356,7 @@ int xfrm_alloc_spi(struct xfrm_state *x, u32 low, u32 high,
 		h = xfrm_spi_hash(net, &x->id.daddr, x->id.spi, x->id.proto, x->props.family);
 		XFRM_STATE_INSERT(byspi, &x->byspi, net->xfrm.state_byspi + h,
 				  x->xso.type);
+		xfrm_state_cache_invalidate(net);
 		spin_unlock_bh(&net->xfrm.xfrm_state_lock);
 
 		err = 0;
@@ -2893,6 +3003,9 @@ int __net_init xfrm_state_init(struct net *net)
 	net->xfrm.state_byseq = xfrm_hash_alloc(sz);
 	if (!net->xfrm.state_byseq)
 		goto out_byseq;
+	net->xfrm.state_cache_input = alloc_percpu(struct xfrm_state_cache);
+	if (!net->xfrm.state_cache_input)
+		goto out_state_cache_input;
 	net->xfrm.state_hmask = ((sz / sizeof(struct hlist_head)) - 1);
 
 	net->xfrm.state_num = 0;
@@ -2902,6 +3015,8 @@ int __net_init xfrm_state_init(struct net *net)
 			       &net->xfrm.xfrm_state_lock);
 	return 0;
 
+out_state_cache_input:
+	xfrm_hash_free(net->xfrm.state_byseq, sz);
 out_byseq:
 	xfrm_hash_free(net->xfrm.state_byspi, sz);
 out_byspi:
@@ -2931,6 +3046,7 @@ void xfrm_state_fini(struct net *net)
 	xfrm_hash_free(net->xfrm.state_bysrc, sz);
 	WARN_ON(!hlist_empty(net->xfrm.state_bydst));
 	xfrm_hash_free(net->xfrm.state_bydst, sz);
+	free_percpu(net->xfrm.state_cache_input);
 }
 
 #ifdef CONFIG_AUDITSYSCALL
@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <argp.h>
+#include <stdlib.h>
+#include <linux/bpf.h>
+#include "lpm_trie_bench.skel.h"
+#include "bench.h"
+
+#define NR_KEYS		(1 << 16)
+
+/* Same as struct lpm_key in the BPF program */
+struct lpm_key {
+	__u32 prefixlen;
+	__u8 data[16];
+};
+
+static struct ctx {
+	struct lpm_trie_bench *skel;
+} ctx;
+
+static struct {
+	__u32 nr_entries;
+	bool multibit;
+	bool ipv4;
+} args = {
+	.nr_entries = 100000,
+};
+
+enum {
+	ARG_NR_ENTRIES = 9001,
+	ARG_MULTIBIT,
+	ARG_IPV4,
+};
+
+static const struct argp_option opts[] = {
+	{ "nr_entries", ARG_NR_ENTRIES, "NR_ENTRIES", 0,
+	  "Set number of prefixes in the trie" },
+	{ "multibit", ARG_MULTIBIT, NULL, 0,
+	  "Create the trie with BPF_F_LPM_MULTIBIT" },
+	{ "ipv4", ARG_IPV4, NULL, 0,
+	  "Use 4 byte keys instead of 16 byte ones" },
+	{},
+};
+
+static error_t parse_arg(int key, char *arg, struct argp_state *state)
+{
+	long ret;
+
+	switch (key) {
+	case ARG_NR_ENTRIES:
+		ret = strtol(arg, NULL, 10);
+		if (ret < 1 || ret > (1 << 20)) {
+			fprintf(stderr, "invalid nr_entries\n");
+			argp_usage(state);
+		}
+		args.nr_entries = ret;
+		break;
+	case ARG_MULTIBIT:
+		args.multibit = true;
+		break;
+	case ARG_IPV4:
+		args.ipv4 = true;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+const struct argp bench_lpm_trie_map_argp = {
+	.options = opts,
+	.parser = parse_arg,
+};
+
+static void validate(void)
+{
+	if (env.consumer_cnt != 0) {
+		fprintf(stderr, "benchmark doesn't support consumer!\n");
+		exit(1);
+	}
+}
+
+static void *producer(void *input)
+{
+	while (true) {
+		/* trigger the bpf program */
+		syscall(__NR_getpgid);
+	}
+
+	return NULL;
+}
+
+static void measure(struct bench_res *res)
+{
+	res->hits = atomic_swap(&ctx.skel->bss->hits, 0);
+	res->drops = atomic_swap(&ctx.skel->bss->misses, 0);
+}
+
+/* Roughly the shape of a routing table: mostly /24 (or /48) prefixes, the
+ * rest spread over shorter lengths.
+ */
+static __u32 random_prefixlen(__u32 data_size)
+{
+	__u32 common = data_size == 4 ? 24 : 48;
+
+	if (rand() % 2)
+		return common;
+
+	return 8 + rand() % (common - 7);
+}
+
+static void random_bytes(__u8 *data, __u32 len)
+{
+	__u32 i;
+
+	for (i = 0; i < len; i++)
+		data[i] = rand();
+}
+
+static void fill_trie(int map_fd, struct lpm_key *prefixes, __u32 data_size)
+{
+	struct lpm_key *key;
+	__u32 i, val;
+
+	for (i = 0; i < args.nr_entries; i++) {
+		key = &prefixes[i];
+		key->prefixlen = random_prefixlen(data_size);
+		random_bytes(key->data, data_size);
+
+		val = i;
+		if (bpf_map_update_elem(map_fd, key, &val, BPF_ANY)) {
+			fprintf(stderr, "failed to add prefix %u\n", i);
+			exit(1);
+		}
+	}
+}
+
+/* Full length keys, three out of four falling in one of the prefixes */
+static void fill_lookup_keys(int map_fd, struct lpm_key *prefixes,
+			     __u32 data_size)
+{
+	struct lpm_key key;
+	__u32 i, j, bits;
+
+	for (i = 0; i < NR_KEYS; i++) {
+		memset(&key, 0, sizeof(key));
+		key.prefixlen = data_size * 8;
+		random_bytes(key.data, data_size);
+
+		if (i % 4) {
+			struct lpm_key *p = &prefixes[rand() % args.nr_entries];
+
+			for (j = 0; j < data_size; j++) {
+				bits = p->prefixlen > j * 8 ? p->prefixlen - j * 8 : 0;
+				if (bits >= 8)
+					key.data[j] = p->data[j];
+				else if (bits)
+					key.data[j] = (p->data[j] & (0xff << (8 - bits))) |
+						      (key.data[j] & (0xff >> bits));
+			}
+		}
+
+		if (bpf_map_update_elem(map_fd, &i, &key, BPF_ANY)) {
+			fprintf(stderr, "failed to add lookup key %u\n", i);
+			exit(1);
+		}
+	}
+}
+
+static void setup(void)
+{
+	__u32 data_size = args.ipv4 ? 4 : 16;
+	struct lpm_key *prefixes;
+	struct bpf_link *link;
+	__u32 flags;
+	int err;
+
+	setup_libbpf();
+
+	ctx.skel = lpm_trie_bench__open();
+	if (!ctx.skel) {
+		fprintf(stderr, "failed to open skeleton\n");
+		exit(1);
+	}
+
+	flags = bpf_map__map_flags(ctx.skel->maps.trie_map);
+	if (args.multibit)
+		flags |= BPF_F_LPM_MULTIBIT;
+	bpf_map__set_map_flags(ctx.skel->maps.trie_map, flags);
+	bpf_map__set_key_size(ctx.skel->maps.trie_map,
+			      sizeof(__u32) + data_size);
+
+	err = lpm_trie_bench__load(ctx.skel);
+	if (err) {
+		fprintf(stderr, "failed to load skeleton\n");
+		exit(1);
+	}
+
+	prefixes = calloc(args.nr_entries, sizeof(*prefixes));
+	if (!prefixes) {
+		fprintf(stderr, "failed to allocate prefixes\n");
+		exit(1);
+	}
+
+	srand(1);
+	fill_trie(bpf_map__fd(ctx.skel->maps.trie_map), prefixes, data_size);
+	fill_lookup_keys(bpf_map__fd(ctx.skel->maps.lookup_keys), prefixes,
+			 data_size);
+	free(prefixes);
+
+	link = bpf_program__attach(ctx.skel->progs.benchmark);
+	if (!link) {
+		fprintf(stderr, "failed to attach program!\n");
+		exit(1);
+	}
+}
+
+/* hits and drops are matching and non matching lookups */
+const struct bench bench_lpm_trie_map = {
+	.name = "lpm-trie-map",
+	.argp = &bench_lpm_trie_map_argp,
+	.validate = validate,
+	.setup = setup,
+	.producer_thread = producer,
+	.measure = measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = hits_drops_report_final,
+};
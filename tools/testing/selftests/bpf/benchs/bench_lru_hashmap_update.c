@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <argp.h>
+#include <stdlib.h>
+#include <linux/bpf.h>
+#include "lru_hashmap_update_bench.skel.h"
+#include "bench.h"
+
+static struct ctx {
+	struct lru_hashmap_update_bench *skel;
+} ctx;
+
+static struct {
+	__u32 max_entries;
+	bool percpu_lru;
+} args = {
+	.max_entries = 1 << 20,
+};
+
+enum {
+	ARG_MAX_ENTRIES = 9101,
+	ARG_PERCPU_LRU,
+};
+
+static const struct argp_option opts[] = {
+	{ "max_entries", ARG_MAX_ENTRIES, "MAX_ENTRIES", 0,
+	  "Set max_entries of the LRU hash map" },
+	{ "percpu_lru", ARG_PERCPU_LRU, NULL, 0,
+	  "Create the map with BPF_F_NO_COMMON_LRU" },
+	{},
+};
+
+static error_t parse_arg(int key, char *arg, struct argp_state *state)
+{
+	long ret;
+
+	switch (key) {
+	case ARG_MAX_ENTRIES:
+		ret = strtol(arg, NULL, 10);
+		if (ret < 1 || ret > UINT_MAX) {
+			fprintf(stderr, "invalid max_entries\n");
+			argp_usage(state);
+		}
+		args.max_entries = ret;
+		break;
+	case ARG_PERCPU_LRU:
+		args.percpu_lru = true;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+const struct argp bench_lru_hashmap_update_argp = {
+	.options = opts,
+	.parser = parse_arg,
+};
+
+static void validate(void)
+{
+	if (env.consumer_cnt != 0) {
+		fprintf(stderr, "benchmark doesn't support consumer!\n");
+		exit(1);
+	}
+}
+
+static void *producer(void *input)
+{
+	while (true) {
+		/* trigger the bpf program */
+		syscall(__NR_getpgid);
+	}
+
+	return NULL;
+}
+
+static void measure(struct bench_res *res)
+{
+	res->hits = atomic_swap(&ctx.skel->bss->updates, 0);
+	res->drops = atomic_swap(&ctx.skel->bss->failures, 0);
+}
+
+static void setup(void)
+{
+	struct bpf_link *link;
+	__u32 flags;
+
+	setup_libbpf();
+
+	ctx.skel = lru_hashmap_update_bench__open();
+	if (!ctx.skel) {
+		fprintf(stderr, "failed to open skeleton\n");
+		exit(1);
+	}
+
+	bpf_map__set_max_entries(ctx.skel->maps.lru_map, args.max_entries);
+	if (args.percpu_lru) {
+		flags = bpf_map__map_flags(ctx.skel->maps.lru_map);
+		bpf_map__set_map_flags(ctx.skel->maps.lru_map,
+				       flags | BPF_F_NO_COMMON_LRU);
+	}
+
+	if (lru_hashmap_update_bench__load(ctx.skel)) {
+		fprintf(stderr, "failed to load skeleton\n");
+		exit(1);
+	}
+
+	link = bpf_program__attach(ctx.skel->progs.benchmark);
+	if (!link) {
+		fprintf(stderr, "failed to attach program!\n");
+		exit(1);
+	}
+}
+
+/* hits and drops are successful and failed updates */
+const struct bench bench_lru_hashmap_update = {
+	.name = "lru-hashmap-update",
+	.argp = &bench_lru_hashmap_update_argp,
+	.validate = validate,
+	.setup = setup,
+	.producer_thread = producer,
+	.measure = measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = hits_drops_report_final,
+};
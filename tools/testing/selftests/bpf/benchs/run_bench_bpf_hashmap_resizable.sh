@@ -0,0 +1,27 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Lookup rate of hash maps holding a growing share of max_entries: with
+# preallocated elements, elements allocated on demand, and resizable buckets.
+# The first two have roundup_pow_of_two(max_entries) buckets whatever the
+# number of elements, the last one grows them with the elements.
+
+source ./benchs/run_common.sh
+
+set -eufo pipefail
+
+max_entries=${MAX_ENTRIES:-262144}
+
+BPF_F_NO_PREALLOC=$((1 << 0))
+BPF_F_RESIZABLE=$((1 << 15))
+
+header "Hashmap lookup vs. fill factor, max_entries $max_entries"
+for div in 64 16 4 2 1; do
+	nr_entries=$((max_entries / div))
+	for flags in 0 $BPF_F_NO_PREALLOC \
+		     $((BPF_F_NO_PREALLOC | BPF_F_RESIZABLE)); do
+		subtitle "nr_entries $nr_entries, map_flags $(printf 0x%x $flags)"
+		$RUN_BENCH bpf-hashmap-lookup --max_entries "$max_entries" \
+			--nr_entries "$nr_entries" --map_flags "$flags"
+	done
+done
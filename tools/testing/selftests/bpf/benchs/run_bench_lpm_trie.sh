@@ -0,0 +1,19 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Lookup rate of full length keys in LPM tries of growing size, walking the
+# binary trie, and going through the multibit index.
+
+source ./benchs/run_common.sh
+
+set -eufo pipefail
+
+for keys in --ipv4 ""; do
+	header "LPM trie lookup, ${keys:-ipv6} keys"
+	for nr_entries in 1000 10000 100000 1000000; do
+		for mb in "" --multibit; do
+			subtitle "nr_entries $nr_entries ${mb:---binary}"
+			$RUN_BENCH lpm-trie-map $keys $mb --nr_entries "$nr_entries"
+		done
+	done
+done
@@ -0,0 +1,21 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Update rate of full LRU hash maps, where each update evicts an element, as
+# the number of producers grows. The map's fdinfo reports the time spent
+# refilling free lists.
+
+source ./benchs/run_common.sh
+
+set -eufo pipefail
+
+max_entries=${MAX_ENTRIES:-1048576}
+
+for lru in "" --percpu_lru; do
+	header "LRU hashmap update, max_entries $max_entries ${lru:---common_lru}"
+	for p in 1 4 16 32 64; do
+		subtitle "producers $p"
+		$RUN_BENCH -p $p lru-hashmap-update $lru \
+			--max_entries "$max_entries"
+	done
+done
@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Concurrent lookups, updates and deletes on a BPF_F_RESIZABLE hash map,
+ * while its buckets grow and shrink under the updaters.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+
+#ifndef BPF_F_RESIZABLE
+#define BPF_F_RESIZABLE		(1U << 15)
+#endif
+
+#define MAX_ENTRIES		(1 << 16)
+/* always in the map, must be found by every lookup */
+#define NR_STABLE		1024
+#define NR_UPDATERS		4
+/* grows the map to ~3/4 of MAX_ENTRIES, then back to NR_STABLE */
+#define NR_CHURN		((MAX_ENTRIES / 4 * 3 - NR_STABLE) / NR_UPDATERS)
+#define NR_LOOKUPS		2
+#define NR_ROUNDS		8
+#define VALUE_MAGIC		0x5a5a5a5a
+
+static volatile int stop;
+
+struct lookup_arg {
+	int fd;
+	int nr_values;
+	unsigned long lookups;
+	unsigned long missing;
+	unsigned long corrupt;
+};
+
+static void *lookup_fn(void *arg)
+{
+	struct lookup_arg *l = arg;
+	__u64 *values;
+	__u32 key;
+	int i;
+
+	values = calloc(l->nr_values, sizeof(*values));
+	if (!values)
+		return NULL;
+
+	for (key = 0; !stop; key = (key + 7) % NR_STABLE) {
+		l->lookups++;
+		if (bpf_map_lookup_elem(l->fd, &key, values)) {
+			l->missing++;
+			continue;
+		}
+		for (i = 0; i < l->nr_values; i++)
+			if (values[i] != (key ^ VALUE_MAGIC))
+				l->corrupt++;
+	}
+
+	free(values);
+	return NULL;
+}
+
+struct update_arg {
+	int fd;
+	int id;
+	int nr_values;
+	int err;
+};
+
+static void *update_fn(void *arg)
+{
+	struct update_arg *u = arg;
+	__u32 first = NR_STABLE + u->id * NR_CHURN;
+	int round, i;
+	__u64 *values;
+	__u32 key;
+
+	values = calloc(u->nr_values, sizeof(*values));
+	if (!values) {
+		u->err = -ENOMEM;
+		return NULL;
+	}
+
+	for (round = 0; round < NR_ROUNDS; round++) {
+		for (key = first; key < first + NR_CHURN; key++) {
+			for (i = 0; i < u->nr_values; i++)
+				values[i] = key ^ VALUE_MAGIC;
+			if (bpf_map_update_elem(u->fd, &key, values,
+						BPF_NOEXIST)) {
+				u->err = -errno;
+				goto out;
+			}
+		}
+		for (key = first; key < first + NR_CHURN; key++) {
+			if (bpf_map_delete_elem(u->fd, &key)) {
+				u->err = -errno;
+				goto out;
+			}
+		}
+	}
+out:
+	free(values);
+	return NULL;
+}
+
+static void test_htab_resizable_type(enum bpf_map_type type)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts,
+		    .map_flags = BPF_F_NO_PREALLOC | BPF_F_RESIZABLE);
+	struct lookup_arg larg[NR_LOOKUPS] = {};
+	struct update_arg uarg[NR_UPDATERS] = {};
+	pthread_t lthr[NR_LOOKUPS], uthr[NR_UPDATERS];
+	__u64 *values;
+	__u32 key;
+	int fd, i, err, nr_cpus, nr_values;
+
+	nr_cpus = libbpf_num_possible_cpus();
+	CHECK(nr_cpus < 0, "nr_cpus", "err %d\n", nr_cpus);
+	nr_values = type == BPF_MAP_TYPE_PERCPU_HASH ? nr_cpus : 1;
+
+	fd = bpf_map_create(type, "htab_resizable", sizeof(key),
+			    sizeof(*values), MAX_ENTRIES, &opts);
+	if (fd < 0 && errno == EINVAL) {
+		printf("%s:SKIP: no BPF_F_RESIZABLE support\n", __func__);
+		skips++;
+		return;
+	}
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+
+	values = calloc(nr_cpus, sizeof(*values));
+	CHECK(!values, "calloc", "out of memory\n");
+
+	for (key = 0; key < NR_STABLE; key++) {
+		for (i = 0; i < nr_cpus; i++)
+			values[i] = key ^ VALUE_MAGIC;
+		err = bpf_map_update_elem(fd, &key, values, BPF_NOEXIST);
+		CHECK(err, "stable update", "key %u: %s\n", key,
+		      strerror(errno));
+	}
+
+	stop = 0;
+	for (i = 0; i < NR_LOOKUPS; i++) {
+		larg[i].fd = fd;
+		larg[i].nr_values = nr_values;
+		err = pthread_create(&lthr[i], NULL, lookup_fn, &larg[i]);
+		CHECK(err, "pthread_create", "lookup: %d\n", err);
+	}
+
+	for (i = 0; i < NR_UPDATERS; i++) {
+		uarg[i].fd = fd;
+		uarg[i].id = i;
+		uarg[i].nr_values = nr_values;
+		err = pthread_create(&uthr[i], NULL, update_fn, &uarg[i]);
+		CHECK(err, "pthread_create", "update: %d\n", err);
+	}
+
+	for (i = 0; i < NR_UPDATERS; i++) {
+		pthread_join(uthr[i], NULL);
+		CHECK(uarg[i].err, "churn", "updater %d: %s\n", i,
+		      strerror(-uarg[i].err));
+	}
+
+	stop = 1;
+	for (i = 0; i < NR_LOOKUPS; i++) {
+		pthread_join(lthr[i], NULL);
+		CHECK(!larg[i].lookups, "lookup", "thread %d didn't run\n", i);
+		CHECK(larg[i].missing || larg[i].corrupt, "lookup",
+		      "%lu of %lu lookups missed a stable key, %lu got a wrong value\n",
+		      larg[i].missing, larg[i].lookups, larg[i].corrupt);
+	}
+
+	/* after the churn, only the stable keys are left, all intact */
+	for (key = 0; key < NR_STABLE + NR_UPDATERS * NR_CHURN; key++) {
+		err = bpf_map_lookup_elem(fd, &key, values);
+		if (key >= NR_STABLE) {
+			CHECK(!err || errno != ENOENT, "deleted key",
+			      "key %u: err %d errno %d\n", key, err, errno);
+			continue;
+		}
+		CHECK(err, "stable key", "key %u: %s\n", key, strerror(errno));
+		for (i = 0; i < nr_values; i++)
+			CHECK(values[i] != (key ^ VALUE_MAGIC), "stable value",
+			      "key %u cpu %d: %llx\n", key, i,
+			      (unsigned long long)values[i]);
+	}
+
+	/* grow again, up to max_entries, which still has to be enforced */
+	for (key = NR_STABLE; key < MAX_ENTRIES; key++) {
+		for (i = 0; i < nr_cpus; i++)
+			values[i] = key ^ VALUE_MAGIC;
+		err = bpf_map_update_elem(fd, &key, values, BPF_NOEXIST);
+		CHECK(err, "fill", "key %u: %s\n", key, strerror(errno));
+	}
+	key = MAX_ENTRIES;
+	err = bpf_map_update_elem(fd, &key, values, BPF_NOEXIST);
+	CHECK(!err || errno != E2BIG, "full map",
+	      "update past max_entries: err %d errno %d\n", err, errno);
+
+	free(values);
+	close(fd);
+}
+
+void test_htab_resizable(void)
+{
+	test_htab_resizable_type(BPF_MAP_TYPE_HASH);
+	printf("%s:PASS (hash)\n", __func__);
+	test_htab_resizable_type(BPF_MAP_TYPE_PERCPU_HASH);
+	printf("%s:PASS (percpu hash)\n", __func__);
+}
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Lookups through the BPF_F_LPM_MULTIBIT index of an LPM trie must return
+ * what the binary trie returns: fill two maps, with and without the flag,
+ * with the same random and overlapping prefixes, delete some of them, and
+ * compare lookups of addresses around every prefix boundary.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+
+#ifndef BPF_F_LPM_MULTIBIT
+#define BPF_F_LPM_MULTIBIT	(1U << 16)
+#endif
+
+#define NR_PREFIXES		2048
+#define NR_RANDOM_LOOKUPS	65536
+#define DATA_SIZE_MAX		16
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+#endif
+
+struct lpm_key {
+	__u32 prefixlen;
+	__u8 data[DATA_SIZE_MAX];
+};
+
+struct prefix {
+	struct lpm_key key;
+	__u32 value;
+};
+
+static struct prefix prefixes[NR_PREFIXES];
+
+/* A few base addresses with random low bits, so that prefixes overlap and
+ * nest, plus some default-ish short ones.
+ */
+static void gen_prefix(struct lpm_key *key, int data_size)
+{
+	static const __u8 bases[][2] = { { 10, 0 }, { 10, 1 }, { 192, 168 },
+					 { 0x20, 0x01 }, { 0xfe, 0x80 } };
+	int i, b = rand() % ARRAY_SIZE(bases);
+	int max_bits = data_size * 8;
+
+	memset(key, 0, sizeof(*key));
+	key->data[0] = bases[b][0];
+	key->data[1] = bases[b][1];
+	for (i = 2; i < data_size; i++)
+		key->data[i] = rand() % 4 ? rand() & 0x0f : rand();
+
+	switch (rand() % 4) {
+	case 0:		/* host routes */
+		key->prefixlen = max_bits;
+		break;
+	case 1:		/* on a byte boundary */
+		key->prefixlen = (rand() % data_size + 1) * 8;
+		break;
+	default:
+		key->prefixlen = rand() % (max_bits + 1);
+		break;
+	}
+
+	/* the trie ignores bits past prefixlen, keep them clear anyway */
+	for (i = key->prefixlen; i < max_bits; i++)
+		key->data[i / 8] &= ~(0x80 >> (i % 8));
+}
+
+static void lookup_both(int ref_fd, int mb_fd, const struct lpm_key *key,
+			int data_size, const char *what)
+{
+	__u32 ref_value, mb_value;
+	int ref_err, mb_err, i;
+
+	ref_err = bpf_map_lookup_elem(ref_fd, key, &ref_value) ? -errno : 0;
+	mb_err = bpf_map_lookup_elem(mb_fd, key, &mb_value) ? -errno : 0;
+
+	if (ref_err == mb_err && (ref_err || ref_value == mb_value))
+		return;
+
+	printf("%s: data_size %d, address", what, data_size);
+	for (i = 0; i < data_size; i++)
+		printf("%s%02x", i ? ":" : " ", key->data[i]);
+	printf(": binary trie %d/%u, multibit %d/%u\n",
+	       ref_err, ref_err ? 0 : ref_value, mb_err, mb_err ? 0 : mb_value);
+	CHECK(1, "lookup mismatch", "\n");
+}
+
+/* Look up addresses at, just inside and just outside each prefix */
+static void compare_lookups(int ref_fd, int mb_fd, int data_size)
+{
+	int max_bits = data_size * 8;
+	struct lpm_key key;
+	int i, j, bit;
+
+	for (i = 0; i < NR_PREFIXES; i++) {
+		const struct prefix *p = &prefixes[i];
+
+		key = p->key;
+		key.prefixlen = max_bits;
+		lookup_both(ref_fd, mb_fd, &key, data_size, "prefix start");
+
+		/* last address of the prefix */
+		for (bit = p->key.prefixlen; bit < max_bits; bit++)
+			key.data[bit / 8] |= 0x80 >> (bit % 8);
+		lookup_both(ref_fd, mb_fd, &key, data_size, "prefix end");
+
+		/* flip the last bit of the prefix */
+		if (p->key.prefixlen) {
+			bit = p->key.prefixlen - 1;
+			key.data[bit / 8] ^= 0x80 >> (bit % 8);
+			lookup_both(ref_fd, mb_fd, &key, data_size,
+				    "sibling prefix");
+		}
+	}
+
+	for (i = 0; i < NR_RANDOM_LOOKUPS; i++) {
+		key = prefixes[rand() % NR_PREFIXES].key;
+		key.prefixlen = max_bits;
+		for (j = rand() % max_bits; j < max_bits; j++)
+			if (rand() & 1)
+				key.data[j / 8] ^= 0x80 >> (j % 8);
+		lookup_both(ref_fd, mb_fd, &key, data_size, "random");
+	}
+}
+
+static void test_lpm_multibit_size(int data_size)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, ref_opts,
+		    .map_flags = BPF_F_NO_PREALLOC);
+	LIBBPF_OPTS(bpf_map_create_opts, mb_opts,
+		    .map_flags = BPF_F_NO_PREALLOC | BPF_F_LPM_MULTIBIT);
+	size_t key_size = sizeof(__u32) + data_size;
+	int ref_fd, mb_fd, i, err;
+
+	ref_fd = bpf_map_create(BPF_MAP_TYPE_LPM_TRIE, "lpm_ref", key_size,
+				sizeof(__u32), NR_PREFIXES, &ref_opts);
+	CHECK(ref_fd < 0, "bpf_map_create", "reference: %s\n",
+	      strerror(errno));
+
+	mb_fd = bpf_map_create(BPF_MAP_TYPE_LPM_TRIE, "lpm_multibit", key_size,
+			       sizeof(__u32), NR_PREFIXES, &mb_opts);
+	if (mb_fd < 0 && errno == EINVAL) {
+		printf("%s:SKIP: no BPF_F_LPM_MULTIBIT support\n", __func__);
+		skips++;
+		close(ref_fd);
+		return;
+	}
+	CHECK(mb_fd < 0, "bpf_map_create", "multibit: %s\n", strerror(errno));
+
+	/* duplicates just replace the value, in both maps alike */
+	for (i = 0; i < NR_PREFIXES; i++) {
+		gen_prefix(&prefixes[i].key, data_size);
+		prefixes[i].value = i;
+
+		err = bpf_map_update_elem(ref_fd, &prefixes[i].key,
+					  &prefixes[i].value, BPF_ANY);
+		CHECK(err, "update", "reference: %s\n", strerror(errno));
+		err = bpf_map_update_elem(mb_fd, &prefixes[i].key,
+					  &prefixes[i].value, BPF_ANY);
+		CHECK(err, "update", "multibit: %s\n", strerror(errno));
+	}
+	compare_lookups(ref_fd, mb_fd, data_size);
+
+	/* delete a third of them, including prefixes others are nested in */
+	for (i = 0; i < NR_PREFIXES; i += 3) {
+		int ref_err, mb_err;
+
+		ref_err = bpf_map_delete_elem(ref_fd, &prefixes[i].key) ?
+			  -errno : 0;
+		mb_err = bpf_map_delete_elem(mb_fd, &prefixes[i].key) ?
+			 -errno : 0;
+		CHECK(ref_err != mb_err, "delete",
+		      "prefix %d: reference %d, multibit %d\n", i, ref_err,
+		      mb_err);
+	}
+	compare_lookups(ref_fd, mb_fd, data_size);
+
+	/* and put some back, with new values */
+	for (i = 0; i < NR_PREFIXES; i += 6) {
+		prefixes[i].value = NR_PREFIXES + i;
+		err = bpf_map_update_elem(ref_fd, &prefixes[i].key,
+					  &prefixes[i].value, BPF_ANY);
+		CHECK(err, "update", "reference: %s\n", strerror(errno));
+		err = bpf_map_update_elem(mb_fd, &prefixes[i].key,
+					  &prefixes[i].value, BPF_ANY);
+		CHECK(err, "update", "multibit: %s\n", strerror(errno));
+	}
+	compare_lookups(ref_fd, mb_fd, data_size);
+
+	close(mb_fd);
+	close(ref_fd);
+}
+
+void test_lpm_trie_multibit(void)
+{
+	srand(getpid());
+
+	test_lpm_multibit_size(4);
+	printf("%s:PASS (IPv4 sized keys)\n", __func__);
+	test_lpm_multibit_size(16);
+	printf("%s:PASS (IPv6 sized keys)\n", __func__);
+	test_lpm_multibit_size(3);
+	printf("%s:PASS (3 byte keys)\n", __func__);
+}
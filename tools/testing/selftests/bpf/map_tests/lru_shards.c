@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-2.0
+/* A common LRU hash map split in shards must still hold max_entries
+ * elements when all of them are inserted from a single CPU: its free
+ * elements are spread over all shards, and none may be evicted before
+ * they're all used up.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+
+/* see SHARD_NR_CPUS and SHARD_MIN_ELEMS in kernel/bpf/bpf_lru_list.c */
+#define SHARD_NR_CPUS		8
+#define SHARD_MIN_ELEMS		(128 * 64)
+#define MAX_SHARDS		16
+/* a single refill evicts at most that many elements */
+#define LOCAL_FREE_TARGET	128
+
+struct lru_fdinfo {
+	unsigned int shards;
+	unsigned long long evicted;
+	unsigned long long stolen;
+};
+
+static void read_fdinfo(int map_fd, struct lru_fdinfo *info)
+{
+	char path[64], line[128];
+	FILE *f;
+
+	memset(info, 0, sizeof(*info));
+
+	snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", map_fd);
+	f = fopen(path, "r");
+	CHECK(!f, "fopen", "%s: %s\n", path, strerror(errno));
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "lru_shards:\t%u", &info->shards) == 1)
+			continue;
+		if (sscanf(line, "lru_evicted:\t%llu", &info->evicted) == 1)
+			continue;
+		sscanf(line, "lru_stolen:\t%llu", &info->stolen);
+	}
+
+	fclose(f);
+}
+
+static unsigned int count_keys(int map_fd, unsigned int nr_keys)
+{
+	unsigned int key, found = 0;
+	__u64 value;
+
+	for (key = 0; key < nr_keys; key++)
+		if (!bpf_map_lookup_elem(map_fd, &key, &value))
+			found++;
+	return found;
+}
+
+void test_lru_shards(void)
+{
+	unsigned int max_entries, key, found;
+	struct lru_fdinfo info;
+	int map_fd, nr_cpus, cpu, err;
+	cpu_set_t cpus, one_cpu;
+	__u64 value;
+
+	nr_cpus = libbpf_num_possible_cpus();
+	CHECK(nr_cpus < 0, "nr_cpus", "err %d\n", nr_cpus);
+
+	/* enough elements for as many shards as there can be */
+	max_entries = SHARD_MIN_ELEMS *
+		      ((nr_cpus + SHARD_NR_CPUS - 1) / SHARD_NR_CPUS);
+	if (max_entries > SHARD_MIN_ELEMS * MAX_SHARDS)
+		max_entries = SHARD_MIN_ELEMS * MAX_SHARDS;
+
+	map_fd = bpf_map_create(BPF_MAP_TYPE_LRU_HASH, "lru_shards",
+				sizeof(key), sizeof(value), max_entries, NULL);
+	CHECK(map_fd < 0, "bpf_map_create", "%s\n", strerror(errno));
+
+	read_fdinfo(map_fd, &info);
+	if (!info.shards) {
+		printf("%s:SKIP: no LRU shards in fdinfo\n", __func__);
+		skips++;
+		close(map_fd);
+		return;
+	}
+
+	/* the updates all refill the local free list of one CPU */
+	CHECK(sched_getaffinity(0, sizeof(cpus), &cpus), "affinity", "%s\n",
+	      strerror(errno));
+	for (cpu = 0; !CPU_ISSET(cpu, &cpus); cpu++)
+		;
+	CPU_ZERO(&one_cpu);
+	CPU_SET(cpu, &one_cpu);
+	CHECK(sched_setaffinity(0, sizeof(one_cpu), &one_cpu), "affinity",
+	      "cpu %d: %s\n", cpu, strerror(errno));
+
+	for (key = 0; key < max_entries; key++) {
+		value = key;
+		err = bpf_map_update_elem(map_fd, &key, &value, BPF_NOEXIST);
+		CHECK(err, "update", "key %u: %s\n", key, strerror(errno));
+	}
+
+	found = count_keys(map_fd, max_entries);
+	read_fdinfo(map_fd, &info);
+	CHECK(found != max_entries || info.evicted, "fill",
+	      "%u of %u keys left, %llu evicted, %u shards\n", found,
+	      max_entries, info.evicted, info.shards);
+	CHECK(info.shards > 1 && !info.stolen, "fill",
+	      "no element taken from the other %u shards\n", info.shards - 1);
+
+	/* one more, and the map has to evict, but not more than a refill */
+	key = max_entries;
+	value = key;
+	err = bpf_map_update_elem(map_fd, &key, &value, BPF_NOEXIST);
+	CHECK(err, "update", "key %u: %s\n", key, strerror(errno));
+
+	found = count_keys(map_fd, max_entries + 1);
+	read_fdinfo(map_fd, &info);
+	CHECK(!info.evicted || found < max_entries + 1 - LOCAL_FREE_TARGET,
+	      "full map", "%u of %u keys left, %llu evicted\n", found,
+	      max_entries + 1, info.evicted);
+	CHECK(bpf_map_lookup_elem(map_fd, &key, &value) || value != key,
+	      "full map", "key %u missing right after its update\n", key);
+
+	CHECK(sched_setaffinity(0, sizeof(cpus), &cpus), "affinity", "%s\n",
+	      strerror(errno));
+	close(map_fd);
+
+	printf("%s:PASS (%u shards)\n", __func__, info.shards);
+}
@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Records which don't fit in a BPF ring buffer are counted as drops, on the
+ * CPU of the producer: run bpf_ringbuf_output() more often than the ring
+ * can hold, from threads pinned to different CPUs, and check the counts
+ * shown in fdinfo against the records the consumer gets.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+
+#define RING_SIZE		4096
+#define REC_SIZE		8
+/* header and data, the ring is never completely full */
+#define RING_RECS		((RING_SIZE - 1) / (REC_SIZE + 8))
+#define NR_RUNS			1000
+#define MAX_THREADS		4
+#define REC_MAGIC		0x5a5a5a5a
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+#endif
+
+static int load_prog(int map_fd)
+{
+	struct bpf_insn insns[] = {
+		BPF_ST_MEM(BPF_DW, BPF_REG_10, -REC_SIZE, REC_MAGIC),
+		BPF_LD_MAP_FD(BPF_REG_1, map_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -REC_SIZE),
+		BPF_MOV64_IMM(BPF_REG_3, REC_SIZE),
+		BPF_MOV64_IMM(BPF_REG_4, 0),
+		BPF_EMIT_CALL(BPF_FUNC_ringbuf_output),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+
+	return bpf_prog_load(BPF_PROG_TYPE_SOCKET_FILTER, "ringbuf_drops",
+			     "GPL", insns, ARRAY_SIZE(insns), NULL);
+}
+
+/* Drops of all CPUs, and of each of them, as shown in fdinfo: CPUs without
+ * drops aren't listed.
+ */
+static unsigned long read_drops(int map_fd, unsigned long *cpu_drops,
+				int nr_cpus)
+{
+	unsigned long val, total = -1UL;
+	char path[64], line[128];
+	FILE *f;
+	int cpu;
+
+	memset(cpu_drops, 0, nr_cpus * sizeof(*cpu_drops));
+
+	snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", map_fd);
+	f = fopen(path, "r");
+	CHECK(!f, "fopen", "%s: %s\n", path, strerror(errno));
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "drops:\t%lu", &val) == 1)
+			total = val;
+		else if (sscanf(line, "drops_cpu%d:\t%lu", &cpu, &val) == 2 &&
+			 cpu >= 0 && cpu < nr_cpus)
+			cpu_drops[cpu] = val;
+	}
+
+	fclose(f);
+	return total;
+}
+
+struct run_arg {
+	int prog_fd;
+	int cpu;
+	int err;
+};
+
+static void *run_fn(void *arg)
+{
+	struct run_arg *r = arg;
+	char pkt[64] = {};
+	LIBBPF_OPTS(bpf_test_run_opts, topts,
+		    .data_in = pkt,
+		    .data_size_in = sizeof(pkt),
+		    .repeat = NR_RUNS);
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(r->cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+		r->err = -errno;
+		return NULL;
+	}
+
+	if (bpf_prog_test_run_opts(r->prog_fd, &topts))
+		r->err = -errno;
+	return NULL;
+}
+
+static int nr_records;
+
+static int record_cb(void *ctx, void *data, size_t size)
+{
+	CHECK(size != REC_SIZE || *(__u64 *)data != REC_MAGIC, "record",
+	      "size %zu, data %llx\n", size,
+	      (unsigned long long)*(__u64 *)data);
+	nr_records++;
+	return 0;
+}
+
+static void run_on_cpus(int prog_fd, const int *cpus, int nr_threads)
+{
+	struct run_arg arg[MAX_THREADS] = {};
+	pthread_t thr[MAX_THREADS];
+	int i, err;
+
+	for (i = 0; i < nr_threads; i++) {
+		arg[i].prog_fd = prog_fd;
+		arg[i].cpu = cpus[i];
+		err = pthread_create(&thr[i], NULL, run_fn, &arg[i]);
+		CHECK(err, "pthread_create", "cpu %d: %d\n", cpus[i], err);
+	}
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(thr[i], NULL);
+		CHECK(arg[i].err, "test_run", "cpu %d: %s\n", cpus[i],
+		      strerror(-arg[i].err));
+	}
+}
+
+void test_ringbuf_drops(void)
+{
+	unsigned long *drops, *prev, total, sum;
+	int cpus[MAX_THREADS], nr_threads = 0;
+	int map_fd, prog_fd, nr_cpus, i, cpu;
+	struct ring_buffer *ringbuf;
+	cpu_set_t online;
+
+	nr_cpus = libbpf_num_possible_cpus();
+	CHECK(nr_cpus < 0, "nr_cpus", "err %d\n", nr_cpus);
+
+	CHECK(sched_getaffinity(0, sizeof(online), &online), "affinity",
+	      "%s\n", strerror(errno));
+	for (cpu = 0; cpu < CPU_SETSIZE && nr_threads < MAX_THREADS; cpu++)
+		if (CPU_ISSET(cpu, &online))
+			cpus[nr_threads++] = cpu;
+
+	drops = calloc(nr_cpus, sizeof(*drops));
+	prev = calloc(nr_cpus, sizeof(*prev));
+	CHECK(!drops || !prev, "calloc", "out of memory\n");
+
+	map_fd = bpf_map_create(BPF_MAP_TYPE_RINGBUF, "ringbuf_drops", 0, 0,
+				RING_SIZE, NULL);
+	CHECK(map_fd < 0, "bpf_map_create", "%s\n", strerror(errno));
+
+	total = read_drops(map_fd, drops, nr_cpus);
+	if (total == -1UL) {
+		printf("%s:SKIP: no ring buffer drops in fdinfo\n", __func__);
+		skips++;
+		goto out_map;
+	}
+	CHECK(total, "drops", "%lu on a new map\n", total);
+
+	prog_fd = load_prog(map_fd);
+	CHECK(prog_fd < 0, "bpf_prog_load", "%s\n", strerror(errno));
+
+	ringbuf = ring_buffer__new(map_fd, record_cb, NULL, NULL);
+	CHECK(!ringbuf, "ring_buffer__new", "%s\n", strerror(errno));
+
+	/* one CPU: the ring fills up, all the rest is dropped on that CPU */
+	run_on_cpus(prog_fd, cpus, 1);
+	total = read_drops(map_fd, drops, nr_cpus);
+	CHECK(total != NR_RUNS - RING_RECS, "drops",
+	      "%lu on cpu %d, expected %d\n", total, cpus[0],
+	      NR_RUNS - RING_RECS);
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		CHECK(drops[cpu] != (cpu == cpus[0] ? total : 0), "cpu drops",
+		      "cpu %d: %lu, producer on cpu %d\n", cpu, drops[cpu],
+		      cpus[0]);
+
+	nr_records = 0;
+	CHECK(ring_buffer__consume(ringbuf) < 0, "consume", "%s\n",
+	      strerror(errno));
+	CHECK(nr_records != RING_RECS, "records", "got %d, expected %d\n",
+	      nr_records, RING_RECS);
+
+	/* several CPUs at once: nothing is lost, or counted twice */
+	memcpy(prev, drops, nr_cpus * sizeof(*prev));
+	run_on_cpus(prog_fd, cpus, nr_threads);
+	total = read_drops(map_fd, drops, nr_cpus);
+
+	nr_records = 0;
+	CHECK(ring_buffer__consume(ringbuf) < 0, "consume", "%s\n",
+	      strerror(errno));
+	CHECK(nr_records != RING_RECS, "records", "got %d, expected %d\n",
+	      nr_records, RING_RECS);
+
+	for (sum = 0, cpu = 0; cpu < nr_cpus; cpu++) {
+		for (i = 0; i < nr_threads; i++)
+			if (cpus[i] == cpu)
+				break;
+		CHECK(i == nr_threads && drops[cpu] != prev[cpu], "cpu drops",
+		      "cpu %d: %lu, without a producer\n", cpu, drops[cpu]);
+		CHECK(drops[cpu] - prev[cpu] > NR_RUNS, "cpu drops",
+		      "cpu %d: %lu more, out of %d runs\n", cpu,
+		      drops[cpu] - prev[cpu], NR_RUNS);
+		sum += drops[cpu];
+	}
+	CHECK(sum != total, "drops", "cpus sum up to %lu, total %lu\n", sum,
+	      total);
+	CHECK(total != NR_RUNS - RING_RECS + nr_threads * NR_RUNS - RING_RECS,
+	      "drops", "%lu with %d producers\n", total, nr_threads);
+
+	printf("%s:PASS (%d producer cpus)\n", __func__, nr_threads);
+
+	ring_buffer__free(ringbuf);
+	close(prog_fd);
+out_map:
+	close(map_fd);
+	free(prev);
+	free(drops);
+}
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-2.0
+/* The verifier keeps the explored states of an insn in lists hashed by the
+ * insn and a signature of the call chain, locks and references of the state,
+ * which states_equal() requires to be the same. States of a subprog reached
+ * through different call chains must not be looked at, let alone compared:
+ * load a subprog called from many places with BPF_F_TEST_STATE_FREQ, so that
+ * a state is kept on every visit of a prune point, and check in the
+ * BPF_LOG_PROFILE output that only the odd hash collision is passed over.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+
+/* call sites of the outer subprog */
+#define NR_CALLS		8
+/* makes the program long, so that the hash lists are short */
+#define NR_PAD			200
+#define NR_INSNS		(NR_PAD + 2 * NR_CALLS + 2 + 2 + 4)
+
+/* see include/linux/bpf_verifier.h */
+#define LOG_STATS		4
+#define LOG_PROFILE		16
+
+#define LOG_SIZE		(64 * 1024)
+
+/* main calls outer() from NR_CALLS places, outer() calls inner() from one,
+ * so the states of inner() differ in the call site of outer() only.
+ */
+static int build_prog(struct bpf_insn *insns)
+{
+	int outer = NR_PAD + 2 * NR_CALLS + 2;
+	int inner = outer + 2;
+	int i, n = 0;
+
+	for (i = 0; i < NR_PAD; i++)
+		insns[n++] = BPF_MOV64_IMM(BPF_REG_2, 0);
+	for (i = 0; i < NR_CALLS; i++) {
+		insns[n++] = BPF_MOV64_IMM(BPF_REG_1, i);
+		insns[n] = BPF_CALL_REL(outer - n - 1);
+		n++;
+	}
+	insns[n++] = BPF_MOV64_IMM(BPF_REG_0, 0);
+	insns[n++] = BPF_EXIT_INSN();
+
+	/* outer() */
+	insns[n] = BPF_CALL_REL(inner - n - 1);
+	n++;
+	insns[n++] = BPF_EXIT_INSN();
+
+	/* inner() */
+	insns[n++] = BPF_MOV64_IMM(BPF_REG_0, 0);
+	insns[n++] = BPF_JMP_IMM(BPF_JGT, BPF_REG_1, NR_CALLS / 2, 1);
+	insns[n++] = BPF_MOV64_IMM(BPF_REG_0, 1);
+	insns[n++] = BPF_EXIT_INSN();
+
+	return n;
+}
+
+void test_verifier_state_sig(void)
+{
+	LIBBPF_OPTS(bpf_prog_load_opts, opts,
+		    .log_size = LOG_SIZE,
+		    .log_level = LOG_STATS | LOG_PROFILE,
+		    .prog_flags = BPF_F_TEST_STATE_FREQ);
+	struct bpf_insn insns[NR_INSNS];
+	unsigned int skipped;
+	char *log, *line;
+	int prog_fd, cnt;
+
+	log = calloc(1, LOG_SIZE);
+	CHECK(!log, "calloc", "out of memory\n");
+	opts.log_buf = log;
+
+	cnt = build_prog(insns);
+	CHECK(cnt != NR_INSNS, "build_prog", "%d insns, expected %d\n", cnt,
+	      NR_INSNS);
+
+	prog_fd = bpf_prog_load(BPF_PROG_TYPE_SOCKET_FILTER, "state_sig", "GPL",
+				insns, cnt, &opts);
+	/* log level rejected before anything is logged */
+	if (prog_fd < 0 && errno == EINVAL && !log[0]) {
+		printf("%s:SKIP: no BPF_LOG_PROFILE\n", __func__);
+		skips++;
+		goto out;
+	}
+	CHECK(prog_fd < 0, "bpf_prog_load", "%s\n%s\n", strerror(errno), log);
+
+	line = strstr(log, "states skipped by signature ");
+	CHECK(!line || sscanf(line, "states skipped by signature %u",
+			      &skipped) != 1,
+	      "log", "no signature count in:\n%s\n", log);
+
+	/* With all the states of an insn in one list, each of the NR_CALLS
+	 * states of inner() would be passed over by the next ones until
+	 * evicted, several dozen times in all. Here it only takes a collision
+	 * of (insn, signature) hashes, of which there are very few with
+	 * lists much shorter than the program.
+	 */
+	CHECK(skipped >= NR_CALLS, "skipped",
+	      "%u states skipped by signature:\n%s\n", skipped, log);
+
+	printf("%s:PASS (%u states skipped)\n", __func__, skipped);
+
+	close(prog_fd);
+out:
+	free(log);
+}
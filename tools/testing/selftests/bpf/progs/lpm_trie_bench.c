@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include "bpf_misc.h"
+
+char _license[] SEC("license") = "GPL";
+
+#define MAX_ENTRIES	(1 << 20)
+#define NR_KEYS		(1 << 16)
+#define NR_LOOPS	1000
+
+/* IPv6 sized keys, IPv4 ones only use the first 4 bytes of data */
+struct lpm_key {
+	__u32 prefixlen;
+	__u8 data[16];
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_LPM_TRIE);
+	__uint(max_entries, MAX_ENTRIES);
+	__type(key, struct lpm_key);
+	__type(value, __u32);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+} trie_map SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, NR_KEYS);
+	__type(key, __u32);
+	__type(value, struct lpm_key);
+} lookup_keys SEC(".maps");
+
+long hits;
+long misses;
+
+struct lookup_ctx {
+	__u32 start;
+	long hits;
+	long misses;
+};
+
+static int lookup_cb(__u32 index, struct lookup_ctx *ctx)
+{
+	__u32 i = (ctx->start + index) % NR_KEYS;
+	struct lpm_key *key;
+
+	key = bpf_map_lookup_elem(&lookup_keys, &i);
+	if (!key)
+		return 1;
+
+	if (bpf_map_lookup_elem(&trie_map, key))
+		ctx->hits++;
+	else
+		ctx->misses++;
+
+	return 0;
+}
+
+SEC("fentry/" SYS_PREFIX "sys_getpgid")
+int benchmark(void *ctx)
+{
+	struct lookup_ctx lctx = { .start = bpf_get_prandom_u32() };
+
+	bpf_loop(NR_LOOPS, lookup_cb, &lctx, 0);
+	__sync_add_and_fetch(&hits, lctx.hits);
+	__sync_add_and_fetch(&misses, lctx.misses);
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include "bpf_misc.h"
+
+char _license[] SEC("license") = "GPL";
+
+#define NR_LOOPS	1000
+
+struct {
+	__uint(type, BPF_MAP_TYPE_LRU_HASH);
+	__uint(max_entries, 1 << 20);
+	__type(key, __u64);
+	__type(value, __u64);
+} lru_map SEC(".maps");
+
+long updates;
+long failures;
+
+struct update_ctx {
+	__u64 key;
+	long updates;
+	long failures;
+};
+
+static int update_cb(__u32 index, struct update_ctx *ctx)
+{
+	__u64 key = ctx->key + index;
+
+	if (bpf_map_update_elem(&lru_map, &key, &key, BPF_ANY))
+		ctx->failures++;
+	else
+		ctx->updates++;
+
+	return 0;
+}
+
+/* Every update inserts a new key, so that once the map is full, each one of
+ * them evicts an element.
+ */
+SEC("fentry/" SYS_PREFIX "sys_getpgid")
+int benchmark(void *ctx)
+{
+	struct update_ctx uctx = {
+		.key = (__u64)bpf_get_prandom_u32() << 32 | bpf_get_prandom_u32(),
+	};
+
+	bpf_loop(NR_LOOPS, update_cb, &uctx, 0);
+	__sync_add_and_fetch(&updates, uctx.updates);
+	__sync_add_and_fetch(&failures, uctx.failures);
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0
+/* MSG_ZEROCOPY on AF_UNIX stream sockets: once the completion for a send
+ * has been reported, the sender may rewrite its buffer, and no reader,
+ * whether it uses recvmsg() or splice(), may see the new contents.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/errqueue.h>
+
+#include "../../kselftest_harness.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+/* Above UNIX_ZEROCOPY_MIN, so the pages really are referenced */
+#define BUF_LEN		(64 * 1024)
+
+FIXTURE(msg_zerocopy)
+{
+	int fd[2];
+	char *buf;
+	char *rbuf;
+};
+
+FIXTURE_SETUP(msg_zerocopy)
+{
+	int one = 1, sndbuf = 4 * BUF_LEN;
+
+	ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, self->fd));
+
+	if (setsockopt(self->fd[0], SOL_SOCKET, SO_ZEROCOPY, &one,
+		       sizeof(one)))
+		SKIP(return, "SO_ZEROCOPY not supported on AF_UNIX");
+
+	ASSERT_EQ(0, setsockopt(self->fd[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+				sizeof(sndbuf)));
+
+	self->buf = malloc(BUF_LEN);
+	self->rbuf = malloc(BUF_LEN);
+	ASSERT_NE(NULL, self->buf);
+	ASSERT_NE(NULL, self->rbuf);
+}
+
+FIXTURE_TEARDOWN(msg_zerocopy)
+{
+	free(self->buf);
+	free(self->rbuf);
+	close(self->fd[0]);
+	close(self->fd[1]);
+}
+
+static void send_zerocopy(struct __test_metadata *_metadata, int fd,
+			  char *buf, size_t len)
+{
+	size_t sent = 0;
+	ssize_t ret;
+
+	while (sent < len) {
+		ret = send(fd, buf + sent, len - sent, MSG_ZEROCOPY);
+		ASSERT_LT(0, ret);
+		sent += ret;
+	}
+}
+
+/* Wait for, and reap, the completions of all sends so far */
+static void wait_completion(struct __test_metadata *_metadata, int fd)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	struct pollfd pfd = { .fd = fd, .events = 0 };
+	struct sock_extended_err *serr;
+	struct msghdr msg = {};
+	struct cmsghdr *cm;
+
+	ASSERT_EQ(1, poll(&pfd, 1, 2000));
+	ASSERT_TRUE(pfd.revents & POLLERR);
+
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	ASSERT_EQ(0, recvmsg(fd, &msg, MSG_ERRQUEUE));
+
+	cm = CMSG_FIRSTHDR(&msg);
+	ASSERT_NE(NULL, cm);
+	ASSERT_EQ(SOL_SOCKET, cm->cmsg_level);
+	ASSERT_EQ(SO_ZEROCOPY, cm->cmsg_type);
+
+	serr = (struct sock_extended_err *)CMSG_DATA(cm);
+	ASSERT_EQ(SO_EE_ORIGIN_ZEROCOPY, serr->ee_origin);
+	ASSERT_EQ(0, serr->ee_errno);
+}
+
+static void check_contents(struct __test_metadata *_metadata,
+			   const char *buf, char c)
+{
+	int i;
+
+	for (i = 0; i < BUF_LEN; i++)
+		ASSERT_EQ(c, buf[i]) {
+			TH_LOG("byte %d changed after completion", i);
+		}
+}
+
+TEST_F(msg_zerocopy, recv)
+{
+	size_t got = 0;
+	ssize_t ret;
+
+	memset(self->buf, 'a', BUF_LEN);
+	send_zerocopy(_metadata, self->fd[0], self->buf, BUF_LEN);
+
+	while (got < BUF_LEN) {
+		ret = recv(self->fd[1], self->rbuf + got, BUF_LEN - got, 0);
+		ASSERT_LT(0, ret);
+		got += ret;
+	}
+
+	wait_completion(_metadata, self->fd[0]);
+	check_contents(_metadata, self->rbuf, 'a');
+}
+
+TEST_F(msg_zerocopy, splice)
+{
+	size_t spliced = 0, got = 0;
+	int pipefd[2];
+	ssize_t ret;
+
+	ASSERT_EQ(0, pipe(pipefd));
+	ASSERT_LE(BUF_LEN, fcntl(pipefd[1], F_SETPIPE_SZ, BUF_LEN));
+
+	memset(self->buf, 'a', BUF_LEN);
+	send_zerocopy(_metadata, self->fd[0], self->buf, BUF_LEN);
+
+	/* Consume the skbs into the pipe, but leave the data there */
+	while (spliced < BUF_LEN) {
+		ret = splice(self->fd[1], NULL, pipefd[1], NULL,
+			     BUF_LEN - spliced, 0);
+		ASSERT_LT(0, ret);
+		spliced += ret;
+	}
+
+	wait_completion(_metadata, self->fd[0]);
+
+	/* The sender owns its buffer again */
+	memset(self->buf, 'b', BUF_LEN);
+
+	while (got < BUF_LEN) {
+		ret = read(pipefd[0], self->rbuf + got, BUF_LEN - got);
+		ASSERT_LT(0, ret);
+		got += ret;
+	}
+
+	check_contents(_metadata, self->rbuf, 'a');
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+}
+
+TEST_HARNESS_MAIN
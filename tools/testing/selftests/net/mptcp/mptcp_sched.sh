@@ -0,0 +1,144 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Transfer a file over two subflows with different netem delays, once with
+# each built-in packet scheduler, check the data made it through intact, that
+# the selected scheduler is the one that picked the subflows, and report the
+# transfer time. Also check that unknown scheduler names are refused.
+#
+#   ns1 eth1 10.0.1.1 <-> 10.0.1.2 eth1 ns2   (delay $DELAY1 ms)
+#   ns1 eth2 10.0.2.1 <-> 10.0.2.2 eth2 ns2   (delay $DELAY2 ms)
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+ret=0
+
+delay1=${DELAY1:-5}
+delay2=${DELAY2:-50}
+size=${SIZE:-4194304}
+timeout=${TIMEOUT:-60}
+port=10100
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns1="ns1-$sfx"
+ns2="ns2-$sfx"
+
+checktool (){
+	if ! $1 > /dev/null 2>&1; then
+		echo "SKIP: Could not $2"
+		exit $ksft_skip
+	fi
+}
+
+checktool "ip -Version" "run test without ip tool"
+checktool "tc -V" "run test without tc tool"
+checktool "ip mptcp limits" "run test without ip mptcp support"
+checktool "nstat -V" "run test without nstat tool"
+if [ ! -x ./mptcp_connect ]; then
+	echo "SKIP: mptcp_connect not built"
+	exit $ksft_skip
+fi
+
+cleanup() {
+	ip netns del "$ns1" 2>/dev/null
+	ip netns del "$ns2" 2>/dev/null
+	rm -f "$cin" "$sout"
+}
+
+trap cleanup EXIT
+
+cin=$(mktemp)
+sout=$(mktemp)
+head -c "$size" /dev/urandom > "$cin"
+
+ip netns add "$ns1" || exit $ksft_skip
+ip netns add "$ns2"
+
+for i in 1 2; do
+	ip link add eth$i netns "$ns1" type veth peer name eth$i netns "$ns2"
+	ip -net "$ns1" addr add 10.0.$i.1/24 dev eth$i
+	ip -net "$ns2" addr add 10.0.$i.2/24 dev eth$i
+	ip -net "$ns1" link set eth$i up
+	ip -net "$ns2" link set eth$i up
+done
+
+tc -net "$ns1" qdisc add dev eth1 root netem delay "${delay1}ms"
+tc -net "$ns1" qdisc add dev eth2 root netem delay "${delay2}ms"
+
+for n in "$ns1" "$ns2"; do
+	ip -net "$n" link set lo up
+	ip netns exec "$n" sysctl -q net.mptcp.enabled=1
+	ip -net "$n" mptcp limits set subflow 1 add_addr_accepted 1
+done
+ip -net "$ns1" mptcp endpoint add 10.0.2.1 dev eth2 subflow
+
+# absolute value of an MPTcpExt counter in $ns1
+get_counter() {
+	ip netns exec "$ns1" nstat -asz "MPTcpExt$1" |
+		awk -v c="MPTcpExt$1" '$1 == c { print $2 }'
+}
+
+# elapsed wall clock of the transfer, in milliseconds
+run_transfer() {
+	local start end spid
+
+	ip netns exec "$ns2" ./mptcp_connect -t "$timeout" -p $port -s MPTCP \
+		-l 0.0.0.0 > "$sout" < /dev/null &
+	spid=$!
+	sleep 0.5
+
+	start=$(date +%s%N)
+	ip netns exec "$ns1" ./mptcp_connect -t "$timeout" -p $port -s MPTCP \
+		10.0.1.2 < "$cin" > /dev/null
+	wait $spid
+	end=$(date +%s%N)
+	port=$((port + 1))
+
+	echo $(((end - start) / 1000000))
+}
+
+if ! ip netns exec "$ns1" sysctl -q net.mptcp.scheduler=default; then
+	echo "SKIP: no net.mptcp.scheduler sysctl"
+	exit $ksft_skip
+fi
+
+if ip netns exec "$ns1" sysctl -q net.mptcp.scheduler=nonexistent 2>/dev/null; then
+	echo "FAIL: unknown scheduler name accepted"
+	ret=1
+fi
+cur=$(ip netns exec "$ns1" sysctl -n net.mptcp.scheduler)
+if [ "$cur" != "default" ]; then
+	echo "FAIL: scheduler is '$cur' after a refused update, not 'default'"
+	ret=1
+fi
+
+for sched in default latency; do
+	ip netns exec "$ns1" sysctl -q net.mptcp.scheduler=$sched
+
+	picked=$(get_counter SchedSubflow)
+	ms=$(run_transfer)
+	picked=$(($(get_counter SchedSubflow) - picked))
+
+	if ! cmp -s "$cin" "$sout"; then
+		echo "FAIL: $sched: transferred data differs"
+		ret=1
+		continue
+	fi
+
+	# the built-in "default" logic doesn't go through get_subflow()
+	if [ "$sched" = "default" ] && [ "$picked" -ne 0 ]; then
+		echo "FAIL: $sched: $picked subflows picked by another scheduler"
+		ret=1
+		continue
+	fi
+	if [ "$sched" != "default" ] && [ "$picked" -eq 0 ]; then
+		echo "FAIL: $sched: scheduler never picked a subflow"
+		ret=1
+		continue
+	fi
+
+	echo "PASS: $sched: $size bytes in ${ms} ms," \
+	     "subflow delays ${delay1}/${delay2} ms"
+done
+
+exit $ret
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0
+#
+# Read the lookup statistics of an openvswitch datapath, and set the size of
+# its flow caches, for ovs_microflow.sh.
+#
+#   ovs_dp_cache.py stats DP
+#     prints "hit missed masks mask_hit cache_hit microflow_hit"
+#   ovs_dp_cache.py set-size DP SIZE
+#     sets the masks cache size, 0 disables both caches
+
+import sys
+
+try:
+    from pyroute2.netlink import NLM_F_ACK
+    from pyroute2.netlink import NLM_F_REQUEST
+    from pyroute2.netlink import genlmsg
+    from pyroute2.netlink import nla
+    from pyroute2.netlink.generic import GenericNetlinkSocket
+except ModuleNotFoundError:
+    print("Need to install the python pyroute2 package.")
+    sys.exit(4)
+
+OVS_DATAPATH_FAMILY = "ovs_datapath"
+OVS_DATAPATH_VERSION = 2
+
+OVS_DP_CMD_GET = 3
+OVS_DP_CMD_SET = 4
+
+
+class ovsdp(genlmsg):
+    fields = (("dp_ifindex", "I"),)
+
+    nla_map = (
+        ("OVS_DP_ATTR_UNSPEC", "none"),
+        ("OVS_DP_ATTR_NAME", "asciiz"),
+        ("OVS_DP_ATTR_UPCALL_PID", "array(uint32)"),
+        ("OVS_DP_ATTR_STATS", "dpstats"),
+        ("OVS_DP_ATTR_MEGAFLOW_STATS", "megaflowstats"),
+        ("OVS_DP_ATTR_USER_FEATURES", "uint32"),
+        ("OVS_DP_ATTR_PAD", "none"),
+        ("OVS_DP_ATTR_MASKS_CACHE_SIZE", "uint32"),
+        ("OVS_DP_ATTR_PER_CPU_PIDS", "array(uint32)"),
+        ("OVS_DP_ATTR_IFINDEX", "uint32"),
+    )
+
+    class dpstats(nla):
+        fields = (
+            ("hit", "=Q"),
+            ("missed", "=Q"),
+            ("lost", "=Q"),
+            ("flows", "=Q"),
+        )
+
+    class megaflowstats(nla):
+        fields = (
+            ("mask_hit", "=Q"),
+            ("masks", "=I"),
+            ("pad0", "=I"),
+            ("cache_hit", "=Q"),
+            ("microflow_hit", "=Q"),
+        )
+
+
+def dp_request(cmd, dpname, attrs=()):
+    sock = GenericNetlinkSocket()
+    sock.bind(OVS_DATAPATH_FAMILY, ovsdp)
+
+    msg = ovsdp()
+    msg["cmd"] = cmd
+    msg["version"] = OVS_DATAPATH_VERSION
+    msg["reserved"] = 0
+    msg["dp_ifindex"] = 0
+    msg["attrs"].append(["OVS_DP_ATTR_NAME", dpname])
+    for attr in attrs:
+        msg["attrs"].append(attr)
+
+    flags = NLM_F_REQUEST
+    if cmd == OVS_DP_CMD_SET:
+        flags |= NLM_F_ACK
+    reply = sock.nlm_request(msg, msg_type=sock.prid, msg_flags=flags)
+    sock.close()
+    return reply[0]
+
+
+def main(argv):
+    if len(argv) == 3 and argv[1] == "stats":
+        reply = dp_request(OVS_DP_CMD_GET, argv[2])
+        stats = reply.get_attr("OVS_DP_ATTR_STATS")
+        mega = reply.get_attr("OVS_DP_ATTR_MEGAFLOW_STATS")
+        print(stats["hit"], stats["missed"], mega["masks"],
+              mega["mask_hit"], mega["cache_hit"], mega["microflow_hit"])
+    elif len(argv) == 4 and argv[1] == "set-size":
+        dp_request(OVS_DP_CMD_SET, argv[2],
+                   [["OVS_DP_ATTR_MASKS_CACHE_SIZE", int(argv[3])]])
+    else:
+        print("usage: %s stats DP | set-size DP SIZE" % argv[0])
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
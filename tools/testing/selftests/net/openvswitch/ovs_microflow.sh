@@ -0,0 +1,145 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Check that the microflow cache of an openvswitch datapath holding many flow
+# masks serves the packets of known connections, and that it's disabled along
+# with the mask cache.
+#
+# Two namespaces are connected through the datapath, which first gets $NMASKS
+# filler flows on an unused port, each of them with a different mask, and then
+# the forwarding flows, so that their masks come last in the mask list.  The
+# verdict is based on the datapath lookup counters, not on timing: with the
+# caches disabled, no lookup may be a microflow hit; with the caches enabled,
+# all lookups but the first one of each flow on each CPU must be.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+ret=0
+
+nmasks=${NMASKS:-1024}
+count=${COUNT:-1000}
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns1="ns1-$sfx"
+ns2="ns2-$sfx"
+dp="dp-$sfx"
+
+dpctl="python3 ./ovs-dpctl.py"
+dpcache="python3 ./ovs_dp_cache.py"
+
+checktool (){
+	if ! $1 > /dev/null 2>&1; then
+		echo "SKIP: Could not $2"
+		exit $ksft_skip
+	fi
+}
+
+checktool "ip -Version" "run test without ip tool"
+checktool "ping -V" "run test without ping tool"
+checktool "$dpctl -h" "run test without ovs-dpctl.py"
+checktool "$dpctl add-flow -h" "add flows with ovs-dpctl.py"
+if ! python3 -c "import pyroute2" > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without pyroute2"
+	exit $ksft_skip
+fi
+
+cleanup() {
+	$dpctl del-dp "$dp" 2>/dev/null
+	ip netns del "$ns1" 2>/dev/null
+	ip netns del "$ns2" 2>/dev/null
+}
+
+trap cleanup EXIT
+
+if ! $dpctl add-dp "$dp"; then
+	echo "SKIP: could not create datapath"
+	exit $ksft_skip
+fi
+
+ip netns add "$ns1" || exit $ksft_skip
+ip netns add "$ns2"
+
+for i in 1 2; do
+	ns="ns$i-$sfx"
+
+	ip link add "ovs$i-$sfx" type veth peer name eth0 netns "$ns"
+	ip link set "ovs$i-$sfx" up
+	ip -net "$ns" addr add 10.0.0.$i/24 dev eth0
+	ip -net "$ns" link set eth0 up
+	ip -net "$ns" link set lo up
+	$dpctl add-if "$dp" "ovs$i-$sfx" || exit 1
+done
+
+# one mask per combination of source and destination prefix lengths
+for ((i = 0; i < nmasks; i++)); do
+	src=$((i % 32 + 1))
+	dst=$((i / 32 % 32 + 1))
+	smask=$(((0xffffffff << (32 - src)) & 0xffffffff))
+	dmask=$(((0xffffffff << (32 - dst)) & 0xffffffff))
+	m1=$((smask >> 24)).$((smask >> 16 & 255)).$((smask >> 8 & 255)).$((smask & 255))
+	m2=$((dmask >> 24)).$((dmask >> 16 & 255)).$((dmask >> 8 & 255)).$((dmask & 255))
+
+	$dpctl add-flow "$dp" \
+		"in_port(3),eth(),eth_type(0x0800),ipv4(src=192.168.0.0/$m1,dst=172.16.0.0/$m2)" \
+		"drop" > /dev/null || break
+done
+
+# ports 1 and 2 are the veth pairs, port 0 is the datapath internal port
+for f in "in_port(1),eth(),eth_type(0x0806),arp() 2" \
+	 "in_port(2),eth(),eth_type(0x0806),arp() 1" \
+	 "in_port(1),eth(),eth_type(0x0800),ipv4() 2" \
+	 "in_port(2),eth(),eth_type(0x0800),ipv4() 1"; do
+	$dpctl add-flow "$dp" ${f% *} ${f##* } || exit 1
+done
+
+if ! ip netns exec "$ns1" ping -q -c 1 -W 1 10.0.0.2 > /dev/null; then
+	echo "FAIL: no connectivity through the datapath"
+	exit 1
+fi
+
+# lookup counters during a ping of $count packets, as
+# "hits mask_hits microflow_hits"
+run_ping() {
+	local h0 mh0 uh0 h1 mh1 uh1
+
+	read -r h0 _ _ mh0 _ uh0 < <($dpcache stats "$dp")
+	ip netns exec "$ns1" ping -q -i 0.001 -c "$count" 10.0.0.2 > /dev/null
+	read -r h1 _ _ mh1 _ uh1 < <($dpcache stats "$dp")
+
+	echo $((h1 - h0)) $((mh1 - mh0)) $((uh1 - uh0))
+}
+
+nmasks=$($dpcache stats "$dp" | cut -d' ' -f3)
+echo "INFO: datapath holds $nmasks masks"
+
+if ! $dpcache set-size "$dp" 0; then
+	echo "FAIL: could not disable the flow caches"
+	exit 1
+fi
+read -r hits mask_hits micro_hits < <(run_ping)
+echo "INFO: caches disabled: $hits lookups, $mask_hits masks tried," \
+     "$micro_hits microflow hits"
+if [ "$micro_hits" -ne 0 ]; then
+	echo "FAIL: microflow cache used while disabled"
+	ret=1
+fi
+
+$dpcache set-size "$dp" 256 || exit 1
+read -r hits mask_hits micro_hits < <(run_ping)
+echo "INFO: caches enabled: $hits lookups, $mask_hits masks tried," \
+     "$micro_hits microflow hits"
+
+# at most one miss per flow (arp and ipv4, both ways) on each CPU
+max_miss=$((4 * $(nproc)))
+if [ "$hits" -lt "$count" ]; then
+	echo "FAIL: only $hits of at least $count packets forwarded"
+	ret=1
+elif [ $((hits - micro_hits)) -gt "$max_miss" ]; then
+	echo "FAIL: $((hits - micro_hits)) microflow misses, expected" \
+	     "at most $max_miss"
+	ret=1
+else
+	echo "PASS: microflow cache served $micro_hits of $hits lookups"
+fi
+
+exit $ret
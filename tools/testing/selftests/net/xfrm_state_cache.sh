@@ -0,0 +1,142 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Check that the per-CPU cache of inbound SA lookups never outlives a change
+# of the SA it holds, while packets for that SA keep coming in.
+#
+# ns1 sends ESP in transport mode to ns2, which receives it through the cache.
+# With a ping running in the background all along, so that the cache is hot,
+# the receiving SA in ns2 is
+#  - deleted: nothing may get through any more,
+#  - added back: traffic must flow again,
+#  - replaced by a larval SA from "ip xfrm state allocspi", which the sender
+#    switches to: nothing may get through while it is larval,
+#  - made valid with "ip xfrm state update": traffic must flow again.
+# A stale cache entry would let packets through, or keep dropping them.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+ret=0
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns1="ns1-$sfx"
+ns2="ns2-$sfx"
+
+addr1=10.0.1.1
+addr2=10.0.1.2
+key1=0x0102030405060708090a0b0c0d0e0f1011121314
+key2=0x1112131415161718191a1b1c1d1e1f2021222324
+bgpid=0
+
+checktool (){
+	if ! $1 > /dev/null 2>&1; then
+		echo "SKIP: Could not $2"
+		exit $ksft_skip
+	fi
+}
+
+checktool "ip -Version" "run test without ip tool"
+checktool "ping -V" "run test without ping tool"
+
+cleanup() {
+	[ "$bgpid" -ne 0 ] && kill "$bgpid" 2>/dev/null
+	ip netns del "$ns1" 2>/dev/null
+	ip netns del "$ns2" 2>/dev/null
+}
+
+trap cleanup EXIT
+
+ip netns add "$ns1" || exit $ksft_skip
+ip netns add "$ns2"
+
+ip -net "$ns1" link add eth0 type veth peer name eth0 netns "$ns2"
+ip -net "$ns1" addr add $addr1/24 dev eth0
+ip -net "$ns2" addr add $addr2/24 dev eth0
+for ns in "$ns1" "$ns2"; do
+	ip -net "$ns" link set eth0 up
+	ip -net "$ns" link set lo up
+done
+
+# add_sa <ns> <src> <dst> <spi> <key> [update]
+add_sa() {
+	ip -net "$1" xfrm state "${6:-add}" src "$2" dst "$3" proto esp \
+		spi "$4" reqid 1 mode transport \
+		aead 'rfc4106(gcm(aes))' "$5" 128
+}
+
+# add_policy <ns> <src> <dst> <dir>
+add_policy() {
+	ip -net "$1" xfrm policy add src "$2" dst "$3" dir "$4" \
+		tmpl src "$2" dst "$3" proto esp reqid 1 mode transport
+}
+
+add_policy "$ns1" $addr1 $addr2 out || exit $ksft_skip
+add_policy "$ns1" $addr2 $addr1 in || exit 1
+add_policy "$ns2" $addr2 $addr1 out || exit 1
+add_policy "$ns2" $addr1 $addr2 in || exit 1
+
+add_sa "$ns1" $addr1 $addr2 0x1000 $key1 || exit $ksft_skip
+add_sa "$ns2" $addr1 $addr2 0x1000 $key1 || exit 1
+add_sa "$ns1" $addr2 $addr1 0x2000 $key2 || exit 1
+add_sa "$ns2" $addr2 $addr1 0x2000 $key2 || exit 1
+
+stat2() {
+	ip netns exec "$ns2" awk -v m="$1" '$1 == m { print $2 }' \
+		/proc/net/xfrm_stat
+}
+
+ping_ok() {
+	ip netns exec "$ns1" ping -q -c 5 -i 0.1 -W 1 $addr2 > /dev/null
+}
+
+# check <description> <ok|fail> [counter that must grow]
+check() {
+	local before after
+
+	[ -n "$3" ] && before=$(stat2 "$3")
+	if ping_ok; then
+		result=ok
+	else
+		result=fail
+	fi
+	[ -n "$3" ] && after=$(stat2 "$3")
+
+	if [ $result != "$2" ]; then
+		echo "FAIL: $1: ping $result, expected $2"
+		ret=1
+	elif [ -n "$3" ] && [ "$after" -le "$before" ]; then
+		echo "FAIL: $1: $3 did not grow"
+		ret=1
+	else
+		echo "PASS: $1"
+	fi
+}
+
+if [ -z "$(stat2 XfrmInStateCacheHit)" ]; then
+	echo "SKIP: no inbound SA cache counters in /proc/net/xfrm_stat"
+	exit $ksft_skip
+fi
+
+check "SA in place" ok XfrmInStateCacheHit
+[ $ret -ne 0 ] && exit $ret
+
+ip netns exec "$ns1" ping -q -i 0.001 -w 60 $addr2 > /dev/null 2>&1 &
+bgpid=$!
+sleep 1
+
+ip -net "$ns2" xfrm state delete src $addr1 dst $addr2 proto esp spi 0x1000
+check "SA deleted" fail XfrmInNoStates
+
+add_sa "$ns2" $addr1 $addr2 0x1000 $key1
+check "SA added back" ok XfrmInStateCacheHit
+
+ip -net "$ns2" xfrm state allocspi src $addr1 dst $addr2 proto esp \
+	mode transport reqid 1 min 0x3000 max 0x3000 > /dev/null || exit 1
+ip -net "$ns1" xfrm state delete src $addr1 dst $addr2 proto esp spi 0x1000
+add_sa "$ns1" $addr1 $addr2 0x3000 $key1
+check "sender on a larval SA" fail XfrmAcquireError
+
+add_sa "$ns2" $addr1 $addr2 0x3000 $key1 update
+check "larval SA updated" ok XfrmInStateCacheHit
+
+exit $ret
@@ -0,0 +1,125 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Report the per-packet cost of evaluating a long nf_tables chain.
+#
+# A forward chain in the router namespace is filled with rules that do not
+# match the test traffic.  The leading "ip saddr ... tcp dport ..." pairs are
+# lowered into precompiled matches at commit time, the trailing ones are left
+# to the expression interpreter.  Flood ping round trips are timed with an
+# empty chain and with the full one, the difference is the chain cost.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+ret=0
+
+nrules=${NRULES:-10000}
+count=${COUNT:-20000}
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns1="ns1-$sfx"
+ns2="ns2-$sfx"
+nsr="nsr-$sfx"
+
+checktool (){
+	if ! $1 > /dev/null 2>&1; then
+		echo "SKIP: Could not $2"
+		exit $ksft_skip
+	fi
+}
+
+checktool "nft --version" "run test without nft tool"
+checktool "ip -Version" "run test without ip tool"
+checktool "ping -V" "run test without ping tool"
+
+cleanup() {
+	ip netns del "$ns1" 2>/dev/null
+	ip netns del "$ns2" 2>/dev/null
+	ip netns del "$nsr" 2>/dev/null
+	rm -f "$rules"
+}
+
+trap cleanup EXIT
+
+rules=$(mktemp)
+
+ip netns add "$ns1" || exit $ksft_skip
+ip netns add "$ns2"
+ip netns add "$nsr"
+
+ip link add veth0 netns "$nsr" type veth peer name eth0 netns "$ns1"
+ip link add veth1 netns "$nsr" type veth peer name eth0 netns "$ns2"
+
+ip -net "$ns1" addr add 10.0.1.99/24 dev eth0
+ip -net "$ns2" addr add 10.0.2.99/24 dev eth0
+ip -net "$nsr" addr add 10.0.1.1/24 dev veth0
+ip -net "$nsr" addr add 10.0.2.1/24 dev veth1
+
+for n in "$ns1" "$ns2" "$nsr"; do
+	ip -net "$n" link set lo up
+	ip -net "$n" link set eth0 up 2>/dev/null
+done
+ip -net "$nsr" link set veth0 up
+ip -net "$nsr" link set veth1 up
+ip -net "$ns1" route add default via 10.0.1.1
+ip -net "$ns2" route add default via 10.0.2.1
+ip netns exec "$nsr" sysctl -q net.ipv4.ip_forward=1
+
+if ! ip netns exec "$ns1" ping -q -c 1 -W 1 10.0.2.99 > /dev/null; then
+	echo "FAIL: no connectivity between namespaces"
+	exit 1
+fi
+
+# elapsed wall clock of the flood ping, in nanoseconds
+run_ping() {
+	local start end
+
+	start=$(date +%s%N)
+	ip netns exec "$ns1" ping -q -f -c "$count" 10.0.2.99 > /dev/null
+	end=$(date +%s%N)
+
+	echo $((end - start))
+}
+
+load_rules() {
+	local i
+
+	{
+		echo "flush ruleset"
+		echo "table ip filter {"
+		echo "	chain forward {"
+		echo "		type filter hook forward priority 0; policy accept;"
+		for ((i = 0; i < $1; i++)); do
+			if [ $((i % 2)) -eq 0 ]; then
+				echo "		ip saddr 192.168.$((i / 256 % 256)).$((i % 256)) tcp dport $((i % 60000 + 1)) drop"
+			else
+				echo "		meta mark $((i + 1)) ip daddr 172.16.$((i / 256 % 256)).$((i % 256)) drop"
+			fi
+		done
+		echo "	}"
+		echo "}"
+	} > "$rules"
+
+	ip netns exec "$nsr" nft -f "$rules"
+}
+
+if ! load_rules 0; then
+	echo "SKIP: could not load nftables ruleset"
+	exit $ksft_skip
+fi
+base=$(run_ping)
+
+if ! load_rules "$nrules"; then
+	echo "FAIL: could not load $nrules rules"
+	exit 1
+fi
+loaded=$(run_ping)
+
+# two passes through the chain per round trip: request and reply
+per_pkt=$(((loaded - base) / (count * 2)))
+[ $per_pkt -lt 0 ] && per_pkt=0
+per_rule=$((per_pkt * 1000 / nrules))
+
+echo "PASS: $nrules rules: ${per_pkt} ns per packet, ${per_rule} ps per rule"
+
+exit $ret
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Mapping of the per CPU trace_pipe_raw files, see linux/trace_mmap.h: the
+ * meta page must describe the buffer, TRACE_MMAP_IOCTL_GET_READER must hand
+ * over the events written, and the mapping must survive mremap() without
+ * being released twice.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/trace_mmap.h>
+
+#include "../kselftest_harness.h"
+
+#define TRACEFS_ROOT		"/sys/kernel/tracing"
+#define DEBUGFS_TRACEFS_ROOT	"/sys/kernel/debug/tracing"
+
+/* see struct buffer_data_page in kernel/trace/ring_buffer.c */
+#define SUBBUF_HDR_SIZE		(sizeof(__u64) + sizeof(long))
+#define SUBBUF_COMMIT_MASK	((1UL << 20) - 1)
+
+static const char *tracefs_root(void)
+{
+	if (!access(TRACEFS_ROOT "/trace_marker", W_OK))
+		return TRACEFS_ROOT;
+	if (!access(DEBUGFS_TRACEFS_ROOT "/trace_marker", W_OK))
+		return DEBUGFS_TRACEFS_ROOT;
+	return NULL;
+}
+
+static int write_tracefs(const char *root, const char *file, const char *val)
+{
+	char path[256];
+	ssize_t ret;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", root, file);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -errno;
+
+	ret = write(fd, val, strlen(val));
+	close(fd);
+
+	return ret < 0 ? -errno : 0;
+}
+
+FIXTURE(map)
+{
+	const char *root;
+	cpu_set_t cpus;
+	int cpu;
+	int fd;
+	long page_size;
+	struct trace_buffer_meta *meta;
+};
+
+FIXTURE_SETUP(map)
+{
+	cpu_set_t one_cpu;
+	char path[256];
+
+	self->fd = -1;
+	self->meta = MAP_FAILED;
+	self->page_size = sysconf(_SC_PAGESIZE);
+
+	self->root = tracefs_root();
+	if (!self->root)
+		SKIP(return, "tracefs not available, or not root");
+
+	/* write all the events from one CPU, to read them from its buffer */
+	ASSERT_EQ(0, sched_getaffinity(0, sizeof(self->cpus), &self->cpus));
+	for (self->cpu = 0; !CPU_ISSET(self->cpu, &self->cpus); self->cpu++)
+		;
+	CPU_ZERO(&one_cpu);
+	CPU_SET(self->cpu, &one_cpu);
+	ASSERT_EQ(0, sched_setaffinity(0, sizeof(one_cpu), &one_cpu));
+
+	ASSERT_EQ(0, write_tracefs(self->root, "tracing_on", "1"));
+
+	snprintf(path, sizeof(path), "%s/per_cpu/cpu%d/trace_pipe_raw",
+		 self->root, self->cpu);
+	self->fd = open(path, O_RDONLY | O_NONBLOCK);
+	ASSERT_LE(0, self->fd);
+
+	self->meta = mmap(NULL, self->page_size, PROT_READ, MAP_SHARED,
+			  self->fd, 0);
+	if (self->meta == MAP_FAILED && errno == ENODEV)
+		SKIP(return, "trace_pipe_raw can't be mapped");
+	ASSERT_NE(MAP_FAILED, self->meta);
+}
+
+FIXTURE_TEARDOWN(map)
+{
+	if (self->meta != MAP_FAILED)
+		munmap(self->meta, self->page_size);
+	if (self->fd >= 0)
+		close(self->fd);
+	sched_setaffinity(0, sizeof(self->cpus), &self->cpus);
+}
+
+TEST_F(map, meta_page)
+{
+	struct trace_buffer_meta *meta = self->meta;
+
+	EXPECT_EQ(self->page_size, meta->meta_page_size);
+	EXPECT_EQ(sizeof(*meta), meta->meta_struct_len);
+	EXPECT_EQ(self->page_size, meta->subbuf_size);
+	/* the reader page, plus at least two ring pages */
+	EXPECT_LE(3, meta->nr_subbufs);
+	EXPECT_GT(meta->nr_subbufs, meta->reader.id);
+	EXPECT_EQ(0, meta->flags);
+}
+
+TEST_F(map, no_write)
+{
+	void *addr;
+
+	addr = mmap(NULL, self->page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    self->fd, 0);
+	EXPECT_EQ(MAP_FAILED, addr);
+
+	/* nor can a read-only mapping be made writable */
+	EXPECT_EQ(-1, mprotect(self->meta, self->page_size,
+			       PROT_READ | PROT_WRITE));
+
+	/* and the buffer can't be resized under it */
+	EXPECT_NE(0, write_tracefs(self->root, "buffer_size_kb", "64"));
+}
+
+TEST_F(map, get_reader)
+{
+	struct trace_buffer_meta *meta = self->meta;
+	unsigned long commit;
+	size_t map_size;
+	char *subbufs;
+	__u32 id;
+	int i;
+
+	map_size = meta->nr_subbufs * meta->subbuf_size;
+	subbufs = mmap(NULL, map_size, PROT_READ, MAP_SHARED, self->fd,
+		       meta->meta_page_size);
+	ASSERT_NE(MAP_FAILED, subbufs);
+
+	/* hand over whatever was there before us, a page at a time */
+	for (i = 0; i <= meta->nr_subbufs; i++)
+		ASSERT_EQ(0, ioctl(self->fd, TRACE_MMAP_IOCTL_GET_READER));
+
+	for (i = 0; i < 16; i++)
+		ASSERT_EQ(0, write_tracefs(self->root, "trace_marker",
+					   "ring-buffer map test"));
+
+	ASSERT_EQ(0, ioctl(self->fd, TRACE_MMAP_IOCTL_GET_READER));
+	ASSERT_GT(meta->nr_subbufs, meta->reader.id);
+
+	/* new events between the read offset and the commit */
+	memcpy(&commit, subbufs + meta->reader.id * meta->subbuf_size +
+	       sizeof(__u64), sizeof(commit));
+	commit &= SUBBUF_COMMIT_MASK;
+	EXPECT_LT(meta->reader.read, commit);
+	EXPECT_GE(meta->subbuf_size - SUBBUF_HDR_SIZE, commit);
+	EXPECT_LE(16, meta->entries);
+
+	/* they're consumed now, the next call starts after them */
+	id = meta->reader.id;
+	ASSERT_EQ(0, ioctl(self->fd, TRACE_MMAP_IOCTL_GET_READER));
+	EXPECT_TRUE(meta->reader.id != id || meta->reader.read >= commit);
+
+	munmap(subbufs, map_size);
+}
+
+TEST_F(map, mremap)
+{
+	struct trace_buffer_meta *meta;
+	__u32 nr_subbufs;
+	void *addr;
+
+	nr_subbufs = self->meta->nr_subbufs;
+
+	/* the mapping can't grow */
+	addr = mremap(self->meta, self->page_size, 2 * self->page_size, 0);
+	EXPECT_EQ(MAP_FAILED, addr);
+
+	/* but it can move, which copies it, then releases the old one */
+	meta = mremap(self->meta, self->page_size, self->page_size,
+		      MREMAP_MAYMOVE | MREMAP_FIXED,
+		      mmap(NULL, self->page_size, PROT_NONE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	ASSERT_NE(MAP_FAILED, meta);
+	self->meta = meta;
+
+	/* still mapped: still readable, and the buffer can't be resized */
+	EXPECT_EQ(nr_subbufs, meta->nr_subbufs);
+	EXPECT_NE(0, write_tracefs(self->root, "buffer_size_kb", "64"));
+
+	ASSERT_EQ(0, munmap(meta, self->page_size));
+	self->meta = MAP_FAILED;
+
+	/* released once and for all, no mapping left to get in the way */
+	EXPECT_EQ(-1, ioctl(self->fd, TRACE_MMAP_IOCTL_GET_READER));
+	EXPECT_EQ(ENODEV, errno);
+
+	/* and mapped again from scratch */
+	meta = mmap(NULL, self->page_size, PROT_READ, MAP_SHARED, self->fd, 0);
+	ASSERT_NE(MAP_FAILED, meta);
+	EXPECT_EQ(nr_subbufs, meta->nr_subbufs);
+	self->meta = meta;
+}
+
+TEST_HARNESS_MAIN